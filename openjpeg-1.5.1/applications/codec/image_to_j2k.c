@@ -216,6 +216,9 @@ void encode_help_display(void) {
 	fprintf(stdout,"-jpip        : write jpip codestream index box in JP2 output file\n");
 	fprintf(stdout,"               NOTICE: currently supports only RPCL order\n");
 	fprintf(stdout,"\n");
+	fprintf(stdout,"-threads     : number of threads used to encode the code-blocks (-threads 4)\n");
+	fprintf(stdout,"               The codestream is the same whatever the number of threads.\n");
+	fprintf(stdout,"\n");
 /* UniPG>> */
 #ifdef USE_JPWL
 	fprintf(stdout,"-W           : adoption of JPWL (Part 11) capabilities (-W params)\n");
@@ -582,16 +585,17 @@ int parse_cmdline_encoder(int argc, char **argv, opj_cparameters_t *parameters,
 													img_fol_t *img_fol, raw_cparameters_t *raw_cp, char *indexfilename) {
 	int i, j, totlen, c;
 	opj_option_t long_option[]={
-		{"cinema2K",REQ_ARG, NULL ,'w'},
-		{"cinema4K",NO_ARG, NULL ,'y'},
-		{"ImgDir",REQ_ARG, NULL ,'z'},
-		{"TP",REQ_ARG, NULL ,'u'},
-		{"SOP",NO_ARG, NULL ,'S'},
-		{"EPH",NO_ARG, NULL ,'E'},
-		{"OutFor",REQ_ARG, NULL ,'O'},
-		{"POC",REQ_ARG, NULL ,'P'},
-		{"ROI",REQ_ARG, NULL ,'R'},
-		{"jpip",NO_ARG, NULL, 'J'}
+		{"cinema2K", NULL, REQ_ARG, 'w'},
+		{"cinema4K", NULL, NO_ARG, 'y'},
+		{"ImgDir", NULL, REQ_ARG, 'z'},
+		{"TP", NULL, REQ_ARG, 'u'},
+		{"SOP", NULL, NO_ARG, 'S'},
+		{"EPH", NULL, NO_ARG, 'E'},
+		{"OutFor", NULL, REQ_ARG, 'O'},
+		{"POC", NULL, REQ_ARG, 'P'},
+		{"ROI", NULL, REQ_ARG, 'R'},
+		{"jpip", NULL, NO_ARG, 'J'},
+		{"threads", NULL, REQ_ARG, 'N'}
 	};
 
 	/* parse the command line */
@@ -1383,6 +1387,14 @@ int parse_cmdline_encoder(int argc, char **argv, opj_cparameters_t *parameters,
 			{
 			  parameters->jpip_on = OPJ_TRUE;
 			}
+			break;
+
+				/* ------------------------------------------------------ */
+
+			case 'N':			/* number of encoding threads */
+			{
+				sscanf(opj_optarg, "%d", &parameters->num_threads);
+			}
 			break;
 				/* ------------------------------------------------------ */
 
@@ -1487,6 +1499,30 @@ void info_callback(const char *msg, void *client_data) {
 	fprintf(stream, "[INFO] %s", msg);
 }
 
+/**
+output file of the byte stream, written as the image is encoded
+*/
+typedef struct out_file {
+	FILE *f;
+	/** position of the file where the codestream starts */
+	long base;
+} out_file_t;
+
+/**
+stream write callback expecting an out_file_t* user object
+*/
+static int out_file_write(const unsigned char *buffer, int length, void *user_data) {
+	out_file_t *out = (out_file_t*)user_data;
+	return (int)fwrite(buffer, 1, length, out->f);
+}
+/**
+stream seek callback expecting an out_file_t* user object
+*/
+static opj_bool out_file_seek(int pos, void *user_data) {
+	out_file_t *out = (out_file_t*)user_data;
+	return fseek(out->f, out->base + pos, SEEK_SET) == 0;
+}
+
 /* -------------------------------------------------------------------------- */
 
 int main(int argc, char **argv) {
@@ -1682,10 +1718,8 @@ int main(int argc, char **argv) {
 			/* ---------------------------- */
 
 			if (parameters.cod_format == J2K_CFMT) {	/* J2K format output */
-				int codestream_length;
-        size_t res;
 				opj_cio_t *cio = NULL;
-				FILE *f = NULL;
+				out_file_t out;
 
 				/* get a J2K compressor handle */
 				opj_cinfo_t* cinfo = opj_create_compress(CODEC_J2K);
@@ -1696,34 +1730,31 @@ int main(int argc, char **argv) {
 				/* setup the encoder parameters using the current image and user parameters */
 				opj_setup_encoder(cinfo, &parameters, image);
 
-				/* open a byte stream for writing */
-				/* allocate memory for all tiles */
-				cio = opj_cio_open((opj_common_ptr)cinfo, NULL, 0);
+				/* open a byte stream writing to the output file */
+				out.f = fopen(parameters.outfile, "wb");
+				if (!out.f) {
+					fprintf(stderr, "failed to open %s for writing\n", parameters.outfile);
+					return 1;
+				}
+				out.base = ftell(out.f);
+				cio = opj_cio_open_output((opj_common_ptr)cinfo, out_file_write, out_file_seek, &out);
 
 				/* encode the image */
 				if (*indexfilename)					/* If need to extract codestream information*/
 				  bSuccess = opj_encode_with_info(cinfo, cio, image, &cstr_info);
 				else
 					bSuccess = opj_encode(cinfo, cio, image, NULL);
-				if (!bSuccess) {
+				if (!bSuccess || fclose(out.f) != 0) {
+					if (bSuccess) {
+						fprintf(stderr, "failed to write %s\n", parameters.outfile);
+					} else {
+						fclose(out.f);
+						fprintf(stderr, "failed to encode image\n");
+					}
 					opj_cio_close(cio);
-					fprintf(stderr, "failed to encode image\n");
+					remove(parameters.outfile);
 					return 1;
 				}
-				codestream_length = cio_tell(cio);
-
-				/* write the buffer to disk */
-				f = fopen(parameters.outfile, "wb");
-				if (!f) {
-					fprintf(stderr, "failed to open %s for writing\n", parameters.outfile);
-					return 1;
-				}
-				res = fwrite(cio->buffer, 1, codestream_length, f);
-        if( res < (size_t)codestream_length ) { /* FIXME */
- 					fprintf(stderr, "failed to write %d (%s)\n", codestream_length, parameters.outfile);
-					return 1;
-         }
-				fclose(f);
 
 				fprintf(stderr,"Generated outfile %s\n",parameters.outfile);
 				/* close and free the byte stream */
@@ -1742,10 +1773,8 @@ int main(int argc, char **argv) {
 				if (*indexfilename)
 					opj_destroy_cstr_info(&cstr_info);
 			} else {			/* JP2 format output */
-				int codestream_length;
-        size_t res;
 				opj_cio_t *cio = NULL;
-				FILE *f = NULL;
+				out_file_t out;
 				opj_cinfo_t *cinfo = NULL;
 
 				/* get a JP2 compressor handle */				
@@ -1757,34 +1786,31 @@ int main(int argc, char **argv) {
 				/* setup the encoder parameters using the current image and using user parameters */
 				opj_setup_encoder(cinfo, &parameters, image);
 
-				/* open a byte stream for writing */
-				/* allocate memory for all tiles */
-				cio = opj_cio_open((opj_common_ptr)cinfo, NULL, 0);
+				/* open a byte stream writing to the output file */
+				out.f = fopen(parameters.outfile, "wb");
+				if (!out.f) {
+					fprintf(stderr, "failed to open %s for writing\n", parameters.outfile);
+					return 1;
+				}
+				out.base = ftell(out.f);
+				cio = opj_cio_open_output((opj_common_ptr)cinfo, out_file_write, out_file_seek, &out);
 
 				/* encode the image */
 				if (*indexfilename || parameters.jpip_on) /* If need to extract codestream information*/
 				  bSuccess = opj_encode_with_info(cinfo, cio, image, &cstr_info);
 				else
 					bSuccess = opj_encode(cinfo, cio, image, NULL);
-				if (!bSuccess) {
+				if (!bSuccess || fclose(out.f) != 0) {
+					if (bSuccess) {
+						fprintf(stderr, "failed to write %s\n", parameters.outfile);
+					} else {
+						fclose(out.f);
+						fprintf(stderr, "failed to encode image\n");
+					}
 					opj_cio_close(cio);
-					fprintf(stderr, "failed to encode image\n");
+					remove(parameters.outfile);
 					return 1;
 				}
-				codestream_length = cio_tell(cio);
-
-				/* write the buffer to disk */
-				f = fopen(parameters.outfile, "wb");
-				if (!f) {
-					fprintf(stderr, "failed to open %s for writing\n", parameters.outfile);
-					return 1;
-				}
-				res = fwrite(cio->buffer, 1, codestream_length, f);
-        if( res < (size_t)codestream_length ) { /* FIXME */
- 					fprintf(stderr, "failed to write %d (%s)\n", codestream_length, parameters.outfile);
-					return 1;
-         }
-				fclose(f);
 				fprintf(stderr,"Generated outfile %s\n",parameters.outfile);
 				/* close and free the byte stream */
 				opj_cio_close(cio);
@@ -128,6 +128,24 @@ void decode_help_display(void) {
 	fprintf(stdout,"    Set the maximum number of quality layers to decode. If there are\n");
 	fprintf(stdout,"    less quality layers than the specified number, all the quality layers\n");
 	fprintf(stdout,"    are decoded.\n");
+	fprintf(stdout,"  -passes <number of coding passes to decode>\n");
+	fprintf(stdout,"    Set the maximum number of coding passes decoded in each code-block.\n");
+	fprintf(stdout,"    3 * n - 2 passes decode the n most significant bit-planes.\n");
+	fprintf(stdout,"    By default, all the passes of the decoded layers are decoded.\n");
+	fprintf(stdout,"  -preview <level>\n");
+	fprintf(stdout,"    Fast preview, from 1 (best quality) to 3 (fastest): combines the\n");
+	fprintf(stdout,"    reduce factor, the number of quality layers and the number of coding\n");
+	fprintf(stdout,"    passes. -r, -l and -passes given after it override its values.\n");
+	fprintf(stdout,"  -truncated\n");
+	fprintf(stdout,"    The codestream may be truncated, e.g. partially downloaded: decode it\n");
+	fprintf(stdout,"    at the highest resolution it holds completely, as far as -r allows.\n");
+	fprintf(stdout,"  -threads <number of threads>\n");
+	fprintf(stdout,"    Number of threads used to decode the tiles, or the code-blocks of\n");
+	fprintf(stdout,"    the image if it has a single tile.\n");
+	fprintf(stdout,"    By default, decoding is done in a single thread.\n");
+	fprintf(stdout,"  -d <x0,y0,x1,y1>\n");
+	fprintf(stdout,"    Only decode the area of the image between (x0,y0) included and\n");
+	fprintf(stdout,"    (x1,y1) excluded, given on the reference grid (full resolution).\n");
 	fprintf(stdout,"  -x  \n"); 
 	fprintf(stdout,"    Create an index file *.Idx (-x index_name.Idx) \n");
 	fprintf(stdout,"\n");
@@ -237,15 +255,19 @@ char get_next_file(int imageno,dircnt_t *dirptr,img_fol_t *img_fol, opj_dparamet
 }
 
 /* -------------------------------------------------------------------------- */
-int parse_cmdline_decoder(int argc, char **argv, opj_dparameters_t *parameters,img_fol_t *img_fol, char *indexfilename) {
+int parse_cmdline_decoder(int argc, char **argv, opj_dparameters_t *parameters,img_fol_t *img_fol, char *indexfilename, int *decode_area) {
 	/* parse the command line */
 	int totlen, c;
 	opj_option_t long_option[]={
-		{"ImgDir",REQ_ARG, NULL ,'y'},
-		{"OutFor",REQ_ARG, NULL ,'O'},
+		{"ImgDir", NULL, REQ_ARG ,'y'},
+		{"OutFor", NULL, REQ_ARG ,'O'},
+		{"threads", NULL, REQ_ARG ,'T'},
+		{"passes", NULL, REQ_ARG ,'P'},
+		{"preview", NULL, REQ_ARG ,'V'},
+		{"truncated", NULL, NO_ARG ,'U'},
 	};
 
-	const char optlist[] = "i:o:r:l:x:"
+	const char optlist[] = "i:o:r:l:x:d:"
 
 /* UniPG>> */
 #ifdef USE_JPWL
@@ -361,6 +383,52 @@ int parse_cmdline_decoder(int argc, char **argv, opj_dparameters_t *parameters,i
 			
 				/* ----------------------------------------------------- */
 
+			case 'T':		/* number of decoding threads */
+			{
+				sscanf(opj_optarg, "%d", &parameters->num_threads);
+			}
+			break;
+			
+				/* ----------------------------------------------------- */
+
+			case 'P':		/* number of coding passes */
+			{
+				sscanf(opj_optarg, "%d", &parameters->cp_max_passes);
+			}
+			break;
+			
+				/* ----------------------------------------------------- */
+
+			case 'V':		/* fast preview */
+			{
+				int level = 0;
+				sscanf(opj_optarg, "%d", &level);
+				opj_set_preview_decoder_parameters(parameters, level);
+			}
+			break;
+			
+				/* ----------------------------------------------------- */
+
+			case 'U':		/* truncated codestream */
+			{
+				parameters->flags |= OPJ_DPARAMETERS_TRUNCATED_FLAG;
+			}
+			break;
+			
+				/* ----------------------------------------------------- */
+
+			case 'd':		/* decode area */
+			{
+				if (sscanf(opj_optarg, "%d,%d,%d,%d", &decode_area[0], &decode_area[1], &decode_area[2], &decode_area[3]) != 4
+					|| decode_area[2] <= decode_area[0] || decode_area[3] <= decode_area[1]) {
+					fprintf(stderr, "-d 'x0,y0,x1,y1' : invalid decode area\n");
+					return 1;
+				}
+			}
+			break;
+			
+				/* ----------------------------------------------------- */
+
 			case 'h': 			/* display an help description */
 				decode_help_display();
 				return 1;				
@@ -511,6 +579,56 @@ void info_callback(const char *msg, void *client_data) {
 	fprintf(stdout, "[INFO] %s", msg);
 }
 
+/**
+stream read callback expecting a FILE* user object
+*/
+static int in_file_read(unsigned char *buffer, int length, void *user_data) {
+	FILE *f = (FILE*)user_data;
+	size_t n = fread(buffer, 1, length, f);
+	return (n == 0 && ferror(f)) ? -1 : (int)n;
+}
+/**
+stream skip callback expecting a FILE* user object
+*/
+static opj_bool in_file_skip(int n, void *user_data) {
+	FILE *f = (FILE*)user_data;
+	unsigned char buffer[4096];
+	if (fseek(f, n, SEEK_CUR) == 0) {
+		return OPJ_TRUE;
+	}
+	/* pipes cannot seek */
+	while (n > 0) {
+		size_t r = fread(buffer, 1, n < (int)sizeof(buffer) ? n : (int)sizeof(buffer), f);
+		if (r == 0) {
+			return OPJ_FALSE;
+		}
+		n -= (int)r;
+	}
+	return OPJ_TRUE;
+}
+
+/**
+Open the stream the image is decoded from. The codestream information and JPT-streams 
+need the whole file in memory, which is then read in *src. Otherwise, the decoder reads 
+the file as it goes.
+*/
+static opj_cio_t* open_input(opj_dinfo_t *dinfo, FILE *fsrc, int in_memory, unsigned char **src) {
+	int file_length;
+	if (!in_memory) {
+		return opj_cio_open_input((opj_common_ptr)dinfo, in_file_read, in_file_skip, NULL, fsrc);
+	}
+	fseek(fsrc, 0, SEEK_END);
+	file_length = ftell(fsrc);
+	fseek(fsrc, 0, SEEK_SET);
+	*src = (unsigned char *) malloc(file_length);
+	if (!*src || fread(*src, 1, file_length, fsrc) != (size_t)file_length)
+	{
+		fprintf(stderr, "\nERROR: fread return a number of element different from the expected.\n");
+		return NULL;
+	}
+	return opj_cio_open((opj_common_ptr)dinfo, *src, file_length);
+}
+
 /* -------------------------------------------------------------------------- */
 
 int main(int argc, char **argv) {
@@ -520,7 +638,6 @@ int main(int argc, char **argv) {
 	opj_image_t *image = NULL;
 	FILE *fsrc = NULL;
 	unsigned char *src = NULL;
-	int file_length;
 	int num_images;
 	int i,imageno;
 	dircnt_t *dirptr = NULL;
@@ -528,6 +645,9 @@ int main(int argc, char **argv) {
 	opj_cio_t *cio = NULL;
 	opj_codestream_info_t cstr_info;  /* Codestream information structure */
 	char indexfilename[OPJ_PATH_LEN];	/* index file name */
+	int decode_area[4] = {0, 0, 0, 0};	/* x0, y0, x1, y1 ; x1 == 0 when the whole image is decoded */
+	opj_arena_t *arena = NULL;	/* memory of the tile structures, reused from one image to the next */
+	int dinfo_format = -1;	/* format decoded by dinfo */
 
 	/* configure the event callbacks (not required) */
 	memset(&event_mgr, 0, sizeof(opj_event_mgr_t));
@@ -543,7 +663,7 @@ int main(int argc, char **argv) {
 	memset(&img_fol,0,sizeof(img_fol_t));
 
 	/* parse input and get user encoding parameters */
-	if(parse_cmdline_decoder(argc, argv, &parameters,&img_fol, indexfilename) == 1) {
+	if(parse_cmdline_decoder(argc, argv, &parameters,&img_fol, indexfilename, decode_area) == 1) {
 		return 1;
 	}
 
@@ -574,6 +694,9 @@ int main(int argc, char **argv) {
 		num_images=1;
 	}
 
+	/* a failure only means that each decompressor allocates its own arena */
+	arena = opj_arena_create();
+
 	/*Encoding image one by one*/
 	for(imageno = 0; imageno < num_images ; imageno++)	{
 		image = NULL;
@@ -586,45 +709,64 @@ int main(int argc, char **argv) {
 			}
 		}
 
-		/* read the input file and put it in memory */
+		/* open the input file, read by the decoder */
 		/* ---------------------------------------- */
 		fsrc = fopen(parameters.infile, "rb");
 		if (!fsrc) {
 			fprintf(stderr, "ERROR -> failed to open %s for reading\n", parameters.infile);
+			/* the decompressor of the previous image uses the arena */
+			opj_destroy_decompress(dinfo);
+			opj_arena_destroy(arena);
 			return 1;
 		}
-		fseek(fsrc, 0, SEEK_END);
-		file_length = ftell(fsrc);
-		fseek(fsrc, 0, SEEK_SET);
-		src = (unsigned char *) malloc(file_length);
-		if (fread(src, 1, file_length, fsrc) != (size_t)file_length)
-		{
-			free(src);
-			fclose(fsrc);
-			fprintf(stderr, "\nERROR: fread return a number of element different from the expected.\n");
-			return 1;
-		}
-		fclose(fsrc);
 
 		/* decode the code-stream */
 		/* ---------------------- */
 
+		/* the decompressor of the previous image is reused when the format is the same */
+		if (dinfo && dinfo_format != parameters.decod_format) {
+			opj_destroy_decompress(dinfo);
+			dinfo = NULL;
+		}
+		if (dinfo) {
+			opj_decoder_reset(dinfo);
+		}
+		dinfo_format = parameters.decod_format;
+
 		switch(parameters.decod_format) {
 		case J2K_CFMT:
 		{
 			/* JPEG-2000 codestream */
 
-			/* get a decoder handle */
-			dinfo = opj_create_decompress(CODEC_J2K);
+			if (!dinfo) {
+				/* get a decoder handle */
+				dinfo = opj_create_decompress(CODEC_J2K);
 
-			/* catch events using our callbacks and give a local context */
-			opj_set_event_mgr((opj_common_ptr)dinfo, &event_mgr, stderr);
+				/* catch events using our callbacks and give a local context */
+				opj_set_event_mgr((opj_common_ptr)dinfo, &event_mgr, stderr);
 
-			/* setup the decoder decoding parameters using user parameters */
-			opj_setup_decoder(dinfo, &parameters);
+				/* setup the decoder decoding parameters using user parameters */
+				opj_setup_decoder(dinfo, &parameters);
+				if (arena) {
+					opj_set_decode_arena(dinfo, arena);
+				}
+				if (decode_area[2] > 0 && !opj_set_decode_area(dinfo, decode_area[0], decode_area[1], decode_area[2], decode_area[3])) {
+					opj_destroy_decompress(dinfo);
+					fclose(fsrc);
+					opj_arena_destroy(arena);
+					return 1;
+				}
+			}
 
 			/* open a byte stream */
-			cio = opj_cio_open((opj_common_ptr)dinfo, src, file_length);
+			cio = open_input(dinfo, fsrc, *indexfilename != 0, &src);
+			if (!cio) {
+				opj_destroy_decompress(dinfo);
+				fclose(fsrc);
+				free(src);
+				opj_arena_destroy(arena);
+				return 1;
+			}
 
 			/* decode the stream and fill the image structure */
 			if (*indexfilename)				/* If need to extract codestream information*/
@@ -635,7 +777,9 @@ int main(int argc, char **argv) {
 				fprintf(stderr, "ERROR -> j2k_to_image: failed to decode image!\n");
 				opj_destroy_decompress(dinfo);
 				opj_cio_close(cio);
+				fclose(fsrc);
 				free(src);
+				opj_arena_destroy(arena);
 				return 1;
 			}
 
@@ -657,17 +801,35 @@ int main(int argc, char **argv) {
 		{
 			/* JPEG 2000 compressed image data */
 
-			/* get a decoder handle */
-			dinfo = opj_create_decompress(CODEC_JP2);
+			if (!dinfo) {
+				/* get a decoder handle */
+				dinfo = opj_create_decompress(CODEC_JP2);
 
-			/* catch events using our callbacks and give a local context */
-			opj_set_event_mgr((opj_common_ptr)dinfo, &event_mgr, stderr);
+				/* catch events using our callbacks and give a local context */
+				opj_set_event_mgr((opj_common_ptr)dinfo, &event_mgr, stderr);
 
-			/* setup the decoder decoding parameters using the current image and user parameters */
-			opj_setup_decoder(dinfo, &parameters);
+				/* setup the decoder decoding parameters using the current image and user parameters */
+				opj_setup_decoder(dinfo, &parameters);
+				if (arena) {
+					opj_set_decode_arena(dinfo, arena);
+				}
+				if (decode_area[2] > 0 && !opj_set_decode_area(dinfo, decode_area[0], decode_area[1], decode_area[2], decode_area[3])) {
+					opj_destroy_decompress(dinfo);
+					fclose(fsrc);
+					opj_arena_destroy(arena);
+					return 1;
+				}
+			}
 
 			/* open a byte stream */
-			cio = opj_cio_open((opj_common_ptr)dinfo, src, file_length);
+			cio = open_input(dinfo, fsrc, *indexfilename != 0, &src);
+			if (!cio) {
+				opj_destroy_decompress(dinfo);
+				fclose(fsrc);
+				free(src);
+				opj_arena_destroy(arena);
+				return 1;
+			}
 
 			/* decode the stream and fill the image structure */
 			if (*indexfilename)				/* If need to extract codestream information*/
@@ -678,7 +840,9 @@ int main(int argc, char **argv) {
 				fprintf(stderr, "ERROR -> j2k_to_image: failed to decode image!\n");
 				opj_destroy_decompress(dinfo);
 				opj_cio_close(cio);
+				fclose(fsrc);
 				free(src);
+				opj_arena_destroy(arena);
 				return 1;
 			}
 
@@ -700,17 +864,35 @@ int main(int argc, char **argv) {
 		{
 			/* JPEG 2000, JPIP */
 
-			/* get a decoder handle */
-			dinfo = opj_create_decompress(CODEC_JPT);
+			if (!dinfo) {
+				/* get a decoder handle */
+				dinfo = opj_create_decompress(CODEC_JPT);
 
-			/* catch events using our callbacks and give a local context */
-			opj_set_event_mgr((opj_common_ptr)dinfo, &event_mgr, stderr);
+				/* catch events using our callbacks and give a local context */
+				opj_set_event_mgr((opj_common_ptr)dinfo, &event_mgr, stderr);
 
-			/* setup the decoder decoding parameters using user parameters */
-			opj_setup_decoder(dinfo, &parameters);
+				/* setup the decoder decoding parameters using user parameters */
+				opj_setup_decoder(dinfo, &parameters);
+				if (arena) {
+					opj_set_decode_arena(dinfo, arena);
+				}
+				if (decode_area[2] > 0 && !opj_set_decode_area(dinfo, decode_area[0], decode_area[1], decode_area[2], decode_area[3])) {
+					opj_destroy_decompress(dinfo);
+					fclose(fsrc);
+					opj_arena_destroy(arena);
+					return 1;
+				}
+			}
 
 			/* open a byte stream */
-			cio = opj_cio_open((opj_common_ptr)dinfo, src, file_length);
+			cio = open_input(dinfo, fsrc, 1, &src);
+			if (!cio) {
+				opj_destroy_decompress(dinfo);
+				fclose(fsrc);
+				free(src);
+				opj_arena_destroy(arena);
+				return 1;
+			}
 
 			/* decode the stream and fill the image structure */
 			if (*indexfilename)				/* If need to extract codestream information*/
@@ -721,7 +903,9 @@ int main(int argc, char **argv) {
 				fprintf(stderr, "ERROR -> j2k_to_image: failed to decode image!\n");
 				opj_destroy_decompress(dinfo);
 				opj_cio_close(cio);
+				fclose(fsrc);
 				free(src);
+				opj_arena_destroy(arena);
 				return 1;
 			}
 
@@ -741,10 +925,12 @@ int main(int argc, char **argv) {
 
 		default:
 			fprintf(stderr, "skipping file..\n");
+			fclose(fsrc);
 			continue;
 	}
 
-		/* free the memory containing the code-stream */
+		/* close the input file and free the memory containing the code-stream */
+		fclose(fsrc);
 		free(src);
 		src = NULL;
 
@@ -836,10 +1022,6 @@ int main(int argc, char **argv) {
 				fprintf(stderr,"Outfile %s not generated\n",parameters.outfile);
 		}
 
-		/* free remaining structures */
-		if(dinfo) {
-			opj_destroy_decompress(dinfo);
-		}
 		/* free codestream information structure */
 		if (*indexfilename)	
 			opj_destroy_cstr_info(&cstr_info);
@@ -847,6 +1029,11 @@ int main(int argc, char **argv) {
 		opj_image_destroy(image);
 
 	}
+	/* free remaining structures */
+	if(dinfo) {
+		opj_destroy_decompress(dinfo);
+	}
+	opj_arena_destroy(arena);
 	return 0;
 }
 /*end main*/
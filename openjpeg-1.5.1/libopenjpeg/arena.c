@@ -0,0 +1,170 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "opj_includes.h"
+
+/** @defgroup ARENA ARENA - Implementation of a memory arena */
+/*@{*/
+
+/** size of the first chunk of an arena */
+#define OPJ_ARENA_MIN_CHUNK_SIZE (64 * 1024)
+/** alignment of the allocations, enough for the SSE types */
+#define OPJ_ARENA_ALIGN 16
+
+/** @name Local data structures */
+/*@{*/
+
+/**
+Block of memory the allocations are carved from
+*/
+typedef struct opj_arena_chunk {
+	/** previously filled chunk */
+	struct opj_arena_chunk *next;
+	/** number of bytes available after the header */
+	size_t size;
+} opj_arena_chunk_t;
+
+struct opj_arena {
+	/** chunk being filled, followed by the full ones */
+	opj_arena_chunk_t *chunks;
+	/** number of bytes used in the first chunk */
+	size_t used;
+};
+
+/*@}*/
+
+/** @name Local static functions */
+/*@{*/
+
+/**
+Add a chunk in front of the chunks of an arena
+@param arena Arena
+@param size Minimum number of bytes available in the chunk
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+static opj_bool opj_arena_add_chunk(opj_arena_t *arena, size_t size);
+
+/*@}*/
+
+/*@}*/
+
+/* ----------------------------------------------------------------------- */
+
+/* chunk header size, rounded up so that the first allocation is aligned */
+#define OPJ_ARENA_HEADER_SIZE ((sizeof(opj_arena_chunk_t) + OPJ_ARENA_ALIGN - 1) & ~(size_t) (OPJ_ARENA_ALIGN - 1))
+
+static opj_bool opj_arena_add_chunk(opj_arena_t *arena, size_t size) {
+	opj_arena_chunk_t *chunk;
+
+	/* grow geometrically, so that a large tile only needs a few chunks */
+	if (arena->chunks && size < 2 * arena->chunks->size) {
+		size = 2 * arena->chunks->size;
+	}
+	if (size < OPJ_ARENA_MIN_CHUNK_SIZE) {
+		size = OPJ_ARENA_MIN_CHUNK_SIZE;
+	}
+	if (size > (size_t) -1 - OPJ_ARENA_HEADER_SIZE) {
+		return OPJ_FALSE;
+	}
+	/* opj_malloc aligns at least on 8 bytes, opj_aligned_malloc on 16 */
+	chunk = (opj_arena_chunk_t*) opj_aligned_malloc(OPJ_ARENA_HEADER_SIZE + size);
+	if (!chunk) {
+		return OPJ_FALSE;
+	}
+	chunk->next = arena->chunks;
+	chunk->size = size;
+	arena->chunks = chunk;
+	arena->used = 0;
+	return OPJ_TRUE;
+}
+
+opj_arena_t* OPJ_CALLCONV opj_arena_create(void) {
+	return (opj_arena_t*) opj_calloc(1, sizeof(opj_arena_t));
+}
+
+void OPJ_CALLCONV opj_arena_destroy(opj_arena_t *arena) {
+	if (arena) {
+		opj_arena_chunk_t *chunk = arena->chunks;
+		while (chunk) {
+			opj_arena_chunk_t *next = chunk->next;
+			opj_aligned_free(chunk);
+			chunk = next;
+		}
+		opj_free(arena);
+	}
+}
+
+void* opj_arena_alloc(opj_arena_t *arena, size_t size) {
+	void *ptr;
+
+	if (size > (size_t) -1 - OPJ_ARENA_ALIGN) {
+		return NULL;
+	}
+	size = (size + OPJ_ARENA_ALIGN - 1) & ~(size_t) (OPJ_ARENA_ALIGN - 1);
+	if (!arena->chunks || size > arena->chunks->size - arena->used) {
+		if (!opj_arena_add_chunk(arena, size)) {
+			return NULL;
+		}
+	}
+	ptr = (unsigned char*) arena->chunks + OPJ_ARENA_HEADER_SIZE + arena->used;
+	arena->used += size;
+	return ptr;
+}
+
+void* opj_arena_calloc(opj_arena_t *arena, size_t num, size_t size) {
+	void *ptr;
+
+	if (size && num > (size_t) -1 / size) {
+		return NULL;
+	}
+	ptr = opj_arena_alloc(arena, num * size);
+	if (ptr) {
+		memset(ptr, 0, num * size);
+	}
+	return ptr;
+}
+
+void opj_arena_reset(opj_arena_t *arena) {
+	opj_arena_chunk_t *chunk = arena->chunks;
+	size_t total = 0;
+
+	if (chunk && chunk->next) {
+		/* replace the chunks by one that holds them all */
+		while (chunk) {
+			opj_arena_chunk_t *next = chunk->next;
+			total += chunk->size;
+			opj_aligned_free(chunk);
+			chunk = next;
+		}
+		arena->chunks = NULL;
+		/* on failure, the next allocations simply start from an empty arena */
+		opj_arena_add_chunk(arena, total);
+	}
+	arena->used = 0;
+}
@@ -0,0 +1,76 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __ARENA_H
+#define __ARENA_H
+/**
+@file arena.h
+@brief Implementation of a memory arena (ARENA)
+
+The functions in ARENA.C hand out memory from a few large chunks instead of calling
+opj_malloc for every object. Nothing allocated from an arena is freed on its own: 
+the whole arena is released at once with opj_arena_reset, which keeps the memory 
+for the next allocations. TCD.C and T2.C use it for the per-tile decoder structures 
+(resolutions, precincts, code-blocks, tag-trees, code-block segments and data).
+An arena is not thread-safe: it must only be used by one thread at a time.
+*/
+
+/** @defgroup ARENA ARENA - Implementation of a memory arena */
+/*@{*/
+
+/** @name Exported functions */
+/*@{*/
+/* ----------------------------------------------------------------------- */
+/**
+Allocate memory from an arena. The memory is aligned on 16 bytes. 
+@param arena Arena
+@param size Number of bytes
+@return Returns a pointer to the memory if successful, returns NULL otherwise
+*/
+void* opj_arena_alloc(opj_arena_t *arena, size_t size);
+/**
+Allocate zero-initialized memory for an array from an arena
+@param arena Arena
+@param num Number of elements
+@param size Size of an element
+@return Returns a pointer to the memory if successful, returns NULL otherwise
+*/
+void* opj_arena_calloc(opj_arena_t *arena, size_t num, size_t size);
+/**
+Release everything allocated from an arena. 
+The memory is kept for the next allocations, merged into a single chunk 
+so that the same workload fits without a new opj_malloc.
+@param arena Arena
+*/
+void opj_arena_reset(opj_arena_t *arena);
+/* ----------------------------------------------------------------------- */
+/*@}*/
+
+/*@}*/
+
+#endif /* __ARENA_H */
@@ -88,6 +88,7 @@ static int bio_bytein(opj_bio_t *bio) {
 	bio->buf = (bio->buf << 8) & 0xffff;
 	bio->ct = bio->buf == 0xff00 ? 7 : 8;
 	if (bio->bp >= bio->end) {
+		bio->overrun++;
 		return 1;
 	}
 	bio->buf |= *bio->bp++;
@@ -131,12 +132,17 @@ int bio_numbytes(opj_bio_t *bio) {
 	return (bio->bp - bio->start);
 }
 
+int bio_overrun(opj_bio_t *bio) {
+	return bio->overrun;
+}
+
 void bio_init_enc(opj_bio_t *bio, unsigned char *bp, int len) {
 	bio->start = bp;
 	bio->end = bp + len;
 	bio->bp = bp;
 	bio->buf = 0;
 	bio->ct = 8;
+	bio->overrun = 0;
 }
 
 void bio_init_dec(opj_bio_t *bio, unsigned char *bp, int len) {
@@ -145,6 +151,7 @@ void bio_init_dec(opj_bio_t *bio, unsigned char *bp, int len) {
 	bio->bp = bp;
 	bio->buf = 0;
 	bio->ct = 0;
+	bio->overrun = 0;
 }
 
 void bio_write(opj_bio_t *bio, int v, int n) {
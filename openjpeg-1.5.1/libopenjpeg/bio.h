@@ -55,6 +55,8 @@ typedef struct opj_bio {
 	unsigned int buf;
 	/** coder : number of bits free to write. decoder : number of bits read */
 	int ct;
+	/** decoder : number of bytes read past the end of the buffer, as zeros */
+	int overrun;
 } opj_bio_t;
 
 /** @name Exported functions */
@@ -77,6 +79,12 @@ Number of bytes written.
 */
 int bio_numbytes(opj_bio_t *bio);
 /**
+Number of bytes read past the end of the buffer, when the data is truncated.
+@param bio BIO handle
+@return Returns 0 if all the bits read were in the buffer
+*/
+int bio_overrun(opj_bio_t *bio);
+/**
 Init encoder
 @param bio BIO handle
 @param bp Output buffer
@@ -33,51 +33,319 @@
 
 #include "opj_includes.h"
 
+#include <errno.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#define cio_sys_write(fd, buffer, length) _write(fd, buffer, (unsigned int) (length))
+#define cio_sys_read(fd, buffer, length) _read(fd, buffer, (unsigned int) (length))
+#define cio_sys_lseek _lseek
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define cio_sys_write write
+#define cio_sys_read read
+#define cio_sys_lseek lseek
+#endif
+
 /* ----------------------------------------------------------------------- */
 
-opj_cio_t* OPJ_CALLCONV opj_cio_open(opj_common_ptr cinfo, unsigned char *buffer, int length) {
+/* first size of the buffer of a stream opened for writing, which grows with the codestream */
+#define CIO_BUFFER_SIZE 65536
+
+/**
+Output of a stream opened with opj_cio_open_fd, input of a stream opened with opj_cio_open_input_fd
+*/
+typedef struct opj_cio_fd {
+	/** file descriptor */
+	int fd;
+	/** position of the file where the stream starts */
+	long base;
+} opj_cio_fd_t;
+
+static int cio_fd_write(const unsigned char *buffer, int length, void *user_data) {
+	opj_cio_fd_t *out = (opj_cio_fd_t*) user_data;
+	int done = 0;
+	while (done < length) {
+		int n = (int) cio_sys_write(out->fd, buffer + done, length - done);
+		if (n <= 0) {
+			break;
+		}
+		done += n;
+	}
+	return done;
+}
+
+static int cio_fd_read(unsigned char *buffer, int length, void *user_data) {
+	opj_cio_fd_t *in = (opj_cio_fd_t*) user_data;
+	int n;
+	/* a signal caught before any byte is read is not an error of the file */
+	do {
+		n = (int) cio_sys_read(in->fd, buffer, length);
+	} while (n < 0 && errno == EINTR);
+	return n;
+}
+
+static opj_bool cio_fd_seek(int pos, void *user_data) {
+	opj_cio_fd_t *out = (opj_cio_fd_t*) user_data;
+	return cio_sys_lseek(out->fd, out->base + pos, SEEK_SET) == out->base + pos;
+}
+
+static void cio_free_user_data(void *user_data) {
+	opj_free(user_data);
+}
+
+/**
+File mapped by opj_cio_open_mmap
+*/
+typedef struct opj_cio_map {
+	/** first byte of the file */
+	void *data;
+	/** size of the file in bytes */
+	int size;
+} opj_cio_map_t;
+
+static void cio_unmap(void *user_data) {
+	opj_cio_map_t *map = (opj_cio_map_t*) user_data;
+#ifdef _WIN32
+	UnmapViewOfFile(map->data);
+#else
+	munmap(map->data, map->size);
+#endif
+	opj_free(map);
+}
+
+/*
+size of the codestream of the image the compressor is set up for: 0.1625 = 1.3/8 and 2000 bytes
+as a minimum for headers. Returns 0 if cinfo is not a compressor.
+*/
+static int cio_output_length(opj_common_ptr cinfo) {
 	opj_cp_t *cp = NULL;
-	opj_cio_t *cio = (opj_cio_t*)opj_malloc(sizeof(opj_cio_t));
+	switch(cinfo->codec_format) {
+		case CODEC_J2K:
+			cp = ((opj_j2k_t*)cinfo->j2k_handle)->cp;
+			break;
+		case CODEC_JP2:
+			cp = ((opj_jp2_t*)cinfo->jp2_handle)->j2k->cp;
+			break;
+		default:
+			return 0;
+	}
+	return (int) (0.1625 * cp->img_size + 2000);
+}
+
+/*
+write the bytes of the buffer to the output and move the buffer to another position of the
+stream, so that bytes already written out can be written again
+*/
+static opj_bool cio_move(opj_cio_t *cio, int pos) {
+	int n = cio->top - cio->start;
+	if (cio->failed) {
+		return OPJ_FALSE;
+	}
+	if (n > 0 && cio->write_fn(cio->start, n, cio->user_data) != n) {
+		opj_event_msg(cio->cinfo, EVT_ERROR, "Cannot write the codestream to the output\n");
+		cio->failed = OPJ_TRUE;
+		return OPJ_FALSE;
+	}
+	cio->offset += n;
+	cio->written = int_max(cio->written, cio->offset);
+	if (pos != cio->offset && (!cio->seek_fn || !cio->seek_fn(pos, cio->user_data))) {
+		opj_event_msg(cio->cinfo, EVT_ERROR, "Cannot seek in the output\n");
+		cio->failed = OPJ_TRUE;
+		return OPJ_FALSE;
+	}
+	cio->offset = pos;
+	cio->bp = cio->start;
+	cio->top = cio->start;
+	return OPJ_TRUE;
+}
+
+opj_cio_t* cio_open_memory(opj_common_ptr cinfo, int length) {
+	int size = int_max(int_min(length, CIO_BUFFER_SIZE), 1);
+	opj_cio_t *cio = (opj_cio_t*)opj_calloc(1, sizeof(opj_cio_t));
 	if(!cio) return NULL;
 	cio->cinfo = cinfo;
+	cio->openmode = OPJ_STREAM_WRITE;
+	cio->length = length;
+	cio->hold = -1;
+	/* the buffer grows with the codestream (see cio_reserve) */
+	cio->buffer = (unsigned char *)opj_malloc(size);
+	if(!cio->buffer) {
+		opj_event_msg(cio->cinfo, EVT_ERROR, "Error allocating memory for compressed bitstream\n");
+		opj_free(cio);
+		return NULL;
+	}
+	cio->start = cio->buffer;
+	cio->end = cio->buffer + size;
+	cio->bp = cio->buffer;
+	cio->top = cio->buffer;
+	return cio;
+}
+
+opj_cio_t* OPJ_CALLCONV opj_cio_open(opj_common_ptr cinfo, unsigned char *buffer, int length) {
+	opj_cio_t *cio = NULL;
 	if(buffer && length) {
 		/* wrap a user buffer containing the encoded image */
+		cio = (opj_cio_t*)opj_calloc(1, sizeof(opj_cio_t));
+		if(!cio) return NULL;
+		cio->cinfo = cinfo;
 		cio->openmode = OPJ_STREAM_READ;
 		cio->buffer = buffer;
 		cio->length = length;
+		cio->hold = -1;
+
+		/* Initialize byte IO */
+		cio->start = cio->buffer;
+		cio->end = cio->buffer + cio->length;
+		cio->bp = cio->buffer;
+		cio->top = cio->buffer;
 	}
 	else if(!buffer && !length && cinfo) {
 		/* allocate a buffer for the encoded image */
-		cio->openmode = OPJ_STREAM_WRITE;
-		switch(cinfo->codec_format) {
-			case CODEC_J2K:
-				cp = ((opj_j2k_t*)cinfo->j2k_handle)->cp;
-				break;
-			case CODEC_JP2:
-				cp = ((opj_jp2_t*)cinfo->jp2_handle)->j2k->cp;
-				break;
-			default:
-				opj_free(cio);
-				return NULL;
-		}
-		cio->length = (unsigned int) (0.1625 * cp->img_size + 2000); /* 0.1625 = 1.3/8 and 2000 bytes as a minimum for headers */
-		cio->buffer = (unsigned char *)opj_malloc(cio->length);
-		if(!cio->buffer) {
-			opj_event_msg(cio->cinfo, EVT_ERROR, "Error allocating memory for compressed bitstream\n");
-			opj_free(cio);
-			return NULL;
+		length = cio_output_length(cinfo);
+		if (length) {
+			cio = cio_open_memory(cinfo, length);
 		}
 	}
-	else {
-		opj_free(cio);
+	return cio;
+}
+
+opj_cio_t* OPJ_CALLCONV opj_cio_open_output(opj_common_ptr cinfo, opj_stream_write_fn write_fn, opj_stream_seek_fn seek_fn, void *user_data) {
+	opj_cio_t *cio = NULL;
+	int length;
+	if (!cinfo || !write_fn) {
 		return NULL;
 	}
+	length = cio_output_length(cinfo);
+	if (length) {
+		cio = cio_open_memory(cinfo, length);
+	}
+	if (cio) {
+		cio->write_fn = write_fn;
+		cio->seek_fn = seek_fn;
+		cio->user_data = user_data;
+#ifdef USE_JPWL
+		/* jpwl_encode rewrites the whole codestream once it is encoded */
+		cio->hold = 0;
+#endif /* USE_JPWL */
+	}
+	return cio;
+}
 
-	/* Initialize byte IO */
-	cio->start = cio->buffer;
-	cio->end = cio->buffer + cio->length;
-	cio->bp = cio->buffer;
+opj_cio_t* OPJ_CALLCONV opj_cio_open_fd(opj_common_ptr cinfo, int fd) {
+	opj_cio_t *cio;
+	opj_cio_fd_t *out = (opj_cio_fd_t*) opj_malloc(sizeof(opj_cio_fd_t));
+	if (!out) {
+		return NULL;
+	}
+	out->fd = fd;
+	/* pipes cannot seek */
+	out->base = (long) cio_sys_lseek(fd, 0, SEEK_CUR);
+	cio = opj_cio_open_output(cinfo, cio_fd_write, out->base >= 0 ? cio_fd_seek : NULL, out);
+	if (!cio) {
+		opj_free(out);
+		return NULL;
+	}
+	cio->release_fn = cio_free_user_data;
+	return cio;
+}
 
+opj_cio_t* OPJ_CALLCONV opj_cio_open_input(opj_common_ptr cinfo, opj_stream_read_fn read_fn, opj_stream_skip_fn skip_fn, opj_stream_seek_fn seek_fn, void *user_data) {
+	opj_cio_t *cio;
+	if (!cinfo || !read_fn) {
+		return NULL;
+	}
+	cio = (opj_cio_t*)opj_calloc(1, sizeof(opj_cio_t));
+	if(!cio) return NULL;
+	cio->cinfo = cinfo;
+	cio->openmode = OPJ_STREAM_READ;
+	cio->hold = -1;
+	/* no buffer: the decoder reads the input with cio_input_read */
+	cio->read_fn = read_fn;
+	cio->skip_fn = skip_fn;
+	cio->seek_fn = seek_fn;
+	cio->user_data = user_data;
+	return cio;
+}
+
+opj_cio_t* OPJ_CALLCONV opj_cio_open_input_fd(opj_common_ptr cinfo, int fd) {
+	opj_cio_t *cio;
+	opj_cio_fd_t *in = (opj_cio_fd_t*) opj_malloc(sizeof(opj_cio_fd_t));
+	if (!in) {
+		return NULL;
+	}
+	in->fd = fd;
+	/* pipes cannot seek: the bytes to skip are read */
+	in->base = (long) cio_sys_lseek(fd, 0, SEEK_CUR);
+	cio = opj_cio_open_input(cinfo, cio_fd_read, NULL, in->base >= 0 ? cio_fd_seek : NULL, in);
+	if (!cio) {
+		opj_free(in);
+		return NULL;
+	}
+	cio->release_fn = cio_free_user_data;
+	return cio;
+}
+
+opj_cio_t* OPJ_CALLCONV opj_cio_open_mmap(opj_common_ptr cinfo, int fd) {
+	opj_cio_t *cio;
+	opj_cio_map_t *map = (opj_cio_map_t*) opj_malloc(sizeof(opj_cio_map_t));
+	if (!map) {
+		return NULL;
+	}
+	/* 
+	the pages are mapped copy-on-write: the decoder may write to its input (JPWL corrects 
+	the codestream in place), which must not change the file 
+	*/
+#ifdef _WIN32
+	{
+		HANDLE file = (HANDLE) _get_osfhandle(fd);
+		HANDLE mapping;
+		LARGE_INTEGER size;
+		if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)
+			|| size.QuadPart <= 0 || size.QuadPart > 0x7fffffff) {
+			opj_free(map);
+			return NULL;
+		}
+		mapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (!mapping) {
+			opj_free(map);
+			return NULL;
+		}
+		map->data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		/* the view keeps the mapping open */
+		CloseHandle(mapping);
+		if (!map->data) {
+			opj_free(map);
+			return NULL;
+		}
+		map->size = (int) size.QuadPart;
+	}
+#else
+	{
+		struct stat st;
+		if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > 0x7fffffff) {
+			opj_free(map);
+			return NULL;
+		}
+		map->size = (int) st.st_size;
+		map->data = mmap(NULL, map->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (map->data == MAP_FAILED) {
+			opj_free(map);
+			return NULL;
+		}
+	}
+#endif
+	cio = opj_cio_open(cinfo, (unsigned char*) map->data, map->size);
+	if (!cio) {
+		cio_unmap(map);
+		return NULL;
+	}
+	cio->user_data = map;
+	cio->release_fn = cio_unmap;
 	return cio;
 }
 
@@ -87,11 +355,118 @@ void OPJ_CALLCONV opj_cio_close(opj_cio_t *cio) {
 			/* destroy the allocated buffer */
 			opj_free(cio->buffer);
 		}
+		if(cio->release_fn) {
+			cio->release_fn(cio->user_data);
+		}
 		/* destroy the cio */
 		opj_free(cio);
 	}
 }
 
+opj_bool cio_reserve(opj_cio_t *cio, int n) {
+	int used, size;
+	unsigned char *buffer;
+	if (n <= cio->end - cio->bp) {
+		return OPJ_TRUE;
+	}
+	if (cio->openmode != OPJ_STREAM_WRITE || n > cio_numbytesleft(cio)) {
+		return OPJ_FALSE;
+	}
+	used = cio->bp - cio->start;
+	size = int_max(2 * (int) (cio->end - cio->start), used + n);
+	size = int_min(size, cio->length - cio->offset);
+	buffer = (unsigned char *) opj_realloc(cio->buffer, size);
+	if (!buffer) {
+		opj_event_msg(cio->cinfo, EVT_ERROR, "Out of memory\n");
+		return OPJ_FALSE;
+	}
+	cio->top = buffer + (cio->top - cio->start);
+	cio->bp = buffer + used;
+	cio->buffer = buffer;
+	cio->start = buffer;
+	cio->end = buffer + size;
+	return OPJ_TRUE;
+}
+
+opj_bool cio_flush(opj_cio_t *cio) {
+	int n;
+	if (!cio->write_fn) {
+		return OPJ_TRUE;
+	}
+	if (cio->failed) {
+		return OPJ_FALSE;
+	}
+	n = int_min(cio->top - cio->start, cio->bp - cio->start);
+	if (cio->hold >= 0) {
+		n = int_min(n, int_max(cio->hold - cio->offset, 0));
+	}
+	if (n <= 0) {
+		return OPJ_TRUE;
+	}
+	if (cio->write_fn(cio->start, n, cio->user_data) != n) {
+		opj_event_msg(cio->cinfo, EVT_ERROR, "Cannot write the codestream to the output\n");
+		cio->failed = OPJ_TRUE;
+		return OPJ_FALSE;
+	}
+	memmove(cio->start, cio->start + n, cio->top - cio->start - n);
+	cio->offset += n;
+	cio->written = int_max(cio->written, cio->offset);
+	cio->bp -= n;
+	cio->top -= n;
+	return OPJ_TRUE;
+}
+
+int cio_hold(opj_cio_t *cio, int pos) {
+	int hold = cio->hold;
+	/* the bytes held already stay so */
+	cio->hold = (pos >= 0 && hold >= 0 && hold < pos) ? hold : pos;
+	return hold;
+}
+
+opj_bool cio_can_seek(opj_cio_t *cio) {
+	return !cio->write_fn || cio->seek_fn;
+}
+
+int cio_input_read(opj_cio_t *cio, unsigned char *buffer, int n) {
+	int done = 0;
+	while (done < n) {
+		int r = cio->read_fn(buffer + done, n - done, cio->user_data);
+		if (r < 0) {
+			opj_event_msg(cio->cinfo, EVT_ERROR, "Cannot read the input\n");
+			return -1;
+		}
+		if (r == 0) {
+			break;
+		}
+		done += r;
+	}
+	cio->offset += done;
+	return done;
+}
+
+opj_bool cio_input_skip(opj_cio_t *cio, int n) {
+	if (cio->skip_fn) {
+		if (!cio->skip_fn(n, cio->user_data)) {
+			return OPJ_FALSE;
+		}
+	} else if (cio->seek_fn) {
+		if (!cio->seek_fn(cio->offset + n, cio->user_data)) {
+			return OPJ_FALSE;
+		}
+	} else {
+		unsigned char buffer[4096];
+		while (n > 0) {
+			int r = cio_input_read(cio, buffer, int_min(n, (int) sizeof(buffer)));
+			if (r <= 0) {
+				return OPJ_FALSE;
+			}
+			n -= r;
+		}
+		return OPJ_TRUE;
+	}
+	cio->offset += n;
+	return OPJ_TRUE;
+}
 
 /* ----------------------------------------------------------------------- */
 
@@ -99,7 +474,7 @@ void OPJ_CALLCONV opj_cio_close(opj_cio_t *cio) {
  * Get position in byte stream.
  */
 int OPJ_CALLCONV cio_tell(opj_cio_t *cio) {
-	return cio->bp - cio->start;
+	return cio->offset + (int) (cio->bp - cio->start);
 }
 
 /*
@@ -108,14 +483,21 @@ int OPJ_CALLCONV cio_tell(opj_cio_t *cio) {
  * pos : position, in number of bytes, from the beginning of the stream
  */
 void OPJ_CALLCONV cio_seek(opj_cio_t *cio, int pos) {
-	cio->bp = cio->start + pos;
+	if (cio->write_fn && (pos < cio->offset || (cio->offset < cio->written && pos > cio->offset + (cio->top - cio->start)))) {
+		/* the bytes at pos have been written out already */
+		cio_move(cio, pos);
+	} else if (cio->openmode == OPJ_STREAM_WRITE && pos > cio_tell(cio)) {
+		cio_skip(cio, pos - cio_tell(cio));
+	} else {
+		cio->bp = cio->start + (pos - cio->offset);
+	}
 }
 
 /*
  * Number of bytes left before the end of the stream.
  */
 int cio_numbytesleft(opj_cio_t *cio) {
-	return cio->end - cio->bp;
+	return cio->length - cio_tell(cio);
 }
 
 /*
@@ -129,11 +511,14 @@ unsigned char *cio_getbp(opj_cio_t *cio) {
  * Write a byte.
  */
 opj_bool cio_byteout(opj_cio_t *cio, unsigned char v) {
-	if (cio->bp >= cio->end) {
+	if (cio->bp >= cio->end && !cio_reserve(cio, 1)) {
 		opj_event_msg(cio->cinfo, EVT_ERROR, "write error\n");
 		return OPJ_FALSE;
 	}
 	*cio->bp++ = v;
+	if (cio->bp > cio->top) {
+		cio->top = cio->bp;
+	}
 	return OPJ_TRUE;
 }
 
@@ -180,12 +565,40 @@ unsigned int cio_read(opj_cio_t *cio, int n) {
 	return v;
 }
 
+/*
+ * Read some bytes of a buffer.
+ *
+ * p : first byte
+ * n : number of bytes to read
+ *
+ * return : big endian value of the n bytes at p
+ */
+unsigned int cio_read_bytes(const unsigned char *p, int n) {
+	unsigned int v = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		v = (v << 8) | p[i];
+	}
+	return v;
+}
+
 /* 
  * Skip some bytes.
  *
  * n : number of bytes to skip
  */
 void cio_skip(opj_cio_t *cio, int n) {
+	if (cio->openmode == OPJ_STREAM_WRITE && n > 0) {
+		/* the bytes skipped are written later */
+		if (!cio_reserve(cio, n)) {
+			n = cio->end - cio->bp;
+		}
+		cio->bp += n;
+		if (cio->bp > cio->top) {
+			cio->top = cio->bp;
+		}
+		return;
+	}
 	cio->bp += n;
 }
 
@@ -79,11 +79,67 @@ Read some bytes
 */
 unsigned int cio_read(opj_cio_t *cio, int n);
 /**
+Read some bytes of a buffer, for the probes that parse a header without a CIO handle
+@param p Pointer to the first byte
+@param n Number of bytes to read
+@return Returns the big endian value of the n bytes at p
+*/
+unsigned int cio_read_bytes(const unsigned char *p, int n);
+/**
 Skip some bytes
 @param cio CIO handle
 @param n Number of bytes to skip
 */
 void cio_skip(opj_cio_t *cio, int n);
+/**
+Open a stream written to a buffer that grows with the codestream
+@param cinfo Codec context info
+@param length Size of the stream: nothing can be written past it
+@return Returns a CIO handle if successful, returns NULL otherwise
+*/
+opj_cio_t* cio_open_memory(opj_common_ptr cinfo, int length);
+/**
+Make room in the buffer for some bytes at the current position
+@param cio CIO handle
+@param n Number of bytes
+@return Returns false if the bytes pass the end of the stream or memory is short
+*/
+opj_bool cio_reserve(opj_cio_t *cio, int n);
+/**
+Write the bytes before the current position to the output of the stream, except those held
+@param cio CIO handle
+@return Returns false if the output failed
+*/
+opj_bool cio_flush(opj_cio_t *cio);
+/**
+Keep the bytes from a position on in the buffer until they are released, so that they can be
+written again on an output that cannot seek
+@param cio CIO handle
+@param pos Position of the first byte held, -1 to release the bytes
+@return Returns the previous position held, to restore when done
+*/
+int cio_hold(opj_cio_t *cio, int pos);
+/**
+Tell if the bytes written out can be written again
+@param cio CIO handle
+@return Returns true if the stream is written to memory or to an output that can seek
+*/
+opj_bool cio_can_seek(opj_cio_t *cio);
+/**
+Read the next bytes of the input of a stream opened with opj_cio_open_input
+@param cio CIO handle
+@param buffer Buffer receiving the bytes
+@param n Number of bytes wanted
+@return Returns the number of bytes read, less than n at the end of the input, -1 on a read error
+*/
+int cio_input_read(opj_cio_t *cio, unsigned char *buffer, int n);
+/**
+Skip the next bytes of the input of a stream opened with opj_cio_open_input
+@param cio CIO handle
+@param n Number of bytes
+@return Returns false if the bytes cannot be skipped
+*/
+opj_bool cio_input_skip(opj_cio_t *cio, int n);
 /* ----------------------------------------------------------------------- */
 /*@}*/
 
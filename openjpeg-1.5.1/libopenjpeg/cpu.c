@@ -0,0 +1,130 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cpu.h"
+
+/* system cpuid headers must come before opj_malloc.h poisons malloc & co */
+#if defined(OPJ_X86_SIMD) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(OPJ_X86_SIMD)
+#include <cpuid.h>
+#endif
+
+#include "opj_includes.h"
+
+/** @defgroup CPU CPU - Detection of the processor features */
+/*@{*/
+
+/** @name Local static functions */
+/*@{*/
+
+/**
+Query the processor features
+@return Returns a combination of the OPJ_CPU_* flags
+*/
+static int opj_cpu_detect(void);
+
+/*@}*/
+
+/*@}*/
+
+/* ----------------------------------------------------------------------- */
+
+#ifdef OPJ_X86_SIMD
+
+static void opj_cpuid(unsigned int leaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+	__cpuidex((int*) regs, (int) leaf, 0);
+#else
+	__cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/* low 32 bits of the XCR0 register: which register sets are saved by the OS */
+static unsigned int opj_xgetbv0(void) {
+#ifdef _MSC_VER
+	return (unsigned int) _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+	return eax;
+#endif
+}
+
+static int opj_cpu_detect(void) {
+	unsigned int regs[4];
+	unsigned int max_leaf;
+	int features = 0;
+
+	opj_cpuid(0, regs);
+	max_leaf = regs[0];
+	if (max_leaf < 1) {
+		return 0;
+	}
+
+	opj_cpuid(1, regs);
+	if (regs[3] & (1u << 26)) {
+		features |= OPJ_CPU_SSE2;
+	}
+	if (regs[2] & (1u << 19)) {
+		features |= OPJ_CPU_SSE41;
+	}
+	/* AVX needs the OS to save the YMM registers (OSXSAVE, then XCR0 bits 1 and 2) */
+	if ((regs[2] & (1u << 27)) && (regs[2] & (1u << 28)) && (opj_xgetbv0() & 0x6) == 0x6) {
+		features |= OPJ_CPU_AVX;
+	}
+
+	if ((features & OPJ_CPU_AVX) && max_leaf >= 7) {
+		opj_cpuid(7, regs);
+		if (regs[1] & (1u << 5)) {
+			features |= OPJ_CPU_AVX2;
+		}
+	}
+
+	return features;
+}
+
+#else
+
+static int opj_cpu_detect(void) {
+	return 0;
+}
+
+#endif /* OPJ_X86_SIMD */
+
+/* ----------------------------------------------------------------------- */
+
+int opj_cpu_features(void) {
+	/* a concurrent first call only computes the same value twice */
+	static volatile int features = -1;
+	if (features < 0) {
+		features = opj_cpu_detect();
+	}
+	return features;
+}
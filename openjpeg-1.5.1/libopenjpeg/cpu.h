@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __CPU_H
+#define __CPU_H
+/**
+@file cpu.h
+@brief Detection of the processor features (CPU)
+
+The functions in CPU.C tell which SIMD instruction sets the processor and the operating
+system support, so that the vectorized code paths can be chosen at run time. This header
+does not depend on the other headers of the library: it may be included before the
+system headers that declare the intrinsics.
+*/
+
+/** @defgroup CPU CPU - Detection of the processor features */
+/*@{*/
+
+/**
+OPJ_X86_SIMD is defined when the compiler can build SSE2/SSE4.1/AVX/AVX2 functions without
+enabling these instruction sets for the whole library. OPJ_TARGET(isa) marks such a function.
+*/
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define OPJ_X86_SIMD
+#define OPJ_TARGET(isa)
+#elif (defined(__i386__) || defined(__x86_64__)) && \
+	(defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define OPJ_X86_SIMD
+#define OPJ_TARGET(isa) __attribute__((target(isa)))
+#else
+#define OPJ_TARGET(isa)
+#endif
+
+/** @name Processor features returned by opj_cpu_features */
+/*@{*/
+#define OPJ_CPU_SSE2	0x0001	/**< SSE2 */
+#define OPJ_CPU_AVX		0x0002	/**< AVX, with the YMM registers saved by the OS */
+#define OPJ_CPU_AVX2	0x0004	/**< AVX2 */
+#define OPJ_CPU_SSE41	0x0008	/**< SSE4.1 */
+/*@}*/
+
+/** @name Exported functions */
+/*@{*/
+/* ----------------------------------------------------------------------- */
+/**
+Get the SIMD instruction sets usable on this processor. 
+The processor is only queried on the first call.
+@return Returns a combination of the OPJ_CPU_* flags, 0 on other architectures
+*/
+int opj_cpu_features(void);
+/* ----------------------------------------------------------------------- */
+/*@}*/
+
+/*@}*/
+
+#endif /* __CPU_H */
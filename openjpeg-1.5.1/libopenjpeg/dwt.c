@@ -33,9 +33,15 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "cpu.h"
+
 #ifdef __SSE__
 #include <xmmintrin.h>
 #endif
+/* SSE2/SSE4.1/AVX/AVX2 functions are built for any x86 target and chosen at run time */
+#ifdef OPJ_X86_SIMD
+#include <immintrin.h>
+#endif
 
 #include "opj_includes.h"
 
@@ -45,6 +51,13 @@
 #define WS(i) v->mem[(i)*2]
 #define WD(i) v->mem[(1+(i)*2)]
 
+/* the 4-wide 9-7 transform uses SSE if the compiler targets it, or if the processor has it */
+#if defined(__SSE__)
+#define DWT_SSE 1
+#elif defined(OPJ_X86_SIMD)
+#define DWT_SSE (opj_cpu_features() & OPJ_CPU_SSE2)
+#endif
+
 /** @name Local data structures */
 /*@{*/
 
@@ -66,6 +79,17 @@ typedef struct v4dwt_local {
 	int		cas ;
 } v4dwt_t ;
 
+typedef union {
+	float	f[8];
+} v8;
+
+typedef struct v8dwt_local {
+	v8*	wavelet ;
+	int		dn ;
+	int		sn ;
+	int		cas ;
+} v8dwt_t ;
+
 static const float dwt_alpha =  1.586134342f; /*  12994 */
 static const float dwt_beta  =  0.052980118f; /*    434 */
 static const float dwt_gamma = -0.882911075f; /*  -7233 */
@@ -77,11 +101,6 @@ static const float c13318 = 1.625732422f;
 
 /*@}*/
 
-/**
-Virtual function type for wavelet transform in 1-D 
-*/
-typedef void (*DWT1DFN)(dwt_t* v);
-
 /** @name Local static functions */
 /*@{*/
 
@@ -117,10 +136,72 @@ static void dwt_encode_1_real(int *a, int dn, int sn, int cas);
 Explicit calculation of the Quantization Stepsizes 
 */
 static void dwt_encode_stepsize(int stepsize, int numbps, opj_stepsize_t *bandno_stepsize);
+#ifdef OPJ_X86_SIMD
+/**
+Inverse 5-3 wavelet transform in 1-D of 4 columns at once (SSE2)
+*/
+static void dwt_decode_1_sse2(__m128i *a, int dn, int sn, int cas);
+/**
+Inverse 5-3 wavelet transform of 4 adjacent columns of the tile (SSE2)
+*/
+static void dwt_decode_v4_sse2(dwt_t *v, int *a, int x);
+/**
+Inverse 5-3 wavelet transform in 1-D of 8 columns at once (AVX2)
+*/
+static void dwt_decode_1_avx2(__m256i *a, int dn, int sn, int cas);
+/**
+Inverse 5-3 wavelet transform of 8 adjacent columns of the tile (AVX2)
+*/
+static void dwt_decode_v8_avx2(dwt_t *v, int *a, int x);
+/**
+Forward 5-3 wavelet transform in 1-D of 4 columns at once (SSE2)
+*/
+static void dwt_encode_1_sse2(__m128i *a, int dn, int sn, int cas);
+/**
+Forward 5-3 wavelet transform in 1-D of 8 columns at once (AVX2)
+*/
+static void dwt_encode_1_avx2(__m256i *a, int dn, int sn, int cas);
+/**
+Forward 9-7 wavelet transform in 1-D of 4 columns at once (SSE4.1)
+*/
+static void dwt_encode_1_real_sse41(__m128i *a, int dn, int sn, int cas);
+/**
+Forward 9-7 wavelet transform in 1-D of 8 columns at once (AVX2)
+*/
+static void dwt_encode_1_real_avx2(__m256i *a, int dn, int sn, int cas);
+/**
+Forward wavelet transform of 4 adjacent columns of the tile
+@param v Buffer and sizes of the transform
+@param a First sample of the columns
+@param x Width of the tile
+@param encode_1 Vector 1-D transform
+*/
+static void dwt_encode_v4(dwt_t *v, int *a, int x, void (*encode_1)(__m128i *a, int dn, int sn, int cas));
+/**
+Forward wavelet transform of 8 adjacent columns of the tile
+@param v Buffer and sizes of the transform
+@param a First sample of the columns
+@param x Width of the tile
+@param encode_1 Vector 1-D transform
+*/
+static void dwt_encode_v8(dwt_t *v, int *a, int x, void (*encode_1)(__m256i *a, int dn, int sn, int cas));
+/**
+Inverse lazy transform of 8 rows (horizontal)
+*/
+static void v8dwt_interleave_h(v8dwt_t* restrict w, float* restrict a, int x);
+/**
+Inverse lazy transform of 8 columns (vertical)
+*/
+static void v8dwt_interleave_v(v8dwt_t* restrict v , float* restrict a , int x);
 /**
-Inverse wavelet transform in 2-D.
+Inverse 9-7 wavelet transform in 1-D of 8 rows or columns at once (AVX)
 */
-static void dwt_decode_tile(opj_tcd_tilecomp_t* tilec, int i, DWT1DFN fn);
+static void v8dwt_decode_avx(v8dwt_t* restrict dwt);
+#endif
+/**
+Inverse 5-3 wavelet transform in 2-D.
+*/
+static void dwt_decode_tile(opj_tcd_tilecomp_t* tilec, int i);
 
 /*@}*/
 
@@ -302,6 +383,93 @@ static void dwt_decode_1(dwt_t *v) {
 	dwt_decode_1_(v->mem, v->dn, v->sn, v->cas);
 }
 
+#ifdef OPJ_X86_SIMD
+
+/*
+The vector versions below apply the lifting steps of dwt_decode_1_ to several columns:
+a[k] holds row k of 4 (SSE2) or 8 (AVX2) adjacent columns, so that S(i), D(i) and the
+boundary macros keep their meaning. Rows are loaded whole, instead of one sample per
+row and per column as with dwt_interleave_v.
+*/
+
+OPJ_TARGET("sse2")
+static void dwt_decode_1_sse2(__m128i *a, int dn, int sn, int cas) {
+	int i;
+	const __m128i two = _mm_set1_epi32(2);
+
+	if (!cas) {
+		if ((dn > 0) || (sn > 1)) { /* NEW :  CASE ONE ELEMENT */
+			for (i = 0; i < sn; i++) S(i) = _mm_sub_epi32(S(i), _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(D_(i - 1), D_(i)), two), 2));
+			for (i = 0; i < dn; i++) D(i) = _mm_add_epi32(D(i), _mm_srai_epi32(_mm_add_epi32(S_(i), S_(i + 1)), 1));
+		}
+	} else {
+		if (!sn  && dn == 1) {        /* NEW :  CASE ONE ELEMENT */
+			/* S(0) /= 2, rounded towards zero */
+			S(0) = _mm_srai_epi32(_mm_add_epi32(S(0), _mm_srli_epi32(S(0), 31)), 1);
+		} else {
+			for (i = 0; i < sn; i++) D(i) = _mm_sub_epi32(D(i), _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(SS_(i), SS_(i + 1)), two), 2));
+			for (i = 0; i < dn; i++) S(i) = _mm_add_epi32(S(i), _mm_srai_epi32(_mm_add_epi32(DD_(i), DD_(i - 1)), 1));
+		}
+	}
+}
+
+OPJ_TARGET("sse2")
+static void dwt_decode_v4_sse2(dwt_t *v, int *a, int x) {
+	__m128i *mem = (__m128i*) v->mem;
+	int i;
+
+	for (i = 0; i < v->sn; i++) {
+		mem[2 * i + v->cas] = _mm_loadu_si128((const __m128i*) &a[i * x]);
+	}
+	for (i = 0; i < v->dn; i++) {
+		mem[2 * i + 1 - v->cas] = _mm_loadu_si128((const __m128i*) &a[(v->sn + i) * x]);
+	}
+	dwt_decode_1_sse2(mem, v->dn, v->sn, v->cas);
+	for (i = 0; i < v->sn + v->dn; i++) {
+		_mm_storeu_si128((__m128i*) &a[i * x], mem[i]);
+	}
+}
+
+OPJ_TARGET("avx2")
+static void dwt_decode_1_avx2(__m256i *a, int dn, int sn, int cas) {
+	int i;
+	const __m256i two = _mm256_set1_epi32(2);
+
+	if (!cas) {
+		if ((dn > 0) || (sn > 1)) { /* NEW :  CASE ONE ELEMENT */
+			for (i = 0; i < sn; i++) S(i) = _mm256_sub_epi32(S(i), _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(D_(i - 1), D_(i)), two), 2));
+			for (i = 0; i < dn; i++) D(i) = _mm256_add_epi32(D(i), _mm256_srai_epi32(_mm256_add_epi32(S_(i), S_(i + 1)), 1));
+		}
+	} else {
+		if (!sn  && dn == 1) {        /* NEW :  CASE ONE ELEMENT */
+			/* S(0) /= 2, rounded towards zero */
+			S(0) = _mm256_srai_epi32(_mm256_add_epi32(S(0), _mm256_srli_epi32(S(0), 31)), 1);
+		} else {
+			for (i = 0; i < sn; i++) D(i) = _mm256_sub_epi32(D(i), _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(SS_(i), SS_(i + 1)), two), 2));
+			for (i = 0; i < dn; i++) S(i) = _mm256_add_epi32(S(i), _mm256_srai_epi32(_mm256_add_epi32(DD_(i), DD_(i - 1)), 1));
+		}
+	}
+}
+
+OPJ_TARGET("avx2")
+static void dwt_decode_v8_avx2(dwt_t *v, int *a, int x) {
+	__m256i *mem = (__m256i*) v->mem;
+	int i;
+
+	for (i = 0; i < v->sn; i++) {
+		mem[2 * i + v->cas] = _mm256_loadu_si256((const __m256i*) &a[i * x]);
+	}
+	for (i = 0; i < v->dn; i++) {
+		mem[2 * i + 1 - v->cas] = _mm256_loadu_si256((const __m256i*) &a[(v->sn + i) * x]);
+	}
+	dwt_decode_1_avx2(mem, v->dn, v->sn, v->cas);
+	for (i = 0; i < v->sn + v->dn; i++) {
+		_mm256_storeu_si256((__m256i*) &a[i * x], mem[i]);
+	}
+}
+
+#endif /* OPJ_X86_SIMD */
+
 /* <summary>                             */
 /* Forward 9-7 wavelet transform in 1-D. */
 /* </summary>                            */
@@ -340,6 +508,200 @@ static void dwt_encode_1_real(int *a, int dn, int sn, int cas) {
 	}
 }
 
+#ifdef OPJ_X86_SIMD
+
+/*
+The forward transforms below follow dwt_encode_1 and dwt_encode_1_real on 4 or 8
+adjacent columns, with the same layout as the vector inverse transforms. fix_mul
+needs a signed 32x32->64 bit multiply, which SSE2 lacks: the 4-wide 9-7 transform
+uses SSE4.1.
+*/
+
+OPJ_TARGET("sse2")
+static void dwt_encode_1_sse2(__m128i *a, int dn, int sn, int cas) {
+	int i;
+	const __m128i two = _mm_set1_epi32(2);
+
+	if (!cas) {
+		if ((dn > 0) || (sn > 1)) {	/* NEW :  CASE ONE ELEMENT */
+			for (i = 0; i < dn; i++) D(i) = _mm_sub_epi32(D(i), _mm_srai_epi32(_mm_add_epi32(S_(i), S_(i + 1)), 1));
+			for (i = 0; i < sn; i++) S(i) = _mm_add_epi32(S(i), _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(D_(i - 1), D_(i)), two), 2));
+		}
+	} else {
+		if (!sn && dn == 1)		    /* NEW :  CASE ONE ELEMENT */
+			S(0) = _mm_add_epi32(S(0), S(0));
+		else {
+			for (i = 0; i < dn; i++) S(i) = _mm_sub_epi32(S(i), _mm_srai_epi32(_mm_add_epi32(DD_(i), DD_(i - 1)), 1));
+			for (i = 0; i < sn; i++) D(i) = _mm_add_epi32(D(i), _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(SS_(i), SS_(i + 1)), two), 2));
+		}
+	}
+}
+
+OPJ_TARGET("avx2")
+static void dwt_encode_1_avx2(__m256i *a, int dn, int sn, int cas) {
+	int i;
+	const __m256i two = _mm256_set1_epi32(2);
+
+	if (!cas) {
+		if ((dn > 0) || (sn > 1)) {	/* NEW :  CASE ONE ELEMENT */
+			for (i = 0; i < dn; i++) D(i) = _mm256_sub_epi32(D(i), _mm256_srai_epi32(_mm256_add_epi32(S_(i), S_(i + 1)), 1));
+			for (i = 0; i < sn; i++) S(i) = _mm256_add_epi32(S(i), _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(D_(i - 1), D_(i)), two), 2));
+		}
+	} else {
+		if (!sn && dn == 1)		    /* NEW :  CASE ONE ELEMENT */
+			S(0) = _mm256_add_epi32(S(0), S(0));
+		else {
+			for (i = 0; i < dn; i++) S(i) = _mm256_sub_epi32(S(i), _mm256_srai_epi32(_mm256_add_epi32(DD_(i), DD_(i - 1)), 1));
+			for (i = 0; i < sn; i++) D(i) = _mm256_add_epi32(D(i), _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(SS_(i), SS_(i + 1)), two), 2));
+		}
+	}
+}
+
+/* fix_mul on each lane: the 64-bit products of the even and of the odd lanes are computed separately */
+OPJ_TARGET("sse4.1")
+static INLINE __m128i fix_mul_sse41(__m128i a, __m128i b) {
+	const __m128i round = _mm_set_epi32(0, 4096, 0, 4096);
+	__m128i even = _mm_mul_epi32(a, b);
+	__m128i odd = _mm_mul_epi32(_mm_srli_epi64(a, 32), b);
+	even = _mm_add_epi64(even, _mm_and_si128(even, round));
+	odd = _mm_add_epi64(odd, _mm_and_si128(odd, round));
+	/* keep bits 13 to 44 of each product */
+	return _mm_blend_epi16(_mm_srli_epi64(even, 13), _mm_slli_epi64(odd, 19), 0xCC);
+}
+
+OPJ_TARGET("avx2")
+static INLINE __m256i fix_mul_avx2(__m256i a, __m256i b) {
+	const __m256i round = _mm256_set_epi32(0, 4096, 0, 4096, 0, 4096, 0, 4096);
+	__m256i even = _mm256_mul_epi32(a, b);
+	__m256i odd = _mm256_mul_epi32(_mm256_srli_epi64(a, 32), b);
+	even = _mm256_add_epi64(even, _mm256_and_si256(even, round));
+	odd = _mm256_add_epi64(odd, _mm256_and_si256(odd, round));
+	/* keep bits 13 to 44 of each product */
+	return _mm256_blend_epi32(_mm256_srli_epi64(even, 13), _mm256_slli_epi64(odd, 19), 0xAA);
+}
+
+OPJ_TARGET("sse4.1")
+static void dwt_encode_1_real_sse41(__m128i *a, int dn, int sn, int cas) {
+	int i;
+	const __m128i c12993 = _mm_set1_epi32(12993);
+	const __m128i c434 = _mm_set1_epi32(434);
+	const __m128i c7233 = _mm_set1_epi32(7233);
+	const __m128i c3633 = _mm_set1_epi32(3633);
+	const __m128i c5038 = _mm_set1_epi32(5038);
+	const __m128i c6659 = _mm_set1_epi32(6659);
+
+	if (!cas) {
+		if ((dn > 0) || (sn > 1)) {	/* NEW :  CASE ONE ELEMENT */
+			for (i = 0; i < dn; i++)
+				D(i) = _mm_sub_epi32(D(i), fix_mul_sse41(_mm_add_epi32(S_(i), S_(i + 1)), c12993));
+			for (i = 0; i < sn; i++)
+				S(i) = _mm_sub_epi32(S(i), fix_mul_sse41(_mm_add_epi32(D_(i - 1), D_(i)), c434));
+			for (i = 0; i < dn; i++)
+				D(i) = _mm_add_epi32(D(i), fix_mul_sse41(_mm_add_epi32(S_(i), S_(i + 1)), c7233));
+			for (i = 0; i < sn; i++)
+				S(i) = _mm_add_epi32(S(i), fix_mul_sse41(_mm_add_epi32(D_(i - 1), D_(i)), c3633));
+			for (i = 0; i < dn; i++)
+				D(i) = fix_mul_sse41(D(i), c5038);
+			for (i = 0; i < sn; i++)
+				S(i) = fix_mul_sse41(S(i), c6659);
+		}
+	} else {
+		if ((sn > 0) || (dn > 1)) {	/* NEW :  CASE ONE ELEMENT */
+			for (i = 0; i < dn; i++)
+				S(i) = _mm_sub_epi32(S(i), fix_mul_sse41(_mm_add_epi32(DD_(i), DD_(i - 1)), c12993));
+			for (i = 0; i < sn; i++)
+				D(i) = _mm_sub_epi32(D(i), fix_mul_sse41(_mm_add_epi32(SS_(i), SS_(i + 1)), c434));
+			for (i = 0; i < dn; i++)
+				S(i) = _mm_add_epi32(S(i), fix_mul_sse41(_mm_add_epi32(DD_(i), DD_(i - 1)), c7233));
+			for (i = 0; i < sn; i++)
+				D(i) = _mm_add_epi32(D(i), fix_mul_sse41(_mm_add_epi32(SS_(i), SS_(i + 1)), c3633));
+			for (i = 0; i < dn; i++)
+				S(i) = fix_mul_sse41(S(i), c5038);
+			for (i = 0; i < sn; i++)
+				D(i) = fix_mul_sse41(D(i), c6659);
+		}
+	}
+}
+
+OPJ_TARGET("avx2")
+static void dwt_encode_1_real_avx2(__m256i *a, int dn, int sn, int cas) {
+	int i;
+	const __m256i c12993 = _mm256_set1_epi32(12993);
+	const __m256i c434 = _mm256_set1_epi32(434);
+	const __m256i c7233 = _mm256_set1_epi32(7233);
+	const __m256i c3633 = _mm256_set1_epi32(3633);
+	const __m256i c5038 = _mm256_set1_epi32(5038);
+	const __m256i c6659 = _mm256_set1_epi32(6659);
+
+	if (!cas) {
+		if ((dn > 0) || (sn > 1)) {	/* NEW :  CASE ONE ELEMENT */
+			for (i = 0; i < dn; i++)
+				D(i) = _mm256_sub_epi32(D(i), fix_mul_avx2(_mm256_add_epi32(S_(i), S_(i + 1)), c12993));
+			for (i = 0; i < sn; i++)
+				S(i) = _mm256_sub_epi32(S(i), fix_mul_avx2(_mm256_add_epi32(D_(i - 1), D_(i)), c434));
+			for (i = 0; i < dn; i++)
+				D(i) = _mm256_add_epi32(D(i), fix_mul_avx2(_mm256_add_epi32(S_(i), S_(i + 1)), c7233));
+			for (i = 0; i < sn; i++)
+				S(i) = _mm256_add_epi32(S(i), fix_mul_avx2(_mm256_add_epi32(D_(i - 1), D_(i)), c3633));
+			for (i = 0; i < dn; i++)
+				D(i) = fix_mul_avx2(D(i), c5038);
+			for (i = 0; i < sn; i++)
+				S(i) = fix_mul_avx2(S(i), c6659);
+		}
+	} else {
+		if ((sn > 0) || (dn > 1)) {	/* NEW :  CASE ONE ELEMENT */
+			for (i = 0; i < dn; i++)
+				S(i) = _mm256_sub_epi32(S(i), fix_mul_avx2(_mm256_add_epi32(DD_(i), DD_(i - 1)), c12993));
+			for (i = 0; i < sn; i++)
+				D(i) = _mm256_sub_epi32(D(i), fix_mul_avx2(_mm256_add_epi32(SS_(i), SS_(i + 1)), c434));
+			for (i = 0; i < dn; i++)
+				S(i) = _mm256_add_epi32(S(i), fix_mul_avx2(_mm256_add_epi32(DD_(i), DD_(i - 1)), c7233));
+			for (i = 0; i < sn; i++)
+				D(i) = _mm256_add_epi32(D(i), fix_mul_avx2(_mm256_add_epi32(SS_(i), SS_(i + 1)), c3633));
+			for (i = 0; i < dn; i++)
+				S(i) = fix_mul_avx2(S(i), c5038);
+			for (i = 0; i < sn; i++)
+				D(i) = fix_mul_avx2(D(i), c6659);
+		}
+	}
+}
+
+OPJ_TARGET("sse2")
+static void dwt_encode_v4(dwt_t *v, int *a, int x, void (*encode_1)(__m128i *a, int dn, int sn, int cas)) {
+	__m128i *mem = (__m128i*) v->mem;
+	int i;
+
+	for (i = 0; i < v->sn + v->dn; i++) {
+		mem[i] = _mm_loadu_si128((const __m128i*) &a[i * x]);
+	}
+	encode_1(mem, v->dn, v->sn, v->cas);
+	for (i = 0; i < v->sn; i++) {
+		_mm_storeu_si128((__m128i*) &a[i * x], mem[2 * i + v->cas]);
+	}
+	for (i = 0; i < v->dn; i++) {
+		_mm_storeu_si128((__m128i*) &a[(v->sn + i) * x], mem[2 * i + 1 - v->cas]);
+	}
+}
+
+OPJ_TARGET("avx2")
+static void dwt_encode_v8(dwt_t *v, int *a, int x, void (*encode_1)(__m256i *a, int dn, int sn, int cas)) {
+	__m256i *mem = (__m256i*) v->mem;
+	int i;
+
+	for (i = 0; i < v->sn + v->dn; i++) {
+		mem[i] = _mm256_loadu_si256((const __m256i*) &a[i * x]);
+	}
+	encode_1(mem, v->dn, v->sn, v->cas);
+	for (i = 0; i < v->sn; i++) {
+		_mm256_storeu_si256((__m256i*) &a[i * x], mem[2 * i + v->cas]);
+	}
+	for (i = 0; i < v->dn; i++) {
+		_mm256_storeu_si256((__m256i*) &a[(v->sn + i) * x], mem[2 * i + 1 - v->cas]);
+	}
+}
+
+#endif /* OPJ_X86_SIMD */
+
 static void dwt_encode_stepsize(int stepsize, int numbps, opj_stepsize_t *bandno_stepsize) {
 	int p, n;
 	p = int_floorlog2(stepsize) - 13;
@@ -363,10 +725,21 @@ void dwt_encode(opj_tcd_tilecomp_t * tilec) {
 	int *aj = NULL;
 	int *bj = NULL;
 	int w, l;
+#ifdef OPJ_X86_SIMD
+	int cpu = opj_cpu_features();
+	int *mem;
+	dwt_t v;
+#endif
 	
 	w = tilec->x1-tilec->x0;
 	l = tilec->numresolutions-1;
 	a = tilec->data;
+
+#ifdef OPJ_X86_SIMD
+	/* room for the rows of 8 columns, 32-byte aligned for AVX2 */
+	mem = (int*)opj_aligned_malloc(((tilec->y1 - tilec->y0) * 8 + 8) * sizeof(int));
+	v.mem = (int*)(((size_t)mem + 31) & ~(size_t)31);
+#endif
 	
 	for (i = 0; i < l; i++) {
 		int rw;			/* width of the resolution level computed                                                           */
@@ -388,7 +761,23 @@ void dwt_encode(opj_tcd_tilecomp_t * tilec) {
 		sn = rh1;
 		dn = rh - rh1;
 		bj = (int*)opj_malloc(rh * sizeof(int));
-		for (j = 0; j < rw; j++) {
+		j = 0;
+#ifdef OPJ_X86_SIMD
+		v.dn = dn;
+		v.sn = sn;
+		v.cas = cas_col;
+		if (cpu & OPJ_CPU_AVX2) {
+			for (; j + 8 <= rw; j += 8) {
+				dwt_encode_v8(&v, a + j, w, dwt_encode_1_avx2);
+			}
+		}
+		if (cpu & OPJ_CPU_SSE2) {
+			for (; j + 4 <= rw; j += 4) {
+				dwt_encode_v4(&v, a + j, w, dwt_encode_1_sse2);
+			}
+		}
+#endif
+		for (; j < rw; j++) {
 			aj = a + j;
 			for (k = 0; k < rh; k++)  bj[k] = aj[k*w];
 			dwt_encode_1(bj, dn, sn, cas_col);
@@ -407,6 +796,9 @@ void dwt_encode(opj_tcd_tilecomp_t * tilec) {
 		}
 		opj_free(bj);
 	}
+#ifdef OPJ_X86_SIMD
+	opj_aligned_free(mem);
+#endif
 }
 
 
@@ -414,7 +806,7 @@ void dwt_encode(opj_tcd_tilecomp_t * tilec) {
 /* Inverse 5-3 wavelet transform in 2-D. */
 /* </summary>                           */
 void dwt_decode(opj_tcd_tilecomp_t* tilec, int numres) {
-	dwt_decode_tile(tilec, numres, &dwt_decode_1);
+	dwt_decode_tile(tilec, numres);
 }
 
 
@@ -446,10 +838,21 @@ void dwt_encode_real(opj_tcd_tilecomp_t * tilec) {
 	int *aj = NULL;
 	int *bj = NULL;
 	int w, l;
+#ifdef OPJ_X86_SIMD
+	int cpu = opj_cpu_features();
+	int *mem;
+	dwt_t v;
+#endif
 	
 	w = tilec->x1-tilec->x0;
 	l = tilec->numresolutions-1;
 	a = tilec->data;
+
+#ifdef OPJ_X86_SIMD
+	/* room for the rows of 8 columns, 32-byte aligned for AVX2 */
+	mem = (int*)opj_aligned_malloc(((tilec->y1 - tilec->y0) * 8 + 8) * sizeof(int));
+	v.mem = (int*)(((size_t)mem + 31) & ~(size_t)31);
+#endif
 	
 	for (i = 0; i < l; i++) {
 		int rw;			/* width of the resolution level computed                                                     */
@@ -471,7 +874,23 @@ void dwt_encode_real(opj_tcd_tilecomp_t * tilec) {
 		sn = rh1;
 		dn = rh - rh1;
 		bj = (int*)opj_malloc(rh * sizeof(int));
-		for (j = 0; j < rw; j++) {
+		j = 0;
+#ifdef OPJ_X86_SIMD
+		v.dn = dn;
+		v.sn = sn;
+		v.cas = cas_col;
+		if (cpu & OPJ_CPU_AVX2) {
+			for (; j + 8 <= rw; j += 8) {
+				dwt_encode_v8(&v, a + j, w, dwt_encode_1_real_avx2);
+			}
+		}
+		if (cpu & OPJ_CPU_SSE41) {
+			for (; j + 4 <= rw; j += 4) {
+				dwt_encode_v4(&v, a + j, w, dwt_encode_1_real_sse41);
+			}
+		}
+#endif
+		for (; j < rw; j++) {
 			aj = a + j;
 			for (k = 0; k < rh; k++)  bj[k] = aj[k*w];
 			dwt_encode_1_real(bj, dn, sn, cas_col);
@@ -490,6 +909,9 @@ void dwt_encode_real(opj_tcd_tilecomp_t * tilec) {
 		}
 		opj_free(bj);
 	}
+#ifdef OPJ_X86_SIMD
+	opj_aligned_free(mem);
+#endif
 }
 
 
@@ -550,18 +972,26 @@ static int dwt_decode_max_resolution(opj_tcd_resolution_t* restrict r, int i) {
 /* <summary>                            */
 /* Inverse wavelet transform in 2-D.     */
 /* </summary>                           */
-static void dwt_decode_tile(opj_tcd_tilecomp_t* tilec, int numres, DWT1DFN dwt_1D) {
+static void dwt_decode_tile(opj_tcd_tilecomp_t* tilec, int numres) {
 	dwt_t h;
 	dwt_t v;
+	int *mem;
 
 	opj_tcd_resolution_t* tr = tilec->resolutions;
 
 	int rw = tr->x1 - tr->x0;	/* width of the resolution level computed */
 	int rh = tr->y1 - tr->y0;	/* height of the resolution level computed */
 
-	int w = tilec->x1 - tilec->x0;
+	/* tilec->data is only as wide as the last resolution decoded */
+	int w = tilec->resolutions[numres - 1].x1 - tilec->resolutions[numres - 1].x0;
+
+#ifdef OPJ_X86_SIMD
+	int cpu = opj_cpu_features();
+#endif
 
-	h.mem = (int*)opj_aligned_malloc(dwt_decode_max_resolution(tr, numres) * sizeof(int));
+	/* room for 8 interleaved columns, 32-byte aligned for AVX2 */
+	mem = (int*)opj_aligned_malloc((dwt_decode_max_resolution(tr, numres) * 8 + 8) * sizeof(int));
+	h.mem = (int*)(((size_t)mem + 31) & ~(size_t)31);
 	v.mem = h.mem;
 
 	while( --numres) {
@@ -580,23 +1010,36 @@ static void dwt_decode_tile(opj_tcd_tilecomp_t* tilec, int numres, DWT1DFN dwt_1
 
 		for(j = 0; j < rh; ++j) {
 			dwt_interleave_h(&h, &tiledp[j*w]);
-			(dwt_1D)(&h);
+			dwt_decode_1(&h);
 			memcpy(&tiledp[j*w], h.mem, rw * sizeof(int));
 		}
 
 		v.dn = rh - v.sn;
 		v.cas = tr->y0 % 2;
 
-		for(j = 0; j < rw; ++j){
+		j = 0;
+#ifdef OPJ_X86_SIMD
+		if (cpu & OPJ_CPU_AVX2) {
+			for(; j + 8 <= rw; j += 8) {
+				dwt_decode_v8_avx2(&v, &tiledp[j], w);
+			}
+		}
+		if (cpu & OPJ_CPU_SSE2) {
+			for(; j + 4 <= rw; j += 4) {
+				dwt_decode_v4_sse2(&v, &tiledp[j], w);
+			}
+		}
+#endif
+		for(; j < rw; ++j){
 			int k;
 			dwt_interleave_v(&v, &tiledp[j], w);
-			(dwt_1D)(&v);
+			dwt_decode_1(&v);
 			for(k = 0; k < rh; ++k) {
 				tiledp[k * w + j] = v.mem[k];
 			}
 		}
 	}
-	opj_aligned_free(h.mem);
+	opj_aligned_free(mem);
 }
 
 static void v4dwt_interleave_h(v4dwt_t* restrict w, float* restrict a, int x, int size){
@@ -652,10 +1095,12 @@ static void v4dwt_interleave_v(v4dwt_t* restrict v , float* restrict a , int x){
 	}
 }
 
-#ifdef __SSE__
+#ifdef DWT_SSE
 
-static void v4dwt_decode_step1_sse(v4* w, int count, const __m128 c){
+OPJ_TARGET("sse")
+static void v4dwt_decode_step1_sse(v4* w, int count, const float f){
 	__m128* restrict vw = (__m128*) w;
+	const __m128 c = _mm_set1_ps(f);
 	int i;
 	/* 4x unrolled loop */
 	for(i = 0; i < count >> 2; ++i){
@@ -675,9 +1120,11 @@ static void v4dwt_decode_step1_sse(v4* w, int count, const __m128 c){
 	}
 }
 
-static void v4dwt_decode_step2_sse(v4* l, v4* w, int k, int m, __m128 c){
+OPJ_TARGET("sse")
+static void v4dwt_decode_step2_sse(v4* l, v4* w, int k, int m, float f){
 	__m128* restrict vl = (__m128*) l;
 	__m128* restrict vw = (__m128*) w;
+	__m128 c = _mm_set1_ps(f);
 	int i;
 	__m128 tmp1, tmp2, tmp3;
 	tmp1 = vl[0];
@@ -701,7 +1148,9 @@ static void v4dwt_decode_step2_sse(v4* l, v4* w, int k, int m, __m128 c){
 	}
 }
 
-#else
+#endif
+
+#ifndef __SSE__
 
 static void v4dwt_decode_step1(v4* w, int count, const float c){
 	float* restrict fw = (float*) w;
@@ -786,14 +1235,18 @@ static void v4dwt_decode(v4dwt_t* restrict dwt){
 		a = 1;
 		b = 0;
 	}
-#ifdef __SSE__
-	v4dwt_decode_step1_sse(dwt->wavelet+a, dwt->sn, _mm_set1_ps(K));
-	v4dwt_decode_step1_sse(dwt->wavelet+b, dwt->dn, _mm_set1_ps(c13318));
-	v4dwt_decode_step2_sse(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), _mm_set1_ps(dwt_delta));
-	v4dwt_decode_step2_sse(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), _mm_set1_ps(dwt_gamma));
-	v4dwt_decode_step2_sse(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), _mm_set1_ps(dwt_beta));
-	v4dwt_decode_step2_sse(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), _mm_set1_ps(dwt_alpha));
-#else
+#ifdef DWT_SSE
+	if (DWT_SSE) {
+		v4dwt_decode_step1_sse(dwt->wavelet+a, dwt->sn, K);
+		v4dwt_decode_step1_sse(dwt->wavelet+b, dwt->dn, c13318);
+		v4dwt_decode_step2_sse(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), dwt_delta);
+		v4dwt_decode_step2_sse(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), dwt_gamma);
+		v4dwt_decode_step2_sse(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), dwt_beta);
+		v4dwt_decode_step2_sse(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), dwt_alpha);
+		return;
+	}
+#endif
+#ifndef __SSE__
 	v4dwt_decode_step1(dwt->wavelet+a, dwt->sn, K);
 	v4dwt_decode_step1(dwt->wavelet+b, dwt->dn, c13318);
 	v4dwt_decode_step2(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), dwt_delta);
@@ -803,26 +1256,140 @@ static void v4dwt_decode(v4dwt_t* restrict dwt){
 #endif
 }
 
+#ifdef OPJ_X86_SIMD
+
+static void v8dwt_interleave_h(v8dwt_t* restrict w, float* restrict a, int x){
+	float* restrict bi = (float*) (w->wavelet + w->cas);
+	int count = w->sn;
+	int i, k, l;
+	for(k = 0; k < 2; ++k){
+		for(i = 0; i < count; ++i){
+			for(l = 0; l < 8; ++l){
+				bi[i*16 + l] = a[i + l*x];
+			}
+		}
+		bi = (float*) (w->wavelet + 1 - w->cas);
+		a += w->sn;
+		count = w->dn;
+	}
+}
+
+static void v8dwt_interleave_v(v8dwt_t* restrict v , float* restrict a , int x){
+	v8* restrict bi = v->wavelet + v->cas;
+	int i;
+	for(i = 0; i < v->sn; ++i){
+		memcpy(&bi[i*2], &a[i*x], 8 * sizeof(float));
+	}
+	a += v->sn * x;
+	bi = v->wavelet + 1 - v->cas;
+	for(i = 0; i < v->dn; ++i){
+		memcpy(&bi[i*2], &a[i*x], 8 * sizeof(float));
+	}
+}
+
+OPJ_TARGET("avx")
+static void v8dwt_decode_step1_avx(v8* w, int count, const float f){
+	__m256* restrict vw = (__m256*) w;
+	const __m256 c = _mm256_set1_ps(f);
+	int i;
+	for(i = 0; i < count; ++i){
+		*vw = _mm256_mul_ps(*vw, c);
+		vw += 2;
+	}
+}
+
+OPJ_TARGET("avx")
+static void v8dwt_decode_step2_avx(v8* l, v8* w, int k, int m, float f){
+	__m256* restrict vl = (__m256*) l;
+	__m256* restrict vw = (__m256*) w;
+	__m256 c = _mm256_set1_ps(f);
+	int i;
+	__m256 tmp1, tmp2, tmp3;
+	tmp1 = vl[0];
+	for(i = 0; i < m; ++i){
+		tmp2 = vw[-1];
+		tmp3 = vw[ 0];
+		vw[-1] = _mm256_add_ps(tmp2, _mm256_mul_ps(_mm256_add_ps(tmp1, tmp3), c));
+		tmp1 = tmp3;
+		vw += 2;
+	}
+	vl = vw - 2;
+	if(m >= k){
+		return;
+	}
+	c = _mm256_add_ps(c, c);
+	c = _mm256_mul_ps(c, vl[0]);
+	for(; m < k; ++m){
+		__m256 tmp = vw[-1];
+		vw[-1] = _mm256_add_ps(tmp, c);
+		vw += 2;
+	}
+}
+
+/* <summary>                                          */
+/* Inverse 9-7 wavelet transform in 1-D, 8 at a time. */
+/* </summary>                                         */
+OPJ_TARGET("avx")
+static void v8dwt_decode_avx(v8dwt_t* restrict dwt){
+	int a, b;
+	if(dwt->cas == 0) {
+		if(!((dwt->dn > 0) || (dwt->sn > 1))){
+			return;
+		}
+		a = 0;
+		b = 1;
+	}else{
+		if(!((dwt->sn > 0) || (dwt->dn > 1))) {
+			return;
+		}
+		a = 1;
+		b = 0;
+	}
+	/* same operations in the same order as the SSE version, so both give the same result */
+	v8dwt_decode_step1_avx(dwt->wavelet+a, dwt->sn, K);
+	v8dwt_decode_step1_avx(dwt->wavelet+b, dwt->dn, c13318);
+	v8dwt_decode_step2_avx(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), dwt_delta);
+	v8dwt_decode_step2_avx(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), dwt_gamma);
+	v8dwt_decode_step2_avx(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), dwt_beta);
+	v8dwt_decode_step2_avx(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), dwt_alpha);
+}
+
+#endif /* OPJ_X86_SIMD */
+
 /* <summary>                             */
 /* Inverse 9-7 wavelet transform in 2-D. */
 /* </summary>                            */
 void dwt_decode_real(opj_tcd_tilecomp_t* restrict tilec, int numres){
 	v4dwt_t h;
 	v4dwt_t v;
+	void *mem;
+#ifdef OPJ_X86_SIMD
+	v8dwt_t h8;
+	v8dwt_t v8c;
+	int avx = opj_cpu_features() & OPJ_CPU_AVX;
+#endif
 
 	opj_tcd_resolution_t* res = tilec->resolutions;
 
 	int rw = res->x1 - res->x0;	/* width of the resolution level computed */
 	int rh = res->y1 - res->y0;	/* height of the resolution level computed */
 
-	int w = tilec->x1 - tilec->x0;
+	/* tilec->data is only as large as the last resolution decoded */
+	int w = tilec->resolutions[numres - 1].x1 - tilec->resolutions[numres - 1].x0;
+	int h0 = tilec->resolutions[numres - 1].y1 - tilec->resolutions[numres - 1].y0;
 
-	h.wavelet = (v4*) opj_aligned_malloc((dwt_decode_max_resolution(res, numres)+5) * sizeof(v4));
+	/* room for 8 interleaved rows or columns, 32-byte aligned for AVX */
+	mem = opj_aligned_malloc((dwt_decode_max_resolution(res, numres)+5) * sizeof(v8) + 32);
+	h.wavelet = (v4*) (((size_t)mem + 31) & ~(size_t)31);
 	v.wavelet = h.wavelet;
+#ifdef OPJ_X86_SIMD
+	h8.wavelet = (v8*) h.wavelet;
+	v8c.wavelet = (v8*) h.wavelet;
+#endif
 
 	while( --numres) {
 		float * restrict aj = (float*) tilec->data;
-		int bufsize = (tilec->x1 - tilec->x0) * (tilec->y1 - tilec->y0);
+		int bufsize = w * h0;
 		int j;
 
 		h.sn = rw;
@@ -836,7 +1403,27 @@ void dwt_decode_real(opj_tcd_tilecomp_t* restrict tilec, int numres){
 		h.dn = rw - h.sn;
 		h.cas = res->x0 % 2;
 
-		for(j = rh; j > 3; j -= 4){
+		j = rh;
+#ifdef OPJ_X86_SIMD
+		if (avx) {
+			h8.sn = h.sn;
+			h8.dn = h.dn;
+			h8.cas = h.cas;
+			for(; j > 7; j -= 8){
+				int k, l;
+				v8dwt_interleave_h(&h8, aj, w);
+				v8dwt_decode_avx(&h8);
+				for(k = rw; --k >= 0;){
+					for(l = 0; l < 8; ++l){
+						aj[k+w*l] = h8.wavelet[k].f[l];
+					}
+				}
+				aj += w*8;
+				bufsize -= w*8;
+			}
+		}
+#endif
+		for(; j > 3; j -= 4){
 			int k;
 			v4dwt_interleave_h(&h, aj, w, bufsize);
 			v4dwt_decode(&h);
@@ -867,7 +1454,24 @@ void dwt_decode_real(opj_tcd_tilecomp_t* restrict tilec, int numres){
 		v.cas = res->y0 % 2;
 
 		aj = (float*) tilec->data;
-		for(j = rw; j > 3; j -= 4){
+		j = rw;
+#ifdef OPJ_X86_SIMD
+		if (avx) {
+			v8c.sn = v.sn;
+			v8c.dn = v.dn;
+			v8c.cas = v.cas;
+			for(; j > 7; j -= 8){
+				int k;
+				v8dwt_interleave_v(&v8c, aj, w);
+				v8dwt_decode_avx(&v8c);
+				for(k = 0; k < rh; ++k){
+					memcpy(&aj[k*w], &v8c.wavelet[k], 8 * sizeof(float));
+				}
+				aj += 8;
+			}
+		}
+#endif
+		for(; j > 3; j -= 4){
 			int k;
 			v4dwt_interleave_v(&v, aj, w);
 			v4dwt_decode(&v);
@@ -887,6 +1491,6 @@ void dwt_decode_real(opj_tcd_tilecomp_t* restrict tilec, int numres){
 			}
 	}
 
-	opj_aligned_free(h.wavelet);
+	opj_aligned_free(mem);
 }
 
@@ -56,7 +56,7 @@ void dwt_encode(opj_tcd_tilecomp_t * tilec);
 /**
 Inverse 5-3 wavelet tranform in 2-D.
 Apply a reversible inverse DWT transform to a component of an image.
-@param tilec Tile component information (current tile)
+@param tilec Tile component information (current tile), tilec->data being as large as resolution numres - 1
 @param numres Number of resolution levels to decode
 */
 void dwt_decode(opj_tcd_tilecomp_t* tilec, int numres);
@@ -82,7 +82,7 @@ void dwt_encode_real(opj_tcd_tilecomp_t * tilec);
 /**
 Inverse 9-7 wavelet transform in 2-D. 
 Apply an irreversible inverse DWT transform to a component of an image.
-@param tilec Tile component information (current tile)
+@param tilec Tile component information (current tile), tilec->data being as large as resolution numres - 1
 @param numres Number of resolution levels to decode
 */
 void dwt_decode_real(opj_tcd_tilecomp_t* tilec, int numres);
@@ -194,11 +194,12 @@ Read the SOT marker (start of tile-part)
 */
 static void j2k_read_sot(opj_j2k_t *j2k);
 /**
-Write the SOD marker (start of data)
+Write the SOD marker (start of data) and the data of the tile-part
 @param j2k J2K handle
 @param tile_coder Pointer to a TCD handle
+@return Returns OPJ_FALSE if the data does not fit in the output
 */
-static void j2k_write_sod(opj_j2k_t *j2k, void *tile_coder);
+static opj_bool j2k_write_sod(opj_j2k_t *j2k, void *tile_coder);
 /**
 Read the SOD marker (start of data)
 @param j2k J2K handle
@@ -227,11 +228,143 @@ Read the EOC marker (end of codestream)
 */
 static void j2k_read_eoc(opj_j2k_t *j2k);
 /**
+Release the data of a tile (copied or referenced tile-parts)
+@param j2k J2K handle
+@param tileno Number of the tile
+*/
+static void j2k_free_tile_data(opj_j2k_t *j2k, int tileno);
+/**
+Tell whether a tile intersects the decode area (see j2k_set_decode_area)
+@param j2k J2K handle
+@param tileno Number of the tile
+@return Returns OPJ_FALSE if the tile can be skipped, returns OPJ_TRUE otherwise
+*/
+static opj_bool j2k_tile_in_decode_area(opj_j2k_t *j2k, int tileno);
+/**
+Decode one of the tiles present in the codestream and release its data
+@param j2k J2K handle
+@param tcd TCD handle
+@param index Index of the tile in cp->tileno
+@return Returns OPJ_FALSE if the tile could not be decoded completely
+*/
+static opj_bool j2k_decode_tile(opj_j2k_t *j2k, opj_tcd_t *tcd, int index);
+/**
+Decode all the tiles, running the tier-1/DWT/MCT stage of several tiles concurrently
+on the thread pool of the tile coder. At most one tile per worker is in flight, so
+that the memory used by the decoded tile-components stays bounded.
+@param j2k J2K handle
+@param tcd TCD handle, with a thread pool
+@return Returns OPJ_FALSE if a tile could not be decoded
+*/
+static opj_bool j2k_decode_tiles_mt(opj_j2k_t *j2k, opj_tcd_t *tcd);
+/**
+Thread pool entry point of a tile decoding job
+@param user_data Job (opj_j2k_tile_job_t)
+@param workerno Worker running the job (unused)
+*/
+static void j2k_decode_tile_job(void *user_data, int workerno);
+/**
+Encode a tile and write its tile-parts at the current position of j2k->cio
+@param j2k J2K handle
+@param tcd TCD handle
+@param tileno Number of the tile
+@param first OPJ_TRUE if the tile coder has not encoded a tile yet (see tcd_malloc_encode)
+@return Returns OPJ_FALSE if the tile does not fit in the output
+*/
+static opj_bool j2k_write_tile(opj_j2k_t *j2k, opj_tcd_t *tcd, int tileno, opj_bool first);
+/**
+Encode a tile with j2k_write_tile, giving tier-2 a window sized after the tile first
+(see j2k->tile_space_bound)
+@param j2k J2K handle
+@param tcd TCD handle
+@param tileno Number of the tile
+@param first OPJ_TRUE if the tile coder has not encoded a tile yet (see tcd_malloc_encode)
+@return Returns OPJ_FALSE if the tile does not fit in the output
+*/
+static opj_bool j2k_encode_tile(opj_j2k_t *j2k, opj_tcd_t *tcd, int tileno, opj_bool first);
+/**
+Free the index of a tile before it is encoded again
+@param cstr_info Codestream information structure
+@param tileno Number of the tile
+*/
+static void j2k_forget_tile_info(opj_codestream_info_t *cstr_info, int tileno);
+/**
+Encode the tiles after the first one, several at once on the thread pool of the tile coder.
+Each worker encodes a tile into a buffer of its own with a tile coder of its own; the tiles
+are then appended to the codestream in order (see j2k_append_tile).
+@param j2k J2K handle
+@param tcd TCD handle that encoded the first tile, with a thread pool
+@return Returns OPJ_FALSE if a tile could not be encoded
+*/
+static opj_bool j2k_encode_tiles_mt(opj_j2k_t *j2k, opj_tcd_t *tcd);
+/**
+Thread pool entry point of a tile encoding job
+@param user_data Job (opj_j2k_enc_tile_job_t)
+@param workerno Worker running the job: selects its tile coder
+*/
+static void j2k_encode_tile_job(void *user_data, int workerno);
+struct opj_j2k_enc_tile_job;
+/**
+Append a tile encoded by a job to the codestream. If the tile could differ from what
+j2k_encode_tile writes here, or could not be encoded, it is encoded again here instead.
+@param j2k J2K handle
+@param tcd TCD handle, used to encode the tile again
+@param job Finished job
+@return Returns OPJ_FALSE if the tile does not fit in the output
+*/
+static opj_bool j2k_append_tile(opj_j2k_t *j2k, opj_tcd_t *tcd, struct opj_j2k_enc_tile_job *job);
+/**
 Read an unknown marker
 @param j2k J2K handle
 */
 static void j2k_read_unk(opj_j2k_t *j2k);
 /**
+Tell whether the next marker segment of an incremental decoder is completely buffered. 
+A SOT marker is only ready once its whole tile-part is buffered.
+@param stream Incremental decoder state
+@return Returns OPJ_TRUE if the marker segment can be read
+*/
+static opj_bool j2k_stream_segment_ready(opj_j2k_stream_t *stream);
+/**
+Skip the tile-part of an incremental decoder that starts at the current position, if its tile 
+is outside the decode area. The bytes of the tile-part not buffered yet are counted in stream->skip.
+@param j2k J2K handle
+@return Returns OPJ_TRUE if the tile-part has been skipped
+*/
+static opj_bool j2k_stream_skip_tile_part(opj_j2k_t *j2k);
+/**
+Tell whether the segment of a marker that has just been read is complete in the codestream. 
+The handlers of the markers read zeros past the end of a truncated codestream.
+@param cio Input stream, positioned after the marker
+@param id Marker value
+@return Returns OPJ_TRUE if the marker has no segment or if its segment ends in the codestream
+*/
+static opj_bool j2k_segment_complete(opj_cio_t *cio, int id);
+/**
+Create the tile coder of an incremental decoder once the main header is read. 
+The tiles present in the codestream are not known yet, so the image is sized for all of them.
+@param j2k J2K handle
+@return Returns OPJ_FALSE if the main header is not complete
+*/
+static opj_bool j2k_stream_setup_tiles(opj_j2k_t *j2k);
+/**
+Free an incremental decoder state
+@param j2k J2K handle
+*/
+static void j2k_stream_destroy(opj_j2k_t *j2k);
+/**
+Get the tile coder of the decoder, created on first use and kept until j2k_destroy_decompress
+@param j2k J2K handle
+@return Returns the TCD handle, or NULL if it cannot be created
+*/
+static opj_tcd_t* j2k_get_tcd(opj_j2k_t *j2k);
+/**
+Free the coding parameters and tile-part arrays sized by the tiles and components of the image
+(see j2k_read_siz)
+@param j2k J2K handle
+*/
+static void j2k_free_tiles(opj_j2k_t *j2k);
+/**
 Add main header marker information
 @param cstr_info Codestream information structure
 @param type marker type
@@ -254,6 +387,45 @@ static void j2k_add_tlmarker( int tileno, opj_codestream_info_t *cstr_info, unsi
 /*@}*/
 
 /* ----------------------------------------------------------------------- */
+/**
+Tile decoding job, run by a thread pool worker once the packets of the tile are decoded
+*/
+typedef struct opj_j2k_tile_job {
+	/** tile coder shared by all the jobs */
+	opj_tcd_t *tcd;
+	/** number of the tile to decode */
+	int tileno;
+	/** result of the tier-1/DWT/MCT stage */
+	opj_bool success;
+} opj_j2k_tile_job_t;
+
+/**
+Tile encoding job, run by a thread pool worker
+*/
+typedef struct opj_j2k_enc_tile_job {
+	/** codestream writer: the job works on a copy of it */
+	opj_j2k_t *j2k;
+	/** tile coder of each worker, set up on the first tile of the image */
+	opj_tcd_t **tcds;
+	/** number of the tile to encode */
+	int tileno;
+	/** output of the tile in memory, with positions relative to its start */
+	opj_cio_t *cio;
+	/** length of cio: what was left of the output when the job started. Its buffer grows up
+	to the space j2k_write_sod reserves for the tile, never to the whole length. */
+	int capacity;
+	/** index of the job, whose tile information is shifted once the tile is appended */
+	opj_codestream_info_t cstr_info;
+	/** rates of the tile before tcd_init_encode converts them, to encode the tile again */
+	float rates[100];
+	/** bytes written to cio */
+	int len;
+	/** rate_headroom of the tile coder after the tile */
+	int rate_headroom;
+	/** OPJ_FALSE if the tile could not be encoded */
+	opj_bool success;
+} opj_j2k_enc_tile_job_t;
+
 typedef struct j2k_prog_order{
 	OPJ_PROG_ORDER enum_prog;
 	char str_prog[5];
@@ -559,13 +731,24 @@ static void j2k_read_siz(opj_j2k_t *j2k) {
 	}
 #endif /* USE_JPWL */
 
-	cp->tcps = (opj_tcp_t*) opj_calloc(cp->tw * cp->th, sizeof(opj_tcp_t));
+	/* after j2k_decoder_reset, the arrays of the previous image are kept if they have the right size */
+	if (j2k->alloc_tiles != cp->tw * cp->th || j2k->alloc_comps != image->numcomps) {
+		j2k_free_tiles(j2k);
+	}
+
+	if (!cp->tcps) {
+		cp->tcps = (opj_tcp_t*) opj_calloc(cp->tw * cp->th, sizeof(opj_tcp_t));
+	}
     if (cp->tcps == NULL)
     {
         opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
         return;
     }
-	cp->tileno = (int*) opj_malloc(cp->tw * cp->th * sizeof(int));
+	j2k->alloc_tiles = cp->tw * cp->th;
+	j2k->alloc_comps = image->numcomps;
+	if (!cp->tileno) {
+		cp->tileno = (int*) opj_malloc(cp->tw * cp->th * sizeof(int));
+	}
     if (cp->tileno == NULL)
     {
         opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
@@ -599,14 +782,29 @@ static void j2k_read_siz(opj_j2k_t *j2k) {
 	cp->ppm_previous = 0;
 	cp->ppm_store = 0;
 
-	j2k->default_tcp->tccps = (opj_tccp_t*) opj_calloc(image->numcomps, sizeof(opj_tccp_t));
+	if (!j2k->default_tcp->tccps) {
+		j2k->default_tcp->tccps = (opj_tccp_t*) opj_calloc(image->numcomps, sizeof(opj_tccp_t));
+	}
 	for (i = 0; i < cp->tw * cp->th; i++) {
-		cp->tcps[i].tccps = (opj_tccp_t*) opj_malloc(image->numcomps * sizeof(opj_tccp_t));
+		if (!cp->tcps[i].tccps) {
+			cp->tcps[i].tccps = (opj_tccp_t*) opj_malloc(image->numcomps * sizeof(opj_tccp_t));
+		}
 	}	
-	j2k->tile_data = (unsigned char**) opj_calloc(cp->tw * cp->th, sizeof(unsigned char*));
-	j2k->tile_len = (int*) opj_calloc(cp->tw * cp->th, sizeof(int));
+	if (!j2k->tile_data) {
+		j2k->tile_data = (unsigned char**) opj_calloc(cp->tw * cp->th, sizeof(unsigned char*));
+		j2k->tile_len = (int*) opj_calloc(cp->tw * cp->th, sizeof(int));
+		j2k->tile_spans = (opj_tile_span_t**) opj_calloc(cp->tw * cp->th, sizeof(opj_tile_span_t*));
+		j2k->tile_numspans = (int*) opj_calloc(cp->tw * cp->th, sizeof(int));
+	}
 	j2k->state = J2K_STATE_MH;
 
+	if (cp->decode_area && (cp->da_x1 <= image->x0 || cp->da_x0 >= image->x1 || cp->da_y1 <= image->y0 || cp->da_y0 >= image->y1)) {
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "The decode area (%d,%d,%d,%d) is outside of the image (%d,%d,%d,%d)\n",
+			cp->da_x0, cp->da_y0, cp->da_x1, cp->da_y1, image->x0, image->y0, image->x1, image->y1);
+		j2k->state |= J2K_STATE_ERR;
+		return;
+	}
+
 	/* Index */
 	if (j2k->cstr_info) {
 		opj_codestream_info_t *cstr_info = j2k->cstr_info;
@@ -1400,9 +1598,33 @@ static void j2k_read_sot(opj_j2k_t *j2k) {
 	}
 }
 
-static void j2k_write_sod(opj_j2k_t *j2k, void *tile_coder) {
+/*
+bytes given to tier-2 for the data of the current tile: 1.3 times the samples of the tile, like
+opj_cio_open for the image, and at least the budget of each layer, so that the layers are
+allocated as if tier-2 wrote in all that is left of the output
+*/
+static int j2k_tile_space(opj_j2k_t *j2k, opj_tcd_t *tcd, int len) {
+	opj_tcd_tile_t *tile = tcd->tcd_image->tiles;
+	opj_tcp_t *tcp = &j2k->cp->tcps[j2k->curtileno];
+	double samples = 0;
+	int compno, layno, space;
+
+	for (compno = 0; compno < tile->numcomps; compno++) {
+		opj_tcd_tilecomp_t *tilec = &tile->comps[compno];
+		samples += (double) (tilec->x1 - tilec->x0) * (tilec->y1 - tilec->y0) * j2k->image->comps[compno].prec;
+	}
+	space = samples < len ? int_min((int) (0.1625 * samples + 2000), len) : len;
+	for (layno = 0; layno < tcp->numlayers; layno++) {
+		if (tcp->rates[layno] > space) {
+			space = tcp->rates[layno] < len ? int_min((int) ceil(tcp->rates[layno]), len) : len;
+		}
+	}
+	return space;
+}
+
+static opj_bool j2k_write_sod(opj_j2k_t *j2k, void *tile_coder) {
 	int l, layno;
-	int totlen;
+	int totlen, len, left;
 	opj_tcp_t *tcp = NULL;
 	opj_codestream_info_t *cstr_info = NULL;
 	
@@ -1457,7 +1679,30 @@ static void j2k_write_sod(opj_j2k_t *j2k, void *tile_coder) {
 			cstr_info->packno = 0;
 	}
 	
-	l = tcd_encode_tile(tcd, j2k->curtileno, cio_getbp(cio), cio_numbytesleft(cio) - 2, cstr_info);
+	left = cio_numbytesleft(cio) - 2;
+	len = j2k->tile_space_bound ? j2k_tile_space(j2k, tcd, left) : left;
+	if (!cio_reserve(cio, len)) {
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "Not enough space in the output for the data of tile %d\n", j2k->curtileno);
+		return OPJ_FALSE;
+	}
+	l = tcd_encode_tile(tcd, j2k->curtileno, cio_getbp(cio), len, cstr_info);
+	if (l == -1) {
+		/* the code-blocks could not be encoded, the tile coder said why */
+		return OPJ_FALSE;
+	}
+	if (l == -999 && len < left) {
+		/* j2k_encode_tile encodes the tile again with all the space left */
+		j2k->tile_overflow = OPJ_TRUE;
+		return OPJ_FALSE;
+	}
+	if (l == -999) {
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "Not enough space in the output for the data of tile %d\n", j2k->curtileno);
+		return OPJ_FALSE;
+	}
+	if (j2k->cur_tp_num == 0) {
+		/* the layers did not use the bytes past the window either */
+		tcd->rate_headroom += left - len;
+	}
 	
 	/* Writing Psot in SOT marker */
 	totlen = cio_tell(cio) + l - j2k->sot_start;
@@ -1471,11 +1716,12 @@ static void j2k_write_sod(opj_j2k_t *j2k, void *tile_coder) {
 		cio_write(cio, totlen, 4);
 	}
 	cio_seek(cio, j2k->sot_start + totlen);
+	return OPJ_TRUE;
 }
 
 static void j2k_read_sod(opj_j2k_t *j2k) {
-	int truncate = 0;
-	unsigned char *data = NULL, *data_ptr = NULL;
+	int len, truncate = 0;
+	opj_tile_span_t *spans = NULL;
 
 	opj_cio_t *cio = j2k->cio;
 	int curtileno = j2k->curtileno;
@@ -1489,22 +1735,53 @@ static void j2k_read_sod(opj_j2k_t *j2k) {
 		j2k->cstr_info->packno = 0;
 	}
 	
-	size_t len = int_min(j2k->eot - cio_getbp(cio), cio_numbytesleft(cio) + 1);
-
-	if (len == cio_numbytesleft(cio) + 1) {
+	len = j2k->eot - cio_getbp(cio);
+	if (len > cio_numbytesleft(cio)) {
+		len = cio_numbytesleft(cio);
 		truncate = 1;		/* Case of a truncate codestream */
-	}	
-
-	data = j2k->tile_data[curtileno];
-	data = (unsigned char*) opj_realloc(data, (j2k->tile_len[curtileno] + len) * sizeof(unsigned char));
-
-	data_ptr = data + j2k->tile_len[curtileno];
-	for (auto i = 0; i < len; i++) {
-		data_ptr[i] = cio_read(cio, 1);
+	}
+	if (len < 0) {
+		len = 0;
 	}
 
-	j2k->tile_len[curtileno] += len;
-	j2k->tile_data[curtileno] = data;
+	if (j2k->copy_tile_data) {
+		unsigned char *data = (unsigned char*) opj_realloc(j2k->tile_data[curtileno], (j2k->tile_len[curtileno] + len) * sizeof(unsigned char));
+		if (!data) {
+			opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+			j2k->state |= J2K_STATE_ERR;
+			return;
+		}
+		memcpy(data + j2k->tile_len[curtileno], cio_getbp(cio), len);
+		j2k->tile_data[curtileno] = data;
+		j2k->tile_len[curtileno] += len;
+
+		/* the copied tile-parts are seen as a single span */
+		if (!j2k->tile_spans[curtileno]) {
+			j2k->tile_spans[curtileno] = (opj_tile_span_t*) opj_malloc(sizeof(opj_tile_span_t));
+			if (!j2k->tile_spans[curtileno]) {
+				opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+				j2k->state |= J2K_STATE_ERR;
+				return;
+			}
+		}
+		j2k->tile_spans[curtileno]->data = data;
+		j2k->tile_spans[curtileno]->len = j2k->tile_len[curtileno];
+		j2k->tile_numspans[curtileno] = 1;
+	} else {
+		/* reference the tile-part in the input buffer: no copy */
+		spans = (opj_tile_span_t*) opj_realloc(j2k->tile_spans[curtileno], (j2k->tile_numspans[curtileno] + 1) * sizeof(opj_tile_span_t));
+		if (!spans) {
+			opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+			j2k->state |= J2K_STATE_ERR;
+			return;
+		}
+		spans[j2k->tile_numspans[curtileno]].data = cio_getbp(cio);
+		spans[j2k->tile_numspans[curtileno]].len = len;
+		j2k->tile_spans[curtileno] = spans;
+		j2k->tile_numspans[curtileno]++;
+		j2k->tile_len[curtileno] += len;
+	}
+	cio_skip(cio, len);
 	
 	if (!truncate) {
 		j2k->state = J2K_STATE_TPHSOT;
@@ -1576,34 +1853,35 @@ static void j2k_read_eoc(opj_j2k_t *j2k) {
 
 	/* if packets should be decoded */
 	if (j2k->cp->limit_decoding != DECODE_ALL_BUT_PACKETS) {
-		opj_tcd_t *tcd = tcd_create(j2k->cinfo);
+		opj_tcd_t *tcd = j2k_get_tcd(j2k);
+		if (!tcd) {
+			opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+			j2k->state = J2K_STATE_MT + J2K_STATE_ERR;
+			return;
+		}
 		tcd_malloc_decode(tcd, j2k->image, j2k->cp);
-		for (i = 0; i < j2k->cp->tileno_size; i++) {
-			tcd_malloc_decode_tile(tcd, j2k->image, j2k->cp, i, j2k->cstr_info);
-			if (j2k->cp->tileno[i] != -1)
-			{
-				tileno = j2k->cp->tileno[i];
-				success = tcd_decode_tile(tcd, j2k->tile_data[tileno], j2k->tile_len[tileno], tileno, j2k->cstr_info);
-				opj_free(j2k->tile_data[tileno]);
-				j2k->tile_data[tileno] = NULL;
-				tcd_free_decode_tile(tcd, i);
-			}
-			else
-				success = OPJ_FALSE;
-			if (success == OPJ_FALSE) {
+		/* with a single tile, the thread pool is used for its code-blocks instead */
+		if (tcd->thread_pool && j2k->cp->tileno_size > 1) {
+			if (!j2k_decode_tiles_mt(j2k, tcd)) {
 				j2k->state |= J2K_STATE_ERR;
-				break;
+			}
+		}
+		else {
+			for (i = 0; i < j2k->cp->tileno_size; i++) {
+				success = j2k_decode_tile(j2k, tcd, i);
+				if (success == OPJ_FALSE) {
+					j2k->state |= J2K_STATE_ERR;
+					break;
+				}
 			}
 		}
 		tcd_free_decode(tcd);
-		tcd_destroy(tcd);
 	}
 	/* if packets should not be decoded  */
 	else {
 		for (i = 0; i < j2k->cp->tileno_size; i++) {
 			tileno = j2k->cp->tileno[i];
-			opj_free(j2k->tile_data[tileno]);
-			j2k->tile_data[tileno] = NULL;
+			j2k_free_tile_data(j2k, tileno);
 		}
 	}	
 	if (j2k->state & J2K_STATE_ERR)
@@ -1612,6 +1890,125 @@ static void j2k_read_eoc(opj_j2k_t *j2k) {
 		j2k->state = J2K_STATE_MT; 
 }
 
+static void j2k_free_tile_data(opj_j2k_t *j2k, int tileno) {
+	opj_free(j2k->tile_data[tileno]);
+	j2k->tile_data[tileno] = NULL;
+	opj_free(j2k->tile_spans[tileno]);
+	j2k->tile_spans[tileno] = NULL;
+	j2k->tile_numspans[tileno] = 0;
+}
+
+static opj_bool j2k_tile_in_decode_area(opj_j2k_t *j2k, int tileno) {
+	opj_cp_t *cp = j2k->cp;
+	opj_image_t *image = j2k->image;
+	int p = tileno % cp->tw;
+	int q = tileno / cp->tw;
+
+	/* with PPM, the packet headers of all the tiles are read in sequence */
+	if (!cp->decode_area || cp->ppm) {
+		return OPJ_TRUE;
+	}
+	return int_max(cp->tx0 + p * cp->tdx, image->x0) < cp->da_x1
+		&& int_min(cp->tx0 + (p + 1) * cp->tdx, image->x1) > cp->da_x0
+		&& int_max(cp->ty0 + q * cp->tdy, image->y0) < cp->da_y1
+		&& int_min(cp->ty0 + (q + 1) * cp->tdy, image->y1) > cp->da_y0;
+}
+
+static opj_bool j2k_decode_tile(opj_j2k_t *j2k, opj_tcd_t *tcd, int index) {
+	int tileno;
+	opj_bool success;
+
+	if (!j2k_tile_in_decode_area(j2k, j2k->cp->tileno[index])) {
+		j2k_free_tile_data(j2k, j2k->cp->tileno[index]);
+		return OPJ_TRUE;
+	}
+	tcd_malloc_decode_tile(tcd, j2k->image, j2k->cp, index, j2k->cstr_info);
+	if (j2k->cp->tileno[index] == -1) {
+		return OPJ_FALSE;
+	}
+	tileno = j2k->cp->tileno[index];
+	success = tcd_decode_tile(tcd, j2k->tile_spans[tileno], j2k->tile_numspans[tileno], tileno, j2k->cstr_info);
+	j2k_free_tile_data(j2k, tileno);
+	/* the tile coder is indexed by tile number, not by position in the codestream */
+	tcd_free_decode_tile(tcd, tileno);
+
+	return success;
+}
+
+static void j2k_decode_tile_job(void *user_data, int workerno) {
+	opj_j2k_tile_job_t *job = (opj_j2k_tile_job_t*) user_data;
+
+	job->success = tcd_decode_tile_t1(job->tcd, job->tileno, NULL, workerno);
+	tcd_free_decode_tile(job->tcd, job->tileno);
+}
+
+static opj_bool j2k_decode_tiles_mt(opj_j2k_t *j2k, opj_tcd_t *tcd) {
+	int i, numjobs = 0;
+	opj_bool success = OPJ_TRUE;
+	opj_cp_t *cp = j2k->cp;
+	int max_tiles_in_flight = opj_thread_pool_get_thread_count(tcd->thread_pool);
+	opj_j2k_tile_job_t *jobs = (opj_j2k_tile_job_t*) opj_calloc(cp->tileno_size, sizeof(opj_j2k_tile_job_t));
+	if (!jobs) {
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+		return OPJ_FALSE;
+	}
+	/* the tiles in flight are released by the workers: they cannot share the arena */
+	tcd->concurrent_tiles = OPJ_TRUE;
+
+	for (i = 0; i < cp->tileno_size; i++) {
+		int tileno;
+		opj_bool truncated = OPJ_FALSE;
+		opj_j2k_tile_job_t *job = &jobs[numjobs];
+
+		if (!j2k_tile_in_decode_area(j2k, cp->tileno[i])) {
+			j2k_free_tile_data(j2k, cp->tileno[i]);
+			continue;
+		}
+
+		/* wait for a free worker before allocating the next tile */
+		opj_thread_pool_wait_completion(tcd->thread_pool, max_tiles_in_flight - 1);
+
+		tcd_malloc_decode_tile(tcd, j2k->image, cp, i, j2k->cstr_info);
+		if (cp->tileno[i] == -1) {
+			success = OPJ_FALSE;
+			break;
+		}
+		tileno = cp->tileno[i];
+
+		/* packets are decoded here, in codestream order: they update the image and the PPM data */
+		if (!tcd_decode_tile_t2(tcd, j2k->tile_spans[tileno], j2k->tile_numspans[tileno], tileno, j2k->cstr_info, &truncated)) {
+			j2k_free_tile_data(j2k, tileno);
+			tcd_free_decode_tile(tcd, tileno);
+			success = OPJ_FALSE;
+			break;
+		}
+		j2k_free_tile_data(j2k, tileno);
+
+		job->tcd = tcd;
+		job->tileno = tileno;
+		numjobs++;
+		/* if it cannot be queued, the tile is decoded here once worker 0 is done with its tile coder */
+		opj_thread_pool_submit_or_run(tcd->thread_pool, j2k_decode_tile_job, job);
+
+		/* like the serial decoder, keep what was decoded of a truncated tile and stop there, unless in truncated mode */
+		if (truncated && !cp->truncated_mode) {
+			success = OPJ_FALSE;
+			break;
+		}
+	}
+	opj_thread_pool_wait_completion(tcd->thread_pool, 0);
+
+	for (i = 0; i < numjobs; i++) {
+		if (!jobs[i].success) {
+			success = OPJ_FALSE;
+		}
+	}
+	opj_free(jobs);
+	tcd->concurrent_tiles = OPJ_FALSE;
+
+	return success;
+}
+
 typedef struct opj_dec_mstabent {
 	/** marker value */
 	int id;
@@ -1732,6 +2129,17 @@ static opj_dec_mstabent_t *j2k_dec_mstab_lookup(int id) {
 	return e;
 }
 
+static opj_bool j2k_segment_complete(opj_cio_t *cio, int id) {
+	unsigned char *bp = cio_getbp(cio);
+	if (id == J2K_MS_SOC || id == J2K_MS_SOD || id == J2K_MS_EOC) {
+		return OPJ_TRUE;
+	}
+	if (cio_numbytesleft(cio) < 2) {
+		return OPJ_FALSE;
+	}
+	return ((bp[0] << 8) | bp[1]) <= cio_numbytesleft(cio);
+}
+
 /* ----------------------------------------------------------------------- */
 /* J2K / JPT decoder interface                                             */
 /* ----------------------------------------------------------------------- */
@@ -1753,37 +2161,32 @@ opj_j2k_t* j2k_create_decompress(opj_common_ptr cinfo) {
 	return j2k;
 }
 
-void j2k_destroy_decompress(opj_j2k_t *j2k) {
-	int i = 0;
+static void j2k_free_tiles(opj_j2k_t *j2k) {
+	int i;
+	opj_cp_t *cp = j2k->cp;
 
-	if(j2k->tile_len != NULL) {
-		opj_free(j2k->tile_len);
-	}
 	if(j2k->tile_data != NULL) {
-        if(j2k->cp != NULL) {
-            for (i = 0; i < j2k->cp->tileno_size; i++) {
-                int tileno = j2k->cp->tileno[i];
-                opj_free(j2k->tile_data[tileno]);
-                j2k->tile_data[tileno] = NULL;
-            }
-        }
-
-		opj_free(j2k->tile_data);
-	}
-	if(j2k->default_tcp != NULL) {
-		opj_tcp_t *default_tcp = j2k->default_tcp;
-		if(default_tcp->ppt_data_first != NULL) {
-			opj_free(default_tcp->ppt_data_first);
+		/* cp->tileno may hold -1 for the tiles that could not be decoded */
+		for (i = 0; i < j2k->alloc_tiles; i++) {
+			j2k_free_tile_data(j2k, i);
 		}
-		if(j2k->default_tcp->tccps != NULL) {
-			opj_free(j2k->default_tcp->tccps);
-		}
-		opj_free(j2k->default_tcp);
 	}
-	if(j2k->cp != NULL) {
-		opj_cp_t *cp = j2k->cp;
+	opj_free(j2k->tile_data);
+	opj_free(j2k->tile_len);
+	opj_free(j2k->tile_spans);
+	opj_free(j2k->tile_numspans);
+	j2k->tile_data = NULL;
+	j2k->tile_len = NULL;
+	j2k->tile_spans = NULL;
+	j2k->tile_numspans = NULL;
+
+	if(j2k->default_tcp->tccps != NULL) {
+		opj_free(j2k->default_tcp->tccps);
+		j2k->default_tcp->tccps = NULL;
+	}
+	if(cp != NULL) {
 		if(cp->tcps != NULL) {
-			for(i = 0; i < cp->tw * cp->th; i++) {
+			for(i = 0; i < j2k->alloc_tiles; i++) {
 				if(cp->tcps[i].ppt_data_first != NULL) {
 					opj_free(cp->tcps[i].ppt_data_first);
 				}
@@ -1792,13 +2195,41 @@ void j2k_destroy_decompress(opj_j2k_t *j2k) {
 				}
 			}
 			opj_free(cp->tcps);
+			cp->tcps = NULL;
+		}
+		if(cp->tileno != NULL) {
+			opj_free(cp->tileno);
+			cp->tileno = NULL;
+		}
+	}
+	j2k->alloc_tiles = 0;
+	j2k->alloc_comps = 0;
+}
+
+static opj_tcd_t* j2k_get_tcd(opj_j2k_t *j2k) {
+	if (!j2k->tcd) {
+		j2k->tcd = tcd_create(j2k->cinfo);
+	}
+	return j2k->tcd;
+}
+
+void j2k_destroy_decompress(opj_j2k_t *j2k) {
+	j2k_stream_destroy(j2k);
+	j2k_free_tiles(j2k);
+	tcd_destroy(j2k->tcd);
+
+	if(j2k->default_tcp != NULL) {
+		opj_tcp_t *default_tcp = j2k->default_tcp;
+		if(default_tcp->ppt_data_first != NULL) {
+			opj_free(default_tcp->ppt_data_first);
 		}
+		opj_free(j2k->default_tcp);
+	}
+	if(j2k->cp != NULL) {
+		opj_cp_t *cp = j2k->cp;
 		if(cp->ppm_data_first != NULL) {
 			opj_free(cp->ppm_data_first);
 		}
-		if(cp->tileno != NULL) {
-			opj_free(cp->tileno);  
-		}
 		if(cp->comment != NULL) {
 			opj_free(cp->comment);
 		}
@@ -1808,13 +2239,96 @@ void j2k_destroy_decompress(opj_j2k_t *j2k) {
 	opj_free(j2k);
 }
 
+void j2k_decoder_reset(opj_j2k_t *j2k) {
+	int i;
+	opj_cp_t *cp = j2k->cp;
+	opj_tcp_t *default_tcp = j2k->default_tcp;
+	opj_tccp_t *tccps;
+
+	j2k_stream_destroy(j2k);
+
+	/* the tile-parts, packet headers and comment belong to the previous image */
+	if (j2k->tile_data != NULL) {
+		for (i = 0; i < j2k->alloc_tiles; i++) {
+			j2k_free_tile_data(j2k, i);
+			j2k->tile_len[i] = 0;
+		}
+	}
+	if (cp != NULL) {
+		opj_cp_t params = *cp;
+		for (i = 0; cp->tcps != NULL && i < j2k->alloc_tiles; i++) {
+			opj_tcp_t *tcp = &cp->tcps[i];
+			if (tcp->ppt_data_first != NULL) {
+				opj_free(tcp->ppt_data_first);
+			}
+			tccps = tcp->tccps;
+			memset(tcp, 0, sizeof(opj_tcp_t));
+			tcp->tccps = tccps;
+		}
+		if (cp->ppm_data_first != NULL) {
+			opj_free(cp->ppm_data_first);
+		}
+		if (cp->comment != NULL) {
+			opj_free(cp->comment);
+		}
+
+		/* keep the decoding parameters and the arrays reused by j2k_read_siz */
+		memset(cp, 0, sizeof(opj_cp_t));
+		cp->reduce = params.reduce;
+		cp->layer = params.layer;
+		cp->max_passes = params.max_passes;
+		cp->limit_decoding = params.limit_decoding;
+		cp->truncated_mode = params.truncated_mode;
+		cp->num_threads = params.num_threads;
+		cp->decode_area = params.decode_area;
+		cp->da_x0 = params.da_x0;
+		cp->da_y0 = params.da_y0;
+		cp->da_x1 = params.da_x1;
+		cp->da_y1 = params.da_y1;
+		cp->arena = params.arena;
+		cp->decode_output = params.decode_output;
+		cp->output = params.output;
+#ifdef USE_JPWL
+		cp->correct = params.correct;
+		cp->exp_comps = params.exp_comps;
+		cp->max_tiles = params.max_tiles;
+#endif /* USE_JPWL */
+		cp->tcps = params.tcps;
+		cp->tileno = params.tileno;
+	}
+
+	if (default_tcp->ppt_data_first != NULL) {
+		opj_free(default_tcp->ppt_data_first);
+	}
+	tccps = default_tcp->tccps;
+	memset(default_tcp, 0, sizeof(opj_tcp_t));
+	default_tcp->tccps = tccps;
+	if (tccps != NULL) {
+		memset(tccps, 0, j2k->alloc_comps * sizeof(opj_tccp_t));
+	}
+
+	/* the image returned by the previous decode belongs to the caller */
+	j2k->image = NULL;
+	j2k->cio = NULL;
+	j2k->cstr_info = NULL;
+	j2k->eot = NULL;
+	j2k->copy_tile_data = OPJ_FALSE;
+	j2k->state = 0;
+	j2k->curtileno = 0;
+	j2k->tp_num = 0;
+	j2k->cur_tp_num = 0;
+}
+
 void j2k_setup_decoder(opj_j2k_t *j2k, opj_dparameters_t *parameters) {
 	if(j2k && parameters) {
 		/* create and initialize the coding parameters structure */
 		opj_cp_t *cp = (opj_cp_t*) opj_calloc(1, sizeof(opj_cp_t));
 		cp->reduce = parameters->cp_reduce;	
 		cp->layer = parameters->cp_layer;
+		cp->max_passes = parameters->cp_max_passes;
 		cp->limit_decoding = parameters->cp_limit_decoding;
+		cp->truncated_mode = (parameters->flags & OPJ_DPARAMETERS_TRUNCATED_FLAG) ? OPJ_TRUE : OPJ_FALSE;
+		cp->num_threads = parameters->num_threads;
 
 #ifdef USE_JPWL
 		cp->correct = parameters->jpwl_correct;
@@ -1828,32 +2342,591 @@ void j2k_setup_decoder(opj_j2k_t *j2k, opj_dparameters_t *parameters) {
 	}
 }
 
-opj_image_t* j2k_decode(opj_j2k_t *j2k, opj_cio_t *cio, opj_codestream_info_t *cstr_info) {
-	opj_image_t *image = NULL;
-
-	opj_common_ptr cinfo = j2k->cinfo;	
-
-	j2k->cio = cio;
-	j2k->cstr_info = cstr_info;
-	if (cstr_info)
-		memset(cstr_info, 0, sizeof(opj_codestream_info_t));
+opj_bool j2k_set_decode_area(opj_j2k_t *j2k, int x0, int y0, int x1, int y1) {
+	opj_cp_t *cp = j2k ? j2k->cp : NULL;
+	if (!cp) {
+		return OPJ_FALSE;
+	}
+	if (x0 < 0 || y0 < 0 || x1 <= x0 || y1 <= y0) {
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "Invalid decode area (x0:%d, y0:%d, x1:%d, y1:%d)\n", x0, y0, x1, y1);
+		return OPJ_FALSE;
+	}
+	cp->decode_area = OPJ_TRUE;
+	cp->da_x0 = x0;
+	cp->da_y0 = y0;
+	cp->da_x1 = x1;
+	cp->da_y1 = y1;
+	return OPJ_TRUE;
+}
 
-	/* create an empty image */
-	image = opj_image_create0();
-	j2k->image = image;
+opj_bool j2k_set_decode_arena(opj_j2k_t *j2k, opj_arena_t *arena) {
+	if (!j2k || !j2k->cp) {
+		return OPJ_FALSE;
+	}
+	j2k->cp->arena = arena;
+	return OPJ_TRUE;
+}
 
-	j2k->state = J2K_STATE_MHSOC;
+opj_bool j2k_set_decode_output(opj_j2k_t *j2k, const opj_output_buffer_t *output) {
+	int bpp;
+	if (!j2k || !j2k->cp) {
+		return OPJ_FALSE;
+	}
+	if (!output) {
+		j2k->cp->decode_output = OPJ_FALSE;
+		return OPJ_TRUE;
+	}
+	switch (output->format) {
+		case OPJ_PIXFMT_L8:
+			bpp = 1;
+			break;
+		case OPJ_PIXFMT_RGB8:
+			bpp = 3;
+			break;
+		case OPJ_PIXFMT_RGBA8:
+			bpp = 4;
+			break;
+		case OPJ_PIXFMT_PLANAR16:
+			bpp = 2;
+			break;
+		default:
+			opj_event_msg(j2k->cinfo, EVT_ERROR, "Unknown pixel format %d of the output buffer\n", output->format);
+			return OPJ_FALSE;
+	}
+	if (!output->data || output->w <= 0 || output->h <= 0 || output->stride < output->w * bpp
+		|| (output->format == OPJ_PIXFMT_PLANAR16 && output->plane_stride < output->stride * output->h)) {
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "Invalid output buffer\n");
+		return OPJ_FALSE;
+	}
+	j2k->cp->decode_output = OPJ_TRUE;
+	j2k->cp->output = *output;
+	return OPJ_TRUE;
+}
 
-	for (;;) {
-		opj_dec_mstabent_t *e;
-		int id = cio_read(cio, 2);
+opj_bool j2k_read_header_info(const unsigned char *buffer, int length, opj_header_info_t *info) {
+	const unsigned char *p = buffer;
+	const unsigned char *end = buffer + length;
+	opj_bool has_siz = OPJ_FALSE, has_cod = OPJ_FALSE, has_qcd = OPJ_FALSE;
+	int numresolutions = J2K_MAXRLVLS;	/* smallest number of resolutions of the COC markers */
+	int compno;
 
-#ifdef USE_JPWL
-		/* we try to honor JPWL correction power */
-		if (j2k->cp->correct) {
+	if (length < 2 || cio_read_bytes(p, 2) != J2K_MS_SOC) {
+		return OPJ_FALSE;
+	}
+	p += 2;
+	info->main_head_end = 0;
 
-			int orig_pos = cio_tell(cio);
-			opj_bool status;
+	while (end - p >= 4) {
+		const unsigned char *seg = p + 4;	/* first byte after the length of the marker */
+		int id = cio_read_bytes(p, 2);
+		int len = cio_read_bytes(p + 2, 2);	/* length of the marker segment, without the marker */
+
+		if (id == J2K_MS_SOT) {
+			info->main_head_end = (int)(p - buffer);
+			break;
+		}
+		/* the SIZ marker must follow SOC */
+		if (id >> 8 != 0xff || len < 2 || (!has_siz && id != J2K_MS_SIZ)) {
+			return OPJ_FALSE;
+		}
+		if (end - p - 2 < len) {
+			/* the buffer ends in this marker */
+			break;
+		}
+
+		switch (id) {
+			case J2K_MS_SIZ:
+				if (has_siz || len < 41) {
+					return OPJ_FALSE;
+				}
+				info->x1 = (int)cio_read_bytes(seg + 2, 4);	/* Xsiz */
+				info->y1 = (int)cio_read_bytes(seg + 6, 4);	/* Ysiz */
+				info->x0 = (int)cio_read_bytes(seg + 10, 4);	/* X0siz */
+				info->y0 = (int)cio_read_bytes(seg + 14, 4);	/* Y0siz */
+				info->tdx = (int)cio_read_bytes(seg + 18, 4);	/* XTsiz */
+				info->tdy = (int)cio_read_bytes(seg + 22, 4);	/* YTsiz */
+				info->tx0 = (int)cio_read_bytes(seg + 26, 4);	/* XT0siz */
+				info->ty0 = (int)cio_read_bytes(seg + 30, 4);	/* YT0siz */
+				info->numcomps = (int)cio_read_bytes(seg + 34, 2);	/* Csiz */
+				if (info->x0 < 0 || info->y0 < 0 || info->x1 <= info->x0 || info->y1 <= info->y0
+						|| info->tdx <= 0 || info->tdy <= 0 || info->tx0 < 0 || info->ty0 < 0
+						|| info->tx0 > info->x0 || info->ty0 > info->y0
+						|| info->x0 - info->tx0 >= info->tdx || info->y0 - info->ty0 >= info->tdy
+						|| info->numcomps == 0 || len < 38 + 3 * info->numcomps) {
+					return OPJ_FALSE;
+				}
+				info->tw = int_ceildiv(info->x1 - info->tx0, info->tdx);
+				info->th = int_ceildiv(info->y1 - info->ty0, info->tdy);
+				for (compno = 0; compno < info->numcomps && compno < OPJ_HEADER_MAXCOMPS; compno++) {
+					const unsigned char *c = seg + 36 + 3 * compno;
+					info->comps[compno].prec = (c[0] & 0x7f) + 1;	/* Ssiz_i */
+					info->comps[compno].sgnd = c[0] >> 7;
+					info->comps[compno].dx = c[1];	/* XRsiz_i */
+					info->comps[compno].dy = c[2];	/* YRsiz_i */
+					if (info->comps[compno].dx == 0 || info->comps[compno].dy == 0) {
+						return OPJ_FALSE;
+					}
+				}
+				has_siz = OPJ_TRUE;
+				break;
+			case J2K_MS_COD:
+				if (len < 12) {
+					return OPJ_FALSE;
+				}
+				info->prog_order = (OPJ_PROG_ORDER)seg[1];	/* SGcod (A) */
+				info->numlayers = (int)cio_read_bytes(seg + 2, 2);	/* SGcod (B) */
+				info->mct = seg[4];	/* SGcod (C) */
+				info->numresolutions = seg[5] + 1;	/* SPcod (D) */
+				info->cblockw = 1 << ((seg[6] & 0x0f) + 2);	/* SPcod (E) */
+				info->cblockh = 1 << ((seg[7] & 0x0f) + 2);	/* SPcod (F) */
+				info->mode = seg[8];	/* SPcod (G) */
+				info->irreversible = seg[9] == 0;	/* SPcod (H) */
+				if (info->numlayers == 0 || info->numresolutions > J2K_MAXRLVLS) {
+					return OPJ_FALSE;
+				}
+				has_cod = OPJ_TRUE;
+				break;
+			case J2K_MS_COC:
+				{
+					int ccoc = info->numcomps <= 256 ? 1 : 2;	/* size of Ccoc */
+					if (len < 2 + ccoc + 6 || seg[ccoc + 1] + 1 > J2K_MAXRLVLS) {
+						return OPJ_FALSE;
+					}
+					if (seg[ccoc + 1] + 1 < numresolutions) {
+						numresolutions = seg[ccoc + 1] + 1;	/* SPcoc (D) */
+					}
+				}
+				break;
+			case J2K_MS_QCD:
+				if (len < 4) {
+					return OPJ_FALSE;
+				}
+				info->qntsty = seg[0] & 0x1f;	/* Sqcd */
+				info->numgbits = seg[0] >> 5;
+				has_qcd = OPJ_TRUE;
+				break;
+			default:
+				break;
+		}
+		p += 2 + len;
+	}
+
+	if (!has_siz || !has_cod || !has_qcd) {
+		return OPJ_FALSE;
+	}
+	if (numresolutions < info->numresolutions) {
+		info->numresolutions = numresolutions;
+	}
+
+	return OPJ_TRUE;
+}
+
+/**
+Progress of the planning of a tile in j2k_plan_byte_range
+*/
+typedef struct opj_plan_tile {
+	/** J2K_PLAN_OPEN, J2K_PLAN_LOST or J2K_PLAN_DONE */
+	int state;
+	/** number of packets up to the last one needed, -1 until the first tile-part header is read */
+	int needed;
+	/** number of packets located so far with the PLT markers */
+	int located;
+	/** end of the data needed, -1 for the end of the codestream */
+	int end;
+	/** OPJ_TRUE if end is the end of the last packet needed */
+	opj_bool exact;
+} opj_plan_tile_t;
+
+#define J2K_PLAN_OPEN 0	/**< the packets of the tile are located with the PLT markers */
+#define J2K_PLAN_LOST 1	/**< a tile-part had no PLT marker: the tile is needed up to its last tile-part */
+#define J2K_PLAN_DONE 2	/**< the end of the data needed in the tile is known */
+
+/* length of the tile-part header from SOT to SOD included, 0 if the buffer ends before SOD, -1 if it is invalid */
+static int j2k_plan_tph_length(const unsigned char *p, int avail) {
+	int pos = 12, len;
+
+	if (avail < 12) {
+		return 0;
+	}
+	if (cio_read_bytes(p, 2) != J2K_MS_SOT || cio_read_bytes(p + 2, 2) != 10) {
+		return -1;
+	}
+	while (avail - pos >= 2) {
+		int id = cio_read_bytes(p + pos, 2);
+		if (id == J2K_MS_SOD) {
+			return pos + 2;
+		}
+		if (id >> 8 != 0xff) {
+			return -1;
+		}
+		if (avail - pos < 4) {
+			break;
+		}
+		len = cio_read_bytes(p + pos + 2, 2);
+		if (len < 2) {
+			return -1;
+		}
+		pos += 2 + len;
+	}
+
+	return 0;
+}
+
+/* append the lengths of the packets of a PLT marker to lengths */
+static void j2k_plan_read_plt(opj_j2k_t *j2k, int **lengths, int *numlengths, int *sizelengths) {
+	int len, i, packet_len = 0, add;
+
+	opj_cio_t *cio = j2k->cio;
+
+	len = cio_read(cio, 2);		/* Lplt */
+	cio_read(cio, 1);			/* Zplt */
+	for (i = len - 3; i > 0; i--) {
+		add = cio_read(cio, 1);
+		packet_len = (packet_len << 7) | (add & 0x7f);	/* Iplt_i */
+		if ((add & 0x80) == 0) {
+			if (*numlengths == *sizelengths) {
+				int size = *sizelengths ? 2 * *sizelengths : 256;
+				int *data = (int*) opj_realloc(*lengths, size * sizeof(int));
+				if (!data) {
+					opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+					j2k->state |= J2K_STATE_ERR;
+					return;
+				}
+				*lengths = data;
+				*sizelengths = size;
+			}
+			(*lengths)[(*numlengths)++] = packet_len;
+			packet_len = 0;
+		}
+	}
+}
+
+/* number of packets of a tile in codestream order, up to the last one of the requested resolutions and layers */
+static int j2k_plan_count_packets(opj_j2k_t *j2k, int tileno, int reduce, int layers) {
+	opj_cp_t *cp = j2k->cp;
+	opj_tcp_t *tcp = &cp->tcps[tileno];
+	opj_pi_iterator_t *pi;
+	int pino, compno, count = 0, needed = 0;
+
+	for (compno = 0; compno < j2k->image->numcomps; compno++) {
+		if (reduce >= tcp->tccps[compno].numresolutions) {
+			opj_event_msg(j2k->cinfo, EVT_ERROR, "Tile %d: cannot remove %d resolutions of component %d, which has %d\n",
+				tileno, reduce, compno, tcp->tccps[compno].numresolutions);
+			return -1;
+		}
+	}
+	pi = pi_create_decode(j2k->image, cp, tileno, NULL);
+	if (!pi) {
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+		return -1;
+	}
+	for (pino = 0; pino <= tcp->numpocs; pino++) {
+		while (pi_next(&pi[pino])) {
+			count++;
+			if ((layers == 0 || pi[pino].layno < layers)
+					&& pi[pino].resno < tcp->tccps[pi[pino].compno].numresolutions - reduce) {
+				needed = count;
+			}
+		}
+	}
+	pi_destroy(pi, cp, tileno);
+
+	return needed;
+}
+
+opj_bool j2k_plan_byte_range(opj_j2k_t *j2k, unsigned char *buffer, int length, int reduce, int layers, opj_byte_range_t *range) {
+	opj_common_ptr cinfo = j2k->cinfo;
+	opj_cp_t *cp = j2k->cp;
+	opj_header_info_t info;
+	opj_image_t *image = NULL;
+	opj_cio_t *cio = NULL;
+	opj_plan_tile_t *tiles = NULL;
+	int *tlm = NULL;		/* tile and length of each tile-part, from the TLM markers */
+	int *lengths = NULL;	/* lengths of the packets of the current tile-part, from its PLT markers */
+	int numtlm = 0, tlmno = 0, numlengths = 0, sizelengths = 0;
+	int limit_decoding, numtiles, tilesleft, pos, len, i;
+	opj_bool eoc = OPJ_FALSE, ret = OPJ_FALSE;
+
+	memset(range, 0, sizeof(opj_byte_range_t));
+	j2k_decoder_reset(j2k);
+
+	if (!j2k_read_header_info(buffer, length, &info)) {
+		opj_event_msg(cinfo, EVT_ERROR, "Cannot read the SIZ, COD and QCD markers of the main header\n");
+		return OPJ_FALSE;
+	}
+	if (!info.main_head_end) {
+		/* the rest of the main header is needed first */
+		range->missing = length;
+		return OPJ_TRUE;
+	}
+
+	/* the TLM markers locate the tile-parts whose header is not in the buffer */
+	for (pos = 2; pos < info.main_head_end; pos += 2 + len) {
+		len = cio_read_bytes(buffer + pos + 2, 2);
+		if (cio_read_bytes(buffer + pos, 2) == J2K_MS_TLM && len >= 4) {
+			int Stlm = buffer[pos + 5];
+			int ST = (Stlm >> 4) & 0x03;
+			int SP = (Stlm >> 6) & 0x01 ? 4 : 2;
+			int n = (len - 4) / (ST + SP);
+			const unsigned char *p = buffer + pos + 6;
+			int *data = (int*) opj_realloc(tlm, 2 * (numtlm + n) * sizeof(int));
+			if (!data) {
+				opj_event_msg(cinfo, EVT_ERROR, "Out of memory\n");
+				goto cleanup;
+			}
+			tlm = data;
+			for (i = 0; i < n; i++) {
+				/* without Ttlm, each tile has a single tile-part, in the order of the tiles */
+				tlm[2 * numtlm] = ST ? (int)cio_read_bytes(p, ST) : numtlm;	/* Ttlm_i */
+				tlm[2 * numtlm + 1] = (int)cio_read_bytes(p + ST, SP);	/* Ptlm_i */
+				p += ST + SP;
+				numtlm++;
+			}
+		}
+	}
+
+	/* the main header, read by the decoder for the packet iterators */
+	cio = opj_cio_open(cinfo, buffer, length);
+	if (!cio) {
+		goto cleanup;
+	}
+	limit_decoding = cp->limit_decoding;
+	cp->limit_decoding = LIMIT_TO_MAIN_HEADER;
+	image = j2k_decode(j2k, cio, NULL);
+	cp->limit_decoding = limit_decoding;
+	if (!image) {
+		goto cleanup;
+	}
+	for (i = 0; i < image->numcomps; i++) {
+		if (reduce >= j2k->default_tcp->tccps[i].numresolutions) {
+			opj_event_msg(cinfo, EVT_ERROR, "Cannot remove %d resolutions of component %d, which has %d\n",
+				reduce, i, j2k->default_tcp->tccps[i].numresolutions);
+			goto cleanup;
+		}
+	}
+
+	numtiles = cp->tw * cp->th;
+	tiles = (opj_plan_tile_t*) opj_malloc(numtiles * sizeof(opj_plan_tile_t));
+	if (!tiles) {
+		opj_event_msg(cinfo, EVT_ERROR, "Out of memory\n");
+		goto cleanup;
+	}
+	for (i = 0; i < numtiles; i++) {
+		tiles[i].state = J2K_PLAN_OPEN;
+		tiles[i].needed = -1;
+		tiles[i].located = 0;
+		tiles[i].end = 0;
+		tiles[i].exact = OPJ_FALSE;
+	}
+	tilesleft = numtiles;
+
+	/* the tile-parts in codestream order, until the end of the data needed in every tile is known */
+	pos = info.main_head_end;
+	while (tilesleft > 0) {
+		opj_plan_tile_t *tile;
+		int tileno, psot, partno, numparts, eot, hdrlen, data;
+
+		if (length - pos >= 2 && cio_read_bytes(buffer + pos, 2) == J2K_MS_EOC) {
+			eoc = OPJ_TRUE;
+			break;
+		}
+		hdrlen = j2k_plan_tph_length(buffer + pos, length - pos);
+		if (hdrlen < 0) {
+			opj_event_msg(cinfo, EVT_ERROR, "%.8x: invalid tile-part header\n", pos);
+			goto cleanup;
+		}
+		if (hdrlen == 0) {
+			/* the header is not in the buffer: only its TLM entry is known, without the packets */
+			if (!range->missing) {
+				range->missing = pos;
+			}
+			if (tlmno >= numtlm) {
+				break;
+			}
+			tileno = tlm[2 * tlmno];
+			psot = tlm[2 * tlmno + 1];
+			tlmno++;
+			if (tileno >= numtiles || psot < 14) {
+				opj_event_msg(cinfo, EVT_ERROR, "Bad TLM entry (tile %d, %d bytes)\n", tileno, psot);
+				goto cleanup;
+			}
+			tile = &tiles[tileno];
+			if (tile->state == J2K_PLAN_OPEN) {
+				tile->state = J2K_PLAN_LOST;
+			}
+			pos += psot;
+			if (tile->state == J2K_PLAN_LOST) {
+				tile->end = pos;
+				/* the last tile-part of the tile */
+				i = tlmno;
+				while (i < numtlm && tlm[2 * i] != tileno) {
+					i++;
+				}
+				if (i == numtlm) {
+					tile->state = J2K_PLAN_DONE;
+					tilesleft--;
+				}
+			}
+			continue;
+		}
+
+		/* Lsot Isot Psot TPsot TNsot */
+		tileno = cio_read_bytes(buffer + pos + 4, 2);
+		psot = cio_read_bytes(buffer + pos + 6, 4);
+		partno = buffer[pos + 10];
+		numparts = buffer[pos + 11];
+		if (tileno >= numtiles || (psot && psot < hdrlen)) {
+			opj_event_msg(cinfo, EVT_ERROR, "%.8x: bad SOT marker (tile %d, %d bytes)\n", pos, tileno, psot);
+			goto cleanup;
+		}
+		tlmno++;
+		eot = psot ? pos + psot : -1;
+
+		/* the markers of the tile-part header update the coding parameters of the tile */
+		numlengths = 0;
+		cio_seek(cio, pos + 2);
+		j2k->state = J2K_STATE_TPHSOT;
+		j2k_read_sot(j2k);
+		while (cio_tell(cio) < pos + hdrlen - 2) {
+			int id = cio_read(cio, 2);
+			opj_dec_mstabent_t *e = j2k_dec_mstab_lookup(id);
+			if (!(j2k->state & e->states)) {
+				opj_event_msg(cinfo, EVT_ERROR, "%.8x: unexpected marker %x\n", cio_tell(cio) - 2, id);
+				goto cleanup;
+			}
+			if (id == J2K_MS_PLT) {
+				j2k_plan_read_plt(j2k, &lengths, &numlengths, &sizelengths);
+			} else if (e->handler) {
+				(*e->handler)(j2k);
+			}
+			if (j2k->state & J2K_STATE_ERR) {
+				goto cleanup;
+			}
+		}
+
+		tile = &tiles[tileno];
+		if (tile->state == J2K_PLAN_OPEN) {
+			if (tile->needed < 0) {
+				tile->needed = j2k_plan_count_packets(j2k, tileno, reduce, layers);
+				if (tile->needed < 0) {
+					goto cleanup;
+				}
+			}
+			data = pos + hdrlen;
+			for (i = 0; i < numlengths && tile->located < tile->needed; i++) {
+				data += lengths[i];
+				tile->located++;
+			}
+			if (tile->located == tile->needed) {
+				tile->end = data;
+				tile->exact = OPJ_TRUE;
+				tile->state = J2K_PLAN_DONE;
+				tilesleft--;
+			} else if (numlengths == 0) {
+				tile->state = J2K_PLAN_LOST;
+			} else {
+				/* the next tile-parts of the tile hold the rest */
+				tile->end = eot;
+			}
+		}
+		if (tile->state == J2K_PLAN_LOST) {
+			tile->end = eot;
+			if (eot < 0 || (numparts && partno == numparts - 1)) {
+				tile->state = J2K_PLAN_DONE;
+				tilesleft--;
+			}
+		}
+
+		if (eot < 0) {
+			/* Psot = 0: the last tile-part runs to the end of the codestream */
+			eoc = OPJ_TRUE;
+			break;
+		}
+		pos = eot;
+	}
+
+	if (tilesleft > 0 && !eoc) {
+		/* a tile-part header is needed to go further */
+		if (!range->missing) {
+			range->missing = pos;
+		}
+		ret = OPJ_TRUE;
+		goto cleanup;
+	}
+
+	/* at the end of the codestream, the tiles still open are needed up to their last tile-part */
+	range->exact = OPJ_TRUE;
+	for (i = 0; i < numtiles; i++) {
+		if (tiles[i].state != J2K_PLAN_DONE) {
+			tiles[i].exact = OPJ_FALSE;
+		}
+		if (!tiles[i].exact) {
+			range->exact = OPJ_FALSE;
+		}
+		if (tiles[i].end < 0 || range->end < 0) {
+			range->end = -1;
+		} else if (tiles[i].end > range->end) {
+			range->end = tiles[i].end;
+		}
+	}
+	if (range->end < 0) {
+		/* the whole codestream, whose end is not known */
+		range->end = 0;
+		range->exact = OPJ_FALSE;
+	}
+	if (range->exact) {
+		range->missing = 0;
+	}
+	ret = OPJ_TRUE;
+
+cleanup:
+	if (image) {
+		opj_image_destroy(image);
+	}
+	if (cio) {
+		opj_cio_close(cio);
+	}
+	opj_free(tiles);
+	opj_free(tlm);
+	opj_free(lengths);
+	j2k_decoder_reset(j2k);
+
+	return ret;
+}
+
+opj_image_t* j2k_decode(opj_j2k_t *j2k, opj_cio_t *cio, opj_codestream_info_t *cstr_info) {
+	opj_image_t *image = NULL;
+
+	opj_common_ptr cinfo = j2k->cinfo;	
+
+	j2k->cio = cio;
+	j2k->cstr_info = cstr_info;
+	if (cstr_info)
+		memset(cstr_info, 0, sizeof(opj_codestream_info_t));
+
+	/* create an empty image */
+	image = opj_image_create0();
+	j2k->image = image;
+
+	j2k->state = J2K_STATE_MHSOC;
+
+	for (;;) {
+		opj_dec_mstabent_t *e;
+		int id;
+
+		/* the codestream ends on a tile-part boundary, without EOC (see opj_plan_byte_range), or in a tile-part header */
+		if ((j2k->state == J2K_STATE_TPHSOT || j2k->state == J2K_STATE_TPH) && cio_numbytesleft(cio) < 2) {
+			j2k->state = J2K_STATE_NEOC;
+			break;
+		}
+		id = cio_read(cio, 2);
+
+#ifdef USE_JPWL
+		/* we try to honor JPWL correction power */
+		if (j2k->cp->correct) {
+
+			int orig_pos = cio_tell(cio);
+			opj_bool status;
 
 			/* call the corrector */
 			status = jpwl_correct(j2k);
@@ -1903,6 +2976,16 @@ opj_image_t* j2k_decode(opj_j2k_t *j2k, opj_cio_t *cio, opj_codestream_info_t *c
 			//opj_event_msg(cinfo, EVT_INFO, "Main Header decoded.\n");
 			return image;
 		}		
+		/* the tiles read so far are decoded, but nothing can be done without the main header */
+		if (!j2k_segment_complete(cio, id)) {
+			if (j2k->state & (J2K_STATE_TPHSOT | J2K_STATE_TPH)) {
+				j2k->state = J2K_STATE_NEOC;
+				break;
+			}
+			opj_image_destroy(image);
+			opj_event_msg(cinfo, EVT_ERROR, "%.8x: the codestream ends in the main header\n", cio_tell(cio) - 2);
+			return 0;
+		}
 
 		if (e->handler) {
 			(*e->handler)(j2k);
@@ -2014,6 +3097,466 @@ opj_image_t* j2k_decode_jpt_stream(opj_j2k_t *j2k, opj_cio_t *cio,  opj_codestre
 	return image;
 }
 
+/* ----------------------------------------------------------------------- */
+/* J2K incremental decoder interface                                       */
+/* ----------------------------------------------------------------------- */
+
+static opj_bool j2k_stream_segment_ready(opj_j2k_stream_t *stream) {
+	unsigned char *bp = cio_getbp(stream->cio);
+	int avail = cio_numbytesleft(stream->cio);
+	unsigned int id, len;
+
+	stream->need = 0;
+	/* nothing more will come: let the marker handlers deal with a truncated segment */
+	if (stream->eos) {
+		return OPJ_TRUE;
+	}
+	if (avail < 2) {
+		stream->need = 2 - avail;
+		return OPJ_FALSE;
+	}
+	id = (bp[0] << 8) | bp[1];
+	if (id >> 8 != 0xff || id == J2K_MS_SOC || id == J2K_MS_EOC) {
+		return OPJ_TRUE;
+	}
+	if (id == J2K_MS_SOT) {
+		/* SOT Lsot Isot Psot TPsot TNsot: Psot is the length of the whole tile-part */
+		if (avail < 12) {
+			stream->need = 12 - avail;
+			return OPJ_FALSE;
+		}
+		len = (bp[6] << 24) | (bp[7] << 16) | (bp[8] << 8) | bp[9];
+		/* Psot = 0: the tile-part runs to the end of the codestream */
+		if (len == 0) {
+			return OPJ_FALSE;
+		}
+	} else {
+		if (avail < 4) {
+			stream->need = 4 - avail;
+			return OPJ_FALSE;
+		}
+		len = 2 + ((bp[2] << 8) | bp[3]);
+	}
+	if (len > (unsigned int) avail) {
+		stream->need = (int) int_min(len - avail, 0x7fffffff);
+		return OPJ_FALSE;
+	}
+	return OPJ_TRUE;
+}
+
+static opj_bool j2k_stream_skip_tile_part(opj_j2k_t *j2k) {
+	opj_j2k_stream_t *stream = j2k->stream;
+	opj_cp_t *cp = j2k->cp;
+	unsigned char *bp = cio_getbp(stream->cio);
+	int avail = cio_numbytesleft(stream->cio);
+	unsigned int tileno, len;
+
+	if (avail < 12 || ((bp[0] << 8) | bp[1]) != J2K_MS_SOT) {
+		return OPJ_FALSE;
+	}
+	/* SOT Lsot Isot Psot TPsot TNsot */
+	tileno = (bp[4] << 8) | bp[5];
+	len = (bp[6] << 24) | (bp[7] << 16) | (bp[8] << 8) | bp[9];
+	/* Psot = 0: the end of the tile-part is not known */
+	if (!len || len < 14 || tileno >= (unsigned int) (cp->tw * cp->th) || j2k_tile_in_decode_area(j2k, tileno)) {
+		return OPJ_FALSE;
+	}
+	if (len <= (unsigned int) avail) {
+		cio_skip(stream->cio, len);
+	} else {
+		cio_skip(stream->cio, avail);
+		stream->skip = len - avail;
+	}
+	return OPJ_TRUE;
+}
+
+static opj_bool j2k_stream_setup_tiles(opj_j2k_t *j2k) {
+	int i;
+	opj_j2k_stream_t *stream = j2k->stream;
+	opj_cp_t *cp = j2k->cp;
+	int numtiles = cp->tw * cp->th;
+
+	stream->tp_total = (int*) opj_calloc(numtiles, sizeof(int));
+	stream->tp_count = (int*) opj_calloc(numtiles, sizeof(int));
+	if (!stream->tp_total || !stream->tp_count) {
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+		return OPJ_FALSE;
+	}
+
+	/* if packets should not be decoded, no tile coder is needed */
+	if (cp->limit_decoding == DECODE_ALL_BUT_PACKETS) {
+		return OPJ_TRUE;
+	}
+	stream->tcd = j2k_get_tcd(j2k);
+	if (!stream->tcd) {
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+		return OPJ_FALSE;
+	}
+
+	/* no SOT has been read yet: cp->tileno is filled again, in codestream order, by j2k_read_sot */
+	for (i = 0; i < numtiles; i++) {
+		cp->tileno[i] = i;
+	}
+	cp->tileno_size = numtiles;
+	tcd_malloc_decode(stream->tcd, j2k->image, cp);
+	cp->tileno_size = 0;
+
+	return OPJ_TRUE;
+}
+
+static void j2k_stream_destroy(opj_j2k_t *j2k) {
+	opj_j2k_stream_t *stream = j2k->stream;
+	if (!stream) {
+		return;
+	}
+
+	/* the tile coder itself is kept by j2k_get_tcd */
+	if (stream->tcd) {
+		tcd_free_decode(stream->tcd);
+	}
+	/* once DECODER_DONE is returned, the image belongs to the caller */
+	if (stream->status != DECODER_DONE && j2k->image) {
+		opj_image_destroy(j2k->image);
+	}
+	j2k->image = NULL;
+	if (j2k->cio == stream->cio) {
+		j2k->cio = NULL;
+	}
+	opj_cio_close(stream->cio);
+	opj_free(stream->buffer);
+	opj_free(stream->tp_total);
+	opj_free(stream->tp_count);
+	opj_free(stream);
+	j2k->stream = NULL;
+}
+
+opj_bool j2k_decoder_feed(opj_j2k_t *j2k, unsigned char *data, int len) {
+	opj_j2k_stream_t *stream = j2k->stream;
+	opj_cio_t *cio = NULL;
+	int used;
+
+	if (!j2k->cp) {
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "The decoder must be set up before being fed\n");
+		return OPJ_FALSE;
+	}
+
+	if (!stream) {
+		stream = (opj_j2k_stream_t*) opj_calloc(1, sizeof(opj_j2k_stream_t));
+		if (stream) {
+			cio = (opj_cio_t*) opj_calloc(1, sizeof(opj_cio_t));
+		}
+		if (!cio) {
+			opj_free(stream);
+			opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+			return OPJ_FALSE;
+		}
+		cio->cinfo = j2k->cinfo;
+		cio->openmode = OPJ_STREAM_READ;
+		stream->cio = cio;
+		stream->status = DECODER_NEED_DATA;
+		j2k->stream = stream;
+
+		/* the input buffer is compacted between two calls: tile-parts cannot be referenced in it */
+		j2k->copy_tile_data = OPJ_TRUE;
+
+		/* same initialization as j2k_decode */
+		j2k->image = opj_image_create0();
+		j2k->cstr_info = NULL;
+		j2k->pos_correction = 0;
+		j2k->state = J2K_STATE_MHSOC;
+	}
+	cio = stream->cio;
+
+	if (!data || len <= 0) {
+		stream->eos = OPJ_TRUE;
+		return OPJ_TRUE;
+	}
+	if (stream->eos) {
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "Data fed after the end of the codestream\n");
+		return OPJ_FALSE;
+	}
+
+	/* drop what has been read already: j2k_decoder_poll always stops between two marker segments */
+	used = cio->bp - cio->start;
+	if (used > 0) {
+		memmove(stream->buffer, stream->buffer + used, stream->length - used);
+		stream->length -= used;
+		j2k->pos_correction += used;
+	}
+	/* the rest of a tile-part skipped by j2k_decoder_poll */
+	if (stream->skip > 0) {
+		int n = int_min(stream->skip, len);
+		stream->skip -= n;
+		j2k->pos_correction += n;
+		data += n;
+		len -= n;
+	}
+	if (stream->length + len > stream->size) {
+		int size = int_max(2 * stream->size, stream->length + len);
+		unsigned char *buffer = (unsigned char*) opj_realloc(stream->buffer, size);
+		if (!buffer) {
+			opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+			return OPJ_FALSE;
+		}
+		stream->buffer = buffer;
+		stream->size = size;
+	}
+	memcpy(stream->buffer + stream->length, data, len);
+	stream->length += len;
+
+	cio->buffer = stream->buffer;
+	cio->length = stream->length;
+	cio->start = stream->buffer;
+	cio->end = stream->buffer + stream->length;
+	cio->bp = stream->buffer;
+
+	return OPJ_TRUE;
+}
+
+OPJ_DECODER_STATUS j2k_decoder_poll(opj_j2k_t *j2k, opj_image_t **image) {
+	opj_j2k_stream_t *stream = j2k->stream;
+	opj_common_ptr cinfo = j2k->cinfo;
+	opj_cp_t *cp = j2k->cp;
+	opj_cio_t *cio;
+
+	*image = NULL;
+	if (!stream) {
+		return DECODER_NEED_DATA;
+	}
+	if (stream->status == DECODER_DONE || stream->status == DECODER_ERROR) {
+		return stream->status;
+	}
+	cio = stream->cio;
+	j2k->cio = cio;
+	*image = j2k->image;
+
+	for (;;) {
+		opj_dec_mstabent_t *e;
+		int id;
+
+		/* decode the tiles in codestream order, each one as soon as all its tile-parts are read */
+		if (j2k->state != J2K_STATE_TPH && stream->next_tile < cp->tileno_size) {
+			int index = stream->next_tile;
+			int tileno = cp->tileno[index];
+			if (stream->last || (stream->tp_total[tileno] && stream->tp_count[tileno] >= stream->tp_total[tileno])) {
+				stream->next_tile++;
+				if (!stream->tcd) {
+					j2k_free_tile_data(j2k, tileno);
+					continue;
+				}
+				if (!j2k_decode_tile(j2k, stream->tcd, index)) {
+					if (!stream->truncated) {
+						stream->status = DECODER_ERROR;
+						return DECODER_ERROR;
+					}
+					/* like j2k_decode, keep what was decoded of a truncated codestream and stop there */
+					stream->next_tile = cp->tileno_size;
+				}
+				return DECODER_TILE_DECODED;
+			}
+		}
+
+		if (stream->last) {
+			if (stream->next_tile < cp->tileno_size) {
+				continue;
+			}
+			if (stream->tcd) {
+				int compno;
+				/* the components get their data from the first tile decoded: without one, they are black */
+				for (compno = 0; compno < j2k->image->numcomps && !cp->decode_output; compno++) {
+					opj_image_comp_t *comp = &j2k->image->comps[compno];
+					if (!comp->data && comp->w * comp->h > 0) {
+						comp->data = (int*) opj_calloc(comp->w * comp->h, sizeof(int));
+						if (!comp->data) {
+							opj_event_msg(cinfo, EVT_ERROR, "Out of memory\n");
+							stream->status = DECODER_ERROR;
+							return DECODER_ERROR;
+						}
+					}
+				}
+				tcd_free_decode(stream->tcd);
+				stream->tcd = NULL;
+			}
+			if (stream->truncated) {
+				opj_event_msg(cinfo, EVT_WARNING, "Incomplete bitstream\n");
+			}
+			j2k->state = J2K_STATE_MT;
+			stream->status = DECODER_DONE;
+			return DECODER_DONE;
+		}
+
+		if (stream->skip > 0 && !stream->eos) {
+			return DECODER_NEED_DATA;
+		}
+		/* the tiles outside the decode area are not read, once the first SOT has set up the tiles */
+		if (j2k->state == J2K_STATE_TPHSOT && j2k_stream_skip_tile_part(j2k)) {
+			continue;
+		}
+		if (j2k->state != J2K_STATE_TPH) {
+			if (!j2k_stream_segment_ready(stream)) {
+				return DECODER_NEED_DATA;
+			}
+			/* the codestream ended on a tile-part boundary, without EOC */
+			if (j2k->state == J2K_STATE_TPHSOT && stream->eos && cio_numbytesleft(cio) < 2) {
+				stream->last = OPJ_TRUE;
+				stream->truncated = OPJ_TRUE;
+				continue;
+			}
+		}
+		/* the codestream ended in a tile-part header */
+		if (j2k->state == J2K_STATE_TPH && stream->eos && cio_numbytesleft(cio) < 2) {
+			j2k->state = J2K_STATE_NEOC;
+			stream->last = OPJ_TRUE;
+			stream->truncated = OPJ_TRUE;
+			continue;
+		}
+
+		id = cio_read(cio, 2);
+		if (id >> 8 != 0xff) {
+			opj_event_msg(cinfo, EVT_ERROR, "%.8x: expected a marker instead of %x\n", cio_tell(cio) + j2k->pos_correction - 2, id);
+			stream->status = DECODER_ERROR;
+			return DECODER_ERROR;
+		}
+		e = j2k_dec_mstab_lookup(id);
+		if (!(j2k->state & e->states)) {
+			opj_event_msg(cinfo, EVT_ERROR, "%.8x: unexpected marker %x\n", cio_tell(cio) + j2k->pos_correction - 2, id);
+			stream->status = DECODER_ERROR;
+			return DECODER_ERROR;
+		}
+		/* like j2k_decode, decode the tiles read so far when the codestream ends in a tile-part header */
+		if (stream->eos && !j2k_segment_complete(cio, id)) {
+			if (!(j2k->state & (J2K_STATE_TPHSOT | J2K_STATE_TPH))) {
+				opj_event_msg(cinfo, EVT_ERROR, "%.8x: the codestream ends in the main header\n", cio_tell(cio) + j2k->pos_correction - 2);
+				stream->status = DECODER_ERROR;
+				return DECODER_ERROR;
+			}
+			j2k->state = J2K_STATE_NEOC;
+			stream->last = OPJ_TRUE;
+			stream->truncated = OPJ_TRUE;
+			continue;
+		}
+
+		if (e->id == J2K_MS_SOT) {
+			unsigned char *bp = cio_getbp(cio);
+			int tileno, partno, numparts;
+
+			/* Check if the decoding is limited to the main header*/
+			if (cp->limit_decoding == LIMIT_TO_MAIN_HEADER) {
+				stream->last = OPJ_TRUE;
+				continue;
+			}
+			if (!stream->tp_count && !j2k_stream_setup_tiles(j2k)) {
+				stream->status = DECODER_ERROR;
+				return DECODER_ERROR;
+			}
+			/* Lsot Isot Psot TPsot TNsot */
+			tileno = (bp[2] << 8) | bp[3];
+			partno = bp[8];
+			numparts = bp[9];
+			if (tileno >= cp->tw * cp->th) {
+				opj_event_msg(cinfo, EVT_ERROR, "Bad tile number %d in SOT (%d tiles)\n", tileno, cp->tw * cp->th);
+				stream->status = DECODER_ERROR;
+				return DECODER_ERROR;
+			}
+			if (numparts) {
+				stream->tp_total[tileno] = int_max(numparts, partno + 1);
+			}
+		}
+		/* the tiles are decoded above rather than by j2k_read_eoc */
+		if (e->id == J2K_MS_EOC) {
+			stream->last = OPJ_TRUE;
+			continue;
+		}
+
+		if (e->handler) {
+			(*e->handler)(j2k);
+		}
+		if (j2k->state & J2K_STATE_ERR) {
+			stream->status = DECODER_ERROR;
+			return DECODER_ERROR;
+		}
+		if (e->id == J2K_MS_SOD) {
+			stream->tp_count[j2k->curtileno]++;
+		}
+		if (j2k->state == J2K_STATE_NEOC) {
+			stream->last = OPJ_TRUE;
+			stream->truncated = OPJ_TRUE;
+		}
+	}
+}
+
+#define J2K_STREAM_CHUNK 65536	/**< largest number of bytes read from the input at a time by j2k_decode_stream */
+
+opj_image_t* j2k_decode_stream(opj_j2k_t *j2k, opj_cio_t *cio, int length) {
+	opj_image_t *image = NULL;
+	OPJ_DECODER_STATUS status;
+	unsigned char *chunk;
+
+	chunk = (unsigned char*) opj_malloc(J2K_STREAM_CHUNK);
+	if (!chunk) {
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+		return NULL;
+	}
+	for (;;) {
+		int n;
+		status = j2k_decoder_poll(j2k, &image);
+		if (status == DECODER_TILE_DECODED) {
+			continue;
+		}
+		if (status != DECODER_NEED_DATA) {
+			break;
+		}
+		/* a tile-part outside the decode area is skipped in the input rather than fed */
+		if (j2k->stream && j2k->stream->skip > 0) {
+			n = length < 0 ? j2k->stream->skip : int_min(j2k->stream->skip, length);
+			if (n == j2k->stream->skip && cio_input_skip(cio, n)) {
+				j2k->stream->skip = 0;
+				j2k->pos_correction += n;
+				if (length >= 0) {
+					length -= n;
+				}
+				continue;
+			}
+			/* the tile-part passes the end of the input: the codestream is truncated */
+			length = 0;
+		}
+		/* 
+		only the bytes of the next marker segment are read, starting with SOC: the SOT of 
+		a tile-part outside the decode area is seen before the tile-part is read 
+		*/
+		if (!j2k->stream) {
+			n = 2;
+		} else {
+			n = j2k->stream->need > 0 ? int_min(j2k->stream->need, J2K_STREAM_CHUNK) : J2K_STREAM_CHUNK;
+		}
+		if (length >= 0) {
+			n = int_min(n, length);
+		}
+		if (n > 0) {
+			n = cio_input_read(cio, chunk, n);
+			if (n < 0) {
+				status = DECODER_ERROR;
+				break;
+			}
+		}
+		if (length >= 0) {
+			length -= n;
+		}
+		if (!j2k_decoder_feed(j2k, n > 0 ? chunk : NULL, n)) {
+			status = DECODER_ERROR;
+			break;
+		}
+	}
+	opj_free(chunk);
+
+	if (status != DECODER_DONE) {
+		image = NULL;
+	}
+	/* the image belongs to the caller once decoded, j2k_decoder_reset destroys it otherwise */
+	j2k_decoder_reset(j2k);
+	return image;
+}
+
 /* ----------------------------------------------------------------------- */
 /* J2K encoder interface                                                       */
 /* ----------------------------------------------------------------------- */
@@ -2076,6 +3619,7 @@ void j2k_setup_encoder(opj_j2k_t *j2k, opj_cparameters_t *parameters, opj_image_
 	cp->disto_alloc = parameters->cp_disto_alloc;
 	cp->fixed_alloc = parameters->cp_fixed_alloc;
 	cp->fixed_quality = parameters->cp_fixed_quality;
+	cp->num_threads = parameters->num_threads;
 
 	/* mod fixed_quality */
 	if(parameters->cp_matrice) {
@@ -2307,8 +3851,328 @@ void j2k_setup_encoder(opj_j2k_t *j2k, opj_cparameters_t *parameters, opj_image_
 	}
 }
 
+static opj_bool j2k_write_tile(opj_j2k_t *j2k, opj_tcd_t *tcd, int tileno, opj_bool first) {
+	int pino, compno;
+	int tilepartno=0;
+	/* UniPG>> */
+	int acc_pack_num = 0;
+	/* <<UniPG */
+
+	opj_cp_t *cp = j2k->cp;
+	opj_cio_t *cio = j2k->cio;
+	opj_image_t *image = j2k->image;
+	opj_codestream_info_t *cstr_info = j2k->cstr_info;
+	opj_tcp_t *tcp = &cp->tcps[tileno];
+
+	j2k->curtileno = tileno;
+	j2k->cur_tp_num = 0;
+	tcd->cur_totnum_tp = j2k->cur_totnum_tp[j2k->curtileno];
+	/* initialisation before tile encoding  */
+	if (first) {
+		tcd_malloc_encode(tcd, image, cp, j2k->curtileno);
+	} else {
+		tcd_init_encode(tcd, image, cp, j2k->curtileno);
+	}
+
+	/* INDEX >> */
+	if(cstr_info) {
+		cstr_info->tile[j2k->curtileno].start_pos = cio_tell(cio) + j2k->pos_correction;
+		cstr_info->tile[j2k->curtileno].maxmarknum = 10;
+		cstr_info->tile[j2k->curtileno].marker = (opj_marker_info_t *) opj_malloc(cstr_info->tile[j2k->curtileno].maxmarknum * sizeof(opj_marker_info_t));
+		cstr_info->tile[j2k->curtileno].marknum = 0;
+	}
+	/* << INDEX */
+
+	for(pino = 0; pino <= tcp->numpocs; pino++) {
+		int tot_num_tp;
+		tcd->cur_pino=pino;
+
+		/*Get number of tile parts*/
+		tot_num_tp = j2k_get_num_tp(cp,pino,tileno);
+		tcd->tp_pos = cp->tp_pos;
+
+		for(tilepartno = 0; tilepartno < tot_num_tp ; tilepartno++){
+			j2k->tp_num = tilepartno;
+			/* INDEX >> */
+			if(cstr_info)
+				cstr_info->tile[j2k->curtileno].tp[j2k->cur_tp_num].tp_start_pos =
+				cio_tell(cio) + j2k->pos_correction;
+			/* << INDEX */
+			j2k_write_sot(j2k);
+
+			if(j2k->cur_tp_num == 0 && cp->cinema == 0){
+				for (compno = 1; compno < image->numcomps; compno++) {
+					j2k_write_coc(j2k, compno);
+					j2k_write_qcc(j2k, compno);
+				}
+				if (cp->tcps[tileno].numpocs) {
+					j2k_write_poc(j2k);
+				}
+			}
+
+			/* INDEX >> */
+			if(cstr_info)
+				cstr_info->tile[j2k->curtileno].tp[j2k->cur_tp_num].tp_end_header =
+				cio_tell(cio) + j2k->pos_correction + 1;
+			/* << INDEX */
+
+			if (!j2k_write_sod(j2k, tcd)) {
+				return OPJ_FALSE;
+			}
+
+			/* INDEX >> */
+			if(cstr_info) {
+				cstr_info->tile[j2k->curtileno].tp[j2k->cur_tp_num].tp_end_pos =
+					cio_tell(cio) + j2k->pos_correction - 1;
+				cstr_info->tile[j2k->curtileno].tp[j2k->cur_tp_num].tp_start_pack =
+					acc_pack_num;
+				cstr_info->tile[j2k->curtileno].tp[j2k->cur_tp_num].tp_numpacks =
+					cstr_info->packno - acc_pack_num;
+				acc_pack_num = cstr_info->packno;
+			}
+			/* << INDEX */
+
+			j2k->cur_tp_num++;
+		}			
+	}
+	if(cstr_info) {
+		cstr_info->tile[j2k->curtileno].end_pos = cio_tell(cio) + j2k->pos_correction - 1;
+	}
+
+	/*
+	if (tile->PPT) { // BAD PPT !!! 
+	FILE *PPT_file;
+	int i;
+	PPT_file=fopen("PPT","rb");
+	fprintf(stderr,"%c%c%c%c",255,97,tile->len_ppt/256,tile->len_ppt%256);
+	for (i=0;i<tile->len_ppt;i++) {
+	unsigned char elmt;
+	fread(&elmt, 1, 1, PPT_file);
+	fwrite(&elmt,1,1,f);
+	}
+	fclose(PPT_file);
+	unlink("PPT");
+	}
+	*/
+
+	return OPJ_TRUE;
+}
+
+static void j2k_forget_tile_info(opj_codestream_info_t *cstr_info, int tileno) {
+	opj_tile_info_t *tile_info = &cstr_info->tile[tileno];
+	opj_free(tile_info->packet);
+	tile_info->packet = NULL;
+	opj_free(tile_info->marker);
+	tile_info->marker = NULL;
+	opj_free(tile_info->thresh);
+	tile_info->thresh = NULL;
+}
+
+static opj_bool j2k_encode_tile(opj_j2k_t *j2k, opj_tcd_t *tcd, int tileno, opj_bool first) {
+	opj_cio_t *cio = j2k->cio;
+	opj_tcp_t *tcp = &j2k->cp->tcps[tileno];
+	int start = cio_tell(cio);
+	float rates[100];
+	opj_bool success;
+
+	memcpy(rates, tcp->rates, sizeof(rates));
+	/* the cinema rate allocation gives all the space left to the layers without a rate */
+	j2k->tile_space_bound = !j2k->cp->cinema;
+	j2k->tile_overflow = OPJ_FALSE;
+	success = j2k_write_tile(j2k, tcd, tileno, first);
+	if (!success && j2k->tile_overflow) {
+		memcpy(tcp->rates, rates, sizeof(rates));
+		if (j2k->cstr_info) {
+			j2k_forget_tile_info(j2k->cstr_info, tileno);
+		}
+		if (first) {
+			tcd_free_encode(tcd);
+		}
+		/* drop what the first attempt wrote */
+		cio_seek(cio, start);
+		cio->top = cio->bp;
+		j2k->tile_space_bound = OPJ_FALSE;
+		success = j2k_write_tile(j2k, tcd, tileno, first);
+	}
+	return success;
+}
+
+static void j2k_encode_tile_job(void *user_data, int workerno) {
+	opj_j2k_enc_tile_job_t *job = (opj_j2k_enc_tile_job_t*) user_data;
+	opj_j2k_t j2k = *job->j2k;	/* the state of the writer is updated along the tile */
+	opj_tcd_t *tcd = job->tcds[workerno];
+
+	j2k.cio = job->cio;
+	if (j2k.cstr_info) {
+		j2k.cstr_info = &job->cstr_info;
+	}
+	/* a tile without tile-parts does not depend on the space left */
+	tcd->rate_headroom = job->capacity;
+	/*
+	unlike j2k_encode_tile, a tile that overflows its space is not encoded again with all the
+	output left, which would take that much memory in each worker: j2k_append_tile does it
+	*/
+	j2k.tile_space_bound = OPJ_TRUE;
+	j2k.tile_overflow = OPJ_FALSE;
+	job->success = j2k_write_tile(&j2k, tcd, job->tileno, OPJ_FALSE);
+	job->len = cio_tell(job->cio);
+	job->rate_headroom = tcd->rate_headroom;
+}
+
+static opj_bool j2k_append_tile(opj_j2k_t *j2k, opj_tcd_t *tcd, opj_j2k_enc_tile_job_t *job) {
+	int i, offset;
+	opj_cio_t *cio = j2k->cio;
+	opj_cp_t *cp = j2k->cp;
+	opj_codestream_info_t *cstr_info = j2k->cstr_info;
+	int tileno = job->tileno;
+	int left = cio_numbytesleft(cio);
+
+	/*
+	here the tile would get capacity - left bytes less than the job gave it: the tile is the
+	same if it still fits, with the end of codestream, and if its rate allocation did not
+	depend on these bytes
+	*/
+	if (!job->success || job->len + 2 > left || job->rate_headroom < job->capacity - left) {
+		if (!job->cio) {
+			opj_event_msg(j2k->cinfo, EVT_WARNING, "Not enough memory to encode tile %d on the thread pool, encoding it serially\n", tileno);
+		} else {
+			opj_event_msg(j2k->cinfo, EVT_INFO, "Encoding tile %d again serially\n", tileno);
+		}
+		memcpy(cp->tcps[tileno].rates, job->rates, sizeof(job->rates));
+		if (cstr_info) {
+			j2k_forget_tile_info(cstr_info, tileno);
+		}
+		return j2k_encode_tile(j2k, tcd, tileno, OPJ_FALSE);
+	}
+
+	offset = cio_tell(cio);
+	if (!cio_reserve(cio, job->len)) {
+		return OPJ_FALSE;
+	}
+	memcpy(cio_getbp(cio), job->cio->buffer, job->len);
+	cio_skip(cio, job->len);
+
+	/* INDEX >> */
+	if (cstr_info) {
+		opj_tile_info_t *info_TL = &cstr_info->tile[tileno];
+		info_TL->start_pos += offset;
+		/* only set by the first tile-part */
+		if (j2k->cur_totnum_tp[tileno]) {
+			info_TL->end_header += offset;
+		}
+		info_TL->end_pos += offset;
+		for (i = 0; i < j2k->cur_totnum_tp[tileno]; i++) {
+			info_TL->tp[i].tp_start_pos += offset;
+			info_TL->tp[i].tp_end_header += offset;
+			info_TL->tp[i].tp_end_pos += offset;
+		}
+		for (i = 0; i < job->cstr_info.packno; i++) {
+			info_TL->packet[i].start_pos += offset;
+			info_TL->packet[i].end_ph_pos += offset;
+			info_TL->packet[i].end_pos += offset;
+		}
+		for (i = 0; i < info_TL->marknum; i++) {
+			info_TL->marker[i].pos += offset;
+		}
+		if (cstr_info->D_max < job->cstr_info.D_max) {
+			cstr_info->D_max = job->cstr_info.D_max;
+		}
+	}
+	/* << INDEX */
+
+	return OPJ_TRUE;
+}
+
+static opj_bool j2k_encode_tiles_mt(opj_j2k_t *j2k, opj_tcd_t *tcd) {
+	int i, first, workerno, compno;
+	float rates[100];
+	opj_bool success = OPJ_TRUE;
+	opj_cp_t *cp = j2k->cp;
+	int numtiles = cp->tw * cp->th;
+	int numworkers = opj_thread_pool_get_thread_count(tcd->thread_pool);
+	opj_j2k_enc_tile_job_t *jobs = (opj_j2k_enc_tile_job_t*) opj_calloc(numworkers, sizeof(opj_j2k_enc_tile_job_t));
+	opj_tcd_t **tcds = (opj_tcd_t**) opj_calloc(numworkers, sizeof(opj_tcd_t*));
+	if (!jobs || !tcds) {
+		opj_free(jobs);
+		opj_free(tcds);
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+		return OPJ_FALSE;
+	}
+
+	/*
+	like the tile coder of the calling thread, the ones of the workers are sized on the
+	first tile, which has the most precincts: this sets up tile 0 again, and its rates
+	*/
+	memcpy(rates, cp->tcps[0].rates, sizeof(rates));
+	for (workerno = 0; workerno < numworkers; workerno++) {
+		tcds[workerno] = tcd_create(j2k->cinfo);
+		if (!tcds[workerno]) {
+			opj_event_msg(j2k->cinfo, EVT_ERROR, "Out of memory\n");
+			success = OPJ_FALSE;
+			break;
+		}
+		/* the workers are busy with the other tiles */
+		tcds[workerno]->pool_worker = OPJ_TRUE;
+		tcd_malloc_encode(tcds[workerno], j2k->image, cp, 0);
+		memcpy(cp->tcps[0].rates, rates, sizeof(rates));
+		/* tcd_init_encode allocates the samples of each tile */
+		for (compno = 0; compno < j2k->image->numcomps; compno++) {
+			opj_aligned_free(tcds[workerno]->tcd_image->tiles->comps[compno].data);
+		}
+	}
+
+	/* one tile per worker at a time: the tiles encoded wait for the ones before them */
+	for (first = 1; success && first < numtiles; first += numworkers) {
+		int numjobs = int_min(numworkers, numtiles - first);
+		/* no tile of this batch can be longer than what is left of the output */
+		int capacity = cio_numbytesleft(j2k->cio);
+
+		for (i = 0; i < numjobs; i++) {
+			opj_j2k_enc_tile_job_t *job = &jobs[i];
+			job->j2k = j2k;
+			job->tcds = tcds;
+			job->tileno = first + i;
+			job->capacity = capacity;
+			job->success = OPJ_FALSE;
+			memcpy(job->rates, cp->tcps[job->tileno].rates, sizeof(job->rates));
+			if (j2k->cstr_info) {
+				job->cstr_info = *j2k->cstr_info;
+				job->cstr_info.packno = 0;
+			}
+			opj_event_msg(j2k->cinfo, EVT_INFO, "tile number %d / %d\n", job->tileno + 1, numtiles);
+
+			/* without its output, the tile is encoded by j2k_append_tile */
+			job->cio = cio_open_memory(j2k->cinfo, capacity);
+			if (!job->cio) {
+				continue;
+			}
+			opj_thread_pool_submit_or_run(tcd->thread_pool, j2k_encode_tile_job, job);
+		}
+		opj_thread_pool_wait_completion(tcd->thread_pool, 0);
+
+		for (i = 0; i < numjobs; i++) {
+			if (success && (!j2k_append_tile(j2k, tcd, &jobs[i]) || !cio_flush(j2k->cio))) {
+				success = OPJ_FALSE;
+			}
+			opj_cio_close(jobs[i].cio);
+		}
+	}
+
+	for (workerno = 0; workerno < numworkers; workerno++) {
+		if (tcds[workerno]) {
+			tcd_free_encode(tcds[workerno]);
+			tcd_destroy(tcds[workerno]);
+		}
+	}
+	opj_free(tcds);
+	opj_free(jobs);
+
+	return success;
+}
+
 opj_bool j2k_encode(opj_j2k_t *j2k, opj_cio_t *cio, opj_image_t *image, opj_codestream_info_t *cstr_info) {
-	int tileno, compno;
+	int tileno, compno, hold;
+	opj_bool success = OPJ_TRUE;
 	opj_cp_t *cp = NULL;
 
 	opj_tcd_t *tcd = NULL;	/* TCD component */
@@ -2318,11 +4182,19 @@ opj_bool j2k_encode(opj_j2k_t *j2k, opj_cio_t *cio, opj_image_t *image, opj_code
 
 	cp = j2k->cp;
 
+#ifdef USE_JPWL
+	/* jpwl_encode works on the whole buffer */
+	if (!cio_reserve(cio, cio_numbytesleft(cio))) {
+		return OPJ_FALSE;
+	}
+#endif /* USE_JPWL */
+
 	/* INDEX >> */
 	j2k->cstr_info = cstr_info;
 	if (cstr_info) {
 		int compno;
-		cstr_info->tile = (opj_tile_info_t *) opj_malloc(cp->tw * cp->th * sizeof(opj_tile_info_t));
+		/* a tile without tile-parts leaves its packets unset */
+		cstr_info->tile = (opj_tile_info_t *) opj_calloc(cp->tw * cp->th, sizeof(opj_tile_info_t));
 		cstr_info->image_w = image->x1 - image->x0;
 		cstr_info->image_h = image->y1 - image->y0;
 		cstr_info->prog = (&cp->tcps[0])->prg;
@@ -2368,9 +4240,12 @@ opj_bool j2k_encode(opj_j2k_t *j2k, opj_cio_t *cio, opj_image_t *image, opj_code
 	}
 
 	j2k->totnum_tp = j2k_calculate_tp(cp,image->numcomps,image,j2k);
+	hold = cio->hold;
 	/* TLM Marker*/
 	if(cp->cinema){
 		j2k_write_tlm(j2k);
+		/* j2k_write_sod fills the TLM marker in along the tile-parts */
+		hold = cio_hold(cio, j2k->tlm_start);
 		if (cp->cinema == CINEMA4K_24) {
 			j2k_write_poc(j2k);
 		}
@@ -2390,107 +4265,19 @@ opj_bool j2k_encode(opj_j2k_t *j2k, opj_cio_t *cio, opj_image_t *image, opj_code
 	tcd = tcd_create(j2k->cinfo);
 
 	/* encode each tile */
-	for (tileno = 0; tileno < cp->tw * cp->th; tileno++) {
-		int pino;
-		int tilepartno=0;
-		/* UniPG>> */
-		int acc_pack_num = 0;
-		/* <<UniPG */
-
-
-		opj_tcp_t *tcp = &cp->tcps[tileno];
+	for (tileno = 0; success && tileno < cp->tw * cp->th; tileno++) {
 		opj_event_msg(j2k->cinfo, EVT_INFO, "tile number %d / %d\n", tileno + 1, cp->tw * cp->th);
-
-		j2k->curtileno = tileno;
-		j2k->cur_tp_num = 0;
-		tcd->cur_totnum_tp = j2k->cur_totnum_tp[j2k->curtileno];
-		/* initialisation before tile encoding  */
-		if (tileno == 0) {
-			tcd_malloc_encode(tcd, image, cp, j2k->curtileno);
-		} else {
-			tcd_init_encode(tcd, image, cp, j2k->curtileno);
-		}
-
-		/* INDEX >> */
-		if(cstr_info) {
-			cstr_info->tile[j2k->curtileno].start_pos = cio_tell(cio) + j2k->pos_correction;
-			cstr_info->tile[j2k->curtileno].maxmarknum = 10;
-			cstr_info->tile[j2k->curtileno].marker = (opj_marker_info_t *) opj_malloc(cstr_info->tile[j2k->curtileno].maxmarknum * sizeof(opj_marker_info_t));
-			cstr_info->tile[j2k->curtileno].marknum = 0;
-		}
-		/* << INDEX */
-
-		for(pino = 0; pino <= tcp->numpocs; pino++) {
-			int tot_num_tp;
-			tcd->cur_pino=pino;
-
-			/*Get number of tile parts*/
-			tot_num_tp = j2k_get_num_tp(cp,pino,tileno);
-			tcd->tp_pos = cp->tp_pos;
-
-			for(tilepartno = 0; tilepartno < tot_num_tp ; tilepartno++){
-				j2k->tp_num = tilepartno;
-				/* INDEX >> */
-				if(cstr_info)
-					cstr_info->tile[j2k->curtileno].tp[j2k->cur_tp_num].tp_start_pos =
-					cio_tell(cio) + j2k->pos_correction;
-				/* << INDEX */
-				j2k_write_sot(j2k);
-
-				if(j2k->cur_tp_num == 0 && cp->cinema == 0){
-					for (compno = 1; compno < image->numcomps; compno++) {
-						j2k_write_coc(j2k, compno);
-						j2k_write_qcc(j2k, compno);
-					}
-					if (cp->tcps[tileno].numpocs) {
-						j2k_write_poc(j2k);
-					}
-				}
-
-				/* INDEX >> */
-				if(cstr_info)
-					cstr_info->tile[j2k->curtileno].tp[j2k->cur_tp_num].tp_end_header =
-					cio_tell(cio) + j2k->pos_correction + 1;
-				/* << INDEX */
-
-				j2k_write_sod(j2k, tcd);
-
-				/* INDEX >> */
-				if(cstr_info) {
-					cstr_info->tile[j2k->curtileno].tp[j2k->cur_tp_num].tp_end_pos =
-						cio_tell(cio) + j2k->pos_correction - 1;
-					cstr_info->tile[j2k->curtileno].tp[j2k->cur_tp_num].tp_start_pack =
-						acc_pack_num;
-					cstr_info->tile[j2k->curtileno].tp[j2k->cur_tp_num].tp_numpacks =
-						cstr_info->packno - acc_pack_num;
-					acc_pack_num = cstr_info->packno;
-				}
-				/* << INDEX */
-
-				j2k->cur_tp_num++;
-			}			
-		}
-		if(cstr_info) {
-			cstr_info->tile[j2k->curtileno].end_pos = cio_tell(cio) + j2k->pos_correction - 1;
-		}
-
-
+		success = j2k_encode_tile(j2k, tcd, tileno, tileno == 0) && cio_flush(cio);
+#ifndef USE_JPWL
 		/*
-		if (tile->PPT) { // BAD PPT !!! 
-		FILE *PPT_file;
-		int i;
-		PPT_file=fopen("PPT","rb");
-		fprintf(stderr,"%c%c%c%c",255,97,tile->len_ppt/256,tile->len_ppt%256);
-		for (i=0;i<tile->len_ppt;i++) {
-		unsigned char elmt;
-		fread(&elmt, 1, 1, PPT_file);
-		fwrite(&elmt,1,1,f);
-		}
-		fclose(PPT_file);
-		unlink("PPT");
-		}
+		the thread pool created for the code-blocks of the first tile encodes the other ones
+		(JPWL keeps a single list of markers, cinema codestreams have a single tile)
 		*/
-
+		if (success && tileno == 0 && tcd->thread_pool && cp->tw * cp->th > 1 && !cp->cinema) {
+			success = j2k_encode_tiles_mt(j2k, tcd);
+			break;
+		}
+#endif /* USE_JPWL */
 	}
 
 	/* destroy the tile encoder */
@@ -2498,6 +4285,11 @@ opj_bool j2k_encode(opj_j2k_t *j2k, opj_cio_t *cio, opj_image_t *image, opj_code
 	tcd_destroy(tcd);
 
 	opj_free(j2k->cur_totnum_tp);
+	cio_hold(cio, hold);
+
+	if (!success) {
+		return OPJ_FALSE;
+	}
 
 	j2k_write_eoc(j2k);
 
@@ -226,8 +226,30 @@ typedef struct opj_cp {
 	int reduce;
 	/** if != 0, then only the first "layer" layers are decoded; if == 0 or not used, all the quality layers are decoded */
 	int layer;
+	/** if != 0, then only the first "max_passes" coding passes of each code-block are decoded; if == 0, all of them are */
+	int max_passes;
 	/** if == NO_LIMITATION, decode entire codestream; if == LIMIT_TO_MAIN_HEADER then only decode the main header */
 	OPJ_LIMIT_DECODING limit_decoding;
+	/** if OPJ_TRUE, a truncated codestream is decoded at the highest resolution it holds completely */
+	opj_bool truncated_mode;
+	/** number of worker threads used for decoding or encoding; if <= 1, the work is done in the calling thread */
+	int num_threads;
+	/** if OPJ_TRUE, only the tiles and code-blocks contributing to the area [da_x0,da_x1[ x [da_y0,da_y1[ are decoded */
+	opj_bool decode_area;
+	/** left border of the decode area, on the reference grid */
+	int da_x0;
+	/** top border of the decode area, on the reference grid */
+	int da_y0;
+	/** right border (excluded) of the decode area, on the reference grid */
+	int da_x1;
+	/** bottom border (excluded) of the decode area, on the reference grid */
+	int da_y1;
+	/** arena supplied by the caller for the per-tile decoder structures, NULL to use a private one */
+	opj_arena_t *arena;
+	/** if OPJ_TRUE, the tiles are stored into output instead of the image components */
+	opj_bool decode_output;
+	/** buffer of the caller receiving the decoded pixels */
+	opj_output_buffer_t output;
 	/** XTOsiz */
 	int tx0;
 	/** YTOsiz */
@@ -308,6 +330,50 @@ typedef struct opj_cp {
 /* <<UniPG */
 } opj_cp_t;
 
+/**
+Data of a tile-part, as found in the codestream
+*/
+typedef struct opj_tile_span {
+	/** first byte of the tile-part data (after SOD) */
+	unsigned char *data;
+	/** number of bytes of data */
+	int len;
+} opj_tile_span_t;
+
+/**
+State of the incremental decoder (see j2k_decoder_feed and j2k_decoder_poll)
+*/
+typedef struct opj_j2k_stream {
+	/** codestream bytes received but not consumed yet */
+	unsigned char *buffer;
+	/** number of bytes in buffer */
+	int length;
+	/** allocated size of buffer */
+	int size;
+	/** byte i/o stream reading buffer */
+	opj_cio_t *cio;
+	/** set when the caller has signalled the end of the codestream */
+	opj_bool eos;
+	/** set when no more tile-part will be read (EOC, truncated or finished codestream) */
+	opj_bool last;
+	/** set when the codestream ended before its EOC marker */
+	opj_bool truncated;
+	/** tile coder kept between two calls, created when the main header is complete */
+	struct opj_tcd *tcd;
+	/** number of tile-parts of each tile (TNsot), 0 if unknown */
+	int *tp_total;
+	/** number of tile-parts of each tile already read */
+	int *tp_count;
+	/** index in cp->tileno of the next tile to decode */
+	int next_tile;
+	/** bytes of a tile-part outside the decode area still to come, dropped as they are fed */
+	int skip;
+	/** bytes missing to read the next marker segment, 0 if unknown */
+	int need;
+	/** current status, sticky once DECODER_DONE or DECODER_ERROR */
+	OPJ_DECODER_STATUS status;
+} opj_j2k_stream_t;
+
 /**
 JPEG-2000 codestream reader/writer
 */
@@ -349,10 +415,28 @@ typedef struct opj_j2k {
 	it enables to make the right correction in position return by cio_tell
 	*/
 	int pos_correction;
-	/** array used to store the data of each tile */
+	/**
+	compression only : 
+	if set, tier-2 writes the data of a tile in a window sized after the tile rather than in what
+	is left of the output; the tile is encoded again without it if its data does not fit
+	*/
+	opj_bool tile_space_bound;
+	/** compression only : set when the data of a tile did not fit in its window */
+	opj_bool tile_overflow;
+	/** array used to store the data of each tile, when it is copied (see copy_tile_data) */
 	unsigned char **tile_data;
 	/** array used to store the length of each tile */
 	int *tile_len;
+	/** array used to store the data of each tile, as one span per tile-part */
+	opj_tile_span_t **tile_spans;
+	/** array used to store the number of spans of each tile */
+	int *tile_numspans;
+	/** 
+	decompression only : 
+	if set, the tile-parts are copied in tile_data; otherwise they are referenced 
+	in the input buffer, which must stay valid until the tiles are decoded
+	*/
+	opj_bool copy_tile_data;
 	/** 
 	decompression only : 
 	store decoding parameters common to all tiles (information like COD, COC in main header)
@@ -366,6 +450,14 @@ typedef struct opj_j2k {
 	opj_codestream_info_t *cstr_info;
 	/** pointer to the byte i/o stream */
 	opj_cio_t *cio;
+	/** incremental decoder state, NULL unless j2k_decoder_feed is used */
+	opj_j2k_stream_t *stream;
+	/** decompression only : tile coder kept from one decode to the next (see j2k_decoder_reset) */
+	struct opj_tcd *tcd;
+	/** decompression only : number of tiles of cp->tcps, cp->tileno and the tile-part arrays */
+	int alloc_tiles;
+	/** decompression only : number of components of the tccps arrays */
+	int alloc_comps;
 } opj_j2k_t;
 
 /** @name Exported functions */
@@ -398,6 +490,56 @@ Decode an image from a JPEG-2000 codestream
 */
 opj_image_t* j2k_decode(opj_j2k_t *j2k, opj_cio_t *cio, opj_codestream_info_t *cstr_info);
 /**
+Restrict the decoding to an area of the image
+@param j2k J2K decompressor handle, set up with j2k_setup_decoder
+@param x0 Left border of the area, on the reference grid
+@param y0 Top border of the area, on the reference grid
+@param x1 Right border (excluded) of the area, on the reference grid
+@param y1 Bottom border (excluded) of the area, on the reference grid
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+opj_bool j2k_set_decode_area(opj_j2k_t *j2k, int x0, int y0, int x1, int y1);
+/**
+Allocate the per-tile decoder structures from an arena supplied by the caller
+@param j2k J2K decompressor handle, set up with j2k_setup_decoder
+@param arena Arena, NULL to use a private one
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+opj_bool j2k_set_decode_arena(opj_j2k_t *j2k, opj_arena_t *arena);
+/**
+Store the decoded pixels into a buffer of the caller instead of the image components
+@param j2k J2K decompressor handle, set up with j2k_setup_decoder
+@param output Description of the buffer, NULL to decode into the image components
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+opj_bool j2k_set_decode_output(opj_j2k_t *j2k, const opj_output_buffer_t *output);
+/**
+Prepare a J2K decompressor to decode another codestream. The decoding parameters, 
+the tile coder and the arrays sized by the number of tiles and components are kept, 
+the latter being reallocated by j2k_read_siz only if the new image needs other sizes.
+@param j2k J2K decompressor handle
+*/
+void j2k_decoder_reset(opj_j2k_t *j2k);
+/**
+Read the description of the image from the main header of a codestream, without a decompressor
+@param buffer Start of the codestream
+@param length Number of bytes in buffer
+@param info Filled with the fields read from the SIZ, COD, COC and QCD markers
+@return Returns OPJ_TRUE if the SIZ, COD and QCD markers could be read, returns OPJ_FALSE otherwise
+*/
+opj_bool j2k_read_header_info(const unsigned char *buffer, int length, opj_header_info_t *info);
+/**
+Find the number of bytes of a codestream needed to decode it with a reduce factor and a number of layers
+@param j2k J2K decompressor handle, reset before and after the planning
+@param buffer Start of the codestream
+@param length Number of bytes in buffer
+@param reduce Number of highest resolution levels to discard
+@param layers Number of quality layers to decode, 0 for all
+@param range Filled with the result (see opj_plan_byte_range)
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+opj_bool j2k_plan_byte_range(opj_j2k_t *j2k, unsigned char *buffer, int length, int reduce, int layers, opj_byte_range_t *range);
+/**
 Decode an image form a JPT-stream (JPEG 2000, JPIP)
 @param j2k J2K decompressor handle
 @param cio Input buffer stream
@@ -406,6 +548,31 @@ Decode an image form a JPT-stream (JPEG 2000, JPIP)
 */
 opj_image_t* j2k_decode_jpt_stream(opj_j2k_t *j2k, opj_cio_t *cio, opj_codestream_info_t *cstr_info);
 /**
+Append a chunk of codestream to the incremental decoder
+@param j2k J2K decompressor handle
+@param data Next bytes of the codestream, NULL to signal the end of the codestream
+@param len Number of bytes in data, 0 to signal the end of the codestream
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+opj_bool j2k_decoder_feed(opj_j2k_t *j2k, unsigned char *data, int len);
+/**
+Read the markers received so far and decode the next complete tile, if any
+@param j2k J2K decompressor handle
+@param image Set to the image being decoded
+@return Returns the progress of the decoder
+*/
+OPJ_DECODER_STATUS j2k_decoder_poll(opj_j2k_t *j2k, opj_image_t **image);
+/**
+Decode an image from a codestream read from the input of a stream opened with opj_cio_open_input. 
+The codestream is fed to the incremental decoder by chunks, and the tile-parts of the tiles 
+outside the decode area are skipped in the input.
+@param j2k J2K decompressor handle
+@param cio Input stream
+@param length Number of bytes of the codestream in the input, -1 if it runs to the end of the input
+@return Returns a decoded image if successful, returns NULL otherwise
+*/
+opj_image_t* j2k_decode_stream(opj_j2k_t *j2k, opj_cio_t *cio, int length);
+/**
 Creates a J2K compression structure
 @param cinfo Codec context info
 @return Returns a handle to a J2K compressor if successful, returns NULL otherwise
@@ -92,6 +92,17 @@ Decode the structure of a JP2 file
 static opj_bool jp2_read_struct(opj_jp2_t *jp2, opj_cio_t *cio,
 	opj_jp2_color_t *color);
 /**
+Read the boxes of a JP2 file up to the codestream from the input of a stream opened with 
+opj_cio_open_input. The boxes that jp2_read_struct does not need are skipped in the input.
+@param jp2 JP2 handle
+@param cio Input stream, left at the start of the codestream
+@param color Collector for profile, cdef and pclr data
+@param length Set to the length of the codestream, -1 if it runs to the end of the file
+@return Returns true if successful, returns false otherwise
+*/
+static opj_bool jp2_read_struct_stream(opj_jp2_t *jp2, opj_cio_t *cio,
+	opj_jp2_color_t *color, int *length);
+/**
 Apply collected palette data
 @param color Collector for profile, cdef and pclr data
 @param image 
@@ -730,12 +741,102 @@ opj_bool jp2_read_jp2h(opj_jp2_t *jp2, opj_cio_t *cio, opj_jp2_color_t *color)
 
 }/* jp2_read_jp2h() */
 
-opj_image_t* opj_jp2_decode(opj_jp2_t *jp2, opj_cio_t *cio, 
-	opj_codestream_info_t *cstr_info) 
+static opj_bool jp2_read_struct_stream(opj_jp2_t *jp2, opj_cio_t *cio, 
+	opj_jp2_color_t *color, int *length) 
+{
+	opj_common_ptr cinfo = jp2->cinfo;
+	unsigned char *buffer = NULL;
+	int size = 0;
+	opj_bool success = OPJ_FALSE;
+
+	*length = -1;
+	for (;;) {
+		unsigned char *hdr;
+		unsigned int boxlen, type;
+		int hdrlen = 8;
+		unsigned char *grown = (unsigned char*) opj_realloc(buffer, size + 16);
+		if (!grown) {
+			opj_event_msg(cinfo, EVT_ERROR, "Out of memory\n");
+			break;
+		}
+		buffer = grown;
+		hdr = buffer + size;
+		if (cio_input_read(cio, hdr, 8) != 8) {
+			break;
+		}
+		boxlen = (hdr[0] << 24) | (hdr[1] << 16) | (hdr[2] << 8) | hdr[3];
+		type = (hdr[4] << 24) | (hdr[5] << 16) | (hdr[6] << 8) | hdr[7];
+		if (boxlen == 1) {
+			/* XLBox, only boxes smaller than 2^32 are handled, like jp2_read_boxhdr */
+			if (cio_input_read(cio, hdr + 8, 8) != 8 || hdr[8] || hdr[9] || hdr[10] || hdr[11]) {
+				break;
+			}
+			boxlen = (hdr[12] << 24) | (hdr[13] << 16) | (hdr[14] << 8) | hdr[15];
+			hdrlen = 16;
+		}
+		if (type == JP2_JP2C) {
+			size += hdrlen;
+			/* a length of 0: the codestream runs to the end of the file */
+			if (boxlen >= (unsigned int) hdrlen) {
+				*length = (int) (boxlen - hdrlen);
+			}
+			success = OPJ_TRUE;
+			break;
+		}
+		if (boxlen < (unsigned int) hdrlen || boxlen > 0x7fffffff) {
+			break;
+		}
+		if (type != JP2_JP && type != JP2_FTYP && type != JP2_JP2H) {
+			/* the other boxes are not needed to decode the image */
+			if (!cio_input_skip(cio, boxlen - hdrlen)) {
+				break;
+			}
+			continue;
+		}
+		/* by chunks, so that a wrong box length does not allocate more than the file */
+		size += hdrlen;
+		boxlen -= hdrlen;
+		while (boxlen > 0) {
+			int n = int_min((int) boxlen, 65536);
+			grown = (unsigned char*) opj_realloc(buffer, size + n);
+			if (!grown) {
+				opj_event_msg(cinfo, EVT_ERROR, "Out of memory\n");
+				break;
+			}
+			buffer = grown;
+			if (cio_input_read(cio, buffer + size, n) != n) {
+				break;
+			}
+			size += n;
+			boxlen -= n;
+		}
+		if (boxlen > 0) {
+			break;
+		}
+	}
+
+	/* the boxes up to the codestream are read as by jp2_read_struct */
+	if (success) {
+		opj_cio_t *hcio = opj_cio_open(cinfo, buffer, size);
+		success = hcio && jp2_read_struct(jp2, hcio, color);
+		opj_cio_close(hcio);
+		jp2->j2k_codestream_offset = cio_tell(cio);
+		jp2->j2k_codestream_length = *length < 0 ? 0 : *length;
+	}
+	opj_free(buffer);
+	return success;
+}
+
+/**
+Decode an image from a JP2 file, read from a buffer or, with stream set, from the input of cio
+*/
+static opj_image_t* jp2_decode(opj_jp2_t *jp2, opj_cio_t *cio, 
+	opj_codestream_info_t *cstr_info, opj_bool stream) 
 {
 	opj_common_ptr cinfo;
 	opj_image_t *image = NULL;
 	opj_jp2_color_t color;
+	int length = -1;
 
 	if(!jp2 || !cio) 
    {
@@ -745,15 +846,23 @@ opj_image_t* opj_jp2_decode(opj_jp2_t *jp2, opj_cio_t *cio,
 	cinfo = jp2->cinfo;
 
 /* JP2 decoding */
-	if(!jp2_read_struct(jp2, cio, &color)) 
+	if(!(stream ? jp2_read_struct_stream(jp2, cio, &color, &length) : jp2_read_struct(jp2, cio, &color))) 
    {
 	free_color_data(&color);
 	opj_event_msg(cinfo, EVT_ERROR, "Failed to decode jp2 structure\n");
 	return NULL;
    }
 
+/* the pixels written to an output buffer would be palette indices */
+	if(jp2->j2k->cp->decode_output && color.jp2_pclr && !jp2->ignore_pclr_cmap_cdef)
+   {
+	free_color_data(&color);
+	opj_event_msg(cinfo, EVT_ERROR, "Images with a palette cannot be decoded to an output buffer\n");
+	return NULL;
+   }
+
 /* J2K decoding */
-	image = j2k_decode(jp2->j2k, cio, cstr_info);
+	image = stream ? j2k_decode_stream(jp2->j2k, cio, length) : j2k_decode(jp2->j2k, cio, cstr_info);
 
 	if(!image) 
    {
@@ -774,7 +883,7 @@ opj_image_t* opj_jp2_decode(opj_jp2_t *jp2, opj_cio_t *cio,
 	else
 		image->color_space = CLRSPC_UNKNOWN;
 
-	if(color.jp2_cdef)
+	if(color.jp2_cdef && !jp2->j2k->cp->decode_output)
    {
 	jp2_apply_cdef(image, &color);
    }
@@ -793,10 +902,23 @@ opj_image_t* opj_jp2_decode(opj_jp2_t *jp2, opj_cio_t *cio,
 	image->icc_profile_len = color.icc_profile_len;
    }
    }
+	/* what was not applied to the image */
+	free_color_data(&color);
    
 	return image;
 
-}/* opj_jp2_decode() */
+}/* jp2_decode() */
+
+opj_image_t* opj_jp2_decode(opj_jp2_t *jp2, opj_cio_t *cio, 
+	opj_codestream_info_t *cstr_info) 
+{
+	return jp2_decode(jp2, cio, cstr_info, OPJ_FALSE);
+}
+
+opj_image_t* jp2_decode_stream(opj_jp2_t *jp2, opj_cio_t *cio) 
+{
+	return jp2_decode(jp2, cio, NULL, OPJ_TRUE);
+}
 
 
 void jp2_write_jp2h(opj_jp2_t *jp2, opj_cio_t *cio) {
@@ -875,10 +997,13 @@ static opj_bool jp2_read_ftyp(opj_jp2_t *jp2, opj_cio_t *cio) {
 static int jp2_write_jp2c(opj_jp2_t *jp2, opj_cio_t *cio, opj_image_t *image, opj_codestream_info_t *cstr_info) {
 	unsigned int j2k_codestream_offset, j2k_codestream_length;
 	opj_jp2_box_t box;
+	int hold;
 
 	opj_j2k_t *j2k = jp2->j2k;
 
 	box.init_pos = cio_tell(cio);
+	/* the length of the box is only known at the end of the codestream */
+	hold = cio_can_seek(cio) ? cio->hold : cio_hold(cio, box.init_pos);
 	cio_skip(cio, 4);
 	cio_write(cio, JP2_JP2C, 4);	/* JP2C */
 
@@ -886,6 +1011,7 @@ static int jp2_write_jp2c(opj_jp2_t *jp2, opj_cio_t *cio, opj_image_t *image, op
 	j2k_codestream_offset = cio_tell(cio);
 	if(!j2k_encode(j2k, cio, image, cstr_info)) {
 		opj_event_msg(j2k->cinfo, EVT_ERROR, "Failed to encode image\n");
+		cio_hold(cio, hold);
 		return 0;
 	}
 	j2k_codestream_length = cio_tell(cio) - j2k_codestream_offset;
@@ -897,6 +1023,7 @@ static int jp2_write_jp2c(opj_jp2_t *jp2, opj_cio_t *cio, opj_image_t *image, op
 	cio_seek(cio, box.init_pos);
 	cio_write(cio, box.length, 4);	/* L */
 	cio_seek(cio, box.init_pos + box.length);
+	cio_hold(cio, hold);
 
 	return box.length;
 }
@@ -1078,6 +1205,144 @@ void jp2_setup_decoder(opj_jp2_t *jp2, opj_dparameters_t *parameters) {
 	jp2->ignore_pclr_cmap_cdef = parameters->flags & OPJ_DPARAMETERS_IGNORE_PCLR_CMAP_CDEF_FLAG;
 }
 
+void jp2_decoder_reset(opj_jp2_t *jp2) {
+	opj_common_ptr cinfo = jp2->cinfo;
+	opj_j2k_t *j2k = jp2->j2k;
+	opj_bool ignore_pclr_cmap_cdef = jp2->ignore_pclr_cmap_cdef;
+
+	j2k_decoder_reset(j2k);
+
+	/* the boxes of the previous file */
+	if(jp2->comps) {
+		opj_free(jp2->comps);
+	}
+	if(jp2->cl) {
+		opj_free(jp2->cl);
+	}
+	memset(jp2, 0, sizeof(opj_jp2_t));
+	jp2->cinfo = cinfo;
+	jp2->j2k = j2k;
+	jp2->ignore_pclr_cmap_cdef = ignore_pclr_cmap_cdef;
+}
+
+/*
+ * Size of the header of the box at p, and of the whole box in boxlen, 0 if the box header is invalid.
+ * A box that extends past the end of the buffer is clipped to it.
+ */
+static int jp2_probe_box(const unsigned char *p, const unsigned char *end, unsigned int *type, int *boxlen) {
+	unsigned int len;
+	int hdrlen = 8;
+
+	if (end - p < 8) {
+		return 0;
+	}
+	len = cio_read_bytes(p, 4);
+	*type = cio_read_bytes(p + 4, 4);
+	if (len == 1) {
+		/* XLBox, only boxes smaller than 2^32 are handled, like jp2_read_boxhdr */
+		if (end - p < 16 || cio_read_bytes(p + 8, 4) != 0) {
+			return 0;
+		}
+		len = cio_read_bytes(p + 12, 4);
+		hdrlen = 16;
+	} else if (len == 0) {
+		/* the box extends to the end of the file */
+		len = (unsigned int)(end - p);
+	}
+	if (len < (unsigned int)hdrlen) {
+		return 0;
+	}
+	*boxlen = len > (unsigned int)(end - p) ? (int)(end - p) : (int)len;
+
+	return hdrlen;
+}
+
+opj_bool jp2_read_header_info(const unsigned char *buffer, int length, opj_header_info_t *info) {
+	const unsigned char *p = buffer;
+	const unsigned char *end = buffer + length;
+	opj_bool has_ihdr = OPJ_FALSE;
+	unsigned int type;
+	int hdrlen, boxlen;
+
+	/* JPEG 2000 signature box */
+	hdrlen = jp2_probe_box(p, end, &type, &boxlen);
+	if (hdrlen != 8 || type != JP2_JP || boxlen != 12 || cio_read_bytes(p + 8, 4) != 0x0d0a870a) {
+		return OPJ_FALSE;
+	}
+	p += boxlen;
+
+	info->color_space = CLRSPC_UNSPECIFIED;
+	while ((hdrlen = jp2_probe_box(p, end, &type, &boxlen)) != 0) {
+		if (type == JP2_JP2H) {
+			const unsigned char *sub = p + hdrlen;
+			const unsigned char *subend = p + boxlen;
+			int subhdrlen, sublen;
+			while ((subhdrlen = jp2_probe_box(sub, subend, &type, &sublen)) != 0) {
+				const unsigned char *c = sub + subhdrlen;
+				int clen = sublen - subhdrlen;
+				if (type == JP2_IHDR) {
+					/* HEIGHT, WIDTH, NC, BPC, C, UnkC, IPR */
+					if (clen < 14 || cio_read_bytes(c + 8, 2) == 0) {
+						return OPJ_FALSE;
+					}
+					has_ihdr = OPJ_TRUE;
+				} else if (type == JP2_COLR && clen >= 7 && c[0] == 1) {
+					/* METH, PRECEDENCE, APPROX, EnumCS: only the first colr box counts */
+					if (info->color_space == CLRSPC_UNSPECIFIED) {
+						switch (cio_read_bytes(c + 3, 4)) {
+							case 16: info->color_space = CLRSPC_SRGB; break;
+							case 17: info->color_space = CLRSPC_GRAY; break;
+							case 18: info->color_space = CLRSPC_SYCC; break;
+							default: info->color_space = CLRSPC_UNKNOWN; break;
+						}
+					}
+				} else if (type == JP2_COLR && info->color_space == CLRSPC_UNSPECIFIED) {
+					/* ICC profile */
+					info->color_space = CLRSPC_UNKNOWN;
+				}
+				sub += sublen;
+			}
+		} else if (type == JP2_JP2C) {
+			if (!has_ihdr) {
+				return OPJ_FALSE;
+			}
+			info->codestream_start = (int)(p + hdrlen - buffer);
+			if (!j2k_read_header_info(p + hdrlen, boxlen - hdrlen, info)) {
+				return OPJ_FALSE;
+			}
+			if (info->main_head_end) {
+				info->main_head_end += info->codestream_start;
+			}
+			return OPJ_TRUE;
+		}
+		p += boxlen;
+	}
+
+	return OPJ_FALSE;
+}
+
+opj_bool jp2_plan_byte_range(opj_jp2_t *jp2, unsigned char *buffer, int length, int reduce, int layers, opj_byte_range_t *range) {
+	opj_header_info_t info;
+
+	memset(&info, 0, sizeof(opj_header_info_t));
+	if (!jp2_read_header_info(buffer, length, &info)) {
+		opj_event_msg(jp2->cinfo, EVT_ERROR, "Cannot read the JP2 header and the main header of the codestream\n");
+		return OPJ_FALSE;
+	}
+	if (!j2k_plan_byte_range(jp2->j2k, buffer + info.codestream_start, length - info.codestream_start, reduce, layers, range)) {
+		return OPJ_FALSE;
+	}
+	/* positions in the file */
+	if (range->end) {
+		range->end += info.codestream_start;
+	}
+	if (range->missing) {
+		range->missing += info.codestream_start;
+	}
+
+	return OPJ_TRUE;
+}
+
 /* ----------------------------------------------------------------------- */
 /* JP2 encoder interface                                             */
 /* ----------------------------------------------------------------------- */
@@ -1189,6 +1454,7 @@ void jp2_setup_encoder(opj_jp2_t *jp2, opj_cparameters_t *parameters, opj_image_
 opj_bool opj_jp2_encode(opj_jp2_t *jp2, opj_cio_t *cio, opj_image_t *image, opj_codestream_info_t *cstr_info) {
 
 	int pos_iptr, pos_cidx, pos_jp2c, len_jp2c, len_cidx, end_pos, pos_fidx, len_fidx;
+	int hold;
 	pos_jp2c = pos_iptr = -1; /* remove a warning */
 
 	/* JP2 encoding */
@@ -1200,8 +1466,11 @@ opj_bool opj_jp2_encode(opj_jp2_t *jp2, opj_cio_t *cio, opj_image_t *image, opj_
 	/* JP2 Header box */
 	jp2_write_jp2h(jp2, cio);
 
+	hold = cio->hold;
 	if( jp2->jpip_on){
 	  pos_iptr = cio_tell( cio);
+	  /* the index reads the codestream back (see check_EPHuse) */
+	  hold = cio_hold( cio, pos_iptr);
 	  cio_skip( cio, 24); /* IPTR further ! */
 	  
 	  pos_jp2c = cio_tell( cio);
@@ -1210,6 +1479,7 @@ opj_bool opj_jp2_encode(opj_jp2_t *jp2, opj_cio_t *cio, opj_image_t *image, opj_
 	/* J2K encoding */
 	if(!(len_jp2c = jp2_write_jp2c( jp2, cio, image, cstr_info))){
 	    opj_event_msg(jp2->cinfo, EVT_ERROR, "Failed to encode image\n");
+	    cio_hold( cio, hold);
 	    return OPJ_FALSE;
 	}
 
@@ -1227,6 +1497,7 @@ opj_bool opj_jp2_encode(opj_jp2_t *jp2, opj_cio_t *cio, opj_image_t *image, opj_
 	  write_iptr( pos_fidx, len_fidx, cio);
 	  
 	  cio_seek( cio, end_pos);
+	  cio_hold( cio, hold);
 	}
 
 	return OPJ_TRUE;
@@ -188,6 +188,30 @@ Decoding parameters are returned in jp2->j2k->cp.
 */
 void jp2_setup_decoder(opj_jp2_t *jp2, opj_dparameters_t *parameters);
 /**
+Prepare a JP2 decompressor to decode another file (see j2k_decoder_reset)
+@param jp2 JP2 decompressor handle
+*/
+void jp2_decoder_reset(opj_jp2_t *jp2);
+/**
+Read the description of the image from the ihdr and colr boxes of a JP2 file and the main header of its codestream
+@param buffer Start of the file
+@param length Number of bytes in buffer
+@param info Filled with the fields read from the boxes and from the SIZ, COD, COC and QCD markers
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+opj_bool jp2_read_header_info(const unsigned char *buffer, int length, opj_header_info_t *info);
+/**
+Find the number of bytes of a JP2 file needed to decode it with a reduce factor and a number of layers
+@param jp2 JP2 decompressor handle
+@param buffer Start of the file
+@param length Number of bytes in buffer
+@param reduce Number of highest resolution levels to discard
+@param layers Number of quality layers to decode, 0 for all
+@param range Filled with the result, as positions in the file (see opj_plan_byte_range)
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+opj_bool jp2_plan_byte_range(opj_jp2_t *jp2, unsigned char *buffer, int length, int reduce, int layers, opj_byte_range_t *range);
+/**
 Decode an image from a JPEG-2000 file stream
 @param jp2 JP2 decompressor handle
 @param cio Input buffer stream
@@ -196,6 +220,13 @@ Decode an image from a JPEG-2000 file stream
 */
 opj_image_t* opj_jp2_decode(opj_jp2_t *jp2, opj_cio_t *cio, opj_codestream_info_t *cstr_info);
 /**
+Decode an image from a JPEG-2000 file read from the input of a stream opened with opj_cio_open_input
+@param jp2 JP2 decompressor handle
+@param cio Input stream
+@return Returns a decoded image if successful, returns NULL otherwise
+*/
+opj_image_t* jp2_decode_stream(opj_jp2_t *jp2, opj_cio_t *cio);
+/**
 Creates a JP2 compression structure
 @param cinfo Codec context info
 @return Returns a handle to a JP2 compressor if successful, returns NULL otherwise
@@ -901,6 +901,7 @@ void jpwl_dump_marks(opj_j2k_t *j2k, opj_cio_t *cio, opj_image_t *image) {
 	cio->start = cio->buffer;
 	cio->end = cio->buffer + cio->length;
 	cio->bp = cio->buffer;
+	cio->top = cio->buffer;
 	cio_seek(cio, soc_pos + new_size);
 
 }
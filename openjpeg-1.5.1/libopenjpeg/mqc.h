@@ -70,11 +70,16 @@ typedef struct opj_mqc {
 	unsigned char *end;
 	opj_mqc_state_t *ctxs[MQC_NUMCTXS];
 	opj_mqc_state_t **curctx;
-#ifdef MQC_PERF_OPT
-	unsigned char *buffer;
-#endif
+	/** the two bytes following the segment being decoded, see mqc_init_dec */
+	unsigned char backup[2];
 } opj_mqc_t;
 
+/**
+Number of bytes the decoder overwrites after the end of a segment: 
+the buffers given to mqc_init_dec must have them
+*/
+#define MQC_DEC_MARGIN 2
+
 /** @name Exported functions */
 /*@{*/
 /* ----------------------------------------------------------------------- */
@@ -180,18 +185,93 @@ SEGMARK mode switch (SEGSYM)
 */
 void mqc_segmark_enc(opj_mqc_t *mqc);
 /**
-Initialize the decoder
+Initialize the decoder. The MQC_DEC_MARGIN bytes following the segment are 
+overwritten until mqc_finish_dec is called.
 @param mqc MQC handle
 @param bp Pointer to the start of the buffer from which the bytes will be read
 @param len Length of the input buffer
 */
 void mqc_init_dec(opj_mqc_t *mqc, unsigned char *bp, int len);
 /**
-Decode a symbol
+Restore the bytes following the segment given to mqc_init_dec
+@param mqc MQC handle
+*/
+void mqc_finish_dec(opj_mqc_t *mqc);
+/**
+Input a byte. The bytes written by mqc_init_dec after the segment 
+stop mqc->bp at its end, so the end of the buffer needs no test.
+@param mqc MQC handle
+*/
+static INLINE void mqc_bytein(opj_mqc_t *const mqc) {
+	unsigned int c = *(mqc->bp + 1);
+	if (*mqc->bp == 0xff) {
+		if (c > 0x8f) {
+			mqc->c += 0xff00;
+			mqc->ct = 8;
+		} else {
+			mqc->bp++;
+			mqc->c += c << 9;
+			mqc->ct = 7;
+		}
+	} else {
+		mqc->bp++;
+		mqc->c += c << 8;
+		mqc->ct = 8;
+	}
+}
+/**
+Decode a symbol. 
+Inlined in the coding passes: a, c and ct are kept in local variables, 
+and the state of the context is selected without branches.
 @param mqc MQC handle
 @return Returns the decoded symbol (0 or 1)
 */
-int mqc_decode(opj_mqc_t *const mqc);
+static INLINE int mqc_decode(opj_mqc_t *const mqc) {
+	opj_mqc_state_t *state = *mqc->curctx;
+	unsigned int qeval = state->qeval;
+	unsigned int a = mqc->a - qeval;
+	unsigned int c = mqc->c;
+	unsigned int ct;
+	int exchange, d;
+
+	if ((c >> 16) < qeval) {
+		/* LPS, unless the MPS sub-interval is the smaller one */
+		exchange = a < qeval;
+		d = state->mps ^ !exchange;
+		*mqc->curctx = exchange ? state->nmps : state->nlps;
+		a = qeval;
+	} else {
+		c -= qeval << 16;
+		if (a & 0x8000) {
+			mqc->a = a;
+			mqc->c = c;
+			return state->mps;
+		}
+		/* MPS, unless the LPS sub-interval is the larger one */
+		exchange = a < qeval;
+		d = state->mps ^ exchange;
+		*mqc->curctx = exchange ? state->nlps : state->nmps;
+	}
+
+	/* renormalization */
+	ct = mqc->ct;
+	do {
+		if (ct == 0) {
+			mqc->c = c;
+			mqc_bytein(mqc);
+			c = mqc->c;
+			ct = mqc->ct;
+		}
+		a <<= 1;
+		c <<= 1;
+		ct--;
+	} while (a < 0x8000);
+	mqc->a = a;
+	mqc->c = c;
+	mqc->ct = ct;
+
+	return d;
+}
 /* ----------------------------------------------------------------------- */
 /*@}*/
 
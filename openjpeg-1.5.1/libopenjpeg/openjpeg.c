@@ -64,6 +64,25 @@ const char* OPJ_CALLCONV opj_version(void) {
     return PACKAGE_VERSION;
 }
 
+opj_bool OPJ_CALLCONV opj_read_header_info(const unsigned char *buffer, int length, opj_header_info_t *info) {
+	if(!buffer || !info || length < 12) {
+		return OPJ_FALSE;
+	}
+	memset(info, 0, sizeof(opj_header_info_t));
+	info->color_space = CLRSPC_UNSPECIFIED;
+	/* SOC then SIZ for a codestream, the 12 bytes signature box for a JP2 file */
+	if(buffer[0] == 0xff && buffer[1] == 0x4f && buffer[2] == 0xff && buffer[3] == 0x51) {
+		info->codec_format = CODEC_J2K;
+		return j2k_read_header_info(buffer, length, info);
+	}
+	if(buffer[0] == 0 && buffer[1] == 0 && buffer[2] == 0 && buffer[3] == 12
+			&& !memcmp(buffer + 4, "jP  ", 4)) {
+		info->codec_format = CODEC_JP2;
+		return jp2_read_header_info(buffer, length, info);
+	}
+	return OPJ_FALSE;
+}
+
 opj_dinfo_t* OPJ_CALLCONV opj_create_decompress(OPJ_CODEC_FORMAT format) {
 	opj_dinfo_t *dinfo = (opj_dinfo_t*)opj_calloc(1, sizeof(opj_dinfo_t));
 	if(!dinfo) return NULL;
@@ -123,11 +142,13 @@ void OPJ_CALLCONV opj_set_default_decoder_parameters(opj_dparameters_t *paramete
 		/* default decoding parameters */
 		parameters->cp_layer = 0;
 		parameters->cp_reduce = 0;
+		parameters->cp_max_passes = 0;
 		parameters->cp_limit_decoding = NO_LIMITATION;
 
 		parameters->decod_format = -1;
 		parameters->cod_format = -1;
 		parameters->flags = 0;		
+		parameters->num_threads = 0;
 /* UniPG>> */
 #ifdef USE_JPWL
 		parameters->jpwl_correct = OPJ_FALSE;
@@ -138,6 +159,24 @@ void OPJ_CALLCONV opj_set_default_decoder_parameters(opj_dparameters_t *paramete
 	}
 }
 
+void OPJ_CALLCONV opj_set_preview_decoder_parameters(opj_dparameters_t *parameters, int level) {
+	/* reduce, layers and passes of each level, 3 * n - 2 passes for n bit-planes */
+	static const int presets[3][3] = {
+		{ 0, 2, 16 },
+		{ 1, 1, 10 },
+		{ 2, 1, 7 }
+	};
+
+	if(parameters && level > 0) {
+		if(level > 3) {
+			level = 3;
+		}
+		parameters->cp_reduce = presets[level - 1][0];
+		parameters->cp_layer = presets[level - 1][1];
+		parameters->cp_max_passes = presets[level - 1][2];
+	}
+}
+
 void OPJ_CALLCONV opj_setup_decoder(opj_dinfo_t *dinfo, opj_dparameters_t *parameters) {
 	if(dinfo && parameters) {
 		switch(dinfo->codec_format) {
@@ -159,7 +198,31 @@ opj_image_t* OPJ_CALLCONV opj_decode(opj_dinfo_t *dinfo, opj_cio_t *cio) {
 	return opj_decode_with_info(dinfo, cio, NULL);
 }
 
+/* decode an image read from the input of a stream opened with opj_cio_open_input */
+static opj_image_t* opj_decode_input(opj_dinfo_t *dinfo, opj_cio_t *cio, opj_codestream_info_t *cstr_info) {
+	if (cstr_info) {
+		opj_event_msg((opj_common_ptr)dinfo, EVT_ERROR, "The codestream information is not available when decoding an input stream\n");
+		return NULL;
+	}
+	switch(dinfo->codec_format) {
+		case CODEC_J2K:
+			return j2k_decode_stream((opj_j2k_t*)dinfo->j2k_handle, cio, -1);
+		case CODEC_JP2:
+			return jp2_decode_stream((opj_jp2_t*)dinfo->jp2_handle, cio);
+		case CODEC_JPT:
+			opj_event_msg((opj_common_ptr)dinfo, EVT_ERROR, "JPT-streams cannot be decoded from an input stream\n");
+			break;
+		case CODEC_UNKNOWN:
+		default:
+			break;
+	}
+	return NULL;
+}
+
 opj_image_t* OPJ_CALLCONV opj_decode_with_info(opj_dinfo_t *dinfo, opj_cio_t *cio, opj_codestream_info_t *cstr_info) {
+	if(dinfo && cio && cio->read_fn) {
+		return opj_decode_input(dinfo, cio, cstr_info);
+	}
 	if(dinfo && cio) {
 		switch(dinfo->codec_format) {
 			case CODEC_J2K:
@@ -176,6 +239,122 @@ opj_image_t* OPJ_CALLCONV opj_decode_with_info(opj_dinfo_t *dinfo, opj_cio_t *ci
 	return NULL;
 }
 
+opj_bool OPJ_CALLCONV opj_set_decode_area(opj_dinfo_t *dinfo, int x0, int y0, int x1, int y1) {
+	if(dinfo) {
+		switch(dinfo->codec_format) {
+			case CODEC_J2K:
+			case CODEC_JPT:
+				return j2k_set_decode_area((opj_j2k_t*)dinfo->j2k_handle, x0, y0, x1, y1);
+			case CODEC_JP2:
+				return j2k_set_decode_area(((opj_jp2_t*)dinfo->jp2_handle)->j2k, x0, y0, x1, y1);
+			case CODEC_UNKNOWN:
+			default:
+				break;
+		}
+	}
+	return OPJ_FALSE;
+}
+
+opj_bool OPJ_CALLCONV opj_set_decode_arena(opj_dinfo_t *dinfo, opj_arena_t *arena) {
+	if(dinfo) {
+		switch(dinfo->codec_format) {
+			case CODEC_J2K:
+			case CODEC_JPT:
+				return j2k_set_decode_arena((opj_j2k_t*)dinfo->j2k_handle, arena);
+			case CODEC_JP2:
+				return j2k_set_decode_arena(((opj_jp2_t*)dinfo->jp2_handle)->j2k, arena);
+			case CODEC_UNKNOWN:
+			default:
+				break;
+		}
+	}
+	return OPJ_FALSE;
+}
+
+opj_bool OPJ_CALLCONV opj_set_decode_output(opj_dinfo_t *dinfo, const opj_output_buffer_t *output) {
+	if(dinfo) {
+		switch(dinfo->codec_format) {
+			case CODEC_J2K:
+			case CODEC_JPT:
+				return j2k_set_decode_output((opj_j2k_t*)dinfo->j2k_handle, output);
+			case CODEC_JP2:
+				return j2k_set_decode_output(((opj_jp2_t*)dinfo->jp2_handle)->j2k, output);
+			case CODEC_UNKNOWN:
+			default:
+				break;
+		}
+	}
+	return OPJ_FALSE;
+}
+
+opj_bool OPJ_CALLCONV opj_decoder_reset(opj_dinfo_t *dinfo) {
+	if(dinfo) {
+		switch(dinfo->codec_format) {
+			case CODEC_J2K:
+			case CODEC_JPT:
+				j2k_decoder_reset((opj_j2k_t*)dinfo->j2k_handle);
+				return OPJ_TRUE;
+			case CODEC_JP2:
+				jp2_decoder_reset((opj_jp2_t*)dinfo->jp2_handle);
+				return OPJ_TRUE;
+			case CODEC_UNKNOWN:
+			default:
+				break;
+		}
+	}
+	return OPJ_FALSE;
+}
+
+opj_bool OPJ_CALLCONV opj_decoder_feed(opj_dinfo_t *dinfo, unsigned char *data, int len) {
+	if(dinfo) {
+		switch(dinfo->codec_format) {
+			case CODEC_J2K:
+				return j2k_decoder_feed((opj_j2k_t*)dinfo->j2k_handle, data, len);
+			case CODEC_JPT:
+			case CODEC_JP2:
+				opj_event_msg((opj_common_ptr)dinfo, EVT_ERROR, "Incremental decoding is only available for J2K codestreams\n");
+				break;
+			case CODEC_UNKNOWN:
+			default:
+				break;
+		}
+	}
+	return OPJ_FALSE;
+}
+
+OPJ_DECODER_STATUS OPJ_CALLCONV opj_decoder_poll(opj_dinfo_t *dinfo, opj_image_t **image) {
+	if(dinfo && image) {
+		switch(dinfo->codec_format) {
+			case CODEC_J2K:
+				return j2k_decoder_poll((opj_j2k_t*)dinfo->j2k_handle, image);
+			case CODEC_JPT:
+			case CODEC_JP2:
+			case CODEC_UNKNOWN:
+			default:
+				break;
+		}
+	}
+	return DECODER_ERROR;
+}
+
+opj_bool OPJ_CALLCONV opj_plan_byte_range(opj_dinfo_t *dinfo, unsigned char *buffer, int length, int reduce, int layers, opj_byte_range_t *range) {
+	if(dinfo && buffer && range) {
+		switch(dinfo->codec_format) {
+			case CODEC_J2K:
+				return j2k_plan_byte_range((opj_j2k_t*)dinfo->j2k_handle, buffer, length, reduce, layers, range);
+			case CODEC_JP2:
+				return jp2_plan_byte_range((opj_jp2_t*)dinfo->jp2_handle, buffer, length, reduce, layers, range);
+			case CODEC_JPT:
+				opj_event_msg((opj_common_ptr)dinfo, EVT_ERROR, "Byte range planning is only available for J2K codestreams and JP2 files\n");
+				break;
+			case CODEC_UNKNOWN:
+			default:
+				break;
+		}
+	}
+	return OPJ_FALSE;
+}
+
 opj_cinfo_t* OPJ_CALLCONV opj_create_compress(OPJ_CODEC_FORMAT format) {
 	opj_cinfo_t *cinfo = (opj_cinfo_t*)opj_calloc(1, sizeof(opj_cinfo_t));
 	if(!cinfo) return NULL;
@@ -252,6 +431,7 @@ void OPJ_CALLCONV opj_set_default_encoder_parameters(opj_cparameters_t *paramete
 		parameters->cp_fixed_alloc = 0;
 		parameters->cp_fixed_quality = 0;
 		parameters->jpip_on = OPJ_FALSE;
+		parameters->num_threads = 0;
 /* UniPG>> */
 #ifdef USE_JPWL
 		parameters->jpwl_epc_on = OPJ_FALSE;
@@ -312,13 +492,19 @@ opj_bool OPJ_CALLCONV opj_encode(opj_cinfo_t *cinfo, opj_cio_t *cio, opj_image_t
 	return opj_encode_with_info(cinfo, cio, image, NULL);
 }
 
+/* the end of the file is still in the buffer of an output stream, with the bytes held so far */
+static opj_bool opj_encode_finish(opj_cio_t *cio) {
+	cio_hold(cio, -1);
+	return cio_flush(cio);
+}
+
 opj_bool OPJ_CALLCONV opj_encode_with_info(opj_cinfo_t *cinfo, opj_cio_t *cio, opj_image_t *image, opj_codestream_info_t *cstr_info) {
 	if(cinfo && cio && image) {
 		switch(cinfo->codec_format) {
 			case CODEC_J2K:
-				return j2k_encode((opj_j2k_t*)cinfo->j2k_handle, cio, image, cstr_info);
+				return j2k_encode((opj_j2k_t*)cinfo->j2k_handle, cio, image, cstr_info) && opj_encode_finish(cio);
 			case CODEC_JP2:
-				return opj_jp2_encode((opj_jp2_t*)cinfo->jp2_handle, cio, image, cstr_info);	    
+				return opj_jp2_encode((opj_jp2_t*)cinfo->jp2_handle, cio, image, cstr_info) && opj_encode_finish(cio);
 			case CODEC_JPT:
 			case CODEC_UNKNOWN:
 			default:
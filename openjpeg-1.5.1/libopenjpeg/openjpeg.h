@@ -159,6 +159,26 @@ typedef enum LIMIT_DECODING {
 	DECODE_ALL_BUT_PACKETS = 2	/**< Decode everything except the JPEG 2000 packets */
 } OPJ_LIMIT_DECODING;
 
+/**
+Progress of the incremental decoder (see opj_decoder_poll)
+*/
+typedef enum DECODER_STATUS {
+	DECODER_ERROR = -1,			/**< The codestream could not be decoded */
+	DECODER_NEED_DATA = 0,		/**< All the data fed so far has been used: call opj_decoder_feed */
+	DECODER_TILE_DECODED = 1,	/**< A tile has been decoded into the image */
+	DECODER_DONE = 2			/**< The whole image has been decoded */
+} OPJ_DECODER_STATUS;
+
+/**
+Pixel formats of an output buffer (see opj_set_decode_output)
+*/
+typedef enum PIXEL_FORMAT {
+	OPJ_PIXFMT_L8 = 0,		/**< 8 bits per pixel: component 0 */
+	OPJ_PIXFMT_RGB8 = 1,	/**< 3 bytes per pixel: components 0, 1 and 2, or component 0 three times for a grayscale image */
+	OPJ_PIXFMT_RGBA8 = 2,	/**< 4 bytes per pixel: OPJ_PIXFMT_RGB8 followed by the alpha component (component 3, or 1 for a grayscale image), 255 when there is none */
+	OPJ_PIXFMT_PLANAR16 = 3	/**< one plane of 16-bit samples per component, with the sign and range of the component */
+} OPJ_PIXEL_FORMAT;
+
 /* 
 ==========================================================
    event manager typedef definitions
@@ -354,9 +374,25 @@ typedef struct opj_cparameters {
 	char tcp_mct;
 	/** Enable JPIP indexing*/
 	opj_bool jpip_on;
+	/**
+	Number of worker threads used to encode the code-blocks of each tile.
+	The codestream is the same whatever the number of threads.
+	if <= 1, encoding is done in the calling thread
+	*/
+	int num_threads;
 } opj_cparameters_t;
 
 #define OPJ_DPARAMETERS_IGNORE_PCLR_CMAP_CDEF_FLAG	0x0001
+/**
+Decode a codestream that may be truncated, like a partially downloaded one, at the highest
+resolution it holds completely: the precincts of the resolutions kept have all received their
+packet of the first quality layer, in every component. The packets are decoded up to the last
+complete one, the tiles without data stay black, and opj_decode returns the image rather than
+failing. The factor of the image components then gives the resolution decoded, never finer than
+cp_reduce asks, and their resno_decoded the highest complete one (-1 if none), in all the tiles.
+The first tile decoded sets the resolution of the image: the next ones are decoded at it.
+*/
+#define OPJ_DPARAMETERS_TRUNCATED_FLAG	0x0002
 
 /**
 Decompression parameters
@@ -411,6 +447,25 @@ typedef struct opj_dparameters {
 	OPJ_LIMIT_DECODING cp_limit_decoding;
 
 	unsigned int flags;
+
+	/**
+	Number of worker threads used for decoding.
+	Tiles are decoded concurrently when the codestream has several tiles,
+	otherwise the code-blocks of the tile are. Event callbacks may then be
+	called from the worker threads.
+	if <= 1, decoding is done in the calling thread
+	*/
+	int num_threads;
+
+	/**
+	Set the maximum number of coding passes decoded in each code-block, counted from its
+	most significant bit-plane. A bit-plane takes three passes, except the first one which
+	takes one: 3 * n - 2 passes decode the n most significant bit-planes.
+	Like cp_layer, this trades quality for speed, but whatever the layers of the codestream.
+	if != 0, then only the first "max_passes" passes of each code-block are decoded;
+	if == 0 or not used, all the passes of the decoded quality layers are decoded
+	*/
+	int cp_max_passes;
 } opj_dparameters_t;
 
 /** Common fields between JPEG-2000 compression and decompression master structs. */
@@ -456,6 +511,29 @@ typedef struct opj_dinfo {
 	/* other specific fields go here */
 } opj_dinfo_t;
 
+/**
+Memory arena holding the per-tile structures of a decompressor (see opj_set_decode_arena)
+*/
+typedef struct opj_arena opj_arena_t;
+
+/**
+Buffer of the caller into which the decoder stores the pixels of the image (see opj_set_decode_output)
+*/
+typedef struct opj_output_buffer {
+	/** layout of the pixels */
+	OPJ_PIXEL_FORMAT format;
+	/** first pixel of the buffer, holding the top-left pixel of the decoded image */
+	unsigned char *data;
+	/** number of pixels in a row of the buffer */
+	int w;
+	/** number of rows of the buffer */
+	int h;
+	/** distance in bytes between the starts of two rows */
+	int stride;
+	/** distance in bytes between the starts of two planes, only used by OPJ_PIXFMT_PLANAR16 */
+	int plane_stride;
+} opj_output_buffer_t;
+
 /* 
 ==========================================================
    I/O stream typedef definitions
@@ -470,6 +548,37 @@ typedef struct opj_dinfo {
 /** The stream was opened for writing. */
 #define OPJ_STREAM_WRITE 0x0002
 
+/**
+Callback function prototype writing the bytes of an output stream (see opj_cio_open_output)
+@param buffer Next bytes of the output
+@param length Number of bytes in buffer
+@param user_data User data given to opj_cio_open_output
+@return Returns the number of bytes written: anything else than length is a write error
+*/
+typedef int (*opj_stream_write_fn) (const unsigned char *buffer, int length, void *user_data);
+/**
+Callback function prototype moving the position of an output stream (see opj_cio_open_output)
+@param pos New position, in number of bytes from the position of the output when the stream was opened
+@param user_data User data given to opj_cio_open_output
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+typedef opj_bool (*opj_stream_seek_fn) (int pos, void *user_data);
+/**
+Callback function prototype reading the next bytes of an input stream (see opj_cio_open_input)
+@param buffer Buffer receiving the bytes
+@param length Number of bytes wanted
+@param user_data User data given to opj_cio_open_input
+@return Returns the number of bytes read, 0 at the end of the input, -1 on a read error
+*/
+typedef int (*opj_stream_read_fn) (unsigned char *buffer, int length, void *user_data);
+/**
+Callback function prototype skipping the next bytes of an input stream (see opj_cio_open_input)
+@param n Number of bytes to skip
+@param user_data User data given to opj_cio_open_input
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+typedef opj_bool (*opj_stream_skip_fn) (int n, void *user_data);
+
 /**
 Byte input-output stream (CIO)
 */
@@ -484,10 +593,32 @@ typedef struct opj_cio {
 	unsigned char *end;
 	/** pointer to the current position */
 	unsigned char *bp;
-	/** buffer size in bytes */
+	/** buffer size in bytes. Writing: size of the whole stream, of which the buffer holds a part */
 	int length;
 	/** open mode (read/write) either OPJ_STREAM_READ or OPJ_STREAM_WRITE */
 	int openmode;
+	/** position in the stream of the start of the buffer: the bytes before it have been written out */
+	int offset;
+	/** end of the bytes of the buffer written so far */
+	unsigned char *top;
+	/** end of the bytes written out to the output, as a position in the stream */
+	int written;
+	/** position of the first byte that cio_flush keeps in the buffer, -1 if none */
+	int hold;
+	/** output of the stream, NULL when the stream is written to memory */
+	opj_stream_write_fn write_fn;
+	/** seek function of the output, NULL if the output can only be appended to */
+	opj_stream_seek_fn seek_fn;
+	/** input of the stream, NULL when the stream is read from memory */
+	opj_stream_read_fn read_fn;
+	/** skip function of the input, NULL to skip with seek_fn or by reading */
+	opj_stream_skip_fn skip_fn;
+	/** user data given to the callbacks */
+	void *user_data;
+	/** function freeing user_data when the stream is closed, NULL if the caller owns it */
+	void (*release_fn) (void *user_data);
+	/** OPJ_TRUE once writing to the output has failed */
+	opj_bool failed;
 } opj_cio_t;
 
 /* 
@@ -717,6 +848,100 @@ typedef struct opj_codestream_info {
 	int codestream_size;
 } opj_codestream_info_t;
 
+/*
+==========================================================
+   header probe definitions
+==========================================================
+*/
+
+#define OPJ_HEADER_MAXCOMPS 4	/**< Number of components described by opj_header_info_t */
+
+/**
+Description of a component, read from the SIZ marker
+*/
+typedef struct opj_header_comp {
+	/** XRsiz: horizontal separation of a sample of the component with respect to the reference grid */
+	int dx;
+	/** YRsiz: vertical separation of a sample of the component with respect to the reference grid */
+	int dy;
+	/** precision */
+	int prec;
+	/** signed (1) / unsigned (0) */
+	int sgnd;
+} opj_header_comp_t;
+
+/**
+Main header of a J2K codestream or a JP2 file, read by opj_read_header_info
+*/
+typedef struct opj_header_info {
+	/** CODEC_J2K or CODEC_JP2 */
+	OPJ_CODEC_FORMAT codec_format;
+	/** XOsiz: horizontal offset from the origin of the reference grid to the left side of the image area */
+	int x0;
+	/** YOsiz: vertical offset from the origin of the reference grid to the top side of the image area */
+	int y0;
+	/** Xsiz: width of the reference grid */
+	int x1;
+	/** Ysiz: height of the reference grid */
+	int y1;
+	/** XTOsiz: horizontal offset of the first tile */
+	int tx0;
+	/** YTOsiz: vertical offset of the first tile */
+	int ty0;
+	/** XTsiz: width of a tile */
+	int tdx;
+	/** YTsiz: height of a tile */
+	int tdy;
+	/** number of tiles in width */
+	int tw;
+	/** number of tiles in height */
+	int th;
+	/** number of components */
+	int numcomps;
+	/** description of the first OPJ_HEADER_MAXCOMPS components */
+	opj_header_comp_t comps[OPJ_HEADER_MAXCOMPS];
+	/** smallest number of resolutions of the components (COD and COC of the main header), cp_reduce must be below it */
+	int numresolutions;
+	/** number of quality layers */
+	int numlayers;
+	/** progression order */
+	OPJ_PROG_ORDER prog_order;
+	/** multi-component transform */
+	int mct;
+	/** width of the code-blocks */
+	int cblockw;
+	/** height of the code-blocks */
+	int cblockh;
+	/** mode switches of the code-blocks (see the mode field of opj_cparameters_t) */
+	int mode;
+	/** 1 for the 9-7 wavelet transform, 0 for the reversible 5-3 one */
+	int irreversible;
+	/** quantization style */
+	int qntsty;
+	/** number of guard bits */
+	int numgbits;
+	/** colour space of the colr box of a JP2 file, CLRSPC_UNSPECIFIED for a J2K codestream */
+	OPJ_COLOR_SPACE color_space;
+	/** position of the codestream in the buffer, 0 for a J2K codestream */
+	int codestream_start;
+	/** position of the first SOT marker in the buffer, 0 if the buffer ends before */
+	int main_head_end;
+} opj_header_info_t;
+
+/**
+Part of a codestream needed to decode some resolutions and quality layers (see opj_plan_byte_range)
+*/
+typedef struct opj_byte_range {
+	/** number of bytes from the start of the buffer after which the requested data is complete, 0 if it is not known */
+	int end;
+	/** OPJ_TRUE if end is the end of the last packet needed, located with the PLT markers, 
+	OPJ_FALSE if it is rounded up to the end of a tile-part */
+	opj_bool exact;
+	/** position of the first tile-part header missing from the buffer, 0 if none was needed. 
+	Fetching the bytes from there lets the planning find end, or make it exact */
+	int missing;
+} opj_byte_range_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -751,6 +976,25 @@ Deallocate any resources associated with an image
 */
 OPJ_API void OPJ_CALLCONV opj_image_destroy(opj_image_t *image);
 
+/* 
+==========================================================
+   header probe functions definitions
+==========================================================
+*/
+
+/**
+Read the description of an image from the start of a J2K codestream or a JP2 file, 
+without creating a decompressor or an image. Only the SIZ, COD, COC and QCD markers 
+of the main header and the ihdr and colr boxes of a JP2 file are read. The buffer may 
+end before the first tile, as long as it holds the SIZ, COD and QCD markers: main_head_end 
+is then 0, and the COC markers that are cut off are not taken into account.
+@param buffer Start of the codestream or of the file
+@param length Number of bytes in buffer
+@param info Filled with the description of the image
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE if the format is unknown or the header is invalid or incomplete
+*/
+OPJ_API opj_bool OPJ_CALLCONV opj_read_header_info(const unsigned char *buffer, int length, opj_header_info_t *info);
+
 /* 
 ==========================================================
    stream functions definitions
@@ -762,13 +1006,77 @@ Open and allocate a memory stream for read / write.
 On reading, the user must provide a buffer containing encoded data. The buffer will be 
 wrapped by the returned CIO handle. 
 On writing, buffer parameters must be set to 0: a buffer will be allocated by the library 
-to contain encoded data. 
+to contain encoded data. The buffer grows with the codestream, up to 1.3 times the size of 
+the image and 2000 bytes, so the compressor must be set up with opj_setup_encoder first. 
+Once the image is encoded, the codestream is in buffer and its length is given by cio_tell. 
 @param cinfo Codec context info
 @param buffer Reading: buffer address. Writing: NULL
 @param length Reading: buffer length. Writing: 0
 @return Returns a CIO handle if successful, returns NULL otherwise
 */
 OPJ_API opj_cio_t* OPJ_CALLCONV opj_cio_open(opj_common_ptr cinfo, unsigned char *buffer, int length);
+/**
+Open a stream writing the encoded image to an output of the caller. 
+The encoder writes the tile-parts to the output as they are finished, so that only one tile 
+of the codestream is held in memory. The size of the codestream is limited as with opj_cio_open, 
+so the compressor must be set up with opj_setup_encoder first. 
+Some lengths are written once what they measure is known: with a seek function, the encoder 
+goes back to write them in the output, otherwise it keeps the bytes that follow them in memory. 
+Without a seek function, a JP2 file is held in memory up to its end. The index boxes of JPIP 
+read the main header again and keep the whole file in memory, as does JPWL, which protects 
+the codestream once it is encoded. 
+The output is complete once opj_encode returns. 
+@param cinfo Compressor handle, set up with opj_setup_encoder
+@param write_fn Function writing the bytes of the codestream to the output
+@param seek_fn Function moving the position of the output, NULL if the output can only be appended to
+@param user_data Argument given to write_fn and seek_fn
+@return Returns a CIO handle if successful, returns NULL otherwise
+*/
+OPJ_API opj_cio_t* OPJ_CALLCONV opj_cio_open_output(opj_common_ptr cinfo, opj_stream_write_fn write_fn, opj_stream_seek_fn seek_fn, void *user_data);
+/**
+Open a stream writing the encoded image to a file descriptor, from its current position on 
+(see opj_cio_open_output). The encoder seeks in the file if the descriptor allows it. 
+The descriptor is not closed by opj_cio_close. 
+@param cinfo Compressor handle, set up with opj_setup_encoder
+@param fd File descriptor open for writing
+@return Returns a CIO handle if successful, returns NULL otherwise
+*/
+OPJ_API opj_cio_t* OPJ_CALLCONV opj_cio_open_fd(opj_common_ptr cinfo, int fd);
+/**
+Open a stream reading the codestream or JP2 file to decode from an input of the caller. 
+The decoder reads the input as it goes and only keeps the tile-parts it has not decoded yet, 
+so that the file is never held in memory as a whole. The tile-parts of the tiles outside the 
+decode area (see opj_set_decode_area) are skipped without being read. 
+Such a stream can be given to opj_decode, but not to opj_decode_with_info, 
+and JPT-streams cannot be read from it. 
+@param cinfo Decompressor handle
+@param read_fn Function reading the next bytes of the input
+@param skip_fn Function skipping bytes of the input, NULL to skip with seek_fn
+@param seek_fn Function moving the position of the input, NULL to skip bytes by reading them
+@param user_data Argument given to read_fn, skip_fn and seek_fn
+@return Returns a CIO handle if successful, returns NULL otherwise
+*/
+OPJ_API opj_cio_t* OPJ_CALLCONV opj_cio_open_input(opj_common_ptr cinfo, opj_stream_read_fn read_fn, opj_stream_skip_fn skip_fn, opj_stream_seek_fn seek_fn, void *user_data);
+/**
+Open a stream reading the image to decode from a file descriptor, from its current position on 
+(see opj_cio_open_input). The descriptor is not closed by opj_cio_close. 
+@param cinfo Decompressor handle
+@param fd File descriptor open for reading
+@return Returns a CIO handle if successful, returns NULL otherwise
+*/
+OPJ_API opj_cio_t* OPJ_CALLCONV opj_cio_open_input_fd(opj_common_ptr cinfo, int fd);
+/**
+Open a stream reading the image to decode from a file mapped in memory. The stream is read 
+like a buffer given to opj_cio_open, but the pages of the file are only loaded when the decoder 
+reads them: as the decoder refers to the tile-parts in the stream instead of copying them, 
+the data of the tiles outside the decode area is not read. Unlike opj_cio_open_input, such a 
+stream can be used for any decoding. The file is unmapped by opj_cio_close, and the 
+descriptor may be closed once the stream is open. 
+@param cinfo Decompressor handle
+@param fd File descriptor of a regular file open for reading
+@return Returns a CIO handle if successful, returns NULL if the file cannot be mapped
+*/
+OPJ_API opj_cio_t* OPJ_CALLCONV opj_cio_open_mmap(opj_common_ptr cinfo, int fd);
 
 /**
 Close and free a CIO handle
@@ -819,6 +1127,22 @@ Set decoding parameters to default values
 */
 OPJ_API void OPJ_CALLCONV opj_set_default_decoder_parameters(opj_dparameters_t *parameters);
 /**
+Set the decoding parameters of a fast preview, on top of the current parameters.
+The level combines a resolution reduction (cp_reduce), a number of quality layers
+(cp_layer) and a number of coding passes per code-block (cp_max_passes):
+<ul>
+<li>1: full resolution, the 6 most significant bit-planes of the first 2 layers
+<li>2: half resolution, the 4 most significant bit-planes of the first layer
+<li>3: quarter resolution, the 3 most significant bit-planes of the first layer
+</ul>
+The pass cap bounds the decoding time of single layer codestreams, the layer cap
+that of codestreams with several quality layers.
+A level <= 0 leaves the parameters unchanged.
+@param parameters Decompression parameters
+@param level Preview level, from 1 (best quality) to 3 (fastest)
+*/
+OPJ_API void OPJ_CALLCONV opj_set_preview_decoder_parameters(opj_dparameters_t *parameters, int level);
+/**
 Setup the decoder decoding parameters using user parameters.
 Decoding parameters are returned in j2k->cp. 
 @param dinfo decompressor handle
@@ -828,7 +1152,7 @@ OPJ_API void OPJ_CALLCONV opj_setup_decoder(opj_dinfo_t *dinfo, opj_dparameters_
 /**
 Decode an image from a JPEG-2000 codestream 
 @param dinfo decompressor handle
-@param cio Input buffer stream
+@param cio Input buffer stream, or input stream opened with opj_cio_open_input
 @return Returns a decoded image if successful, returns NULL otherwise
 */
 OPJ_API opj_image_t* OPJ_CALLCONV opj_decode(opj_dinfo_t *dinfo, opj_cio_t *cio);
@@ -842,6 +1166,121 @@ Decode an image from a JPEG-2000 codestream and extract the codestream informati
 */
 OPJ_API opj_image_t* OPJ_CALLCONV opj_decode_with_info(opj_dinfo_t *dinfo, opj_cio_t *cio, opj_codestream_info_t *cstr_info);
 /**
+Restrict the decoding to a window of the image. 
+Only the tiles, precincts and code-blocks that contribute to the window (through the 
+support of the wavelet filters) are decoded, and the components of the decoded image 
+only cover the window: their x0, y0, w and h describe the part of the image that was decoded. 
+Must be called after opj_setup_decoder and before opj_decode or opj_decoder_feed. 
+@param dinfo decompressor handle
+@param x0 Left border of the window, on the reference grid
+@param y0 Top border of the window, on the reference grid
+@param x1 Right border (excluded) of the window, on the reference grid
+@param y1 Bottom border (excluded) of the window, on the reference grid
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+OPJ_API opj_bool OPJ_CALLCONV opj_set_decode_area(opj_dinfo_t *dinfo, int x0, int y0, int x1, int y1);
+/**
+Create a memory arena for opj_set_decode_arena
+@return Returns a new arena if successful, returns NULL otherwise
+*/
+OPJ_API opj_arena_t* OPJ_CALLCONV opj_arena_create(void);
+/**
+Destroy a memory arena and free its memory. 
+The decompressors the arena was given to must have been destroyed before.
+@param arena Arena to destroy
+*/
+OPJ_API void OPJ_CALLCONV opj_arena_destroy(opj_arena_t *arena);
+/**
+Allocate the per-tile structures of the decoder (resolutions, precincts, code-blocks, 
+tag-trees and code-block data) from an arena supplied by the caller. 
+The arena is reset after each tile and keeps its memory, so the same arena given 
+to successive decompressors saves most of the allocations of each decode. 
+It must not be used by two decompressors at the same time. When tiles are decoded 
+concurrently (see opj_dparameters_t::num_threads), the tiles in flight get arenas of their own. 
+Without this call, each decode uses an arena of its own. 
+Must be called after opj_setup_decoder and before opj_decode or opj_decoder_feed. 
+@param dinfo decompressor handle
+@param arena Arena created with opj_arena_create, NULL to go back to a private arena
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+OPJ_API opj_bool OPJ_CALLCONV opj_set_decode_arena(opj_dinfo_t *dinfo, opj_arena_t *arena);
+/**
+Store the decoded pixels straight into a buffer of the caller instead of the components
+of the image. Each tile is written to the buffer as soon as it is decoded, clamped to the
+range of its component, and the components of the returned image keep their description
+but have no data. For the 8-bit formats, signed samples are made unsigned by adding
+2^(prec-1) and precisions other than 8 bits are rescaled to 8 bits.
+The components written must all have the size of component 0, which must fit in the buffer:
+its size can be found by decoding the main header first (see OPJ_LIMIT_DECODING) and calling
+opj_decoder_reset. The parts of the buffer not covered by a decoded tile are left untouched.
+Colour boxes of JP2 files are not applied to the buffer, and images with a palette are refused.
+Must be called after opj_setup_decoder and before opj_decode or opj_decoder_feed.
+@param dinfo decompressor handle
+@param output Description of the buffer, copied by the decompressor. NULL to decode into the image again
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+OPJ_API opj_bool OPJ_CALLCONV opj_set_decode_output(opj_dinfo_t *dinfo, const opj_output_buffer_t *output);
+/**
+Prepare a decompressor to decode another image, instead of destroying it and creating 
+a new one. The parameters given to opj_setup_decoder, opj_set_decode_area, opj_set_decode_output and 
+opj_set_decode_arena are kept, and so are the buffers of the decoder: the tier-1 coders, 
+worker threads, tile structures and packet iterators are reused, and the arrays 
+sized by the tiles and components of the image are only reallocated when the next image 
+has another geometry. The images returned by the previous decodes belong to the caller, 
+and an unfinished incremental decode (see opj_decoder_feed) is abandoned. 
+@param dinfo decompressor handle, set up with opj_setup_decoder
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+OPJ_API opj_bool OPJ_CALLCONV opj_decoder_reset(opj_dinfo_t *dinfo);
+/**
+Append a chunk of a J2K codestream to the incremental decoder. 
+The bytes are copied, so the chunk may be reused as soon as the function returns. 
+Nothing is decoded here: call opj_decoder_poll to make progress. 
+@param dinfo J2K decompressor handle, set up with opj_setup_decoder
+@param data Next bytes of the codestream, NULL to signal the end of the codestream
+@param len Number of bytes in data, 0 to signal the end of the codestream
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+OPJ_API opj_bool OPJ_CALLCONV opj_decoder_feed(opj_dinfo_t *dinfo, unsigned char *data, int len);
+/**
+Decode as much as possible of the data given to opj_decoder_feed. 
+Each tile is decoded as soon as its last tile-part has been received, so that 
+decoding overlaps with the transfer of the codestream. The tile-parts of the tiles 
+outside the decode area are dropped as they are fed. The function returns 
+after each decoded tile, so it is usually called in a loop until it returns 
+DECODER_NEED_DATA or DECODER_DONE. 
+@param dinfo J2K decompressor handle
+@param image Set to the image being decoded. The image belongs to the decompressor until DECODER_DONE is returned: from then on 
+the caller must free it with opj_image_destroy.
+@return Returns the progress of the decoder (see OPJ_DECODER_STATUS)
+*/
+OPJ_API OPJ_DECODER_STATUS OPJ_CALLCONV opj_decoder_poll(opj_dinfo_t *dinfo, opj_image_t **image);
+/**
+Find how many bytes of a codestream are needed to decode it with a reduce factor and a number 
+of quality layers, without decoding it, to fetch exactly these bytes of a remote file. 
+The buffer holds the start of the J2K codestream or JP2 file, at least up to the QCD marker 
+of the main header (see opj_read_header_info). The coding parameters are read from the main 
+header and from the tile-part headers present in the buffer, and the packets needed are 
+located with the PLT markers of the tile-parts. A tile-part whose header is not in the buffer 
+is skipped with the TLM markers of the main header, if any. Without PLT markers, the data 
+needed in a tile ends with its last tile-part. PLM markers are not used.
+The result is:
+<ul>
+<li>end != 0: the first end bytes of the buffer are enough, exactly if range->exact is set
+<li>end == 0 and missing != 0: the headers in the buffer are not enough, more bytes are needed from missing on
+<li>end == 0 and missing == 0: the whole codestream is needed (its last tile-part has no length)
+</ul>
+The decompressor is reset as by opj_decoder_reset before and after the planning.
+@param dinfo J2K or JP2 decompressor handle, set up with opj_setup_decoder
+@param buffer Start of the codestream or of the file
+@param length Number of bytes in buffer
+@param reduce Number of highest resolution levels to discard (see cp_reduce)
+@param layers Number of quality layers to decode, 0 for all (see cp_layer)
+@param range Filled with the result
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE if the headers are invalid or the reduce factor too high
+*/
+OPJ_API opj_bool OPJ_CALLCONV opj_plan_byte_range(opj_dinfo_t *dinfo, unsigned char *buffer, int length, int reduce, int layers, opj_byte_range_t *range);
+/**
 Creates a J2K/JP2 compression structure
 @param format Coder to select
 @return Returns a handle to a compressor if successful, returns NULL otherwise
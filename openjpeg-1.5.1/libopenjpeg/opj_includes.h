@@ -67,7 +67,7 @@ Most compilers implement their own version of this keyword ...
 	#if defined(_MSC_VER)
 		#define INLINE __forceinline
 	#elif defined(__GNUC__)
-		#define INLINE __inline__
+		#define INLINE __inline__ __attribute__((always_inline))
 	#elif defined(__MWERKS__)
 		#define INLINE inline
 	#else 
@@ -118,7 +118,10 @@ static INLINE long lrintf(float f){
 #include "mqc.h"
 #include "raw.h"
 #include "bio.h"
+#include "arena.h"
 #include "tgt.h"
+#include "thread.h"
+#include "cpu.h"
 #include "pi.h"
 #include "tcd.h"
 #include "t1.h"
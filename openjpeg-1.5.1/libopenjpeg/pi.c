@@ -70,6 +70,14 @@ Get next packet in component-precinct-resolution-layer order.
 @return returns false if pi pointed to the last packet or else returns true 
 */
 static opj_bool pi_next_cprl(opj_pi_iterator_t * pi);
+/**
+Allocate zero-initialized memory for the decoder packet iterator
+@param arena Arena to allocate from, NULL to allocate from the heap
+@param num Number of elements
+@param size Size of an element
+@return Returns a pointer to the memory if successful, returns NULL otherwise
+*/
+static void* pi_calloc(opj_arena_t *arena, size_t num, size_t size);
 
 /*@}*/
 
@@ -403,13 +411,17 @@ LABEL_SKIP:;
 	return OPJ_FALSE;
 }
 
+static void* pi_calloc(opj_arena_t *arena, size_t num, size_t size) {
+	return arena ? opj_arena_calloc(arena, num, size) : opj_calloc(num, size);
+}
+
 /* 
 ==========================================================
    Packet iterator interface
 ==========================================================
 */
 
-opj_pi_iterator_t *pi_create_decode(opj_image_t *image, opj_cp_t *cp, int tileno) {
+opj_pi_iterator_t *pi_create_decode(opj_image_t *image, opj_cp_t *cp, int tileno, opj_arena_t *arena) {
 	int p, q;
 	int compno, resno, pino;
 	opj_pi_iterator_t *pi = NULL;
@@ -418,7 +430,7 @@ opj_pi_iterator_t *pi_create_decode(opj_image_t *image, opj_cp_t *cp, int tileno
 
 	tcp = &cp->tcps[tileno];
 
-	pi = (opj_pi_iterator_t*) opj_calloc((tcp->numpocs + 1), sizeof(opj_pi_iterator_t));
+	pi = (opj_pi_iterator_t*) pi_calloc(arena, (tcp->numpocs + 1), sizeof(opj_pi_iterator_t));
 	if(!pi) {
 		/* TODO: throw an error */
 		return NULL;
@@ -436,10 +448,12 @@ opj_pi_iterator_t *pi_create_decode(opj_image_t *image, opj_cp_t *cp, int tileno
 		pi[pino].ty1 = int_min(cp->ty0 + (q + 1) * cp->tdy, image->y1);
 		pi[pino].numcomps = image->numcomps;
 
-		pi[pino].comps = (opj_pi_comp_t*) opj_calloc(image->numcomps, sizeof(opj_pi_comp_t));
+		pi[pino].comps = (opj_pi_comp_t*) pi_calloc(arena, image->numcomps, sizeof(opj_pi_comp_t));
 		if(!pi[pino].comps) {
 			/* TODO: throw an error */
-			pi_destroy(pi, cp, tileno);
+			if (!arena) {
+				pi_destroy(pi, cp, tileno);
+			}
 			return NULL;
 		}
 		
@@ -451,10 +465,12 @@ opj_pi_iterator_t *pi_create_decode(opj_image_t *image, opj_cp_t *cp, int tileno
 			comp->dy = image->comps[compno].dy;
 			comp->numresolutions = tccp->numresolutions;
 
-			comp->resolutions = (opj_pi_resolution_t*) opj_calloc(comp->numresolutions, sizeof(opj_pi_resolution_t));
+			comp->resolutions = (opj_pi_resolution_t*) pi_calloc(arena, comp->numresolutions, sizeof(opj_pi_resolution_t));
 			if(!comp->resolutions) {
 				/* TODO: throw an error */
-				pi_destroy(pi, cp, tileno);
+				if (!arena) {
+					pi_destroy(pi, cp, tileno);
+				}
 				return NULL;
 			}
 
@@ -504,10 +520,12 @@ opj_pi_iterator_t *pi_create_decode(opj_image_t *image, opj_cp_t *cp, int tileno
 		pi[pino].step_l = maxres * pi[pino].step_r;
 		
 		if (pino == 0) {
-			pi[pino].include = (short int*) opj_calloc(image->numcomps * maxres * tcp->numlayers * maxprec, sizeof(short int));
+			pi[pino].include = (short int*) pi_calloc(arena, image->numcomps * maxres * tcp->numlayers * maxprec, sizeof(short int));
 			if(!pi[pino].include) {
 				/* TODO: throw an error */
-				pi_destroy(pi, cp, tileno);
+				if (!arena) {
+					pi_destroy(pi, cp, tileno);
+				}
 				return NULL;
 			}
 		}
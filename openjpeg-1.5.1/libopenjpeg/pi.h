@@ -128,10 +128,11 @@ Create a packet iterator for Decoder
 @param image Raw image for which the packets will be listed
 @param cp Coding parameters
 @param tileno Number that identifies the tile for which to list the packets
+@param arena Arena to allocate the iterator from, or NULL to allocate it from the heap
 @return Returns a packet iterator that points to the first packet of the tile
-@see pi_destroy
+@see pi_destroy (only for an iterator allocated from the heap)
 */
-opj_pi_iterator_t *pi_create_decode(opj_image_t * image, opj_cp_t * cp, int tileno);
+opj_pi_iterator_t *pi_create_decode(opj_image_t * image, opj_cp_t * cp, int tileno, opj_arena_t *arena);
 
 /**
 Destroy a packet iterator
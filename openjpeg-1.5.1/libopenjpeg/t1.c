@@ -38,6 +38,40 @@
 /** @defgroup T1 T1 - Implementation of the tier-1 coding */
 /*@{*/
 
+/** @name Local data structures */
+/*@{*/
+
+/**
+Code-block decoding job, run by a thread pool worker
+*/
+typedef struct opj_t1_cblk_job {
+	/** one T1 handle per worker of the thread pool */
+	opj_t1_t **t1s;
+	opj_tcd_tilecomp_t *tilec;
+	opj_tccp_t *tccp;
+	int resno;
+	opj_tcd_band_t *band;
+	opj_tcd_cblk_dec_t *cblk;
+} opj_t1_cblk_job_t;
+
+/**
+Code-block encoding job, run by a thread pool worker
+*/
+typedef struct opj_t1_cblk_enc_job {
+	/** one T1 handle per worker of the thread pool */
+	opj_t1_t **t1s;
+	opj_tcd_tile_t *tile;
+	opj_tcp_t *tcp;
+	int compno;
+	int resno;
+	opj_tcd_band_t *band;
+	opj_tcd_cblk_enc_t *cblk;
+	/** set by the worker when the code-block could not be encoded */
+	opj_bool failed;
+} opj_t1_cblk_enc_job_t;
+
+/*@}*/
+
 /** @name Local static functions */
 /*@{*/
 
@@ -49,6 +83,24 @@ static short t1_getnmsedec_sig(int x, int bitpos);
 static short t1_getnmsedec_ref(int x, int bitpos);
 static void t1_updateflags(flag_t *flagsp, int s, int stride);
 /**
+Get the index of the sign coding context and sign prediction bit of a sample in lut_ctxno_sc and lut_spb
+@param f Packed state of the column of the sample
+@param pf Packed state of the column on its west
+@param nf Packed state of the column on its east
+@param ci Row of the sample in the stripe
+@return Returns the T1_SIG_PRIM and T1_SGN bits of the sample, as they would be in its flag_t
+*/
+static INLINE int t1_getsc_index(colflag_t f, colflag_t pf, colflag_t nf, int ci);
+/**
+Update the packed decoder state when a sample becomes significant
+@param flags Packed state of the column of the sample, kept by the caller while it works on the column
+@param flagsp Location of the packed state of the column, to reach its neighbours
+@param ci Row of the sample in the stripe
+@param s Sign of the sample
+@param stride Number of columns of the packed state
+*/
+static INLINE void t1_updateflags_col(colflag_t *flags, colflag_t *flagsp, int ci, int s, int stride);
+/**
 Encode significant pass
 */
 static void t1_enc_sigpass_step(
@@ -66,24 +118,22 @@ Decode significant pass
 */
 static INLINE void t1_dec_sigpass_step_raw(
 		opj_t1_t *t1,
-		flag_t *flagsp,
+		colflag_t *flags,
+		colflag_t *flagsp,
 		int *datap,
-		int orient,
 		int oneplushalf,
+		int ci,
 		int vsc);
 static INLINE void t1_dec_sigpass_step_mqc(
 		opj_t1_t *t1,
-		flag_t *flagsp,
-		int *datap,
-		int orient,
-		int oneplushalf);
-static INLINE void t1_dec_sigpass_step_mqc_vsc(
-		opj_t1_t *t1,
-		flag_t *flagsp,
+		colflag_t *flags,
+		colflag_t *flagsp,
 		int *datap,
 		int orient,
 		int oneplushalf,
-		int vsc);
+		int ci,
+		int vsc,
+		int flags_stride);
 /**
 Encode significant pass
 */
@@ -100,13 +150,24 @@ Decode significant pass
 static void t1_dec_sigpass_raw(
 		opj_t1_t *t1,
 		int bpno,
-		int orient,
 		int cblksty);
+static INLINE void t1_dec_sigpass_mqc_generic(
+		opj_t1_t *t1,
+		int bpno,
+		int orient,
+		int w,
+		int h,
+		int vsc);
 static void t1_dec_sigpass_mqc(
+		opj_t1_t *t1,
+		int bpno,
+		int orient,
+		int cblksty);
+static void t1_dec_sigpass_mqc_64x64(
 		opj_t1_t *t1,
 		int bpno,
 		int orient);
-static void t1_dec_sigpass_mqc_vsc(
+static void t1_dec_sigpass_mqc_32x32(
 		opj_t1_t *t1,
 		int bpno,
 		int orient);
@@ -127,23 +188,18 @@ Decode refinement pass
 */
 static INLINE void t1_dec_refpass_step_raw(
 		opj_t1_t *t1,
-		flag_t *flagsp,
+		colflag_t *flags,
 		int *datap,
 		int poshalf,
 		int neghalf,
-		int vsc);
+		int ci);
 static INLINE void t1_dec_refpass_step_mqc(
 		opj_t1_t *t1,
-		flag_t *flagsp,
-		int *datap,
-		int poshalf,
-		int neghalf);
-static INLINE void t1_dec_refpass_step_mqc_vsc(
-		opj_t1_t *t1,
-		flag_t *flagsp,
+		colflag_t *flags,
 		int *datap,
 		int poshalf,
 		int neghalf,
+		int ci,
 		int vsc);
 
 /**
@@ -159,13 +215,22 @@ static void t1_enc_refpass(
 Decode refinement pass
 */
 static void t1_dec_refpass_raw(
+		opj_t1_t *t1,
+		int bpno);
+static INLINE void t1_dec_refpass_mqc_generic(
 		opj_t1_t *t1,
 		int bpno,
-		int cblksty);
+		int w,
+		int h,
+		int vsc);
 static void t1_dec_refpass_mqc(
+		opj_t1_t *t1,
+		int bpno,
+		int cblksty);
+static void t1_dec_refpass_mqc_64x64(
 		opj_t1_t *t1,
 		int bpno);
-static void t1_dec_refpass_mqc_vsc(
+static void t1_dec_refpass_mqc_32x32(
 		opj_t1_t *t1,
 		int bpno);
 /**
@@ -184,26 +249,25 @@ static void t1_enc_clnpass_step(
 /**
 Decode clean-up pass
 */
-static void t1_dec_clnpass_step_partial(
-		opj_t1_t *t1,
-		flag_t *flagsp,
-		int *datap,
-		int orient,
-		int oneplushalf);
-static void t1_dec_clnpass_step(
+static INLINE void t1_dec_clnpass_step_partial(
 		opj_t1_t *t1,
-		flag_t *flagsp,
+		colflag_t *flags,
+		colflag_t *flagsp,
 		int *datap,
-		int orient,
-		int oneplushalf);
-static void t1_dec_clnpass_step_vsc(
+		int oneplushalf,
+		int ci,
+		int vsc,
+		int flags_stride);
+static INLINE void t1_dec_clnpass_step(
 		opj_t1_t *t1,
-		flag_t *flagsp,
+		colflag_t *flags,
+		colflag_t *flagsp,
 		int *datap,
 		int orient,
 		int oneplushalf,
-		int partial,
-		int vsc);
+		int ci,
+		int vsc,
+		int flags_stride);
 /**
 Encode clean-up pass
 */
@@ -216,11 +280,26 @@ static void t1_enc_clnpass(
 /**
 Decode clean-up pass
 */
+static INLINE void t1_dec_clnpass_generic(
+		opj_t1_t *t1,
+		int bpno,
+		int orient,
+		int w,
+		int h,
+		int vsc);
 static void t1_dec_clnpass(
 		opj_t1_t *t1,
 		int bpno,
 		int orient,
 		int cblksty);
+static void t1_dec_clnpass_64x64(
+		opj_t1_t *t1,
+		int bpno,
+		int orient);
+static void t1_dec_clnpass_32x32(
+		opj_t1_t *t1,
+		int bpno,
+		int orient);
 static double t1_getwmsedec(
 		int nmsedec,
 		int compno,
@@ -243,7 +322,6 @@ Encode 1 code-block
 @param cblksty Code-block style
 @param numcomps
 @param mct
-@param tile
 */
 static void t1_encode_cblk(
 		opj_t1_t *t1,
@@ -255,8 +333,41 @@ static void t1_encode_cblk(
 		double stepsize,
 		int cblksty,
 		int numcomps,
-		int mct,
-		opj_tcd_tile_t * tile);
+		int mct);
+/**
+Load 1 code-block from the tile-component and encode it. The distortion
+decrease of each pass is left in its distortiondec, until t1_sum_distortions.
+@param t1 T1 handle
+@param tile Tile the code-block belongs to
+@param tcp Tile coding parameters
+@param compno Component of the code-block
+@param resno Resolution level of the code-block
+@param band Subband of the code-block
+@param cblk Code-block to encode
+@return Returns OPJ_FALSE if the code-block could not be encoded: it is then left empty
+*/
+static opj_bool t1_encode_cblk_from_tile(
+		opj_t1_t *t1,
+		opj_tcd_tile_t *tile,
+		opj_tcp_t *tcp,
+		int compno,
+		int resno,
+		opj_tcd_band_t *band,
+		opj_tcd_cblk_enc_t *cblk);
+/**
+Thread pool entry point of a code-block encoding job
+@param user_data Job (opj_t1_cblk_enc_job_t)
+@param workerno Worker running the job, selects the T1 handle
+*/
+static void t1_encode_cblk_job(void *user_data, int workerno);
+/**
+Compute the distortion of the tile and the cumulated distortion decrease of
+each pass, from the decrease of the passes alone left by t1_encode_cblk. The
+sums are made in code-block order, so that they do not depend on the order
+in which the code-blocks were encoded.
+@param tile Encoded tile
+*/
+static void t1_sum_distortions(opj_tcd_tile_t *tile);
 /**
 Decode 1 code-block
 @param t1 T1 handle
@@ -271,6 +382,28 @@ static void t1_decode_cblk(
 		int orient,
 		int roishift,
 		int cblksty);
+/**
+Decode 1 code-block and store its coefficients in the tile-component
+@param t1 T1 handle
+@param tilec Tile-component the code-block belongs to
+@param tccp Tile-component coding parameters
+@param resno Resolution level of the code-block
+@param band Subband of the code-block
+@param cblk Code-block to decode
+*/
+static void t1_decode_cblk_to_tile(
+		opj_t1_t* t1,
+		opj_tcd_tilecomp_t* tilec,
+		opj_tccp_t* tccp,
+		int resno,
+		opj_tcd_band_t* band,
+		opj_tcd_cblk_dec_t* cblk);
+/**
+Thread pool entry point of a code-block decoding job
+@param user_data Job (opj_t1_cblk_job_t)
+@param workerno Worker running the job, selects the T1 handle
+*/
+static void t1_decode_cblk_job(void *user_data, int workerno);
 
 /*@}*/
 
@@ -336,6 +469,51 @@ static void t1_updateflags(flag_t *flagsp, int s, int stride) {
 	sp[1]  |= T1_SIG_NW;
 }
 
+static int t1_getsc_index(colflag_t f, colflag_t pf, colflag_t nf, int ci) {
+	int ci3 = ci * 3;
+	int lu;
+
+	lu = (f >> (ci3 + 1)) & 1;	/* T1_SIG_N */
+	lu |= ((f >> (ci3 + 5)) & 1) << 1;	/* T1_SIG_E */
+	lu |= ((f >> (ci3 + 7)) & 1) << 2;	/* T1_SIG_S */
+	lu |= ((f >> (ci3 + 3)) & 1) << 3;	/* T1_SIG_W */
+	if (ci == 0) {
+		lu |= ((f >> T1_CHI_0_I) & 1) << 4;	/* T1_SGN_N */
+	} else {
+		lu |= ((f >> (T1_CHI_1_I + ci3 - 3)) & 1) << 4;
+	}
+	lu |= ((nf >> (T1_CHI_1_I + ci3)) & 1) << 5;	/* T1_SGN_E */
+	lu |= ((f >> (T1_CHI_2_I + ci3)) & 1) << 6;	/* T1_SGN_S */
+	lu |= ((pf >> (T1_CHI_1_I + ci3)) & 1) << 7;	/* T1_SGN_W */
+
+	return lu;
+}
+
+static void t1_updateflags_col(colflag_t *flags, colflag_t *flagsp, int ci, int s, int stride) {
+	int ci3 = ci * 3;
+
+	/* west and east columns, and the column itself */
+	flagsp[-1] |= T1_SIGMA_5 << ci3;
+	*flags |= (((colflag_t)s << T1_CHI_1_I) | T1_SIGMA_4) << ci3;
+	flagsp[1] |= T1_SIGMA_3 << ci3;
+
+	/* the first row is the row 4 of the stripe above */
+	if (ci == 0) {
+		colflag_t *np = flagsp - stride;
+		np[-1] |= T1_SIGMA_17;
+		np[0] |= ((colflag_t)s << T1_CHI_5_I) | T1_SIGMA_16;
+		np[1] |= T1_SIGMA_15;
+	}
+
+	/* the last row is the row -1 of the stripe below */
+	if (ci == 3) {
+		colflag_t *sp = flagsp + stride;
+		sp[-1] |= T1_SIGMA_2;
+		sp[0] |= ((colflag_t)s << T1_CHI_0_I) | T1_SIGMA_1;
+		sp[1] |= T1_SIGMA_0;
+	}
+}
+
 static void t1_enc_sigpass_step(
 		opj_t1_t *t1,
 		flag_t *flagsp,
@@ -377,74 +555,57 @@ static void t1_enc_sigpass_step(
 
 static INLINE void t1_dec_sigpass_step_raw(
 		opj_t1_t *t1,
-		flag_t *flagsp,
+		colflag_t *flags,
+		colflag_t *flagsp,
 		int *datap,
-		int orient,
 		int oneplushalf,
+		int ci,
 		int vsc)
 {
-	int v, flag;
+	int v;
+	colflag_t flag;
 	opj_raw_t *raw = t1->raw;	/* RAW component */
 	
-	OPJ_ARG_NOT_USED(orient);
-	
-	flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
-	if ((flag & T1_SIG_OTH) && !(flag & (T1_SIG | T1_VISIT))) {
-			if (raw_decode(raw)) {
-				v = raw_decode(raw);	/* ESSAI */
-				*datap = v ? -oneplushalf : oneplushalf;
-				t1_updateflags(flagsp, v, t1->flags_stride);
-			}
-		*flagsp |= T1_VISIT;
+	flag = (vsc && ci == 3) ? (*flags & ~T1_VSC_MASK) : *flags;
+	flag >>= ci * 3;
+	if ((flag & T1_SIGMA_NEIGHBOURS) && !(flag & (T1_SIGMA_THIS | T1_PI_THIS))) {
+		if (raw_decode(raw)) {
+			v = raw_decode(raw);	/* ESSAI */
+			*datap = v ? -oneplushalf : oneplushalf;
+			t1_updateflags_col(flags, flagsp, ci, v, t1->flags_stride);
+		}
+		*flags |= T1_PI_THIS << (ci * 3);
 	}
 }				/* VSC and  BYPASS by Antonin */
 
 static INLINE void t1_dec_sigpass_step_mqc(
 		opj_t1_t *t1,
-		flag_t *flagsp,
-		int *datap,
-		int orient,
-		int oneplushalf)
-{
-	int v, flag;
-	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
-	
-	flag = *flagsp;
-	if ((flag & T1_SIG_OTH) && !(flag & (T1_SIG | T1_VISIT))) {
-			mqc_setcurctx(mqc, t1_getctxno_zc(flag, orient));
-			if (mqc_decode(mqc)) {
-				mqc_setcurctx(mqc, t1_getctxno_sc(flag));
-				v = mqc_decode(mqc) ^ t1_getspb(flag);
-				*datap = v ? -oneplushalf : oneplushalf;
-				t1_updateflags(flagsp, v, t1->flags_stride);
-			}
-		*flagsp |= T1_VISIT;
-	}
-}				/* VSC and  BYPASS by Antonin */
-
-static INLINE void t1_dec_sigpass_step_mqc_vsc(
-		opj_t1_t *t1,
-		flag_t *flagsp,
+		colflag_t *flags,
+		colflag_t *flagsp,
 		int *datap,
 		int orient,
 		int oneplushalf,
-		int vsc)
+		int ci,
+		int vsc,
+		int flags_stride)
 {
-	int v, flag;
+	int v, lu;
+	colflag_t flag, shifted;
 	
 	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
 	
-	flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
-	if ((flag & T1_SIG_OTH) && !(flag & (T1_SIG | T1_VISIT))) {
-		mqc_setcurctx(mqc, t1_getctxno_zc(flag, orient));
+	flag = (vsc && ci == 3) ? (*flags & ~T1_VSC_MASK) : *flags;
+	shifted = flag >> (ci * 3);
+	if ((shifted & T1_SIGMA_NEIGHBOURS) && !(shifted & (T1_SIGMA_THIS | T1_PI_THIS))) {
+		mqc_setcurctx(mqc, lut_ctxno_zc_col[(orient << 9) | (shifted & T1_SIGMA_NEIGHBOURS)]);
 		if (mqc_decode(mqc)) {
-			mqc_setcurctx(mqc, t1_getctxno_sc(flag));
-			v = mqc_decode(mqc) ^ t1_getspb(flag);
+			lu = t1_getsc_index(flag, flagsp[-1], flagsp[1], ci);
+			mqc_setcurctx(mqc, lut_ctxno_sc[lu]);
+			v = mqc_decode(mqc) ^ lut_spb[lu];
 			*datap = v ? -oneplushalf : oneplushalf;
-			t1_updateflags(flagsp, v, t1->flags_stride);
+			t1_updateflags_col(flags, flagsp, ci, v, flags_stride);
 		}
-		*flagsp |= T1_VISIT;
+		*flags |= T1_PI_THIS << (ci * 3);
 	}
 }				/* VSC and  BYPASS by Antonin */
 
@@ -481,95 +642,115 @@ static void t1_enc_sigpass(
 static void t1_dec_sigpass_raw(
 		opj_t1_t *t1,
 		int bpno,
-		int orient,
 		int cblksty)
 {
-	int i, j, k, one, half, oneplushalf, vsc;
+	int i, k, ci, one, half, oneplushalf;
+	int vsc = cblksty & J2K_CCP_CBLKSTY_VSC;
+	int *data1 = t1->data;
+	colflag_t *flags1 = &t1->colflags[t1->flags_stride + 1];
 	one = 1 << bpno;
 	half = one >> 1;
 	oneplushalf = one | half;
 	for (k = 0; k < t1->h; k += 4) {
+		int rows = int_min(4, t1->h - k);
 		for (i = 0; i < t1->w; ++i) {
-			for (j = k; j < k + 4 && j < t1->h; ++j) {
-				vsc = ((cblksty & J2K_CCP_CBLKSTY_VSC) && (j == k + 3 || j == t1->h - 1)) ? 1 : 0;
-				t1_dec_sigpass_step_raw(
-						t1,
-						&t1->flags[((j+1) * t1->flags_stride) + i + 1],
-						&t1->data[(j * t1->w) + i],
-						orient,
-						oneplushalf,
-						vsc);
+			int *data2 = data1 + i;
+			colflag_t *flags2 = flags1 + i;
+			colflag_t flags = *flags2;
+			if (flags == 0) {
+				continue;
+			}
+			for (ci = 0; ci < rows; ++ci) {
+				t1_dec_sigpass_step_raw(t1, &flags, flags2, data2, oneplushalf, ci, vsc);
+				data2 += t1->w;
 			}
+			*flags2 = flags;
 		}
+		data1 += t1->w << 2;
+		flags1 += t1->flags_stride;
 	}
 }				/* VSC and  BYPASS by Antonin */
 
-static void t1_dec_sigpass_mqc(
+/*
+The passes are written once, for a code-block of w x h samples, and instantiated for the
+common code-block sizes without the VSC mode switch: the compiler then knows the bounds of
+the loops and the stride of the flags.
+The packed state holds the whole neighbourhood of the 4 samples of a stripe column, so a
+column that has no significant sample around it is skipped with a single test.
+*/
+static INLINE void t1_dec_sigpass_mqc_generic(
 		opj_t1_t *t1,
 		int bpno,
-		int orient)
+		int orient,
+		int w,
+		int h,
+		int vsc)
 {
-	int i, j, k, one, half, oneplushalf;
+	int i, k, ci, one, half, oneplushalf;
+	int flags_stride = w + 2;
 	int *data1 = t1->data;
-	flag_t *flags1 = &t1->flags[1];
+	colflag_t *flags1 = &t1->colflags[flags_stride + 1];
 	one = 1 << bpno;
 	half = one >> 1;
 	oneplushalf = one | half;
-	for (k = 0; k < (t1->h & ~3); k += 4) {
-		for (i = 0; i < t1->w; ++i) {
+	for (k = 0; k < (h & ~3); k += 4) {
+		for (i = 0; i < w; ++i) {
 			int *data2 = data1 + i;
-			flag_t *flags2 = flags1 + i;
-			flags2 += t1->flags_stride;
-			t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
-			data2 += t1->w;
-			flags2 += t1->flags_stride;
-			t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
-			data2 += t1->w;
-			flags2 += t1->flags_stride;
-			t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
-			data2 += t1->w;
-			flags2 += t1->flags_stride;
-			t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
-			data2 += t1->w;
+			colflag_t *flags2 = flags1 + i;
+			colflag_t flags = *flags2;
+			if (flags == 0) {
+				continue;
+			}
+			t1_dec_sigpass_step_mqc(t1, &flags, flags2, data2, orient, oneplushalf, 0, vsc, flags_stride);
+			data2 += w;
+			t1_dec_sigpass_step_mqc(t1, &flags, flags2, data2, orient, oneplushalf, 1, vsc, flags_stride);
+			data2 += w;
+			t1_dec_sigpass_step_mqc(t1, &flags, flags2, data2, orient, oneplushalf, 2, vsc, flags_stride);
+			data2 += w;
+			t1_dec_sigpass_step_mqc(t1, &flags, flags2, data2, orient, oneplushalf, 3, vsc, flags_stride);
+			*flags2 = flags;
 		}
-		data1 += t1->w << 2;
-		flags1 += t1->flags_stride << 2;
+		data1 += w << 2;
+		flags1 += flags_stride;
 	}
-	for (i = 0; i < t1->w; ++i) {
-		int *data2 = data1 + i;
-		flag_t *flags2 = flags1 + i;
-		for (j = k; j < t1->h; ++j) {
-			flags2 += t1->flags_stride;
-			t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
-			data2 += t1->w;
+	if (k < h) {
+		for (i = 0; i < w; ++i) {
+			int *data2 = data1 + i;
+			colflag_t *flags2 = flags1 + i;
+			colflag_t flags = *flags2;
+			for (ci = 0; ci < h - k; ++ci) {
+				t1_dec_sigpass_step_mqc(t1, &flags, flags2, data2, orient, oneplushalf, ci, vsc, flags_stride);
+				data2 += w;
+			}
+			*flags2 = flags;
 		}
 	}
 }				/* VSC and  BYPASS by Antonin */
 
-static void t1_dec_sigpass_mqc_vsc(
+static void t1_dec_sigpass_mqc(
+		opj_t1_t *t1,
+		int bpno,
+		int orient,
+		int cblksty)
+{
+	t1_dec_sigpass_mqc_generic(t1, bpno, orient, t1->w, t1->h, cblksty & J2K_CCP_CBLKSTY_VSC);
+}
+
+static void t1_dec_sigpass_mqc_64x64(
 		opj_t1_t *t1,
 		int bpno,
 		int orient)
 {
-	int i, j, k, one, half, oneplushalf, vsc;
-	one = 1 << bpno;
-	half = one >> 1;
-	oneplushalf = one | half;
-	for (k = 0; k < t1->h; k += 4) {
-		for (i = 0; i < t1->w; ++i) {
-			for (j = k; j < k + 4 && j < t1->h; ++j) {
-				vsc = (j == k + 3 || j == t1->h - 1) ? 1 : 0;
-				t1_dec_sigpass_step_mqc_vsc(
-						t1,
-						&t1->flags[((j+1) * t1->flags_stride) + i + 1],
-						&t1->data[(j * t1->w) + i],
-						orient,
-						oneplushalf,
-						vsc);
-			}
-		}
-	}
-}				/* VSC and  BYPASS by Antonin */
+	t1_dec_sigpass_mqc_generic(t1, bpno, orient, 64, 64, 0);
+}
+
+static void t1_dec_sigpass_mqc_32x32(
+		opj_t1_t *t1,
+		int bpno,
+		int orient)
+{
+	t1_dec_sigpass_mqc_generic(t1, bpno, orient, 32, 32, 0);
+}
 
 static void t1_enc_refpass_step(
 		opj_t1_t *t1,
@@ -601,65 +782,47 @@ static void t1_enc_refpass_step(
 
 static INLINE void t1_dec_refpass_step_raw(
 		opj_t1_t *t1,
-		flag_t *flagsp,
+		colflag_t *flags,
 		int *datap,
 		int poshalf,
 		int neghalf,
-		int vsc)
+		int ci)
 {
-	int v, t, flag;
+	int v, t;
 	
 	opj_raw_t *raw = t1->raw;	/* RAW component */
 	
-	flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
-	if ((flag & (T1_SIG | T1_VISIT)) == T1_SIG) {
-			v = raw_decode(raw);
+	if (((*flags >> (ci * 3)) & (T1_SIGMA_THIS | T1_PI_THIS)) == T1_SIGMA_THIS) {
+		v = raw_decode(raw);
 		t = v ? poshalf : neghalf;
 		*datap += *datap < 0 ? -t : t;
-		*flagsp |= T1_REFINE;
+		*flags |= T1_MU_THIS << (ci * 3);
 	}
 }				/* VSC and  BYPASS by Antonin  */
 
 static INLINE void t1_dec_refpass_step_mqc(
 		opj_t1_t *t1,
-		flag_t *flagsp,
-		int *datap,
-		int poshalf,
-		int neghalf)
-{
-	int v, t, flag;
-	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
-	
-	flag = *flagsp;
-	if ((flag & (T1_SIG | T1_VISIT)) == T1_SIG) {
-		mqc_setcurctx(mqc, t1_getctxno_mag(flag));	/* ESSAI */
-			v = mqc_decode(mqc);
-		t = v ? poshalf : neghalf;
-		*datap += *datap < 0 ? -t : t;
-		*flagsp |= T1_REFINE;
-		}
-}				/* VSC and  BYPASS by Antonin  */
-
-static INLINE void t1_dec_refpass_step_mqc_vsc(
-		opj_t1_t *t1,
-		flag_t *flagsp,
+		colflag_t *flags,
 		int *datap,
 		int poshalf,
 		int neghalf,
+		int ci,
 		int vsc)
 {
-	int v, t, flag;
+	int v, t;
+	colflag_t flag;
 	
 	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
 	
-	flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
-	if ((flag & (T1_SIG | T1_VISIT)) == T1_SIG) {
-		mqc_setcurctx(mqc, t1_getctxno_mag(flag));	/* ESSAI */
+	flag = (vsc && ci == 3) ? (*flags & ~T1_VSC_MASK) : *flags;
+	flag >>= ci * 3;
+	if ((flag & (T1_SIGMA_THIS | T1_PI_THIS)) == T1_SIGMA_THIS) {
+		mqc_setcurctx(mqc, (flag & T1_MU_THIS) ? T1_CTXNO_MAG + 2 :
+			(flag & T1_SIGMA_NEIGHBOURS) ? T1_CTXNO_MAG + 1 : T1_CTXNO_MAG);	/* ESSAI */
 		v = mqc_decode(mqc);
 		t = v ? poshalf : neghalf;
 		*datap += *datap < 0 ? -t : t;
-		*flagsp |= T1_REFINE;
+		*flags |= T1_MU_THIS << (ci * 3);
 	}
 }				/* VSC and  BYPASS by Antonin  */
 
@@ -693,95 +856,103 @@ static void t1_enc_refpass(
 
 static void t1_dec_refpass_raw(
 		opj_t1_t *t1,
-		int bpno,
-		int cblksty)
+		int bpno)
 {
-	int i, j, k, one, poshalf, neghalf;
-	int vsc;
+	int i, k, ci, one, poshalf, neghalf;
+	int *data1 = t1->data;
+	colflag_t *flags1 = &t1->colflags[t1->flags_stride + 1];
 	one = 1 << bpno;
 	poshalf = one >> 1;
 	neghalf = bpno > 0 ? -poshalf : -1;
 	for (k = 0; k < t1->h; k += 4) {
+		int rows = int_min(4, t1->h - k);
 		for (i = 0; i < t1->w; ++i) {
-			for (j = k; j < k + 4 && j < t1->h; ++j) {
-				vsc = ((cblksty & J2K_CCP_CBLKSTY_VSC) && (j == k + 3 || j == t1->h - 1)) ? 1 : 0;
-				t1_dec_refpass_step_raw(
-						t1,
-						&t1->flags[((j+1) * t1->flags_stride) + i + 1],
-						&t1->data[(j * t1->w) + i],
-						poshalf,
-						neghalf,
-						vsc);
+			int *data2 = data1 + i;
+			colflag_t *flags2 = flags1 + i;
+			colflag_t flags = *flags2;
+			if (!(flags & (T1_SIGMA_4 | T1_SIGMA_7 | T1_SIGMA_10 | T1_SIGMA_13))) {
+				continue;
+			}
+			for (ci = 0; ci < rows; ++ci) {
+				t1_dec_refpass_step_raw(t1, &flags, data2, poshalf, neghalf, ci);
+				data2 += t1->w;
 			}
+			*flags2 = flags;
 		}
+		data1 += t1->w << 2;
+		flags1 += t1->flags_stride;
 	}
 }				/* VSC and  BYPASS by Antonin */
 
-static void t1_dec_refpass_mqc(
+static INLINE void t1_dec_refpass_mqc_generic(
 		opj_t1_t *t1,
-		int bpno)
+		int bpno,
+		int w,
+		int h,
+		int vsc)
 {
-	int i, j, k, one, poshalf, neghalf;
+	int i, k, ci, one, poshalf, neghalf;
+	int flags_stride = w + 2;
 	int *data1 = t1->data;
-	flag_t *flags1 = &t1->flags[1];
+	colflag_t *flags1 = &t1->colflags[flags_stride + 1];
 	one = 1 << bpno;
 	poshalf = one >> 1;
 	neghalf = bpno > 0 ? -poshalf : -1;
-	for (k = 0; k < (t1->h & ~3); k += 4) {
-		for (i = 0; i < t1->w; ++i) {
+	for (k = 0; k < (h & ~3); k += 4) {
+		for (i = 0; i < w; ++i) {
 			int *data2 = data1 + i;
-			flag_t *flags2 = flags1 + i;
-			flags2 += t1->flags_stride;
-			t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
-			data2 += t1->w;
-			flags2 += t1->flags_stride;
-			t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
-			data2 += t1->w;
-			flags2 += t1->flags_stride;
-			t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
-			data2 += t1->w;
-			flags2 += t1->flags_stride;
-			t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
-			data2 += t1->w;
+			colflag_t *flags2 = flags1 + i;
+			colflag_t flags = *flags2;
+			if (!(flags & (T1_SIGMA_4 | T1_SIGMA_7 | T1_SIGMA_10 | T1_SIGMA_13))) {
+				continue;
+			}
+			t1_dec_refpass_step_mqc(t1, &flags, data2, poshalf, neghalf, 0, vsc);
+			data2 += w;
+			t1_dec_refpass_step_mqc(t1, &flags, data2, poshalf, neghalf, 1, vsc);
+			data2 += w;
+			t1_dec_refpass_step_mqc(t1, &flags, data2, poshalf, neghalf, 2, vsc);
+			data2 += w;
+			t1_dec_refpass_step_mqc(t1, &flags, data2, poshalf, neghalf, 3, vsc);
+			*flags2 = flags;
 		}
-		data1 += t1->w << 2;
-		flags1 += t1->flags_stride << 2;
+		data1 += w << 2;
+		flags1 += flags_stride;
 	}
-	for (i = 0; i < t1->w; ++i) {
-		int *data2 = data1 + i;
-		flag_t *flags2 = flags1 + i;
-		for (j = k; j < t1->h; ++j) {
-			flags2 += t1->flags_stride;
-			t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
-			data2 += t1->w;
+	if (k < h) {
+		for (i = 0; i < w; ++i) {
+			int *data2 = data1 + i;
+			colflag_t *flags2 = flags1 + i;
+			colflag_t flags = *flags2;
+			for (ci = 0; ci < h - k; ++ci) {
+				t1_dec_refpass_step_mqc(t1, &flags, data2, poshalf, neghalf, ci, vsc);
+				data2 += w;
+			}
+			*flags2 = flags;
 		}
 	}
 }				/* VSC and  BYPASS by Antonin */
 
-static void t1_dec_refpass_mqc_vsc(
+static void t1_dec_refpass_mqc(
+		opj_t1_t *t1,
+		int bpno,
+		int cblksty)
+{
+	t1_dec_refpass_mqc_generic(t1, bpno, t1->w, t1->h, cblksty & J2K_CCP_CBLKSTY_VSC);
+}
+
+static void t1_dec_refpass_mqc_64x64(
 		opj_t1_t *t1,
 		int bpno)
 {
-	int i, j, k, one, poshalf, neghalf;
-	int vsc;
-	one = 1 << bpno;
-	poshalf = one >> 1;
-	neghalf = bpno > 0 ? -poshalf : -1;
-	for (k = 0; k < t1->h; k += 4) {
-		for (i = 0; i < t1->w; ++i) {
-			for (j = k; j < k + 4 && j < t1->h; ++j) {
-				vsc = ((j == k + 3 || j == t1->h - 1)) ? 1 : 0;
-				t1_dec_refpass_step_mqc_vsc(
-						t1,
-						&t1->flags[((j+1) * t1->flags_stride) + i + 1],
-						&t1->data[(j * t1->w) + i],
-						poshalf,
-						neghalf,
-						vsc);
-			}
-		}
-	}
-}				/* VSC and  BYPASS by Antonin */
+	t1_dec_refpass_mqc_generic(t1, bpno, 64, 64, 0);
+}
+
+static void t1_dec_refpass_mqc_32x32(
+		opj_t1_t *t1,
+		int bpno)
+{
+	t1_dec_refpass_mqc_generic(t1, bpno, 32, 32, 0);
+}
 
 static void t1_enc_clnpass_step(
 		opj_t1_t *t1,
@@ -818,79 +989,57 @@ LABEL_PARTIAL:
 	*flagsp &= ~T1_VISIT;
 }
 
-static void t1_dec_clnpass_step_partial(
+static INLINE void t1_dec_clnpass_step_partial(
 		opj_t1_t *t1,
-		flag_t *flagsp,
+		colflag_t *flags,
+		colflag_t *flagsp,
 		int *datap,
-		int orient,
-		int oneplushalf)
+		int oneplushalf,
+		int ci,
+		int vsc,
+		int flags_stride)
 {
-	int v, flag;
+	int v, lu;
+	colflag_t flag;
 	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
 	
-	OPJ_ARG_NOT_USED(orient);
-	
-	flag = *flagsp;
-	mqc_setcurctx(mqc, t1_getctxno_sc(flag));
-	v = mqc_decode(mqc) ^ t1_getspb(flag);
+	flag = (vsc && ci == 3) ? (*flags & ~T1_VSC_MASK) : *flags;
+	lu = t1_getsc_index(flag, flagsp[-1], flagsp[1], ci);
+	mqc_setcurctx(mqc, lut_ctxno_sc[lu]);
+	v = mqc_decode(mqc) ^ lut_spb[lu];
 	*datap = v ? -oneplushalf : oneplushalf;
-	t1_updateflags(flagsp, v, t1->flags_stride);
-	*flagsp &= ~T1_VISIT;
+	t1_updateflags_col(flags, flagsp, ci, v, flags_stride);
 }				/* VSC and  BYPASS by Antonin */
 
-static void t1_dec_clnpass_step(
+static INLINE void t1_dec_clnpass_step(
 		opj_t1_t *t1,
-		flag_t *flagsp,
-		int *datap,
-		int orient,
-		int oneplushalf)
-{
-	int v, flag;
-	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
-	
-	flag = *flagsp;
-	if (!(flag & (T1_SIG | T1_VISIT))) {
-		mqc_setcurctx(mqc, t1_getctxno_zc(flag, orient));
-		if (mqc_decode(mqc)) {
-			mqc_setcurctx(mqc, t1_getctxno_sc(flag));
-			v = mqc_decode(mqc) ^ t1_getspb(flag);
-			*datap = v ? -oneplushalf : oneplushalf;
-			t1_updateflags(flagsp, v, t1->flags_stride);
-		}
-	}
-	*flagsp &= ~T1_VISIT;
-}				/* VSC and  BYPASS by Antonin */
-
-static void t1_dec_clnpass_step_vsc(
-		opj_t1_t *t1,
-		flag_t *flagsp,
+		colflag_t *flags,
+		colflag_t *flagsp,
 		int *datap,
 		int orient,
 		int oneplushalf,
-		int partial,
-		int vsc)
+		int ci,
+		int vsc,
+		int flags_stride)
 {
-	int v, flag;
+	int v, lu;
+	colflag_t flag, shifted;
 	
 	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
 	
-	flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
-	if (partial) {
-		goto LABEL_PARTIAL;
-	}
-	if (!(flag & (T1_SIG | T1_VISIT))) {
-		mqc_setcurctx(mqc, t1_getctxno_zc(flag, orient));
+	flag = (vsc && ci == 3) ? (*flags & ~T1_VSC_MASK) : *flags;
+	shifted = flag >> (ci * 3);
+	if (!(shifted & (T1_SIGMA_THIS | T1_PI_THIS))) {
+		mqc_setcurctx(mqc, lut_ctxno_zc_col[(orient << 9) | (shifted & T1_SIGMA_NEIGHBOURS)]);
 		if (mqc_decode(mqc)) {
-LABEL_PARTIAL:
-			mqc_setcurctx(mqc, t1_getctxno_sc(flag));
-			v = mqc_decode(mqc) ^ t1_getspb(flag);
+			lu = t1_getsc_index(flag, flagsp[-1], flagsp[1], ci);
+			mqc_setcurctx(mqc, lut_ctxno_sc[lu]);
+			v = mqc_decode(mqc) ^ lut_spb[lu];
 			*datap = v ? -oneplushalf : oneplushalf;
-			t1_updateflags(flagsp, v, t1->flags_stride);
+			t1_updateflags_col(flags, flagsp, ci, v, flags_stride);
 		}
 	}
-	*flagsp &= ~T1_VISIT;
-}
+}				/* VSC and  BYPASS by Antonin */
 
 static void t1_enc_clnpass(
 		opj_t1_t *t1,
@@ -956,33 +1105,31 @@ static void t1_enc_clnpass(
 	}
 }
 
-static void t1_dec_clnpass(
+static INLINE void t1_dec_clnpass_generic(
 		opj_t1_t *t1,
 		int bpno,
 		int orient,
-		int cblksty)
+		int w,
+		int h,
+		int vsc)
 {
-	int i, j, k, one, half, oneplushalf, agg, runlen, vsc;
-	int segsym = cblksty & J2K_CCP_CBLKSTY_SEGSYM;
-	
+	int i, k, ci, one, half, oneplushalf, runlen;
+	int flags_stride = w + 2;
+	int *data1 = t1->data;
+	colflag_t *flags1 = &t1->colflags[flags_stride + 1];
+
 	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
-	
+
 	one = 1 << bpno;
 	half = one >> 1;
 	oneplushalf = one | half;
-	if (cblksty & J2K_CCP_CBLKSTY_VSC) {
-	for (k = 0; k < t1->h; k += 4) {
-		for (i = 0; i < t1->w; ++i) {
-			if (k + 3 < t1->h) {
-					agg = !(MACRO_t1_flags(1 + k,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-						|| MACRO_t1_flags(1 + k + 1,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-						|| MACRO_t1_flags(1 + k + 2,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-						|| (MACRO_t1_flags(1 + k + 3,1 + i) 
-						& (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW |	T1_SGN_S))) & (T1_SIG | T1_VISIT | T1_SIG_OTH));
-				} else {
-				agg = 0;
-			}
-			if (agg) {
+	for (k = 0; k < (h & ~3); k += 4) {
+		for (i = 0; i < w; ++i) {
+			int *data2 = data1 + i;
+			colflag_t *flags2 = flags1 + i;
+			colflag_t flags = *flags2;
+			/* no significant or visited sample in the column nor around it */
+			if (!(vsc ? (flags & ~T1_VSC_MASK) : flags)) {
 				mqc_setcurctx(mqc, T1_CTXNO_AGG);
 				if (!mqc_decode(mqc)) {
 					continue;
@@ -990,80 +1137,51 @@ static void t1_dec_clnpass(
 				mqc_setcurctx(mqc, T1_CTXNO_UNI);
 				runlen = mqc_decode(mqc);
 				runlen = (runlen << 1) | mqc_decode(mqc);
+				data2 += runlen * w;
+				t1_dec_clnpass_step_partial(t1, &flags, flags2, data2, oneplushalf, runlen, vsc, flags_stride);
+				for (ci = runlen + 1; ci < 4; ++ci) {
+					data2 += w;
+					t1_dec_clnpass_step(t1, &flags, flags2, data2, orient, oneplushalf, ci, vsc, flags_stride);
+				}
 			} else {
-				runlen = 0;
-			}
-			for (j = k + runlen; j < k + 4 && j < t1->h; ++j) {
-					vsc = (j == k + 3 || j == t1->h - 1) ? 1 : 0;
-					t1_dec_clnpass_step_vsc(
-						t1,
-						&t1->flags[((j+1) * t1->flags_stride) + i + 1],
-						&t1->data[(j * t1->w) + i],
-						orient,
-						oneplushalf,
-						agg && (j == k + runlen),
-						vsc);
+				t1_dec_clnpass_step(t1, &flags, flags2, data2, orient, oneplushalf, 0, vsc, flags_stride);
+				data2 += w;
+				t1_dec_clnpass_step(t1, &flags, flags2, data2, orient, oneplushalf, 1, vsc, flags_stride);
+				data2 += w;
+				t1_dec_clnpass_step(t1, &flags, flags2, data2, orient, oneplushalf, 2, vsc, flags_stride);
+				data2 += w;
+				t1_dec_clnpass_step(t1, &flags, flags2, data2, orient, oneplushalf, 3, vsc, flags_stride);
 			}
+			*flags2 = flags & ~(T1_PI_0 | T1_PI_1 | T1_PI_2 | T1_PI_3);
 		}
+		data1 += w << 2;
+		flags1 += flags_stride;
 	}
-	} else {
-		int *data1 = t1->data;
-		flag_t *flags1 = &t1->flags[1];
-		for (k = 0; k < (t1->h & ~3); k += 4) {
-			for (i = 0; i < t1->w; ++i) {
-				int *data2 = data1 + i;
-				flag_t *flags2 = flags1 + i;
-				agg = !(MACRO_t1_flags(1 + k,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-					|| MACRO_t1_flags(1 + k + 1,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-					|| MACRO_t1_flags(1 + k + 2,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-					|| MACRO_t1_flags(1 + k + 3,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH));
-				if (agg) {
-					mqc_setcurctx(mqc, T1_CTXNO_AGG);
-					if (!mqc_decode(mqc)) {
-						continue;
-					}
-					mqc_setcurctx(mqc, T1_CTXNO_UNI);
-					runlen = mqc_decode(mqc);
-					runlen = (runlen << 1) | mqc_decode(mqc);
-					flags2 += runlen * t1->flags_stride;
-					data2 += runlen * t1->w;
-					for (j = k + runlen; j < k + 4 && j < t1->h; ++j) {
-						flags2 += t1->flags_stride;
-						if (agg && (j == k + runlen)) {
-							t1_dec_clnpass_step_partial(t1, flags2, data2, orient, oneplushalf);
-						} else {
-							t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
-						}
-						data2 += t1->w;
-					}
-				} else {
-					flags2 += t1->flags_stride;
-					t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
-					data2 += t1->w;
-					flags2 += t1->flags_stride;
-					t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
-					data2 += t1->w;
-					flags2 += t1->flags_stride;
-					t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
-					data2 += t1->w;
-					flags2 += t1->flags_stride;
-					t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
-					data2 += t1->w;
-				}
-			}
-			data1 += t1->w << 2;
-			flags1 += t1->flags_stride << 2;
-		}
-		for (i = 0; i < t1->w; ++i) {
+	if (k < h) {
+		for (i = 0; i < w; ++i) {
 			int *data2 = data1 + i;
-			flag_t *flags2 = flags1 + i;
-			for (j = k; j < t1->h; ++j) {
-				flags2 += t1->flags_stride;
-				t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
-				data2 += t1->w;
+			colflag_t *flags2 = flags1 + i;
+			colflag_t flags = *flags2;
+			for (ci = 0; ci < h - k; ++ci) {
+				t1_dec_clnpass_step(t1, &flags, flags2, data2, orient, oneplushalf, ci, vsc, flags_stride);
+				data2 += w;
 			}
+			*flags2 = flags & ~(T1_PI_0 | T1_PI_1 | T1_PI_2 | T1_PI_3);
 		}
 	}
+}
+
+static void t1_dec_clnpass(
+		opj_t1_t *t1,
+		int bpno,
+		int orient,
+		int cblksty)
+{
+	int segsym = cblksty & J2K_CCP_CBLKSTY_SEGSYM;
+	
+	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
+	
+	t1_dec_clnpass_generic(t1, bpno, orient, t1->w, t1->h, cblksty & J2K_CCP_CBLKSTY_VSC);
 
 	if (segsym) {
 		int v = 0;
@@ -1080,6 +1198,22 @@ static void t1_dec_clnpass(
 	}
 }				/* VSC and  BYPASS by Antonin */
 
+static void t1_dec_clnpass_64x64(
+		opj_t1_t *t1,
+		int bpno,
+		int orient)
+{
+	t1_dec_clnpass_generic(t1, bpno, orient, 64, 64, 0);
+}
+
+static void t1_dec_clnpass_32x32(
+		opj_t1_t *t1,
+		int bpno,
+		int orient)
+{
+	t1_dec_clnpass_generic(t1, bpno, orient, 32, 32, 0);
+}
+
 
 /** mod fixed_quality */
 static double t1_getwmsedec(
@@ -1144,6 +1278,44 @@ static opj_bool allocate_buffers(
 	return OPJ_TRUE;
 }
 
+static opj_bool allocate_dec_buffers(
+		opj_t1_t *t1,
+		int w,
+		int h)
+{
+	int datasize=w * h;
+	int colflagssize;
+
+	if(datasize > t1->datasize){
+		opj_aligned_free(t1->data);
+		t1->data = (int*) opj_aligned_malloc(datasize * sizeof(int));
+		if(!t1->data){
+			return OPJ_FALSE;
+		}
+		t1->datasize=datasize;
+	}
+	memset(t1->data,0,datasize * sizeof(int));
+
+	/* one row of columns per stripe of 4 rows, plus the rows above and below the code-block */
+	t1->flags_stride=w+2;
+	colflagssize=t1->flags_stride * (((h+3)>>2)+2);
+
+	if(colflagssize > t1->colflagssize){
+		opj_aligned_free(t1->colflags);
+		t1->colflags = (colflag_t*) opj_aligned_malloc(colflagssize * sizeof(colflag_t));
+		if(!t1->colflags){
+			return OPJ_FALSE;
+		}
+		t1->colflagssize=colflagssize;
+	}
+	memset(t1->colflags,0,colflagssize * sizeof(colflag_t));
+
+	t1->w=w;
+	t1->h=h;
+
+	return OPJ_TRUE;
+}
+
 /** mod fixed_quality */
 static void t1_encode_cblk(
 		opj_t1_t *t1,
@@ -1155,11 +1327,8 @@ static void t1_encode_cblk(
 		double stepsize,
 		int cblksty,
 		int numcomps,
-		int mct,
-		opj_tcd_tile_t * tile)
+		int mct)
 {
-	double cumwmsedec = 0.0;
-
 	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
 
 	int passno, bpno, passtype;
@@ -1207,8 +1376,6 @@ static void t1_encode_cblk(
 		
 		/* fixed_quality */
 		tempwmsedec = t1_getwmsedec(nmsedec, compno, level, orient, bpno, qmfbid, stepsize, numcomps, mct);
-		cumwmsedec += tempwmsedec;
-		tile->distotile += tempwmsedec;
 		
 		/* Code switch "RESTART" (i.e. TERMALL) */
 		if ((cblksty & J2K_CCP_CBLKSTY_TERMALL)	&& !((passtype == 2) && (bpno - 1 < 0))) {
@@ -1251,7 +1418,8 @@ static void t1_encode_cblk(
 				mqc_restart_init_enc(mqc);
 		}
 		
-		pass->distortiondec = cumwmsedec;
+		/* cumulated by t1_sum_distortions */
+		pass->distortiondec = tempwmsedec;
 		pass->rate = mqc_numbytes(mqc) + correction;	/* FIXME */
 		
 		/* Code-switch "RESET" */
@@ -1291,9 +1459,11 @@ static void t1_decode_cblk(
 
 	int bpno, passtype;
 	int segno, passno;
+	int passes_left;	/* number of passes that may still be decoded: the passes of the layers read, or fewer with max_passes */
 	char type = T1_TYPE_MQ; /* BYPASS mode */
+	int size;	/* 64 or 32 to use the passes specialized for 64x64 or 32x32 code-blocks, 0 otherwise */
 
-	if(!allocate_buffers(
+	if(!allocate_dec_buffers(
 				t1,
 				cblk->x1 - cblk->x0,
 				cblk->y1 - cblk->y0))
@@ -1301,8 +1471,14 @@ static void t1_decode_cblk(
 		return;
 	}
 
+	size = 0;
+	if (t1->w == t1->h && (t1->w == 64 || t1->w == 32) && !(cblksty & (J2K_CCP_CBLKSTY_VSC | J2K_CCP_CBLKSTY_SEGSYM))) {
+		size = t1->w;
+	}
+
 	bpno = roishift + cblk->numbps - 1;
 	passtype = 2;
+	passes_left = t1->max_passes > 0 ? int_min(t1->max_passes, cblk->numpasses) : cblk->numpasses;
 	
 	mqc_resetstates(mqc);
 	mqc_setstate(mqc, T1_CTXNO_UNI, 0, 46);
@@ -1314,7 +1490,7 @@ static void t1_decode_cblk(
 		
 		/* BYPASS mode */
 		type = ((bpno <= (cblk->numbps - 1) - 4) && (passtype < 2) && (cblksty & J2K_CCP_CBLKSTY_LAZY)) ? T1_TYPE_RAW : T1_TYPE_MQ;
-		/* FIXME: slviewer gets here with a null pointer. Why? Partially downloaded and/or corrupt textures? */
+		/* not expected any more: t2_decode_packet stops before an incomplete packet instead of leaving segments without data */
 		if(seg->data == NULL){
 			continue;
 		}
@@ -1324,32 +1500,42 @@ static void t1_decode_cblk(
 			mqc_init_dec(mqc, (*seg->data) + seg->dataindex, seg->len);
 		}
 		
-		for (passno = 0; passno < seg->numpasses; ++passno) {
+		for (passno = 0; passno < seg->numpasses && passes_left != 0; ++passno, --passes_left) {
 			switch (passtype) {
 				case 0:
 					if (type == T1_TYPE_RAW) {
-						t1_dec_sigpass_raw(t1, bpno+1, orient, cblksty);
+						t1_dec_sigpass_raw(t1, bpno+1, cblksty);
 					} else {
-						if (cblksty & J2K_CCP_CBLKSTY_VSC) {
-							t1_dec_sigpass_mqc_vsc(t1, bpno+1, orient);
+						if (size == 64) {
+							t1_dec_sigpass_mqc_64x64(t1, bpno+1, orient);
+						} else if (size == 32) {
+							t1_dec_sigpass_mqc_32x32(t1, bpno+1, orient);
 						} else {
-							t1_dec_sigpass_mqc(t1, bpno+1, orient);
+							t1_dec_sigpass_mqc(t1, bpno+1, orient, cblksty);
 						}
 					}
 					break;
 				case 1:
 					if (type == T1_TYPE_RAW) {
-						t1_dec_refpass_raw(t1, bpno+1, cblksty);
+						t1_dec_refpass_raw(t1, bpno+1);
 					} else {
-						if (cblksty & J2K_CCP_CBLKSTY_VSC) {
-							t1_dec_refpass_mqc_vsc(t1, bpno+1);
+						if (size == 64) {
+							t1_dec_refpass_mqc_64x64(t1, bpno+1);
+						} else if (size == 32) {
+							t1_dec_refpass_mqc_32x32(t1, bpno+1);
 						} else {
-							t1_dec_refpass_mqc(t1, bpno+1);
+							t1_dec_refpass_mqc(t1, bpno+1, cblksty);
 						}
 					}
 					break;
 				case 2:
-					t1_dec_clnpass(t1, bpno+1, orient, cblksty);
+					if (size == 64) {
+						t1_dec_clnpass_64x64(t1, bpno+1, orient);
+					} else if (size == 32) {
+						t1_dec_clnpass_32x32(t1, bpno+1, orient);
+					} else {
+						t1_dec_clnpass(t1, bpno+1, orient, cblksty);
+					}
 					break;
 			}
 			
@@ -1364,6 +1550,13 @@ static void t1_decode_cblk(
 				bpno--;
 			}
 		}
+		if (type == T1_TYPE_MQ) {
+			mqc_finish_dec(mqc);
+		}
+		/* the remaining passes only refine the coefficients already decoded */
+		if (passes_left == 0) {
+			break;
+		}
 	}
 }
 
@@ -1381,8 +1574,11 @@ opj_t1_t* t1_create(opj_common_ptr cinfo) {
 
 	t1->data=NULL;
 	t1->flags=NULL;
+	t1->colflags=NULL;
 	t1->datasize=0;
 	t1->flagssize=0;
+	t1->colflagssize=0;
+	t1->max_passes=0;
 
 	return t1;
 }
@@ -1394,103 +1590,320 @@ void t1_destroy(opj_t1_t *t1) {
 		raw_destroy(t1->raw);
 		opj_aligned_free(t1->data);
 		opj_aligned_free(t1->flags);
+		opj_aligned_free(t1->colflags);
 		opj_free(t1);
 	}
 }
 
-void t1_encode_cblks(
+static opj_bool t1_encode_cblk_from_tile(
 		opj_t1_t *t1,
 		opj_tcd_tile_t *tile,
-		opj_tcp_t *tcp)
+		opj_tcp_t *tcp,
+		int compno,
+		int resno,
+		opj_tcd_band_t *band,
+		opj_tcd_cblk_enc_t *cblk)
 {
-	int compno, resno, bandno, precno, cblkno;
+	opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
+	opj_tccp_t* tccp = &tcp->tccps[compno];
+	int tile_w = tilec->x1 - tilec->x0;
+	int bandconst = 8192 * 8192 / ((int) floor(band->stepsize * 8192));
+	int* restrict datap;
+	int* restrict tiledp;
+	int cblk_w;
+	int cblk_h;
+	int i, j;
+
+	int x = cblk->x0 - band->x0;
+	int y = cblk->y0 - band->y0;
+	if (band->bandno & 1) {
+		opj_tcd_resolution_t *pres = &tilec->resolutions[resno - 1];
+		x += pres->x1 - pres->x0;
+	}
+	if (band->bandno & 2) {
+		opj_tcd_resolution_t *pres = &tilec->resolutions[resno - 1];
+		y += pres->y1 - pres->y0;
+	}
+
+	if(!allocate_buffers(
+				t1,
+				cblk->x1 - cblk->x0,
+				cblk->y1 - cblk->y0))
+	{
+		cblk->numbps = 0;
+		cblk->totalpasses = 0;
+		return OPJ_FALSE;
+	}
+
+	datap=t1->data;
+	cblk_w = t1->w;
+	cblk_h = t1->h;
+
+	tiledp=&tilec->data[(y * tile_w) + x];
+	if (tccp->qmfbid == 1) {
+		for (j = 0; j < cblk_h; ++j) {
+			for (i = 0; i < cblk_w; ++i) {
+				int tmp = tiledp[(j * tile_w) + i];
+				datap[(j * cblk_w) + i] = tmp << T1_NMSEDEC_FRACBITS;
+			}
+		}
+	} else {		/* if (tccp->qmfbid == 0) */
+		for (j = 0; j < cblk_h; ++j) {
+			for (i = 0; i < cblk_w; ++i) {
+				int tmp = tiledp[(j * tile_w) + i];
+				datap[(j * cblk_w) + i] =
+					fix_mul(
+					tmp,
+					bandconst) >> (11 - T1_NMSEDEC_FRACBITS);
+			}
+		}
+	}
+
+	t1_encode_cblk(
+			t1,
+			cblk,
+			band->bandno,
+			compno,
+			tilec->numresolutions - 1 - resno,
+			tccp->qmfbid,
+			band->stepsize,
+			tccp->cblksty,
+			tile->numcomps,
+			tcp->mct);
+
+	return OPJ_TRUE;
+}
+
+static void t1_encode_cblk_job(void *user_data, int workerno) {
+	opj_t1_cblk_enc_job_t *job = (opj_t1_cblk_enc_job_t*) user_data;
+	job->failed = !t1_encode_cblk_from_tile(job->t1s[workerno], job->tile, job->tcp, job->compno, job->resno, job->band, job->cblk);
+}
+
+static void t1_sum_distortions(opj_tcd_tile_t *tile) {
+	int compno, resno, bandno, precno, cblkno, passno;
 
 	tile->distotile = 0;		/* fixed_quality */
 
 	for (compno = 0; compno < tile->numcomps; ++compno) {
 		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
-		opj_tccp_t* tccp = &tcp->tccps[compno];
-		int tile_w = tilec->x1 - tilec->x0;
-
 		for (resno = 0; resno < tilec->numresolutions; ++resno) {
 			opj_tcd_resolution_t *res = &tilec->resolutions[resno];
-
 			for (bandno = 0; bandno < res->numbands; ++bandno) {
-				opj_tcd_band_t* restrict band = &res->bands[bandno];
-        int bandconst = 8192 * 8192 / ((int) floor(band->stepsize * 8192));
-
+				opj_tcd_band_t* band = &res->bands[bandno];
 				for (precno = 0; precno < res->pw * res->ph; ++precno) {
 					opj_tcd_precinct_t *prc = &band->precincts[precno];
-
 					for (cblkno = 0; cblkno < prc->cw * prc->ch; ++cblkno) {
 						opj_tcd_cblk_enc_t* cblk = &prc->cblks.enc[cblkno];
-						int* restrict datap;
-						int* restrict tiledp;
-						int cblk_w;
-						int cblk_h;
-						int i, j;
-
-						int x = cblk->x0 - band->x0;
-						int y = cblk->y0 - band->y0;
-						if (band->bandno & 1) {
-							opj_tcd_resolution_t *pres = &tilec->resolutions[resno - 1];
-							x += pres->x1 - pres->x0;
-						}
-						if (band->bandno & 2) {
-							opj_tcd_resolution_t *pres = &tilec->resolutions[resno - 1];
-							y += pres->y1 - pres->y0;
+						double cumwmsedec = 0.0;
+						for (passno = 0; passno < cblk->totalpasses; passno++) {
+							opj_tcd_pass_t *pass = &cblk->passes[passno];
+							cumwmsedec += pass->distortiondec;
+							tile->distotile += pass->distortiondec;
+							pass->distortiondec = cumwmsedec;
 						}
+					}
+				}
+			}
+		}
+	}
+}
 
-						if(!allocate_buffers(
-									t1,
-									cblk->x1 - cblk->x0,
-									cblk->y1 - cblk->y0))
-						{
-							return;
-						}
+opj_bool t1_encode_cblks(
+		opj_t1_t *t1,
+		opj_tcd_tile_t *tile,
+		opj_tcp_t *tcp)
+{
+	int compno, resno, bandno, precno, cblkno;
+	opj_bool success = OPJ_TRUE;
 
-						datap=t1->data;
-						cblk_w = t1->w;
-						cblk_h = t1->h;
-
-						tiledp=&tilec->data[(y * tile_w) + x];
-						if (tccp->qmfbid == 1) {
-							for (j = 0; j < cblk_h; ++j) {
-								for (i = 0; i < cblk_w; ++i) {
-									int tmp = tiledp[(j * tile_w) + i];
-									datap[(j * cblk_w) + i] = tmp << T1_NMSEDEC_FRACBITS;
-								}
-							}
-						} else {		/* if (tccp->qmfbid == 0) */
-							for (j = 0; j < cblk_h; ++j) {
-								for (i = 0; i < cblk_w; ++i) {
-									int tmp = tiledp[(j * tile_w) + i];
-									datap[(j * cblk_w) + i] =
-										fix_mul(
-										tmp,
-										bandconst) >> (11 - T1_NMSEDEC_FRACBITS);
-								}
-							}
-						}
+	for (compno = 0; compno < tile->numcomps; ++compno) {
+		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
 
-						t1_encode_cblk(
-								t1,
-								cblk,
-								band->bandno,
-								compno,
-								tilec->numresolutions - 1 - resno,
-								tccp->qmfbid,
-								band->stepsize,
-								tccp->cblksty,
-								tile->numcomps,
-								tcp->mct,
-								tile);
+		for (resno = 0; resno < tilec->numresolutions; ++resno) {
+			opj_tcd_resolution_t *res = &tilec->resolutions[resno];
+
+			for (bandno = 0; bandno < res->numbands; ++bandno) {
+				opj_tcd_band_t* restrict band = &res->bands[bandno];
+
+				for (precno = 0; precno < res->pw * res->ph; ++precno) {
+					opj_tcd_precinct_t *prc = &band->precincts[precno];
 
+					for (cblkno = 0; cblkno < prc->cw * prc->ch; ++cblkno) {
+						if (!t1_encode_cblk_from_tile(t1, tile, tcp, compno, resno, band, &prc->cblks.enc[cblkno])) {
+							success = OPJ_FALSE;
+						}
 					} /* cblkno */
 				} /* precno */
 			} /* bandno */
 		} /* resno  */
 	} /* compno  */
+
+	t1_sum_distortions(tile);
+	return success;
+}
+
+opj_bool t1_encode_cblks_mt(
+		opj_thread_pool_t* tp,
+		opj_t1_t** t1s,
+		opj_tcd_tile_t* tile,
+		opj_tcp_t* tcp)
+{
+	int compno, resno, bandno, precno, cblkno;
+	int numjobs = 0, jobno;
+	opj_t1_cblk_enc_job_t *jobs = NULL;
+	opj_bool success = OPJ_TRUE;
+
+	for (compno = 0; compno < tile->numcomps; ++compno) {
+		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
+		for (resno = 0; resno < tilec->numresolutions; ++resno) {
+			opj_tcd_resolution_t* res = &tilec->resolutions[resno];
+			for (bandno = 0; bandno < res->numbands; ++bandno) {
+				opj_tcd_band_t* band = &res->bands[bandno];
+				for (precno = 0; precno < res->pw * res->ph; ++precno) {
+					numjobs += band->precincts[precno].cw * band->precincts[precno].ch;
+				}
+			}
+		}
+	}
+	if (numjobs == 0) {
+		t1_sum_distortions(tile);
+		return OPJ_TRUE;
+	}
+	jobs = (opj_t1_cblk_enc_job_t*) opj_malloc(numjobs * sizeof(opj_t1_cblk_enc_job_t));
+	if (!jobs) {
+		/* still encode the tile, in the calling thread */
+		return t1_encode_cblks(t1s[0], tile, tcp);
+	}
+
+	/* every code-block reads its own area of tilec->data and has its own passes, so they can be encoded in any order */
+	jobno = 0;
+	for (compno = 0; compno < tile->numcomps; ++compno) {
+		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
+		for (resno = 0; resno < tilec->numresolutions; ++resno) {
+			opj_tcd_resolution_t* res = &tilec->resolutions[resno];
+			for (bandno = 0; bandno < res->numbands; ++bandno) {
+				opj_tcd_band_t* band = &res->bands[bandno];
+				for (precno = 0; precno < res->pw * res->ph; ++precno) {
+					opj_tcd_precinct_t* prc = &band->precincts[precno];
+					for (cblkno = 0; cblkno < prc->cw * prc->ch; ++cblkno) {
+						opj_t1_cblk_enc_job_t *job = &jobs[jobno++];
+						job->t1s = t1s;
+						job->tile = tile;
+						job->tcp = tcp;
+						job->compno = compno;
+						job->resno = resno;
+						job->band = band;
+						job->cblk = &prc->cblks.enc[cblkno];
+						job->failed = OPJ_FALSE;
+						opj_thread_pool_submit_or_run(tp, t1_encode_cblk_job, job);
+					}
+				}
+			}
+		}
+	}
+	opj_thread_pool_wait_completion(tp, 0);
+
+	for (jobno = 0; jobno < numjobs; jobno++) {
+		if (jobs[jobno].failed) {
+			success = OPJ_FALSE;
+		}
+	}
+	opj_free(jobs);
+
+	t1_sum_distortions(tile);
+	return success;
+}
+
+static void t1_decode_cblk_to_tile(
+		opj_t1_t* t1,
+		opj_tcd_tilecomp_t* tilec,
+		opj_tccp_t* tccp,
+		int resno,
+		opj_tcd_band_t* band,
+		opj_tcd_cblk_dec_t* cblk)
+{
+	int* restrict datap;
+	int cblk_w, cblk_h;
+	int x, y;
+	int i, j;
+
+	/* tilec->data only holds the resolutions that are decoded */
+	opj_tcd_resolution_t* rdec = &tilec->resolutions[tilec->resno_decoded];
+	int tile_w = rdec->x1 - rdec->x0;
+
+	x = cblk->x0 - band->x0;
+	y = cblk->y0 - band->y0;
+	if (band->bandno & 1) {
+		opj_tcd_resolution_t* pres = &tilec->resolutions[resno - 1];
+		x += pres->x1 - pres->x0;
+	}
+	if (band->bandno & 2) {
+		opj_tcd_resolution_t* pres = &tilec->resolutions[resno - 1];
+		y += pres->y1 - pres->y0;
+	}
+
+	/* outside of the decode area: the DWT only needs defined (zero) coefficients */
+	if (cblk->skip) {
+		cblk_w = cblk->x1 - cblk->x0;
+		cblk_h = cblk->y1 - cblk->y0;
+		for (j = 0; j < cblk_h; ++j) {
+			memset(&tilec->data[((y + j) * tile_w) + x], 0, cblk_w * sizeof(int));
+		}
+		return;
+	}
+
+	t1_decode_cblk(
+			t1,
+			cblk,
+			band->bandno,
+			tccp->roishift,
+			tccp->cblksty);
+
+	datap=t1->data;
+	cblk_w = t1->w;
+	cblk_h = t1->h;
+
+	if (tccp->roishift) {
+		int thresh = 1 << tccp->roishift;
+		for (j = 0; j < cblk_h; ++j) {
+			for (i = 0; i < cblk_w; ++i) {
+				int val = datap[(j * cblk_w) + i];
+				int mag = abs(val);
+				if (mag >= thresh) {
+					mag >>= tccp->roishift;
+					datap[(j * cblk_w) + i] = val < 0 ? -mag : mag;
+				}
+			}
+		}
+	}
+
+	if (tccp->qmfbid == 1) {
+		int* restrict tiledp = &tilec->data[(y * tile_w) + x];
+		for (j = 0; j < cblk_h; ++j) {
+			for (i = 0; i < cblk_w; ++i) {
+				int tmp = datap[(j * cblk_w) + i];
+				((int*)tiledp)[(j * tile_w) + i] = tmp / 2;
+			}
+		}
+	} else {		/* if (tccp->qmfbid == 0) */
+		float* restrict tiledp = (float*) &tilec->data[(y * tile_w) + x];
+		for (j = 0; j < cblk_h; ++j) {
+			float* restrict tiledp2 = tiledp;
+			for (i = 0; i < cblk_w; ++i) {
+				float tmp = *datap * band->stepsize;
+				*tiledp2 = tmp;
+				datap++;
+				tiledp2++;
+			}
+			tiledp += tile_w;
+		}
+	}
+	/* the code-block data belongs to the arena of the tile, released by tcd_free_decode_tile */
+}
+
+static void t1_decode_cblk_job(void *user_data, int workerno) {
+	opj_t1_cblk_job_t *job = (opj_t1_cblk_job_t*) user_data;
+	t1_decode_cblk_to_tile(job->t1s[workerno], job->tilec, job->tccp, job->resno, job->band, job->cblk);
 }
 
 void t1_decode_cblks(
@@ -1500,9 +1913,8 @@ void t1_decode_cblks(
 {
 	int resno, bandno, precno, cblkno;
 
-	int tile_w = tilec->x1 - tilec->x0;
-
-	for (resno = 0; resno < tilec->numresolutions; ++resno) {
+	/* the resolutions above resno_decoded are never read by the DWT */
+	for (resno = 0; resno <= tilec->resno_decoded; ++resno) {
 		opj_tcd_resolution_t* res = &tilec->resolutions[resno];
 
 		for (bandno = 0; bandno < res->numbands; ++bandno) {
@@ -1512,76 +1924,66 @@ void t1_decode_cblks(
 				opj_tcd_precinct_t* precinct = &band->precincts[precno];
 
 				for (cblkno = 0; cblkno < precinct->cw * precinct->ch; ++cblkno) {
-					opj_tcd_cblk_dec_t* cblk = &precinct->cblks.dec[cblkno];
-					int* restrict datap;
-					int cblk_w, cblk_h;
-					int x, y;
-					int i, j;
-
-					t1_decode_cblk(
-							t1,
-							cblk,
-							band->bandno,
-							tccp->roishift,
-							tccp->cblksty);
-
-					x = cblk->x0 - band->x0;
-					y = cblk->y0 - band->y0;
-					if (band->bandno & 1) {
-						opj_tcd_resolution_t* pres = &tilec->resolutions[resno - 1];
-						x += pres->x1 - pres->x0;
-					}
-					if (band->bandno & 2) {
-						opj_tcd_resolution_t* pres = &tilec->resolutions[resno - 1];
-						y += pres->y1 - pres->y0;
-					}
-
-					datap=t1->data;
-					cblk_w = t1->w;
-					cblk_h = t1->h;
-
-					if (tccp->roishift) {
-						int thresh = 1 << tccp->roishift;
-						for (j = 0; j < cblk_h; ++j) {
-							for (i = 0; i < cblk_w; ++i) {
-								int val = datap[(j * cblk_w) + i];
-								int mag = abs(val);
-								if (mag >= thresh) {
-									mag >>= tccp->roishift;
-									datap[(j * cblk_w) + i] = val < 0 ? -mag : mag;
-								}
-							}
-						}
-					}
-
-					if (tccp->qmfbid == 1) {
-						int* restrict tiledp = &tilec->data[(y * tile_w) + x];
-						for (j = 0; j < cblk_h; ++j) {
-							for (i = 0; i < cblk_w; ++i) {
-								int tmp = datap[(j * cblk_w) + i];
-								((int*)tiledp)[(j * tile_w) + i] = tmp / 2;
-							}
-						}
-					} else {		/* if (tccp->qmfbid == 0) */
-						float* restrict tiledp = (float*) &tilec->data[(y * tile_w) + x];
-						for (j = 0; j < cblk_h; ++j) {
-							float* restrict tiledp2 = tiledp;
-							for (i = 0; i < cblk_w; ++i) {
-								float tmp = *datap * band->stepsize;
-								*tiledp2 = tmp;
-								datap++;
-								tiledp2++;
-							}
-							tiledp += tile_w;
-						}
-					}
-					opj_free(cblk->data);
-					opj_free(cblk->segs);
+					t1_decode_cblk_to_tile(t1, tilec, tccp, resno, band, &precinct->cblks.dec[cblkno]);
 				} /* cblkno */
-				opj_free(precinct->cblks.dec);
-                precinct->cblks.dec = NULL;
 			} /* precno */
 		} /* bandno */
 	} /* resno */
 }
 
+opj_bool t1_decode_cblks_mt(
+		opj_thread_pool_t* tp,
+		opj_t1_t** t1s,
+		opj_tcd_tile_t* tile,
+		opj_tcp_t* tcp)
+{
+	int compno, resno, bandno, precno, cblkno;
+	int numjobs = 0, jobno = 0;
+	opj_t1_cblk_job_t *jobs = NULL;
+
+	for (compno = 0; compno < tile->numcomps; ++compno) {
+		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
+		for (resno = 0; resno <= tilec->resno_decoded; ++resno) {
+			opj_tcd_resolution_t* res = &tilec->resolutions[resno];
+			for (bandno = 0; bandno < res->numbands; ++bandno) {
+				opj_tcd_band_t* band = &res->bands[bandno];
+				for (precno = 0; precno < res->pw * res->ph; ++precno) {
+					numjobs += band->precincts[precno].cw * band->precincts[precno].ch;
+				}
+			}
+		}
+	}
+	/* the jobs are released with the rest of the tile */
+	jobs = (opj_t1_cblk_job_t*) opj_arena_alloc(tile->arena, numjobs * sizeof(opj_t1_cblk_job_t));
+	if (numjobs > 0 && !jobs) {
+		return OPJ_FALSE;
+	}
+
+	/* every code-block writes to its own area of tilec->data, so they can be decoded in any order */
+	for (compno = 0; compno < tile->numcomps; ++compno) {
+		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
+		for (resno = 0; resno <= tilec->resno_decoded; ++resno) {
+			opj_tcd_resolution_t* res = &tilec->resolutions[resno];
+			for (bandno = 0; bandno < res->numbands; ++bandno) {
+				opj_tcd_band_t* band = &res->bands[bandno];
+				for (precno = 0; precno < res->pw * res->ph; ++precno) {
+					opj_tcd_precinct_t* precinct = &band->precincts[precno];
+					for (cblkno = 0; cblkno < precinct->cw * precinct->ch; ++cblkno) {
+						opj_t1_cblk_job_t *job = &jobs[jobno++];
+						job->t1s = t1s;
+						job->tilec = tilec;
+						job->tccp = &tcp->tccps[compno];
+						job->resno = resno;
+						job->band = band;
+						job->cblk = &precinct->cblks.dec[cblkno];
+						/* decoded here rather than leave a hole in the tile if it cannot be queued */
+						opj_thread_pool_submit_or_run(tp, t1_decode_cblk_job, job);
+					}
+				}
+			}
+		}
+	}
+	opj_thread_pool_wait_completion(tp, 0);
+	return OPJ_TRUE;
+}
+
@@ -65,6 +65,67 @@ in T1.C are used by some function in TCD.C.
 #define T1_REFINE 0x2000
 #define T1_VISIT 0x4000
 
+/*
+Packed state used by the decoder: one 32-bit word per column of a 4-row stripe.
+The SIGMA bits are the significance of the 3 columns x 6 rows window centered on the column
+(rows -1 to 4 of the stripe, from west to east), CHI the sign of the rows -1 to 4 of the column,
+MU the refinement and PI the visit state of its rows 0 to 3.
+The window of row ci of the stripe is made of the bits 3*ci to 3*ci+8.
+*/
+#define T1_SIGMA_0 (1U << 0)
+#define T1_SIGMA_1 (1U << 1)
+#define T1_SIGMA_2 (1U << 2)
+#define T1_SIGMA_3 (1U << 3)
+#define T1_SIGMA_4 (1U << 4)
+#define T1_SIGMA_5 (1U << 5)
+#define T1_SIGMA_6 (1U << 6)
+#define T1_SIGMA_7 (1U << 7)
+#define T1_SIGMA_8 (1U << 8)
+#define T1_SIGMA_9 (1U << 9)
+#define T1_SIGMA_10 (1U << 10)
+#define T1_SIGMA_11 (1U << 11)
+#define T1_SIGMA_12 (1U << 12)
+#define T1_SIGMA_13 (1U << 13)
+#define T1_SIGMA_14 (1U << 14)
+#define T1_SIGMA_15 (1U << 15)
+#define T1_SIGMA_16 (1U << 16)
+#define T1_SIGMA_17 (1U << 17)
+#define T1_CHI_0 (1U << 18)
+#define T1_CHI_0_I 18
+#define T1_CHI_1 (1U << 19)
+#define T1_CHI_1_I 19
+#define T1_MU_0 (1U << 20)
+#define T1_PI_0 (1U << 21)
+#define T1_CHI_2 (1U << 22)
+#define T1_CHI_2_I 22
+#define T1_MU_1 (1U << 23)
+#define T1_PI_1 (1U << 24)
+#define T1_CHI_3 (1U << 25)
+#define T1_MU_2 (1U << 26)
+#define T1_PI_2 (1U << 27)
+#define T1_CHI_4 (1U << 28)
+#define T1_MU_3 (1U << 29)
+#define T1_PI_3 (1U << 30)
+#define T1_CHI_5 (1U << 31)
+#define T1_CHI_5_I 31
+
+#define T1_SIGMA_NW T1_SIGMA_0	/**< Row 0 of the stripe : North-West neighbour */
+#define T1_SIGMA_N T1_SIGMA_1	/**< Row 0 of the stripe : North neighbour */
+#define T1_SIGMA_NE T1_SIGMA_2	/**< Row 0 of the stripe : North-East neighbour */
+#define T1_SIGMA_W T1_SIGMA_3	/**< Row 0 of the stripe : West neighbour */
+#define T1_SIGMA_THIS T1_SIGMA_4	/**< Row 0 of the stripe : the sample itself */
+#define T1_SIGMA_E T1_SIGMA_5	/**< Row 0 of the stripe : East neighbour */
+#define T1_SIGMA_SW T1_SIGMA_6	/**< Row 0 of the stripe : South-West neighbour */
+#define T1_SIGMA_S T1_SIGMA_7	/**< Row 0 of the stripe : South neighbour */
+#define T1_SIGMA_SE T1_SIGMA_8	/**< Row 0 of the stripe : South-East neighbour */
+#define T1_SIGMA_NEIGHBOURS (T1_SIGMA_NW|T1_SIGMA_N|T1_SIGMA_NE|T1_SIGMA_W|T1_SIGMA_E|T1_SIGMA_SW|T1_SIGMA_S|T1_SIGMA_SE)
+#define T1_CHI_THIS T1_CHI_1
+#define T1_CHI_THIS_I T1_CHI_1_I
+#define T1_MU_THIS T1_MU_0
+#define T1_PI_THIS T1_PI_0
+/** Bits of the row 4 of the stripe, ignored by the last row of a stripe in VSC mode */
+#define T1_VSC_MASK (T1_SIGMA_15|T1_SIGMA_16|T1_SIGMA_17|T1_CHI_5)
+
 #define T1_NUMCTXS_ZC 9
 #define T1_NUMCTXS_SC 5
 #define T1_NUMCTXS_MAG 3
@@ -86,6 +147,8 @@ in T1.C are used by some function in TCD.C.
 /* ----------------------------------------------------------------------- */
 
 typedef short flag_t;
+/** Packed decoder state of a column of a 4-row stripe (T1_SIGMA_*, T1_CHI_*, T1_MU_* and T1_PI_* bits) */
+typedef unsigned int colflag_t;
 
 /**
 Tier-1 coding (coding of code-block coefficients)
@@ -100,12 +163,18 @@ typedef struct opj_t1 {
 	opj_raw_t *raw;
 
 	int *data;
+	/** encoder state, one flag_t per sample */
 	flag_t *flags;
+	/** decoder state, one colflag_t per column of each stripe */
+	colflag_t *colflags;
 	int w;
 	int h;
 	int datasize;
 	int flagssize;
+	int colflagssize;
 	int flags_stride;
+	/** if != 0, maximum number of coding passes decoded per code-block (see opj_cp_t::max_passes) */
+	int max_passes;
 } opj_t1_t;
 
 #define MACRO_t1_flags(x,y) t1->flags[((x)*(t1->flags_stride))+(y)]
@@ -130,15 +199,36 @@ Encode the code-blocks of a tile
 @param t1 T1 handle
 @param tile The tile to encode
 @param tcp Tile coding parameters
+@return Returns OPJ_FALSE if a code-block could not be encoded (it is left empty), returns OPJ_TRUE otherwise
+*/
+opj_bool t1_encode_cblks(opj_t1_t *t1, opj_tcd_tile_t *tile, opj_tcp_t *tcp);
+/**
+Encode the code-blocks of all the components of a tile, using one T1 handle per worker.
+The codestream and the distortions are the same as with t1_encode_cblks, whatever the
+number of workers.
+@param tp Thread pool running the code-block jobs
+@param t1s One T1 handle per worker of tp
+@param tile The tile to encode
+@param tcp Tile coding parameters
+@return Returns OPJ_FALSE if a code-block could not be encoded (it is left empty), returns OPJ_TRUE otherwise
 */
-void t1_encode_cblks(opj_t1_t *t1, opj_tcd_tile_t *tile, opj_tcp_t *tcp);
+opj_bool t1_encode_cblks_mt(opj_thread_pool_t *tp, opj_t1_t **t1s, opj_tcd_tile_t *tile, opj_tcp_t *tcp);
 /**
-Decode the code-blocks of a tile
+Decode the code-blocks of a tile, up to resolution tilec->resno_decoded
 @param t1 T1 handle
 @param tilec The tile to decode
 @param tccp Tile coding parameters
 */
 void t1_decode_cblks(opj_t1_t* t1, opj_tcd_tilecomp_t* tilec, opj_tccp_t* tccp);
+/**
+Decode the code-blocks of all the components of a tile, using one T1 handle per worker
+@param tp Thread pool running the code-block jobs
+@param t1s One T1 handle per worker of tp
+@param tile The tile to decode (tilec->data must be allocated)
+@param tcp Tile coding parameters
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+opj_bool t1_decode_cblks_mt(opj_thread_pool_t *tp, opj_t1_t **t1s, opj_tcd_tile_t *tile, opj_tcp_t *tcp);
 /* ----------------------------------------------------------------------- */
 /*@}*/
 
@@ -173,6 +173,22 @@ static int t1_init_spb(int f) {
 	return n;
 }
 
+static int t1_init_sigma_flags(int s) {
+	static const int sig[9] = {
+		T1_SIG_NW, T1_SIG_N, T1_SIG_NE,
+		T1_SIG_W, 0, T1_SIG_E,
+		T1_SIG_SW, T1_SIG_S, T1_SIG_SE
+	};
+	int i, f = 0;
+
+	for (i = 0; i < 9; ++i) {
+		if (s & (1 << i))
+			f |= sig[i];
+	}
+
+	return f;
+}
+
 void dump_array16(int array[],int size){
 	int i;
 	--size;
@@ -217,6 +233,15 @@ int main(){
 	}
 	printf("%i\n};\n\n", lut_ctxno_zc[1023]);
 
+	/* lut_ctxno_zc_col: lut_ctxno_zc indexed by the 3x3 significance window of colflag_t */
+	printf("static char lut_ctxno_zc_col[2048] = {\n  ");
+	for (i = 0; i < 2047; ++i) {
+		printf("%i, ", lut_ctxno_zc[((i >> 9) << 8) | t1_init_sigma_flags(i & 0x1ff)]);
+		if(!((i+1)&0x1f))
+			printf("\n  ");
+	}
+	printf("%i\n};\n\n", lut_ctxno_zc[(3 << 8) | t1_init_sigma_flags(0x1ff)]);
+
 	/* lut_ctxno_sc */
 	printf("static char lut_ctxno_sc[256] = {\n  ");
 	for (i = 0; i < 255; ++i) {
@@ -67,7 +67,7 @@ static int t2_encode_packet(opj_tcd_tile_t *tile, opj_tcp_t *tcp, opj_pi_iterato
 @param cblksty
 @param first
 */
-static opj_bool t2_init_seg(opj_tcd_cblk_dec_t* cblk, int index, int cblksty, int first);
+static opj_bool t2_init_seg(opj_arena_t *arena, opj_tcd_cblk_dec_t* cblk, int index, int cblksty, int first);
 /**
 Decode a packet of a tile from a source buffer
 @param t2 T2 handle
@@ -77,7 +77,8 @@ Decode a packet of a tile from a source buffer
 @param tcp Tile coding parameters
 @param pi Packet identity
 @param pack_info Packet information
-@return 
+@return Returns the number of bytes read, or -999 if the packet is incomplete or invalid.
+An incomplete packet leaves the code-blocks as they were: they are decoded with the packets read before.
 */
 static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_tile_t *tile, 
 														opj_tcp_t *tcp, opj_pi_iterator_t *pi, opj_packet_info_t *pack_info);
@@ -299,16 +300,22 @@ static int t2_encode_packet(opj_tcd_tile_t * tile, opj_tcp_t * tcp, opj_pi_itera
 	return (c - dest);
 }
 
-static opj_bool t2_init_seg(opj_tcd_cblk_dec_t* cblk, int index, int cblksty, int first) {
+static opj_bool t2_init_seg(opj_arena_t *arena, opj_tcd_cblk_dec_t* cblk, int index, int cblksty, int first) {
 	opj_tcd_seg_t* seg;
-    opj_tcd_seg_t* segs;
-    segs = (opj_tcd_seg_t*) opj_realloc(cblk->segs, (index + 1) * sizeof(opj_tcd_seg_t));
 
-    if (segs == NULL)
-    {
-        return OPJ_FALSE;
-    }
-    cblk->segs = segs;
+	/* the arena cannot grow a block in place: double the capacity to copy the segments only a few times */
+	if (index >= cblk->maxsegs) {
+		int maxsegs = int_max(index + 1, 2 * cblk->maxsegs);
+		opj_tcd_seg_t* segs = (opj_tcd_seg_t*) opj_arena_alloc(arena, maxsegs * sizeof(opj_tcd_seg_t));
+		if (segs == NULL) {
+			return OPJ_FALSE;
+		}
+		if (cblk->segs) {
+			memcpy(segs, cblk->segs, cblk->maxsegs * sizeof(opj_tcd_seg_t));
+		}
+		cblk->segs = segs;
+		cblk->maxsegs = maxsegs;
+	}
 
 	seg = &cblk->segs[index];
 	seg->data = NULL;
@@ -343,14 +350,22 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 	int precno = pi->precno;	/* precinct value */
 	int layno  = pi->layno;		/* quality layer value */
 
-	unsigned char *hd = NULL;
+	unsigned char *hd = NULL, *hd_end = NULL;
 	int present;
+	int bodylen = 0;	/* length of the packet body, from its header, capped past the end of the data */
 	
 	opj_bio_t *bio = NULL;	/* BIO component */
 
 	opj_tcd_resolution_t* res;
+	/* resolution discarded by the reduce factor: its packets are parsed but their data is not kept */
+	opj_bool skip_data;
+	/* layer past cp_layer: parsed to reach the next packets, but not given to tier-1 */
+	opj_bool skip_layer;
 	assert(&tile->comps[compno] != NULL);
 	res = &tile->comps[compno].resolutions[resno];
+	/* the factor of the image is cp->reduce, unless a truncated codestream raised it (see tcd_decode_tile_t2) */
+	skip_layer = cp->layer && layno >= cp->layer;
+	skip_data = skip_layer || resno >= tile->comps[compno].numresolutions - t2->image->comps[compno].factor;
 
 	if (layno == 0) {
 		for (bandno = 0; bandno < res->numbands; bandno++) {
@@ -364,6 +379,7 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 			for (cblkno = 0; cblkno < prc->cw * prc->ch; cblkno++) {
 				opj_tcd_cblk_dec_t* cblk = &prc->cblks.dec[cblkno];
 				cblk->numsegs = 0;
+				cblk->numpasses = 0;
 			}
 		}
 	}
@@ -371,7 +387,7 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 	/* SOP markers */
 	
 	if (tcp->csty & J2K_CP_CSTY_SOP) {
-		if ((*c) != 0xff || (*(c + 1) != 0x91)) {
+		if (src + len - c < 6 || (*c) != 0xff || (*(c + 1) != 0x91)) {
 			opj_event_msg(t2->cinfo, EVT_WARNING, "Expected SOP marker\n");
 		} else {
 			c += 6;
@@ -391,12 +407,15 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 	
 	if (cp->ppm == 1) {		/* PPM */
 		hd = cp->ppm_data;
+		hd_end = hd + cp->ppm_len;
 		bio_init_dec(bio, hd, cp->ppm_len);
 	} else if (tcp->ppt == 1) {	/* PPT */
 		hd = tcp->ppt_data;
+		hd_end = hd + tcp->ppt_len;
 		bio_init_dec(bio, hd, tcp->ppt_len);
 	} else {			/* Normal Case */
 		hd = c;
+		hd_end = src + len;
 		bio_init_dec(bio, hd, src+len-hd);
 	}
 	
@@ -405,12 +424,17 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 	if (!present) {
 		bio_inalign(bio);
 		hd += bio_numbytes(bio);
+		/* the packet is missing: the data ends before it */
+		if (bio_overrun(bio)) {
+			bio_destroy(bio);
+			return -999;
+		}
 		bio_destroy(bio);
 		
 		/* EPH markers */
 		
 		if (tcp->csty & J2K_CP_CSTY_EPH) {
-			if ((*hd) != 0xff || (*(hd + 1) != 0x92)) {
+			if (hd_end - hd < 2 || (*hd) != 0xff || (*(hd + 1) != 0x92)) {
 				printf("Error : expected EPH marker\n");
 			} else {
 				hd += 2;
@@ -477,7 +501,7 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 			cblk->numlenbits += increment;
 			segno = 0;
 			if (!cblk->numsegs) {
-                if (!t2_init_seg(cblk, segno, tcp->tccps[compno].cblksty, 1))
+                if (!t2_init_seg(tile->arena, cblk, segno, tcp->tccps[compno].cblksty, 1))
                 {
                     opj_event_msg(t2->cinfo, EVT_ERROR, "Out of memory\n");
                     bio_destroy(bio);
@@ -487,7 +511,7 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 				segno = cblk->numsegs - 1;
 				if (cblk->segs[segno].numpasses == cblk->segs[segno].maxpasses) {
 					++segno;
-                    if (!t2_init_seg(cblk, segno, tcp->tccps[compno].cblksty, 0))
+                    if (!t2_init_seg(tile->arena, cblk, segno, tcp->tccps[compno].cblksty, 0))
                     {
                         opj_event_msg(t2->cinfo, EVT_ERROR, "Out of memory\n");
                         bio_destroy(bio);
@@ -500,10 +524,11 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 			do {
 				cblk->segs[segno].numnewpasses = int_min(cblk->segs[segno].maxpasses - cblk->segs[segno].numpasses, n);
 				cblk->segs[segno].newlen = bio_read(bio, cblk->numlenbits + int_floorlog2(cblk->segs[segno].numnewpasses));
+				bodylen += int_min(cblk->segs[segno].newlen, len + 1 - bodylen);
 				n -= cblk->segs[segno].numnewpasses;
 				if (n > 0) {
 					++segno;
-                    if (!t2_init_seg(cblk, segno, tcp->tccps[compno].cblksty, 0))
+                    if (!t2_init_seg(tile->arena, cblk, segno, tcp->tccps[compno].cblksty, 0))
                     {
                         opj_event_msg(t2->cinfo, EVT_ERROR, "Out of memory\n");
                         bio_destroy(bio);
@@ -514,7 +539,8 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 		}
 	}
 	
-	if (bio_inalign(bio)) {
+	/* the header is incomplete: the data ends inside it */
+	if (bio_inalign(bio) || bio_overrun(bio)) {
 		bio_destroy(bio);
 		return -999;
 	}
@@ -524,7 +550,7 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 	
 	/* EPH markers */
 	if (tcp->csty & J2K_CP_CSTY_EPH) {
-		if ((*hd) != 0xff || (*(hd + 1) != 0x92)) {
+		if (hd_end - hd < 2 || (*hd) != 0xff || (*(hd + 1) != 0x92)) {
 			opj_event_msg(t2->cinfo, EVT_ERROR, "Expected EPH marker\n");
 			return -999;
 		} else {
@@ -549,6 +575,14 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 	} else {
 		c=hd;
 	}
+
+	/* 
+	the body is incomplete: stop before any code-block takes a part of it, so that
+	the code-blocks are decoded as they were after the previous packet
+	*/
+	if (bodylen > src + len - c) {
+		return -999;
+	}
 	
 	for (bandno = 0; bandno < res->numbands; bandno++) {
 		opj_tcd_band_t *band = &res->bands[bandno];
@@ -598,15 +632,33 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 
 #endif /* USE_JPWL */
 				
-				cblk->data = (unsigned char*) opj_realloc(cblk->data, (cblk->len + seg->newlen) * sizeof(unsigned char));
-				memcpy(cblk->data + cblk->len, c, seg->newlen);
-				if (seg->numpasses == 0) {
-					seg->data = &cblk->data;
-					seg->dataindex = cblk->len;
+				if (!skip_data && !cblk->skip) {
+					if (cblk->len + seg->newlen > cblk->maxlen || !cblk->data) {
+						/* same growth as the segments, see t2_init_seg. The MQ decoder writes past the end of the data, even when empty */
+						int maxlen = int_max(cblk->len + seg->newlen, 2 * cblk->maxlen);
+						unsigned char *data = (unsigned char*) opj_arena_alloc(tile->arena, (maxlen + MQC_DEC_MARGIN) * sizeof(unsigned char));
+						if (!data) {
+							opj_event_msg(t2->cinfo, EVT_ERROR, "Out of memory\n");
+							return -999;
+						}
+						if (cblk->data) {
+							memcpy(data, cblk->data, int_min(cblk->len, cblk->maxlen));
+						}
+						cblk->data = data;
+						cblk->maxlen = maxlen;
+					}
+					memcpy(cblk->data + cblk->len, c, seg->newlen);
+					if (seg->numpasses == 0) {
+						seg->data = &cblk->data;
+						seg->dataindex = cblk->len;
+					}
 				}
 				c += seg->newlen;
-				cblk->len += seg->newlen;
-				seg->len += seg->newlen;
+				if (!skip_layer) {
+					cblk->len += seg->newlen;
+					seg->len += seg->newlen;
+					cblk->numpasses += seg->numnewpasses;
+				}
 				seg->numpasses += seg->numnewpasses;
 				cblk->numnewpasses -= seg->numnewpasses;
 				if (cblk->numnewpasses > 0) {
@@ -713,47 +765,93 @@ int t2_encode_packets(opj_t2_t* t2,int tileno, opj_tcd_tile_t *tile, int maxlaye
   return (c - dest);
 }
 
-int t2_decode_packets(opj_t2_t *t2, unsigned char *src, int len, int tileno, opj_tcd_tile_t *tile, opj_codestream_info_t *cstr_info) {
-	unsigned char *c = src;
+int t2_decode_packets(opj_t2_t *t2, opj_tile_span_t *spans, int numspans, int tileno, opj_tcd_tile_t *tile, opj_codestream_info_t *cstr_info) {
+	opj_tile_span_t nodata = { NULL, 0 };
+	unsigned char *c, *end;
+	int spanno = 0, spanstart = 0;
 	opj_pi_iterator_t *pi;
 	int pino, e = 0;
 	int n = 0, curtp = 0;
+	/* the next packets are not read: the ones that follow must not be needed */
+	opj_bool done = OPJ_FALSE;
 	int tp_start_packno;
 
 	opj_image_t *image = t2->image;
 	opj_cp_t *cp = t2->cp;
+	int compno, resno;
 	
-	/* create a packet iterator */
-	pi = pi_create_decode(image, cp, tileno);
+	/* create a packet iterator, released with the rest of the tile */
+	pi = pi_create_decode(image, cp, tileno, tile->arena);
 	if(!pi) {
 		/* TODO: throw an error */
 		return -999;
 	}
 
+	for (compno = 0; compno < tile->numcomps; compno++) {
+		for (resno = 0; resno < tile->comps[compno].numresolutions; resno++) {
+			tile->comps[compno].resolutions[resno].numprc_decoded = 0;
+		}
+	}
+
 	tp_start_packno = 0;
+
+	if (numspans == 0) {
+		spans = &nodata;
+		numspans = 1;
+	}
+	c = spans[0].data;
+	end = c + spans[0].len;
 	
 	for (pino = 0; pino <= cp->tcps[tileno].numpocs; pino++) {
 		while (pi_next(&pi[pino])) {
-			if ((cp->layer==0) || (cp->layer>=((pi[pino].layno)+1))) {
-				opj_packet_info_t *pack_info;
-				if (cstr_info)
-					pack_info = &cstr_info->tile[tileno].packet[cstr_info->packno];
-				else
-					pack_info = NULL;
-				e = t2_decode_packet(t2, c, src + len - c, tile, &cp->tcps[tileno], &pi[pino], pack_info);
-			} else {
-				e = 0;
+			opj_packet_info_t *pack_info;
+			int pcompno = pi[pino].compno;
+			/* the packet is needed for the layers and resolutions asked by cp_layer and cp_reduce */
+			opj_bool needed = (cp->layer == 0 || pi[pino].layno < cp->layer)
+				&& pi[pino].resno < tile->comps[pcompno].numresolutions - image->comps[pcompno].factor;
+
+			if (done) {
+				if (needed) {
+					return -999;
+				}
+				continue;
+			}
+			/* in layer order, the packets past cp_layer are the last ones: they are not read */
+			if (!needed && cp->layer && pino == cp->tcps[tileno].numpocs && pi[pino].poc.prg == LRCP && pi[pino].layno >= cp->layer) {
+				done = OPJ_TRUE;
+				continue;
+			}
+			/* the current tile-part is exhausted: the packet starts the next one */
+			while (c == end && spanno + 1 < numspans) {
+				spanstart += spans[spanno].len;
+				spanno++;
+				c = spans[spanno].data;
+				end = c + spans[spanno].len;
+			}
+			if (cstr_info)
+				pack_info = &cstr_info->tile[tileno].packet[cstr_info->packno];
+			else
+				pack_info = NULL;
+			/* the other packets are parsed too, to find where the next ones start */
+			e = t2_decode_packet(t2, c, end - c, tile, &cp->tcps[tileno], &pi[pino], pack_info);
+			if (e == -999) {
+				if (needed) {
+					return -999;
+				}
+				/* the data ends before a packet that is not needed: the tile is complete if the next ones are not either */
+				done = OPJ_TRUE;
+				continue;
+			}
+			if (pi[pino].layno == 0) {
+				tile->comps[pi[pino].compno].resolutions[pi[pino].resno].numprc_decoded++;
+			}
+			/* progression in resolution; in truncated mode, tcd_decode_tile_t2 sets the complete ones instead */
+			if (!cp->truncated_mode) {
+				image->comps[pi[pino].compno].resno_decoded =	
+					(e > 0) ? 
+					int_max(pi[pino].resno, image->comps[pi[pino].compno].resno_decoded) 
+					: image->comps[pi[pino].compno].resno_decoded;
 			}
-            if(e == -999)
-            {
-                pi_destroy(pi, cp, tileno);
-                return -999;
-            }
-			/* progression in resolution */
-			image->comps[pi[pino].compno].resno_decoded =	
-				(e > 0) ? 
-				int_max(pi[pino].resno, image->comps[pi[pino].compno].resno_decoded) 
-				: image->comps[pi[pino].compno].resno_decoded;
 			n++;
 
 			/* INDEX >> */
@@ -778,11 +876,7 @@ int t2_decode_packets(opj_t2_t *t2, unsigned char *src, int len, int tileno, opj
 			}
 			/* << INDEX */
 			
-			if (e == -999) {		/* ADD */
-				break;
-			} else {
-				c += e;
-			}			
+			c += e;
 		}
 	}
 	/* INDEX >> */
@@ -792,14 +886,7 @@ int t2_decode_packets(opj_t2_t *t2, unsigned char *src, int len, int tileno, opj
 	}
 	/* << INDEX */
 
-	/* don't forget to release pi */
-	pi_destroy(pi, cp, tileno);
-	
-	if (e == -999) {
-		return e;
-	}
-	
-	return (c - src);
+	return spanstart + (int)(c - spans[spanno].data);
 }
 
 /* ----------------------------------------------------------------------- */
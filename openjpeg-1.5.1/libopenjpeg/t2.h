@@ -73,15 +73,19 @@ Encode the packets of a tile to a destination buffer
 */
 int t2_encode_packets(opj_t2_t* t2,int tileno, opj_tcd_tile_t *tile, int maxlayers, unsigned char *dest, int len, opj_codestream_info_t *cstr_info,int tpnum, int tppos,int pino,J2K_T2_MODE t2_mode,int cur_totnum_tp);
 /**
-Decode the packets of a tile from a source buffer
+Decode the packets of a tile from its tile-parts. 
+A packet never straddles two tile-parts, so the spans are read one after the other.
 @param t2 T2 handle
-@param src the source buffer
-@param len length of the source buffer
+@param spans data of the tile, one span per tile-part
+@param numspans number of spans
 @param tileno number that identifies the tile for which to decode the packets
 @param tile tile for which to decode the packets
 @param cstr_info Codestream information structure
+@return Returns the number of bytes read, or -999 if the data is incomplete. The decoding then
+stops at the last complete packet: numprc_decoded counts, in each resolution of the tile, the
+precincts whose packet of the first layer was decoded.
  */
-int t2_decode_packets(opj_t2_t *t2, unsigned char *src, int len, int tileno, opj_tcd_tile_t *tile, opj_codestream_info_t *cstr_info);
+int t2_decode_packets(opj_t2_t *t2, opj_tile_span_t *spans, int numspans, int tileno, opj_tcd_tile_t *tile, opj_codestream_info_t *cstr_info);
 
 /**
 Create a T2 handle
@@ -33,8 +33,20 @@
  */
 
 #define _ISOC99_SOURCE /* lrintf is C99 */
+#include "cpu.h"
+#ifdef OPJ_X86_SIMD
+#include <immintrin.h>
+#endif
 #include "opj_includes.h"
 
+/*
+Number of subband samples added on each side of the decode area, so that every coefficient
+reaching the area through the inverse DWT is decoded. The synthesis filters extend by 2 (5-3)
+or 3 (9-7) samples of a subband per level, which sums up to twice that over all the levels.
+*/
+#define TCD_DECODE_AREA_MARGIN_53 4
+#define TCD_DECODE_AREA_MARGIN_97 6
+
 void tcd_dump(FILE *fd, opj_tcd_t *tcd, opj_tcd_image_t * img) {
 	int tileno, compno, resno, bandno, precno;/*, cblkno;*/
 
@@ -96,6 +108,45 @@ void tcd_dump(FILE *fd, opj_tcd_t *tcd, opj_tcd_image_t * img) {
 
 /* ----------------------------------------------------------------------- */
 
+/* release the T1 handles of the decoder */
+static void tcd_destroy_t1s(opj_tcd_t *tcd) {
+	int t1no;
+	if (tcd->t1s) {
+		for (t1no = 0; t1no < tcd->numt1s; t1no++) {
+			t1_destroy(tcd->t1s[t1no]);
+		}
+		opj_free(tcd->t1s);
+	}
+	tcd->t1s = NULL;
+	tcd->numt1s = 0;
+}
+
+/* 
+create the thread pool asked by cp->num_threads, unless the TCD has one, and a T1 handle per
+worker. The T1 handles keep their buffers and MQ coder from one tile, and one image, to the next.
+*/
+static void tcd_create_workers(opj_tcd_t *tcd, opj_cp_t *cp) {
+	int t1no, numt1s;
+
+	if (cp->num_threads > 1 && !tcd->thread_pool && !tcd->pool_worker) {
+		tcd->thread_pool = opj_thread_pool_create(cp->num_threads);
+	}
+	numt1s = tcd->thread_pool ? opj_thread_pool_get_thread_count(tcd->thread_pool) : 1;
+	if (tcd->numt1s != numt1s) {
+		tcd_destroy_t1s(tcd);
+		tcd->t1s = (opj_t1_t**) opj_calloc(numt1s, sizeof(opj_t1_t*));
+		if (tcd->t1s) {
+			tcd->numt1s = numt1s;
+		}
+		for (t1no = 0; tcd->t1s && t1no < numt1s; t1no++) {
+			tcd->t1s[t1no] = t1_create(tcd->cinfo);
+			if (!tcd->t1s[t1no]) {
+				tcd_destroy_t1s(tcd);
+			}
+		}
+	}
+}
+
 /**
 Create a new TCD handle
 */
@@ -104,6 +155,15 @@ opj_tcd_t* tcd_create(opj_common_ptr cinfo) {
 	opj_tcd_t *tcd = (opj_tcd_t*)opj_malloc(sizeof(opj_tcd_t));
 	if(!tcd) return NULL;
 	tcd->cinfo = cinfo;
+	tcd->thread_pool = NULL;
+	tcd->arena = NULL;
+	tcd->own_arena = NULL;
+	tcd->concurrent_tiles = OPJ_FALSE;
+	tcd->t1s = NULL;
+	tcd->numt1s = 0;
+	tcd->t2 = NULL;
+	tcd->pool_worker = OPJ_FALSE;
+	tcd->rate_headroom = 0;
 	tcd->tcd_image = (opj_tcd_image_t*)opj_malloc(sizeof(opj_tcd_image_t));
 	if(!tcd->tcd_image) {
 		opj_free(tcd);
@@ -118,6 +178,10 @@ Destroy a previously created TCD handle
 */
 void tcd_destroy(opj_tcd_t *tcd) {
 	if(tcd) {
+		opj_thread_pool_destroy(tcd->thread_pool);
+		opj_arena_destroy(tcd->own_arena);
+		tcd_destroy_t1s(tcd);
+		t2_destroy(tcd->t2);
 		opj_free(tcd->tcd_image);
 		opj_free(tcd);
 	}
@@ -133,6 +197,9 @@ void tcd_malloc_encode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp, int c
 	tcd->tcd_image->tw = cp->tw;
 	tcd->tcd_image->th = cp->th;
 	tcd->tcd_image->tiles = (opj_tcd_tile_t *) opj_malloc(sizeof(opj_tcd_tile_t));
+
+	/* without a thread pool, the code-blocks are encoded in the calling thread */
+	tcd_create_workers(tcd, cp);
 	
 	for (tileno = 0; tileno < 1; tileno++) {
 		opj_tcp_t *tcp = &cp->tcps[curtileno];
@@ -568,6 +635,15 @@ void tcd_init_encode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp, int cur
 						tlcblkystart = int_floordivpow2(prc->y0, cblkheightexpn) << cblkheightexpn;
 						brcblkxend = int_ceildivpow2(prc->x1, cblkwidthexpn) << cblkwidthexpn;
 						brcblkyend = int_ceildivpow2(prc->y1, cblkheightexpn) << cblkheightexpn;
+
+						/* the code-blocks of the previous tile */
+						if (prc->cblks.enc) {
+							for (cblkno = 0; cblkno < prc->cw * prc->ch; cblkno++) {
+								opj_free(prc->cblks.enc[cblkno].data - 2);
+								opj_free(prc->cblks.enc[cblkno].layers);
+								opj_free(prc->cblks.enc[cblkno].passes);
+							}
+						}
 						prc->cw = (brcblkxend - tlcblkxstart) >> cblkwidthexpn;
 						prc->ch = (brcblkyend - tlcblkystart) >> cblkheightexpn;
 
@@ -616,13 +692,38 @@ void tcd_init_encode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp, int cur
 
 void tcd_malloc_decode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp) {
 	int i, j, tileno, p, q;
+	int t1no;
 	unsigned int x0 = 0, y0 = 0, x1 = 0, y1 = 0, w, h;
 
 	tcd->image = image;
+	tcd->cp = cp;
+	tcd->resolution_set = OPJ_FALSE;
 	tcd->tcd_image->tw = cp->tw;
 	tcd->tcd_image->th = cp->th;
     tcd->tcd_image->tiles = (opj_tcd_tile_t *) opj_calloc(cp->tw * cp->th, sizeof(opj_tcd_tile_t));
 
+	/* a failure to create the pool is not fatal: tiles are then decoded in the calling thread */
+	tcd_create_workers(tcd, cp);
+
+	/* a failure is reported by tcd_malloc_decode_tile */
+	if (!cp->arena && !tcd->own_arena) {
+		tcd->own_arena = opj_arena_create();
+	}
+	tcd->arena = cp->arena ? cp->arena : tcd->own_arena;
+
+	/* a failure to create the T1 handles is reported by tcd_decode_tile_t1 */
+	for (t1no = 0; tcd->t1s && t1no < tcd->numt1s; t1no++) {
+		tcd->t1s[t1no]->max_passes = cp->max_passes;
+	}
+	/* the image may change between two decodes (a failure is reported by tcd_decode_tile_t2) */
+	if (!tcd->t2) {
+		tcd->t2 = t2_create(tcd->cinfo, image, cp);
+	}
+	if (tcd->t2) {
+		tcd->t2->image = image;
+		tcd->t2->cp = cp;
+	}
+
 	/* 
 	Allocate place to store the decoded data = final image
 	Place limited by the tile really present in the codestream 
@@ -669,8 +770,20 @@ void tcd_malloc_decode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp) {
 			y1 = j == 0 ? tilec->y1 : int_max(y1,	(unsigned int) tilec->y1);
 		}
 
-		w = int_ceildivpow2(x1 - x0, image->comps[i].factor);
-		h = int_ceildivpow2(y1 - y0, image->comps[i].factor);
+		/* only allocate the part of the component that is inside the decode area */
+		if (cp->decode_area) {
+			int factor = image->comps[i].factor;
+			x0 = int_max(x0, int_ceildiv(cp->da_x0, image->comps[i].dx));
+			y0 = int_max(y0, int_ceildiv(cp->da_y0, image->comps[i].dy));
+			x1 = int_max(x0, int_min(x1, int_ceildiv(cp->da_x1, image->comps[i].dx)));
+			y1 = int_max(y0, int_min(y1, int_ceildiv(cp->da_y1, image->comps[i].dy)));
+			/* the exact extent at the decoded resolution, so that the window does not grow past the image */
+			w = int_ceildivpow2(x1, factor) - int_ceildivpow2(x0, factor);
+			h = int_ceildivpow2(y1, factor) - int_ceildivpow2(y0, factor);
+		} else {
+			w = int_ceildivpow2(x1 - x0, image->comps[i].factor);
+			h = int_ceildivpow2(y1 - y0, image->comps[i].factor);
+		}
 
 		image->comps[i].w = w;
 		image->comps[i].h = h;
@@ -681,17 +794,24 @@ void tcd_malloc_decode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp) {
 
 void tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp, int tileno, opj_codestream_info_t *cstr_info) {
 	int compno, resno, bandno, precno, cblkno;
+	int index = tileno;
+	int dax0 = 0, day0 = 0, dax1 = 0, day1 = 0;
+	int bdax0 = 0, bday0 = 0, bdax1 = 0, bday1 = 0;
 	opj_tcp_t *tcp;
 	opj_tcd_tile_t *tile;
 
 	OPJ_ARG_NOT_USED(cstr_info);
 
-	tcd->cp = cp;
-	
 	tcp = &(cp->tcps[cp->tileno[tileno]]);
 	tile = &(tcd->tcd_image->tiles[cp->tileno[tileno]]);
 	
 	tileno = cp->tileno[tileno];
+
+	/* everything below is released at once by tcd_free_decode_tile */
+	tile->arena = tcd->concurrent_tiles ? opj_arena_create() : tcd->arena;
+	if (!tile->arena) {
+		goto out_of_memory;
+	}
 	
 	for (compno = 0; compno < tile->numcomps; compno++) {
 		opj_tccp_t *tccp = &tcp->tccps[compno];
@@ -699,7 +819,7 @@ void tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp,
 		
 		if (tccp->numresolutions <= 0)
 		{
-			cp->tileno[tileno] = -1;
+			cp->tileno[index] = -1;
 			return;
 		}
 
@@ -710,7 +830,23 @@ void tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp,
 		tilec->y1 = int_ceildiv(tile->y1, image->comps[compno].dy);
 
 		tilec->numresolutions = tccp->numresolutions;
-		tilec->resolutions = (opj_tcd_resolution_t *) opj_malloc(tilec->numresolutions * sizeof(opj_tcd_resolution_t));
+		tilec->resolutions = (opj_tcd_resolution_t *) opj_arena_alloc(tile->arena, tilec->numresolutions * sizeof(opj_tcd_resolution_t));
+		if (!tilec->resolutions) {
+			tilec->numresolutions = 0;
+			goto out_of_memory;
+		}
+
+		/* decode area in tile-component coordinates, at full resolution */
+		if (cp->decode_area) {
+			opj_image_comp_t *imagec = &image->comps[compno];
+			int factor = imagec->factor;
+			int offset_x = int_ceildivpow2(imagec->x0, factor);
+			int offset_y = int_ceildivpow2(imagec->y0, factor);
+			dax0 = offset_x << factor;
+			day0 = offset_y << factor;
+			dax1 = (offset_x + imagec->w) << factor;
+			day1 = (offset_y + imagec->h) << factor;
+		}
 		
 		for (resno = 0; resno < tilec->numresolutions; resno++) {
 			int pdx, pdy;
@@ -796,7 +932,20 @@ void tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp,
 				band->stepsize = (float)(((1.0 + ss->mant / 2048.0) * pow(2.0, numbps - ss->expn)) * 0.5);
 				band->numbps = ss->expn + tccp->numgbits - 1;	/* WHY -1 ? */
 				
-				band->precincts = (opj_tcd_precinct_t *) opj_malloc(res->pw * res->ph * sizeof(opj_tcd_precinct_t));
+				band->precincts = (opj_tcd_precinct_t *) opj_arena_alloc(tile->arena, res->pw * res->ph * sizeof(opj_tcd_precinct_t));
+				if (!band->precincts) {
+					goto out_of_memory;
+				}
+
+				/* decode area in band coordinates, extended by the support of the synthesis filters */
+				if (cp->decode_area) {
+					int bandlevel = band->bandno == 0 ? levelno : levelno + 1;
+					int margin = tccp->qmfbid == 1 ? TCD_DECODE_AREA_MARGIN_53 : TCD_DECODE_AREA_MARGIN_97;
+					bdax0 = int_floordivpow2(dax0 - (1 << levelno) * x0b, bandlevel) - margin;
+					bday0 = int_floordivpow2(day0 - (1 << levelno) * y0b, bandlevel) - margin;
+					bdax1 = int_ceildivpow2(dax1 - (1 << levelno) * x0b, bandlevel) + margin;
+					bday1 = int_ceildivpow2(day1 - (1 << levelno) * y0b, bandlevel) + margin;
+				}
 				
 				for (precno = 0; precno < res->pw * res->ph; precno++) {
 					int tlcblkxstart, tlcblkystart, brcblkxend, brcblkyend;
@@ -819,10 +968,13 @@ void tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp,
 					prc->cw = (brcblkxend - tlcblkxstart) >> cblkwidthexpn;
 					prc->ch = (brcblkyend - tlcblkystart) >> cblkheightexpn;
 
-					prc->cblks.dec = (opj_tcd_cblk_dec_t*) opj_malloc(prc->cw * prc->ch * sizeof(opj_tcd_cblk_dec_t));
-
-					prc->incltree = tgt_create(prc->cw, prc->ch);
-					prc->imsbtree = tgt_create(prc->cw, prc->ch);
+					prc->cblks.dec = (opj_tcd_cblk_dec_t*) opj_arena_alloc(tile->arena, prc->cw * prc->ch * sizeof(opj_tcd_cblk_dec_t));
+					prc->incltree = tgt_create_arena(tile->arena, prc->cw, prc->ch);
+					prc->imsbtree = tgt_create_arena(tile->arena, prc->cw, prc->ch);
+					/* an empty precinct has no tag-trees */
+					if (prc->cw > 0 && prc->ch > 0 && (!prc->cblks.dec || !prc->incltree || !prc->imsbtree)) {
+						goto out_of_memory;
+					}
 					
 					for (cblkno = 0; cblkno < prc->cw * prc->ch; cblkno++) {
 						int cblkxstart = tlcblkxstart + (cblkno % prc->cw) * (1 << cblkwidthexpn);
@@ -833,18 +985,28 @@ void tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp,
 						opj_tcd_cblk_dec_t* cblk = &prc->cblks.dec[cblkno];
 						cblk->data = NULL;
 						cblk->segs = NULL;
+						cblk->maxlen = 0;
+						cblk->maxsegs = 0;
 						/* code-block size (global) */
 						cblk->x0 = int_max(cblkxstart, prc->x0);
 						cblk->y0 = int_max(cblkystart, prc->y0);
 						cblk->x1 = int_min(cblkxend, prc->x1);
 						cblk->y1 = int_min(cblkyend, prc->y1);
 						cblk->numsegs = 0;
+						cblk->numpasses = 0;
+						cblk->skip = cp->decode_area
+							&& (cblk->x0 >= bdax1 || cblk->x1 <= bdax0 || cblk->y0 >= bday1 || cblk->y1 <= bday0);
 					}
 				} /* precno */
 			} /* bandno */
 		} /* resno */
 	} /* compno */
 	/* tcd_dump(stdout, tcd, &tcd->tcd_image); */
+	return;
+
+out_of_memory:
+	opj_event_msg(tcd->cinfo, EVT_ERROR, "Out of memory\n");
+	cp->tileno[index] = -1;
 }
 
 void tcd_makelayer_fixed(opj_tcd_t *tcd, int layno, int final) {
@@ -1013,12 +1175,118 @@ void tcd_makelayer(opj_tcd_t *tcd, int layno, double thresh, int final) {
 	}
 }
 
+/*
+Trial encodes of tcd_rateallocate. A trial only depends on the passes tcd_makelayer puts in
+each code-block for the layer, and most thresholds tried by the bisection select the same
+passes as one tried before, or too much data for the layer anyway: such trials are answered
+without running tier-2 again.
+*/
+typedef struct opj_tcd_rate_cache {
+	/** number of code-blocks of the tile */
+	int numcblks;
+	/** memory of cur, fit and nofit, which are swapped */
+	int *buffer;
+	/** passes of the layer in each code-block, for the current threshold */
+	int *cur;
+	/** passes of the layer in each code-block, for the last trial that fitted */
+	int *fit;
+	/** passes of the layer in each code-block, for the last trial that did not fit */
+	int *nofit;
+	/** length of the packets of the last trial that fitted */
+	int fit_len;
+	opj_bool has_fit;
+	opj_bool has_nofit;
+	/** 
+	bytes written in each packet besides the code-block data, at least (an empty header and SOP);
+	0 when a trial does not encode each packet of the tile once (cinema, maximum component size)
+	*/
+	int packet_min_len;
+	/** number of packets of the tile in each layer */
+	int numpackets;
+} opj_tcd_rate_cache_t;
+
+/*
+Record the passes selected by tcd_makelayer for layer layno in cache->cur and return the
+number of code-block bytes of the layers up to layno.
+*/
+static int tcd_rate_cache_select(opj_tcd_tile_t *tcd_tile, opj_tcd_rate_cache_t *cache, int layno) {
+	int compno, resno, bandno, precno, cblkno;
+	int i = 0, len = 0;
+
+	for (compno = 0; compno < tcd_tile->numcomps; compno++) {
+		opj_tcd_tilecomp_t *tilec = &tcd_tile->comps[compno];
+		for (resno = 0; resno < tilec->numresolutions; resno++) {
+			opj_tcd_resolution_t *res = &tilec->resolutions[resno];
+			for (bandno = 0; bandno < res->numbands; bandno++) {
+				opj_tcd_band_t *band = &res->bands[bandno];
+				for (precno = 0; precno < res->pw * res->ph; precno++) {
+					opj_tcd_precinct_t *prc = &band->precincts[precno];
+					for (cblkno = 0; cblkno < prc->cw * prc->ch; cblkno++) {
+						opj_tcd_cblk_enc_t *cblk = &prc->cblks.enc[cblkno];
+						int n = cblk->numpassesinlayers + cblk->layers[layno].numpasses;
+						cache->cur[i++] = cblk->layers[layno].numpasses;
+						if (n) {
+							len += cblk->passes[n - 1].rate;
+						}
+					}
+				}
+			}
+		}
+	}
+	return len;
+}
+
+/*
+Length of the packets of the layers up to layno, as t2_encode_packets in THRESH_CALC mode
+returns it for the passes selected by tcd_makelayer, or -999 if they do not fit in maxlen.
+tier-2 only runs when the cache cannot tell.
+*/
+static int tcd_trial_encode(opj_tcd_t *tcd, opj_t2_t *t2, opj_tcd_rate_cache_t *cache, int layno, unsigned char *dest, int maxlen, opj_codestream_info_t *cstr_info) {
+	opj_tcd_tile_t *tcd_tile = tcd->tcd_tile;
+	int *swap;
+	int l;
+
+	if (!cache->cur) {
+		return t2_encode_packets(t2, tcd->tcd_tileno, tcd_tile, layno + 1, dest, maxlen, cstr_info, tcd->cur_tp_num, tcd->tp_pos, tcd->cur_pino, THRESH_CALC, tcd->cur_totnum_tp);
+	}
+
+	/*
+	t2_encode_packet fails as soon as its output goes past maxlen, except for the markers that it
+	does not check: EPH is not counted, and the SOP of the last packet may end up to 6 bytes past it
+	*/
+	l = tcd_rate_cache_select(tcd_tile, cache, layno);
+	if (cache->packet_min_len && (double) l + (double) cache->numpackets * (layno + 1) * cache->packet_min_len > maxlen + cache->packet_min_len - 1) {
+		return -999;
+	}
+	if (cache->has_fit && !memcmp(cache->cur, cache->fit, cache->numcblks * sizeof(int))) {
+		return cache->fit_len;
+	}
+	if (cache->has_nofit && !memcmp(cache->cur, cache->nofit, cache->numcblks * sizeof(int))) {
+		return -999;
+	}
+
+	l = t2_encode_packets(t2, tcd->tcd_tileno, tcd_tile, layno + 1, dest, maxlen, cstr_info, tcd->cur_tp_num, tcd->tp_pos, tcd->cur_pino, THRESH_CALC, tcd->cur_totnum_tp);
+	if (l == -999) {
+		swap = cache->nofit;
+		cache->nofit = cache->cur;
+		cache->has_nofit = OPJ_TRUE;
+	} else {
+		swap = cache->fit;
+		cache->fit = cache->cur;
+		cache->fit_len = l;
+		cache->has_fit = OPJ_TRUE;
+	}
+	cache->cur = swap;
+	return l;
+}
+
 opj_bool tcd_rateallocate(opj_tcd_t *tcd, unsigned char *dest, int len, opj_codestream_info_t *cstr_info) {
 	int compno, resno, bandno, precno, cblkno, passno, layno;
 	double min, max;
 	double cumdisto[100];	/* fixed_quality */
 	const double K = 1;		/* 1.1; fixed_quality */
 	double maxSE = 0;
+	opj_tcd_rate_cache_t cache;
 
 	opj_cp_t *cp = tcd->cp;
 	opj_tcd_tile_t *tcd_tile = tcd->tcd_tile;
@@ -1028,6 +1296,7 @@ opj_bool tcd_rateallocate(opj_tcd_t *tcd, unsigned char *dest, int len, opj_code
 	max = 0;
 	
 	tcd_tile->numpix = 0;		/* fixed_quality */
+	memset(&cache, 0, sizeof(cache));
 	
 	for (compno = 0; compno < tcd_tile->numcomps; compno++) {
 		opj_tcd_tilecomp_t *tilec = &tcd_tile->comps[compno];
@@ -1035,6 +1304,7 @@ opj_bool tcd_rateallocate(opj_tcd_t *tcd, unsigned char *dest, int len, opj_code
 
 		for (resno = 0; resno < tilec->numresolutions; resno++) {
 			opj_tcd_resolution_t *res = &tilec->resolutions[resno];
+			cache.numpackets += res->pw * res->ph;
 
 			for (bandno = 0; bandno < res->numbands; bandno++) {
 				opj_tcd_band_t *band = &res->bands[bandno];
@@ -1071,6 +1341,7 @@ opj_bool tcd_rateallocate(opj_tcd_t *tcd, unsigned char *dest, int len, opj_code
 						/* fixed_quality */
 						tcd_tile->numpix += ((cblk->x1 - cblk->x0) * (cblk->y1 - cblk->y0));
 						tilec->numpix += ((cblk->x1 - cblk->x0) * (cblk->y1 - cblk->y0));
+						cache.numcblks++;
 					} /* cbklno */
 				} /* precno */
 			} /* bandno */
@@ -1088,6 +1359,19 @@ opj_bool tcd_rateallocate(opj_tcd_t *tcd, unsigned char *dest, int len, opj_code
 		tile_info->distotile = tcd_tile->distotile;
 		tile_info->thresh = (double *) opj_malloc(tcd_tcp->numlayers * sizeof(double));
 	}
+
+	/* without the cache, every trial runs tier-2 */
+	if (cache.numcblks > 0) {
+		cache.buffer = (int*) opj_malloc(3 * cache.numcblks * sizeof(int));
+	}
+	if (cache.buffer) {
+		cache.cur = cache.buffer;
+		cache.fit = cache.cur + cache.numcblks;
+		cache.nofit = cache.fit + cache.numcblks;
+		if (!cp->cinema && !cp->max_comp_size) {
+			cache.packet_min_len = (tcd_tcp->csty & J2K_CP_CSTY_SOP) ? 7 : 1;
+		}
+	}
 	
 	for (layno = 0; layno < tcd_tcp->numlayers; layno++) {
 		double lo = min;
@@ -1110,16 +1394,29 @@ opj_bool tcd_rateallocate(opj_tcd_t *tcd, unsigned char *dest, int len, opj_code
 			opj_t2_t *t2 = t2_create(tcd->cinfo, tcd->image, cp);
 			double thresh = 0;
 
+			/* the output space only matters to the trials when it is smaller than the budget of the layer */
+			if (!cp->fixed_quality || cp->cinema) {
+				tcd->rate_headroom = int_min(tcd->rate_headroom, len - (tcd_tcp->rates[layno] ? (int) ceil(tcd_tcp->rates[layno]) : len));
+			}
+			/* the trials of the previous layers used other passes for the layers before this one */
+			cache.has_fit = OPJ_FALSE;
+			cache.has_nofit = OPJ_FALSE;
+
 			for (i = 0; i < 128; i++) {
 				int l = 0;
 				double distoachieved = 0;	/* fixed_quality */
+				double prevthresh = thresh;
 				thresh = (lo + hi) / 2;
+				/* the trial would select the passes of the previous one: nothing changes any more */
+				if (i > 0 && thresh == prevthresh) {
+					break;
+				}
 				
 				tcd_makelayer(tcd, layno, thresh, 0);
 				
 				if (cp->fixed_quality) {	/* fixed_quality */
 					if(cp->cinema){
-						l = t2_encode_packets(t2,tcd->tcd_tileno, tcd_tile, layno + 1, dest, maxlen, cstr_info,tcd->cur_tp_num,tcd->tp_pos,tcd->cur_pino,THRESH_CALC, tcd->cur_totnum_tp);
+						l = tcd_trial_encode(tcd, t2, &cache, layno, dest, maxlen, cstr_info);
 						if (l == -999) {
 							lo = thresh;
 							continue;
@@ -1145,7 +1442,7 @@ opj_bool tcd_rateallocate(opj_tcd_t *tcd, unsigned char *dest, int len, opj_code
 						lo = thresh;
 					}
 				} else {
-					l = t2_encode_packets(t2, tcd->tcd_tileno, tcd_tile, layno + 1, dest, maxlen, cstr_info,tcd->cur_tp_num,tcd->tp_pos,tcd->cur_pino,THRESH_CALC, tcd->cur_totnum_tp);
+					l = tcd_trial_encode(tcd, t2, &cache, layno, dest, maxlen, cstr_info);
 					/* TODO: what to do with l ??? seek / tell ??? */
 					/* opj_event_msg(tcd->cinfo, EVT_INFO, "rate alloc: len=%d, max=%d\n", l, maxlen); */
 					if (l == -999) {
@@ -1165,6 +1462,7 @@ opj_bool tcd_rateallocate(opj_tcd_t *tcd, unsigned char *dest, int len, opj_code
 		}
 		
 		if (!success) {
+			opj_free(cache.buffer);
 			return OPJ_FALSE;
 		}
 		
@@ -1177,6 +1475,7 @@ opj_bool tcd_rateallocate(opj_tcd_t *tcd, unsigned char *dest, int len, opj_code
 		cumdisto[layno] = (layno == 0) ? tcd_tile->distolayer[0] : (cumdisto[layno - 1] + tcd_tile->distolayer[layno]);	
 	}
 
+	opj_free(cache.buffer);
 	return OPJ_TRUE;
 }
 
@@ -1191,7 +1490,6 @@ int tcd_encode_tile(opj_tcd_t *tcd, int tileno, unsigned char *dest, int len, op
 	opj_tccp_t *tccp = &tcp->tccps[0];
 	opj_image_t *image = tcd->image;
 	
-	opj_t1_t *t1 = NULL;		/* T1 component */
 	opj_t2_t *t2 = NULL;		/* T2 component */
 
 	tcd->tcd_tileno = tileno;
@@ -1283,9 +1581,17 @@ int tcd_encode_tile(opj_tcd_t *tcd, int tileno, unsigned char *dest, int len, op
 		}
 		
 		/*------------------TIER1-----------------*/
-		t1 = t1_create(tcd->cinfo);
-		t1_encode_cblks(t1, tile, tcd_tcp);
-		t1_destroy(t1);
+		/* the T1 handles are created by tcd_malloc_encode */
+		if (!tcd->t1s
+			|| (tcd->thread_pool ? !t1_encode_cblks_mt(tcd->thread_pool, tcd->t1s, tile, tcd_tcp)
+				: !t1_encode_cblks(tcd->t1s[0], tile, tcd_tcp))) {
+			opj_event_msg(tcd->cinfo, EVT_ERROR, "Out of memory\n");
+			for (compno = 0; compno < tile->numcomps; compno++) {
+				opj_tcd_tilecomp_t *tilec = &tile->comps[compno];
+				opj_aligned_free(tilec->data);
+			}
+			return -1;
+		}
 		
 		/*-----------RATE-ALLOCATE------------------*/
 		
@@ -1293,6 +1599,7 @@ int tcd_encode_tile(opj_tcd_t *tcd, int tileno, unsigned char *dest, int len, op
 		if(cstr_info) {
 			cstr_info->index_write = 0;
 		}
+		tcd->rate_headroom = len;
 		if (cp->disto_alloc || cp->fixed_quality) {	/* fixed_quality */
 			/* Normal Rate/distortion allocation */
 			tcd_rateallocate(tcd, dest, len, cstr_info);
@@ -1324,27 +1631,429 @@ int tcd_encode_tile(opj_tcd_t *tcd, int tileno, unsigned char *dest, int len, op
 			opj_tcd_tilecomp_t *tilec = &tile->comps[compno];
 			opj_aligned_free(tilec->data);
 		}
+	} else if (l == -999) {
+		/* the tile is not finished: it may be encoded again */
+		for (compno = 0; compno < tile->numcomps; compno++) {
+			opj_tcd_tilecomp_t *tilec = &tile->comps[compno];
+			opj_aligned_free(tilec->data);
+		}
 	}
 
 	return l;
 }
 
-opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno, opj_codestream_info_t *cstr_info) {
+/*
+Output stage of the decoder: a row of decoded samples is DC level shifted, clamped to the
+range of the image component and stored. The vector versions return the number of samples
+they stored, the scalar loop finishes the row. Converting floats with the current rounding
+mode, as lrintf does, they give the same samples as the scalar code.
+*/
+
+#ifdef OPJ_X86_SIMD
+
+/* v clamped to [min, max] without the SSE4.1 min/max instructions */
+OPJ_TARGET("sse2")
+static INLINE __m128i tcd_clamp_sse2(__m128i v, __m128i min, __m128i max) {
+	__m128i m = _mm_cmpgt_epi32(v, max);
+	v = _mm_or_si128(_mm_and_si128(m, max), _mm_andnot_si128(m, v));
+	m = _mm_cmplt_epi32(v, min);
+	return _mm_or_si128(_mm_and_si128(m, min), _mm_andnot_si128(m, v));
+}
+
+OPJ_TARGET("sse2")
+static int tcd_store_row_int_sse2(const int *src, int *dst, int n, int adjust, int min, int max) {
+	const __m128i vadjust = _mm_set1_epi32(adjust);
+	const __m128i vmin = _mm_set1_epi32(min);
+	const __m128i vmax = _mm_set1_epi32(max);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i v = _mm_add_epi32(_mm_loadu_si128((const __m128i*) &src[i]), vadjust);
+		_mm_storeu_si128((__m128i*) &dst[i], tcd_clamp_sse2(v, vmin, vmax));
+	}
+	return i;
+}
+
+OPJ_TARGET("sse2")
+static int tcd_store_row_real_sse2(const float *src, int *dst, int n, int adjust, int min, int max) {
+	const __m128i vadjust = _mm_set1_epi32(adjust);
+	const __m128i vmin = _mm_set1_epi32(min);
+	const __m128i vmax = _mm_set1_epi32(max);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i v = _mm_add_epi32(_mm_cvtps_epi32(_mm_loadu_ps(&src[i])), vadjust);
+		_mm_storeu_si128((__m128i*) &dst[i], tcd_clamp_sse2(v, vmin, vmax));
+	}
+	return i;
+}
+
+OPJ_TARGET("sse2")
+static int tcd_store_row_mct_real_sse2(float *src[3], int *dst[3], int n, const int adjust[3], const int min[3], const int max[3]) {
+	const __m128 vrv = _mm_set1_ps(1.402f);
+	const __m128 vgu = _mm_set1_ps(0.34413f);
+	const __m128 vgv = _mm_set1_ps(0.71414f);
+	const __m128 vbu = _mm_set1_ps(1.772f);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 vy = _mm_loadu_ps(&src[0][i]);
+		__m128 vu = _mm_loadu_ps(&src[1][i]);
+		__m128 vv = _mm_loadu_ps(&src[2][i]);
+		__m128 vr = _mm_add_ps(vy, _mm_mul_ps(vv, vrv));
+		__m128 vg = _mm_sub_ps(_mm_sub_ps(vy, _mm_mul_ps(vu, vgu)), _mm_mul_ps(vv, vgv));
+		__m128 vb = _mm_add_ps(vy, _mm_mul_ps(vu, vbu));
+		_mm_storeu_si128((__m128i*) &dst[0][i], tcd_clamp_sse2(_mm_add_epi32(_mm_cvtps_epi32(vr), _mm_set1_epi32(adjust[0])),
+			_mm_set1_epi32(min[0]), _mm_set1_epi32(max[0])));
+		_mm_storeu_si128((__m128i*) &dst[1][i], tcd_clamp_sse2(_mm_add_epi32(_mm_cvtps_epi32(vg), _mm_set1_epi32(adjust[1])),
+			_mm_set1_epi32(min[1]), _mm_set1_epi32(max[1])));
+		_mm_storeu_si128((__m128i*) &dst[2][i], tcd_clamp_sse2(_mm_add_epi32(_mm_cvtps_epi32(vb), _mm_set1_epi32(adjust[2])),
+			_mm_set1_epi32(min[2]), _mm_set1_epi32(max[2])));
+	}
+	return i;
+}
+
+OPJ_TARGET("avx2")
+static int tcd_store_row_int_avx2(const int *src, int *dst, int n, int adjust, int min, int max) {
+	const __m256i vadjust = _mm256_set1_epi32(adjust);
+	const __m256i vmin = _mm256_set1_epi32(min);
+	const __m256i vmax = _mm256_set1_epi32(max);
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*) &src[i]), vadjust);
+		_mm256_storeu_si256((__m256i*) &dst[i], _mm256_max_epi32(_mm256_min_epi32(v, vmax), vmin));
+	}
+	return i;
+}
+
+OPJ_TARGET("avx2")
+static int tcd_store_row_real_avx2(const float *src, int *dst, int n, int adjust, int min, int max) {
+	const __m256i vadjust = _mm256_set1_epi32(adjust);
+	const __m256i vmin = _mm256_set1_epi32(min);
+	const __m256i vmax = _mm256_set1_epi32(max);
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_add_epi32(_mm256_cvtps_epi32(_mm256_loadu_ps(&src[i])), vadjust);
+		_mm256_storeu_si256((__m256i*) &dst[i], _mm256_max_epi32(_mm256_min_epi32(v, vmax), vmin));
+	}
+	return i;
+}
+
+OPJ_TARGET("avx2")
+static int tcd_store_row_mct_real_avx2(float *src[3], int *dst[3], int n, const int adjust[3], const int min[3], const int max[3]) {
+	const __m256 vrv = _mm256_set1_ps(1.402f);
+	const __m256 vgu = _mm256_set1_ps(0.34413f);
+	const __m256 vgv = _mm256_set1_ps(0.71414f);
+	const __m256 vbu = _mm256_set1_ps(1.772f);
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 vy = _mm256_loadu_ps(&src[0][i]);
+		__m256 vu = _mm256_loadu_ps(&src[1][i]);
+		__m256 vv = _mm256_loadu_ps(&src[2][i]);
+		__m256 vr = _mm256_add_ps(vy, _mm256_mul_ps(vv, vrv));
+		__m256 vg = _mm256_sub_ps(_mm256_sub_ps(vy, _mm256_mul_ps(vu, vgu)), _mm256_mul_ps(vv, vgv));
+		__m256 vb = _mm256_add_ps(vy, _mm256_mul_ps(vu, vbu));
+		_mm256_storeu_si256((__m256i*) &dst[0][i], _mm256_max_epi32(_mm256_min_epi32(
+			_mm256_add_epi32(_mm256_cvtps_epi32(vr), _mm256_set1_epi32(adjust[0])), _mm256_set1_epi32(max[0])), _mm256_set1_epi32(min[0])));
+		_mm256_storeu_si256((__m256i*) &dst[1][i], _mm256_max_epi32(_mm256_min_epi32(
+			_mm256_add_epi32(_mm256_cvtps_epi32(vg), _mm256_set1_epi32(adjust[1])), _mm256_set1_epi32(max[1])), _mm256_set1_epi32(min[1])));
+		_mm256_storeu_si256((__m256i*) &dst[2][i], _mm256_max_epi32(_mm256_min_epi32(
+			_mm256_add_epi32(_mm256_cvtps_epi32(vb), _mm256_set1_epi32(adjust[2])), _mm256_set1_epi32(max[2])), _mm256_set1_epi32(min[2])));
+	}
+	return i;
+}
+
+#endif /* OPJ_X86_SIMD */
+
+/* store a row of reversibly decoded samples */
+static void tcd_store_row_int(const int *src, int *dst, int n, int adjust, int min, int max) {
+	int i = 0;
+#ifdef OPJ_X86_SIMD
+	int cpu = opj_cpu_features();
+	if (cpu & OPJ_CPU_AVX2) {
+		i = tcd_store_row_int_avx2(src, dst, n, adjust, min, max);
+	} else if (cpu & OPJ_CPU_SSE2) {
+		i = tcd_store_row_int_sse2(src, dst, n, adjust, min, max);
+	}
+#endif
+	for (; i < n; ++i) {
+		dst[i] = int_clamp(src[i] + adjust, min, max);
+	}
+}
+
+/* store a row of irreversibly decoded samples, rounded to the nearest integer */
+static void tcd_store_row_real(const float *src, int *dst, int n, int adjust, int min, int max) {
+	int i = 0;
+#ifdef OPJ_X86_SIMD
+	int cpu = opj_cpu_features();
+	if (cpu & OPJ_CPU_AVX2) {
+		i = tcd_store_row_real_avx2(src, dst, n, adjust, min, max);
+	} else if (cpu & OPJ_CPU_SSE2) {
+		i = tcd_store_row_real_sse2(src, dst, n, adjust, min, max);
+	}
+#endif
+	for (; i < n; ++i) {
+		int v = lrintf(src[i]);
+		dst[i] = int_clamp(v + adjust, min, max);
+	}
+}
+
+/* apply the inverse irreversible MCT (see mct_decode_real) to a row of the first three components and store it */
+static void tcd_store_row_mct_real(float *src[3], int *dst[3], int n, const int adjust[3], const int min[3], const int max[3]) {
+	int i = 0;
+#ifdef OPJ_X86_SIMD
+	int cpu = opj_cpu_features();
+	if (cpu & OPJ_CPU_AVX2) {
+		i = tcd_store_row_mct_real_avx2(src, dst, n, adjust, min, max);
+	} else if (cpu & OPJ_CPU_SSE2) {
+		i = tcd_store_row_mct_real_sse2(src, dst, n, adjust, min, max);
+	}
+#endif
+	for (; i < n; ++i) {
+		float y = src[0][i];
+		float u = src[1][i];
+		float v = src[2][i];
+		float r = y + (v * 1.402f);
+		float g = y - (u * 0.34413f) - (v * (0.71414f));
+		float b = y + (u * 1.772f);
+		dst[0][i] = int_clamp((int) lrintf(r) + adjust[0], min[0], max[0]);
+		dst[1][i] = int_clamp((int) lrintf(g) + adjust[1], min[1], max[1]);
+		dst[2][i] = int_clamp((int) lrintf(b) + adjust[2], min[2], max[2]);
+	}
+}
+
+/*
+With an output buffer (see opj_set_decode_output), the rows of the tile are stored in place,
+in tilec->data, then converted to the pixel format and written to the buffer at the position
+they would have in the image component. The components left out by the format are not stored.
+*/
+
+/* bytes per pixel of the output buffer, per sample for OPJ_PIXFMT_PLANAR16 */
+static int tcd_output_bpp(OPJ_PIXEL_FORMAT format) {
+	switch (format) {
+		case OPJ_PIXFMT_RGB8:
+			return 3;
+		case OPJ_PIXFMT_RGBA8:
+			return 4;
+		case OPJ_PIXFMT_PLANAR16:
+			return 2;
+		case OPJ_PIXFMT_L8:
+		default:
+			return 1;
+	}
+}
+
+/* byte of the output pixels receiving component compno, -1 if the pixel format leaves it out */
+static int tcd_output_channel(opj_tcd_t *tcd, int compno) {
+	opj_bool gray = tcd->image->numcomps < 3;
+	switch (tcd->cp->output.format) {
+		case OPJ_PIXFMT_L8:
+			return compno == 0 ? 0 : -1;
+		case OPJ_PIXFMT_RGB8:
+			return compno == 0 || (!gray && compno < 3) ? compno : -1;
+		case OPJ_PIXFMT_RGBA8:
+			if (gray) {
+				return compno == 0 ? 0 : (compno == 1 ? 3 : -1);
+			}
+			return compno < 4 ? compno : -1;
+		case OPJ_PIXFMT_PLANAR16:
+		default:
+			return 0;
+	}
+}
+
+/* whether the components written to the output buffer fit in it */
+static opj_bool tcd_check_output(opj_tcd_t *tcd) {
+	opj_output_buffer_t *out = &tcd->cp->output;
+	opj_image_comp_t *imagec0 = &tcd->image->comps[0];
+	int compno;
+
+	if (imagec0->w > out->w || imagec0->h > out->h) {
+		opj_event_msg(tcd->cinfo, EVT_ERROR, "The output buffer (%dx%d) is smaller than the image (%dx%d)\n",
+			out->w, out->h, imagec0->w, imagec0->h);
+		return OPJ_FALSE;
+	}
+	for (compno = 0; compno < tcd->image->numcomps; compno++) {
+		opj_image_comp_t *imagec = &tcd->image->comps[compno];
+		if (tcd_output_channel(tcd, compno) < 0) {
+			continue;
+		}
+		if (imagec->x0 != imagec0->x0 || imagec->y0 != imagec0->y0 || imagec->w != imagec0->w
+			|| imagec->h != imagec0->h || imagec->factor != imagec0->factor) {
+			opj_event_msg(tcd->cinfo, EVT_ERROR, "Component %d and component 0 have different sizes: cannot decode to the output buffer\n", compno);
+			return OPJ_FALSE;
+		}
+		if (out->format == OPJ_PIXFMT_PLANAR16 && imagec->prec > 16) {
+			opj_event_msg(tcd->cinfo, EVT_ERROR, "Component %d has %d bits: cannot decode to 16-bit samples\n", compno, imagec->prec);
+			return OPJ_FALSE;
+		}
+	}
+	return OPJ_TRUE;
+}
+
+/* range of the stored samples of a component: the 8-bit pixel formats take them as unsigned */
+static void tcd_store_range(opj_tcd_t *tcd, opj_image_comp_t *imagec, int *adjust, int *min, int *max) {
+	opj_bool sgnd = imagec->sgnd && (!tcd->cp->decode_output || tcd->cp->output.format == OPJ_PIXFMT_PLANAR16);
+	*adjust = sgnd ? 0 : 1 << (imagec->prec - 1);
+	*min = sgnd ? -(1 << (imagec->prec - 1)) : 0;
+	*max = sgnd ?  (1 << (imagec->prec - 1)) - 1 : (1 << imagec->prec) - 1;
+}
+
+/* write n stored samples of component compno, at (x, y) in the image component, to the output buffer */
+static void tcd_write_output_row(opj_tcd_t *tcd, int compno, int *src, int x, int y, int n) {
+	opj_output_buffer_t *out = &tcd->cp->output;
+	int prec = tcd->image->comps[compno].prec;
+	int bpp = tcd_output_bpp(out->format);
+	unsigned char *dst;
+	int i;
+
+	if (out->format == OPJ_PIXFMT_PLANAR16) {
+		unsigned short *dst16 = (unsigned short*) (out->data + compno * out->plane_stride + y * out->stride) + x;
+		for (i = 0; i < n; ++i) {
+			dst16[i] = (unsigned short) src[i];
+		}
+		return;
+	}
+
+	/* rescale the unsigned samples of prec bits to 8 bits, rounding to the nearest */
+	if (prec > 8) {
+		int shift = prec - 8;
+		for (i = 0; i < n; ++i) {
+			src[i] = int_min((src[i] + (1 << (shift - 1))) >> shift, 255);
+		}
+	} else if (prec < 8) {
+		int maxv = (1 << prec) - 1;
+		for (i = 0; i < n; ++i) {
+			src[i] = (src[i] * 255 + maxv / 2) / maxv;
+		}
+	}
+
+	dst = out->data + y * out->stride + x * bpp + tcd_output_channel(tcd, compno);
+	if (bpp == 1) {
+		for (i = 0; i < n; ++i) {
+			dst[i] = (unsigned char) src[i];
+		}
+	} else if (compno == 0 && tcd->image->numcomps < 3) {
+		/* grayscale: the same sample for the red, green and blue channels */
+		for (i = 0; i < n; ++i) {
+			dst[i * bpp] = dst[i * bpp + 1] = dst[i * bpp + 2] = (unsigned char) src[i];
+		}
+	} else {
+		for (i = 0; i < n; ++i) {
+			dst[i * bpp] = (unsigned char) src[i];
+		}
+	}
+	if (compno == 0 && out->format == OPJ_PIXFMT_RGBA8 && tcd->image->numcomps != 2 && tcd->image->numcomps < 4) {
+		/* opaque: no alpha component */
+		for (i = 0; i < n; ++i) {
+			dst[i * bpp + 3] = 255;
+		}
+	}
+}
+
+/* whether component compno of the tile is decoded and stored in the image like component 0 */
+static opj_bool tcd_store_area_equal(opj_tcd_t *tcd, opj_tcd_tile_t *tile, int compno) {
+	opj_tcd_resolution_t *res0 = &tile->comps[0].resolutions[tile->comps[0].resno_decoded];
+	opj_tcd_resolution_t *res = &tile->comps[compno].resolutions[tile->comps[compno].resno_decoded];
+	opj_image_comp_t *imagec0 = &tcd->image->comps[0];
+	opj_image_comp_t *imagec = &tcd->image->comps[compno];
+	return res->x0 == res0->x0 && res->y0 == res0->y0 && res->x1 == res0->x1 && res->y1 == res0->y1
+		&& imagec->x0 == imagec0->x0 && imagec->y0 == imagec0->y0
+		&& imagec->w == imagec0->w && imagec->h == imagec0->h && imagec->factor == imagec0->factor;
+}
+
+/* number of samples of tilec->data, i.e. of the last resolution decoded */
+static int tcd_decoded_size(opj_tcd_tilecomp_t *tilec) {
+	opj_tcd_resolution_t *res = &tilec->resolutions[tilec->resno_decoded];
+	return (res->x1 - res->x0) * (res->y1 - res->y0);
+}
+
+/* highest resolution of the tile-component whose precincts have all received their packet of the first layer, -1 if none */
+static int tcd_complete_resolution(opj_tcd_tilecomp_t *tilec) {
+	int resno;
+	for (resno = 0; resno < tilec->numresolutions; resno++) {
+		opj_tcd_resolution_t *res = &tilec->resolutions[resno];
+		if (res->numprc_decoded < res->pw * res->ph) {
+			break;
+		}
+	}
+	return resno - 1;
+}
+
+/* divide the size of an image component by 2^levels more, as tcd_malloc_decode does with its factor */
+static void tcd_reduce_image_comp(opj_tcd_t *tcd, opj_image_comp_t *imagec, int levels) {
+	if (tcd->cp->decode_area) {
+		int x = int_ceildivpow2(imagec->x0, imagec->factor);
+		int y = int_ceildivpow2(imagec->y0, imagec->factor);
+		imagec->w = int_ceildivpow2(x + imagec->w, levels) - int_ceildivpow2(x, levels);
+		imagec->h = int_ceildivpow2(y + imagec->h, levels) - int_ceildivpow2(y, levels);
+	} else {
+		imagec->w = int_ceildivpow2(imagec->w, levels);
+		imagec->h = int_ceildivpow2(imagec->h, levels);
+	}
+	imagec->factor += levels;
+}
+
+/*
+Truncated mode: the packets of the tile have been decoded up to the last complete one. The
+complete resolutions are reported in the image, and the first tile decoded lowers the resolution
+of the image to the highest one it holds completely, in all the components: nothing is stored in
+the image yet. The next tiles are decoded at that resolution, with whatever data they have.
+*/
+static void tcd_set_truncated_resolution(opj_tcd_t *tcd, opj_tcd_tile_t *tile) {
+	int compno, reduce = 0, maxreduce = 0;
+
+	for (compno = 0; compno < tile->numcomps; compno++) {
+		opj_tcd_tilecomp_t *tilec = &tile->comps[compno];
+		opj_image_comp_t *imagec = &tcd->image->comps[compno];
+		int resno = int_min(tcd_complete_resolution(tilec), tilec->numresolutions - tcd->cp->reduce - 1);
+
+		imagec->resno_decoded = tcd->resolution_set ? int_min(imagec->resno_decoded, resno) : resno;
+		/* without any complete resolution, the lowest one is decoded all the same */
+		reduce = int_max(reduce, tilec->numresolutions - 1 - int_max(resno, 0));
+		maxreduce = compno == 0 ? tilec->numresolutions - 1 : int_min(maxreduce, tilec->numresolutions - 1);
+	}
+	if (tcd->resolution_set) {
+		return;
+	}
+	tcd->resolution_set = OPJ_TRUE;
+
+	/* the same factor for all the components, like cp->reduce */
+	reduce = int_min(reduce, maxreduce);
+	if (reduce > tcd->cp->reduce) {
+		opj_event_msg(tcd->cinfo, EVT_WARNING, "Truncated codestream: %d resolution levels discarded instead of %d\n", reduce, tcd->cp->reduce);
+	}
+	for (compno = 0; compno < tile->numcomps; compno++) {
+		opj_image_comp_t *imagec = &tcd->image->comps[compno];
+		if (reduce > imagec->factor) {
+			tcd_reduce_image_comp(tcd, imagec, reduce - imagec->factor);
+		}
+	}
+}
+
+opj_bool tcd_decode_tile(opj_tcd_t *tcd, opj_tile_span_t *spans, int numspans, int tileno, opj_codestream_info_t *cstr_info) {
+	opj_bool truncated = OPJ_FALSE;
+
+	if (!tcd_decode_tile_t2(tcd, spans, numspans, tileno, cstr_info, &truncated)) {
+		return OPJ_FALSE;
+	}
+	if (!tcd_decode_tile_t1(tcd, tileno, tcd->thread_pool, 0)) {
+		return OPJ_FALSE;
+	}
+	
+	/* in truncated mode, the tile is decoded as well as its data allows */
+	return truncated && !tcd->cp->truncated_mode ? OPJ_FALSE : OPJ_TRUE;
+}
+
+opj_bool tcd_decode_tile_t2(opj_tcd_t *tcd, opj_tile_span_t *spans, int numspans, int tileno, opj_codestream_info_t *cstr_info, opj_bool *truncated) {
 	int l;
 	int compno;
-	int eof = 0;
-	double tile_time, t1_time, dwt_time;
+	double t2_time;
 	opj_tcd_tile_t *tile = NULL;
 
-	opj_t1_t *t1 = NULL;		/* T1 component */
-	opj_t2_t *t2 = NULL;		/* T2 component */
-	
 	tcd->tcd_tileno = tileno;
 	tcd->tcd_tile = &(tcd->tcd_image->tiles[tileno]);
 	tcd->tcp = &(tcd->cp->tcps[tileno]);
 	tile = tcd->tcd_tile;
 	
-	tile_time = opj_clock();	/* time needed to decode a tile */
+	t2_time = opj_clock();	/* time needed to decode the packets of a tile */
 	opj_event_msg(tcd->cinfo, EVT_INFO, "tile %d of %d\n", tileno + 1, tcd->cp->tw * tcd->cp->th);
 
 	/* INDEX >>  */
@@ -1376,39 +2085,113 @@ opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno
 	
 	/*--------------TIER2------------------*/
 	
-	t2 = t2_create(tcd->cinfo, tcd->image, tcd->cp);
-	l = t2_decode_packets(t2, src, len, tileno, tile, cstr_info);
-	t2_destroy(t2);
+	*truncated = OPJ_FALSE;
+	if (!tcd->t2) {
+		opj_event_msg(tcd->cinfo, EVT_ERROR, "Out of memory\n");
+		return OPJ_FALSE;
+	}
+	l = t2_decode_packets(tcd->t2, spans, numspans, tileno, tile, cstr_info);
 
 	if (l == -999) {
-		eof = 1;
-		opj_event_msg(tcd->cinfo, EVT_ERROR, "tcd_decode: incomplete bistream\n");
+		*truncated = OPJ_TRUE;
+		opj_event_msg(tcd->cinfo, tcd->cp->truncated_mode ? EVT_WARNING : EVT_ERROR, "tcd_decode: incomplete bistream\n");
 	}
+	t2_time = opj_clock() - t2_time;
+	opj_event_msg(tcd->cinfo, EVT_INFO, "- tiers-2 took %f s\n", t2_time);
+
+	if (tcd->cp->truncated_mode) {
+		tcd_set_truncated_resolution(tcd, tile);
+	}
+
+	/* 
+	The image is shared by all the tiles: update it here, before the
+	tier-1 stage of the tile possibly runs in another thread.
+	*/
+	if (tcd->cp->decode_output && !tcd_check_output(tcd)) {
+		return OPJ_FALSE;
+	}
+	for (compno = 0; compno < tile->numcomps; compno++) {
+		opj_image_comp_t* imagec = &tcd->image->comps[compno];
+
+		if (tcd->cp->reduce != 0 && !tcd->cp->truncated_mode) {
+			if ( tile->comps[compno].numresolutions < ( tcd->cp->reduce - 1 ) ) {				
+				opj_event_msg(tcd->cinfo, EVT_ERROR, "Error decoding tile. The number of resolutions to remove [%d+1] is higher than the number "
+					" of resolutions in the original codestream [%d]\nModify the cp_reduce parameter.\n", tcd->cp->reduce, tile->comps[compno].numresolutions);
+				return OPJ_FALSE;
+			}
+      else {
+		  	imagec->resno_decoded =
+				tile->comps[compno].numresolutions - tcd->cp->reduce - 1;
+      }
+		}
+
+		if (tcd->cp->truncated_mode) {
+			/* imagec->resno_decoded is the complete resolution: the tile is decoded at the factor of the image */
+			tile->comps[compno].resno_decoded = int_max(tile->comps[compno].numresolutions - imagec->factor - 1, 0);
+		} else {
+			tile->comps[compno].resno_decoded = imagec->resno_decoded;
+		}
+
+		/* zeroed: the areas of tiles that are missing or not decoded yet stay black */
+		if (tcd->cp->decode_output) {
+			continue;
+		}
+		if(!imagec->data){
+			imagec->data = (int*) opj_calloc(imagec->w * imagec->h, sizeof(int));
+		}
+        if (!imagec->data)
+        {
+            opj_event_msg(tcd->cinfo, EVT_ERROR, "Out of memory\n");
+            return OPJ_FALSE;
+        }
+	}
+
+	return OPJ_TRUE;
+}
+
+opj_bool tcd_decode_tile_t1(opj_tcd_t *tcd, int tileno, opj_thread_pool_t *tp, int workerno) {
+	int compno;
+	double tile_time, t1_time, dwt_time;
+	opj_tcd_tile_t *tile = &(tcd->tcd_image->tiles[tileno]);
+	opj_tcp_t *tcp = &(tcd->cp->tcps[tileno]);
+
+	opj_t1_t *t1 = NULL;		/* T1 component */
+	opj_bool fuse_mct = OPJ_FALSE;	/* irreversible MCT done while storing the tile */
 	
+	tile_time = opj_clock();	/* time needed to decode a tile */
+
 	/*------------------TIER1-----------------*/
 	
 	t1_time = opj_clock();	/* time needed to decode a tile */
-	t1 = t1_create(tcd->cinfo);
-    if (t1 == NULL)
-    {
-        opj_event_msg(tcd->cinfo, EVT_ERROR, "Out of memory\n");
-        t1_destroy(t1);
-        return OPJ_FALSE;
-    }
+	/* the T1 handles are created by tcd_malloc_decode */
+	if (!tcd->t1s) {
+		opj_event_msg(tcd->cinfo, EVT_ERROR, "Out of memory\n");
+		return OPJ_FALSE;
+	}
+	t1 = tcd->t1s[workerno];
 
 	for (compno = 0; compno < tile->numcomps; ++compno) {
 		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
+		/* only the resolutions kept by cp->reduce are decoded: the buffer is sized for the last one */
+		opj_tcd_resolution_t* res = &tilec->resolutions[tilec->resno_decoded];
 		/* The +3 is headroom required by the vectorized DWT */
-		tilec->data = (int*) opj_aligned_malloc((((tilec->x1 - tilec->x0) * (tilec->y1 - tilec->y0))+3) * sizeof(int));
+		tilec->data = (int*) opj_aligned_malloc((((res->x1 - res->x0) * (res->y1 - res->y0))+3) * sizeof(int));
         if (tilec->data == NULL)
         {
             opj_event_msg(tcd->cinfo, EVT_ERROR, "Out of memory\n");
             return OPJ_FALSE;
         }
 
-		t1_decode_cblks(t1, tilec, &tcd->tcp->tccps[compno]);
+		if (!tp) {
+			t1_decode_cblks(t1, tilec, &tcp->tccps[compno]);
+		}
+	}
+	if (tp) {
+		if (!t1_decode_cblks_mt(tp, tcd->t1s, tile, tcp)) {
+			opj_event_msg(tcd->cinfo, EVT_ERROR, "Out of memory\n");
+			return OPJ_FALSE;
+		}
 	}
-	t1_destroy(t1);
 	t1_time = opj_clock() - t1_time;
 	opj_event_msg(tcd->cinfo, EVT_INFO, "- tiers-1 took %f s\n", t1_time);
 	
@@ -1419,21 +2202,9 @@ opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno
 		opj_tcd_tilecomp_t *tilec = &tile->comps[compno];
 		int numres2decode;
 
-		if (tcd->cp->reduce != 0) {
-			if ( tile->comps[compno].numresolutions < ( tcd->cp->reduce - 1 ) ) {				
-				opj_event_msg(tcd->cinfo, EVT_ERROR, "Error decoding tile. The number of resolutions to remove [%d+1] is higher than the number "
-					" of resolutions in the original codestream [%d]\nModify the cp_reduce parameter.\n", tcd->cp->reduce, tile->comps[compno].numresolutions);
-				return OPJ_FALSE;
-			}
-      else {
-		  	tcd->image->comps[compno].resno_decoded =
-				tile->comps[compno].numresolutions - tcd->cp->reduce - 1;
-      }
-		}
-
-		numres2decode = tcd->image->comps[compno].resno_decoded + 1;
+		numres2decode = tilec->resno_decoded + 1;
 		if(numres2decode > 0){
-			if (tcd->tcp->tccps[compno].qmfbid == 1) {
+			if (tcp->tccps[compno].qmfbid == 1) {
 				dwt_decode(tilec, numres2decode);
 			} else {
 				dwt_decode_real(tilec, numres2decode);
@@ -1445,16 +2216,21 @@ opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno
 
 	/*----------------MCT-------------------*/
 
-	if (tcd->tcp->mct) {
-		int n = (tile->comps[0].x1 - tile->comps[0].x0) * (tile->comps[0].y1 - tile->comps[0].y0);
+	if (tcp->mct) {
+		int n = tcd_decoded_size(&tile->comps[0]);
 
-		if (tile->numcomps >= 3 ){
-			if (tcd->tcp->tccps[0].qmfbid == 1) {
+		if (tile->numcomps >= 3 && (n != tcd_decoded_size(&tile->comps[1]) || n != tcd_decoded_size(&tile->comps[2]))) {
+			opj_event_msg(tcd->cinfo, EVT_WARNING,"Components of different sizes at the decoded resolution. Skip the MCT step.\n");
+		} else if (tile->numcomps >= 3 ){
+			if (tcp->tccps[0].qmfbid == 1) {
 				mct_decode(
 						tile->comps[0].data,
 						tile->comps[1].data,
 						tile->comps[2].data,
 						n);
+			} else if (tcd_store_area_equal(tcd, tile, 1) && tcd_store_area_equal(tcd, tile, 2)) {
+				/* done row by row by tcd_store_row_mct_real, below */
+				fuse_mct = OPJ_TRUE;
 			} else {
 				mct_decode_real(
 						(float*)tile->comps[0].data,
@@ -1472,41 +2248,65 @@ opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno
 	for (compno = 0; compno < tile->numcomps; ++compno) {
 		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
 		opj_image_comp_t* imagec = &tcd->image->comps[compno];
-		opj_tcd_resolution_t* res = &tilec->resolutions[imagec->resno_decoded];
-		int adjust = imagec->sgnd ? 0 : 1 << (imagec->prec - 1);
-		int min = imagec->sgnd ? -(1 << (imagec->prec - 1)) : 0;
-		int max = imagec->sgnd ?  (1 << (imagec->prec - 1)) - 1 : (1 << imagec->prec) - 1;
+		opj_tcd_resolution_t* res = &tilec->resolutions[tilec->resno_decoded];
+		opj_bool output = tcd->cp->decode_output;
+		int adjust, min, max;
 
-		int tw = tilec->x1 - tilec->x0;
+		int tw = res->x1 - res->x0;
 		int w = imagec->w;
 
 		int offset_x = int_ceildivpow2(imagec->x0, imagec->factor);
 		int offset_y = int_ceildivpow2(imagec->y0, imagec->factor);
 
-		int i, j;
-		if(!imagec->data){
-			imagec->data = (int*) opj_malloc(imagec->w * imagec->h * sizeof(int));
-		}
-        if (!imagec->data)
-        {
-            opj_event_msg(tcd->cinfo, EVT_ERROR, "Out of memory\n");
-            return OPJ_FALSE;
-        }
-		if(tcd->tcp->tccps[compno].qmfbid == 1) {
-			for(j = res->y0; j < res->y1; ++j) {
-				for(i = res->x0; i < res->x1; ++i) {
-					int v = tilec->data[i - res->x0 + (j - res->y0) * tw];
-					v += adjust;
-					imagec->data[(i - offset_x) + (j - offset_y) * w] = int_clamp(v, min, max);
+		/* only the part of the tile inside the image component is stored (see tcd_malloc_decode) */
+		int x0 = int_max(res->x0, offset_x);
+		int y0 = int_max(res->y0, offset_y);
+		int x1 = int_min(res->x1, offset_x + w);
+		int y1 = int_min(res->y1, offset_y + imagec->h);
+
+		int j;
+		tcd_store_range(tcd, imagec, &adjust, &min, &max);
+		if (output && tcd_output_channel(tcd, compno) < 0) {
+			/* left out by the pixel format of the output buffer */
+		} else if (fuse_mct && compno < 3) {
+			/* the three components share the same area: store them together */
+			if (compno == 0) {
+				float *src[3];
+				int *dst[3];
+				int adjusts[3], mins[3], maxs[3];
+				int k;
+				for (k = 0; k < 3; ++k) {
+					tcd_store_range(tcd, &tcd->image->comps[k], &adjusts[k], &mins[k], &maxs[k]);
+				}
+				for(j = y0; j < y1; ++j) {
+					for (k = 0; k < 3; ++k) {
+						src[k] = (float*)tile->comps[k].data + (x0 - res->x0) + (j - res->y0) * tw;
+						dst[k] = output ? (int*)src[k] : tcd->image->comps[k].data + (x0 - offset_x) + (j - offset_y) * w;
+					}
+					tcd_store_row_mct_real(src, dst, x1 - x0, adjusts, mins, maxs);
+					for (k = 0; output && k < 3; ++k) {
+						if (tcd_output_channel(tcd, k) >= 0) {
+							tcd_write_output_row(tcd, k, dst[k], x0 - offset_x, j - offset_y, x1 - x0);
+						}
+					}
+				}
+			}
+		} else if(tcp->tccps[compno].qmfbid == 1) {
+			for(j = y0; j < y1; ++j) {
+				int *src = &tilec->data[(x0 - res->x0) + (j - res->y0) * tw];
+				int *dst = output ? src : &imagec->data[(x0 - offset_x) + (j - offset_y) * w];
+				tcd_store_row_int(src, dst, x1 - x0, adjust, min, max);
+				if (output) {
+					tcd_write_output_row(tcd, compno, dst, x0 - offset_x, j - offset_y, x1 - x0);
 				}
 			}
 		}else{
-			for(j = res->y0; j < res->y1; ++j) {
-				for(i = res->x0; i < res->x1; ++i) {
-					float tmp = ((float*)tilec->data)[i - res->x0 + (j - res->y0) * tw];
-					int v = lrintf(tmp);
-					v += adjust;
-					imagec->data[(i - offset_x) + (j - offset_y) * w] = int_clamp(v, min, max);
+			for(j = y0; j < y1; ++j) {
+				float *src = (float*)tilec->data + (x0 - res->x0) + (j - res->y0) * tw;
+				int *dst = output ? (int*)src : &imagec->data[(x0 - offset_x) + (j - offset_y) * w];
+				tcd_store_row_real(src, dst, x1 - x0, adjust, min, max);
+				if (output) {
+					tcd_write_output_row(tcd, compno, dst, x0 - offset_x, j - offset_y, x1 - x0);
 				}
 			}
 		}
@@ -1516,10 +2316,6 @@ opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno
 	tile_time = opj_clock() - tile_time;	/* time needed to decode a tile */
 	opj_event_msg(tcd->cinfo, EVT_INFO, "- tile decoded in %f s\n", tile_time);
 
-	if (eof) {
-		return OPJ_FALSE;
-	}
-	
 	return OPJ_TRUE;
 }
 
@@ -1532,43 +2328,24 @@ void tcd_free_decode(opj_tcd_t *tcd) {
     }
 
 	opj_free(tcd_image->tiles);
+	tcd_image->tiles = NULL;
 }
 
 void tcd_free_decode_tile(opj_tcd_t *tcd, int tileno) {
-    int compno,resno,bandno,precno,cblkno;
-
-	opj_tcd_image_t *tcd_image = tcd->tcd_image;
-
-	opj_tcd_tile_t *tile = &tcd_image->tiles[tileno];
-    if (tile->comps != NULL) {
-        for (compno = 0; compno < tile->numcomps; compno++) {
-            opj_tcd_tilecomp_t *tilec = &tile->comps[compno];
-            for (resno = 0; resno < tilec->numresolutions; resno++) {
-                opj_tcd_resolution_t *res = &tilec->resolutions[resno];
-                for (bandno = 0; bandno < res->numbands; bandno++) {
-                    opj_tcd_band_t *band = &res->bands[bandno];
-                    for (precno = 0; precno < res->ph * res->pw; precno++) {
-                        opj_tcd_precinct_t *prec = &band->precincts[precno];
-                        if (prec->cblks.dec != NULL) {
-                            for (cblkno = 0; cblkno < prec->cw * prec->ch; ++cblkno) {
-                                opj_tcd_cblk_dec_t* cblk = &prec->cblks.dec[cblkno];
-                                opj_free(cblk->data);
-                                opj_free(cblk->segs);
-                            }
-                            opj_free(prec->cblks.dec);
-                        }
-                        if (prec->imsbtree != NULL) tgt_destroy(prec->imsbtree);
-                        if (prec->incltree != NULL) tgt_destroy(prec->incltree);
-
-
-                    }
-                    opj_free(band->precincts);
-				}
-			}
-            opj_free(tilec->resolutions);
+	opj_tcd_tile_t *tile = &tcd->tcd_image->tiles[tileno];
+
+	/* the resolutions, precincts, code-blocks and tag-trees all live in the arena */
+	if (tile->arena) {
+		if (tile->arena == tcd->arena) {
+			opj_arena_reset(tile->arena);
+		} else {
+			opj_arena_destroy(tile->arena);
 		}
-        opj_free(tile->comps);
-        tile->comps = NULL;
+		tile->arena = NULL;
+	}
+	if (tile->comps != NULL) {
+		opj_free(tile->comps);
+		tile->comps = NULL;
 	}
 }
 
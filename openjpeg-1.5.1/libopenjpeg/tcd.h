@@ -96,7 +96,11 @@ typedef struct opj_tcd_cblk_dec {
   int numlenbits;
   int len;			/* length */
   int numnewpasses;		/* number of pass added to the code-blocks */
+  int numpasses;		/* number of passes of the layers decoded (cp_layer), the next ones are only parsed */
   int numsegs;			/* number of segments */
+  int maxsegs;			/* number of segments allocated */
+  int maxlen;			/* number of bytes allocated for data */
+  opj_bool skip;		/* outside of the decode area: its data is neither kept nor decoded */
 } opj_tcd_cblk_dec_t;
 
 /**
@@ -130,6 +134,7 @@ FIXME: documentation
 typedef struct opj_tcd_resolution {
   int x0, y0, x1, y1;		/* dimension of the resolution level : left upper corner (x0, y0) right low corner (x1,y1) */
   int pw, ph;
+  int numprc_decoded;		/* decoder : number of precincts whose packet of the first layer has been decoded */
   int numbands;			/* number sub-band for the resolution level */
   opj_tcd_band_t bands[3];		/* subband information */
 } opj_tcd_resolution_t;
@@ -143,6 +148,7 @@ typedef struct opj_tcd_tilecomp {
   int x0, y0, x1, y1;		/* dimension of component : left upper corner (x0, y0) right low corner (x1,y1) */
   int numresolutions;		/* number of resolutions level */
   int numpix;			/* add fixed_quality */
+  int resno_decoded;		/* last resolution to reconstruct, set once the packets of the tile are decoded */
 } opj_tcd_tilecomp_t;
 
 /**
@@ -157,6 +163,8 @@ typedef struct opj_tcd_tile {
   double distolayer[100];	/* add fixed_quality */
   /** packet number */
   int packno;
+  /** arena holding the decoder structures of the tile, NULL when they are not allocated */
+  opj_arena_t *arena;
 } opj_tcd_tile_t;
 
 /**
@@ -197,6 +205,29 @@ typedef struct opj_tcd {
 	int tcd_tileno;
 	/** Time taken to encode a tile*/
 	double encoding_time;
+	/** worker threads used for decoding or encoding, NULL when working in the calling thread */
+	opj_thread_pool_t *thread_pool;
+	/** arena of the tiles decoded one after the other: cp->arena if the caller supplied one, else own_arena */
+	opj_arena_t *arena;
+	/** arena created by the TCD when the caller supplies none, kept until tcd_destroy */
+	opj_arena_t *own_arena;
+	/** OPJ_TRUE when several tiles are decoded at once: each one then gets an arena of its own */
+	opj_bool concurrent_tiles;
+	/** T1 handles, one per worker of thread_pool (or a single one), kept until tcd_destroy */
+	struct opj_t1 **t1s;
+	/** number of T1 handles in t1s */
+	int numt1s;
+	/** T2 handle of the decoder, kept until tcd_destroy */
+	struct opj_t2 *t2;
+	/** in truncated mode, OPJ_TRUE once the first tile decoded has set the resolution of the image */
+	opj_bool resolution_set;
+	/** OPJ_TRUE for the tile coder of a thread pool worker: it encodes its code-blocks itself, with a single T1 handle */
+	opj_bool pool_worker;
+	/**
+	bytes of the output space given to the last tile encoded that its rate allocation did not depend on:
+	with that much less space, the layers of the tile are the same
+	*/
+	int rate_headroom;
 } opj_tcd_t;
 
 /** @name Exported functions */
@@ -214,7 +245,8 @@ Create a new TCD handle
 */
 opj_tcd_t* tcd_create(opj_common_ptr cinfo);
 /**
-Destroy a previously created TCD handle
+Destroy a previously created TCD handle, with the thread pool, arena and
+T1/T2 handles kept between decodes
 @param tcd TCD handle to destroy
 */
 void tcd_destroy(opj_tcd_t *tcd);
@@ -240,7 +272,8 @@ Initialize the tile coder (reuses the memory allocated by tcd_malloc_encode)
 */
 void tcd_init_encode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp, int curtileno);
 /**
-Initialize the tile decoder
+Initialize the tile decoder. A TCD handle may decode several images in turn:
+the thread pool, arena and T1/T2 handles of the previous ones are reused.
 @param tcd TCD handle
 @param image Raw image
 @param cp Coding parameters
@@ -258,20 +291,45 @@ Encode a tile from the raw image into a buffer
 @param dest Destination buffer
 @param len Length of destination buffer
 @param cstr_info Codestream information structure 
-@return 
+@return Returns the number of bytes written, -999 if the tile does not fit in len bytes, 
+-1 if the code-blocks could not be encoded
 */
 int tcd_encode_tile(opj_tcd_t *tcd, int tileno, unsigned char *dest, int len, opj_codestream_info_t *cstr_info);
 /**
-Decode a tile from a buffer into a raw image
+Decode a tile from its tile-parts into a raw image
 @param tcd TCD handle
-@param src Source buffer
-@param len Length of source buffer
+@param spans Data of the tile, one span per tile-part
+@param numspans Number of spans
 @param tileno Number that identifies one of the tiles to be decoded
 @param cstr_info Codestream information structure
 */
-opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno, opj_codestream_info_t *cstr_info);
+opj_bool tcd_decode_tile(opj_tcd_t *tcd, opj_tile_span_t *spans, int numspans, int tileno, opj_codestream_info_t *cstr_info);
 /**
-Free the memory allocated for decoding
+First stage of tcd_decode_tile: decode the packets of a tile (tier-2) and
+update the image fields shared by all the tiles. Tiles must go through this
+stage one at a time, in codestream order.
+@param tcd TCD handle
+@param spans Data of the tile, one span per tile-part
+@param numspans Number of spans
+@param tileno Number that identifies one of the tiles to be decoded
+@param cstr_info Codestream information structure
+@param truncated Set to OPJ_TRUE when the packets of the tile are incomplete
+@return Returns OPJ_FALSE if the tile cannot be decoded
+*/
+opj_bool tcd_decode_tile_t2(opj_tcd_t *tcd, opj_tile_span_t *spans, int numspans, int tileno, opj_codestream_info_t *cstr_info, opj_bool *truncated);
+/**
+Second stage of tcd_decode_tile: decode the code-blocks (tier-1), apply the
+inverse DWT and MCT and store the tile in the image. Different tiles may go
+through this stage concurrently.
+@param tcd TCD handle
+@param tileno Number that identifies one of the tiles to be decoded
+@param tp Thread pool used to decode the code-blocks, NULL to decode them in the calling thread
+@param workerno Worker of tcd->thread_pool running this stage (0 outside of the pool): selects the T1 handle used when tp is NULL
+@return Returns OPJ_FALSE if the tile cannot be decoded
+*/
+opj_bool tcd_decode_tile_t1(opj_tcd_t *tcd, int tileno, opj_thread_pool_t *tp, int workerno);
+/**
+Free the memory allocated for decoding an image
 @param tcd TCD handle
 */
 void tcd_free_decode(opj_tcd_t *tcd);
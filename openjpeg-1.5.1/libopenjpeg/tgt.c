@@ -40,6 +40,10 @@
 */
 
 opj_tgt_tree_t *tgt_create(int numleafsh, int numleafsv) {
+	return tgt_create_arena(NULL, numleafsh, numleafsv);
+}
+
+opj_tgt_tree_t *tgt_create_arena(opj_arena_t *arena, int numleafsh, int numleafsv) {
 	int nplh[32];
 	int nplv[32];
 	opj_tgt_node_t *node = NULL;
@@ -50,7 +54,7 @@ opj_tgt_tree_t *tgt_create(int numleafsh, int numleafsv) {
 	int numlvls;
 	int n;
 
-	tree = (opj_tgt_tree_t *) opj_malloc(sizeof(opj_tgt_tree_t));
+	tree = (opj_tgt_tree_t *) (arena ? opj_arena_alloc(arena, sizeof(opj_tgt_tree_t)) : opj_malloc(sizeof(opj_tgt_tree_t)));
 	if(!tree) return NULL;
 	tree->numleafsh = numleafsh;
 	tree->numleafsv = numleafsv;
@@ -69,13 +73,14 @@ opj_tgt_tree_t *tgt_create(int numleafsh, int numleafsv) {
 	
 	/* ADD */
 	if (tree->numnodes == 0) {
-		opj_free(tree);
+		if (!arena) opj_free(tree);
 		return NULL;
 	}
 
-	tree->nodes = (opj_tgt_node_t*) opj_calloc(tree->numnodes, sizeof(opj_tgt_node_t));
+	tree->nodes = (opj_tgt_node_t*) (arena ? opj_arena_calloc(arena, tree->numnodes, sizeof(opj_tgt_node_t))
+		: opj_calloc(tree->numnodes, sizeof(opj_tgt_node_t)));
 	if(!tree->nodes) {
-		opj_free(tree);
+		if (!arena) opj_free(tree);
 		return NULL;
 	}
 
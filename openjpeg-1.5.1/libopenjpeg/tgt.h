@@ -73,6 +73,14 @@ Create a tag-tree
 */
 opj_tgt_tree_t *tgt_create(int numleafsh, int numleafsv);
 /**
+Create a tag-tree in an arena. The tree is released with the arena, not with tgt_destroy.
+@param arena Arena the tree is allocated from, NULL to allocate it like tgt_create
+@param numleafsh Width of the array of leafs of the tree
+@param numleafsv Height of the array of leafs of the tree
+@return Returns a new tag-tree if successful, returns NULL otherwise
+*/
+opj_tgt_tree_t *tgt_create_arena(opj_arena_t *arena, int numleafsh, int numleafsv);
+/**
 Destroy a tag-tree, liberating memory
 @param tree Tag-tree to destroy
 */
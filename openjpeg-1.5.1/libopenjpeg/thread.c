@@ -0,0 +1,302 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* system thread headers must come before opj_malloc.h poisons malloc & co */
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "opj_includes.h"
+
+/** @defgroup THREAD THREAD - Implementation of a thread pool */
+/*@{*/
+
+/** @name Local data structures */
+/*@{*/
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION opj_mutex_t;
+typedef CONDITION_VARIABLE opj_cond_t;
+typedef HANDLE opj_thread_t;
+#define opj_mutex_init(m)		InitializeCriticalSection(m)
+#define opj_mutex_destroy(m)	DeleteCriticalSection(m)
+#define opj_mutex_lock(m)		EnterCriticalSection(m)
+#define opj_mutex_unlock(m)		LeaveCriticalSection(m)
+#define opj_cond_init(c)		InitializeConditionVariable(c)
+#define opj_cond_destroy(c)
+#define opj_cond_wait(c, m)		SleepConditionVariableCS(c, m, INFINITE)
+#define opj_cond_signal(c)		WakeConditionVariable(c)
+#define opj_cond_broadcast(c)	WakeAllConditionVariable(c)
+#else
+typedef pthread_mutex_t opj_mutex_t;
+typedef pthread_cond_t opj_cond_t;
+typedef pthread_t opj_thread_t;
+#define opj_mutex_init(m)		pthread_mutex_init(m, NULL)
+#define opj_mutex_destroy(m)	pthread_mutex_destroy(m)
+#define opj_mutex_lock(m)		pthread_mutex_lock(m)
+#define opj_mutex_unlock(m)		pthread_mutex_unlock(m)
+#define opj_cond_init(c)		pthread_cond_init(c, NULL)
+#define opj_cond_destroy(c)		pthread_cond_destroy(c)
+#define opj_cond_wait(c, m)		pthread_cond_wait(c, m)
+#define opj_cond_signal(c)		pthread_cond_signal(c)
+#define opj_cond_broadcast(c)	pthread_cond_broadcast(c)
+#endif
+
+/**
+Queued job
+*/
+typedef struct opj_job {
+	opj_job_fn job_fn;
+	void *user_data;
+	struct opj_job *next;
+} opj_job_t;
+
+/**
+Per-worker start argument
+*/
+typedef struct opj_worker {
+	struct opj_thread_pool *tp;
+	int workerno;
+	opj_thread_t thread;
+} opj_worker_t;
+
+struct opj_thread_pool {
+	/** number of worker threads (0 for a synchronous pool) */
+	int num_threads;
+	/** worker threads */
+	opj_worker_t *workers;
+	/** protects everything below */
+	opj_mutex_t mutex;
+	/** signaled when a job is queued or when the pool is stopping */
+	opj_cond_t job_cond;
+	/** signaled when a job is finished */
+	opj_cond_t done_cond;
+	/** FIFO of queued jobs */
+	opj_job_t *head;
+	opj_job_t *tail;
+	/** number of jobs queued or running */
+	int pending;
+	/** set when the workers must exit */
+	opj_bool stop;
+};
+
+/*@}*/
+
+/** @name Local static functions */
+/*@{*/
+
+/**
+Worker thread main loop: pop jobs until the pool is stopped and drained
+@param worker Worker description
+*/
+static void opj_thread_pool_worker(opj_worker_t *worker);
+
+/*@}*/
+
+/*@}*/
+
+/* ----------------------------------------------------------------------- */
+
+static void opj_thread_pool_worker(opj_worker_t *worker) {
+	opj_thread_pool_t *tp = worker->tp;
+
+	opj_mutex_lock(&tp->mutex);
+	for (;;) {
+		opj_job_t *job;
+
+		while (!tp->head && !tp->stop) {
+			opj_cond_wait(&tp->job_cond, &tp->mutex);
+		}
+		job = tp->head;
+		if (!job) {
+			break;
+		}
+		tp->head = job->next;
+		if (!tp->head) {
+			tp->tail = NULL;
+		}
+		opj_mutex_unlock(&tp->mutex);
+
+		job->job_fn(job->user_data, worker->workerno);
+		opj_free(job);
+
+		opj_mutex_lock(&tp->mutex);
+		tp->pending--;
+		opj_cond_broadcast(&tp->done_cond);
+	}
+	opj_mutex_unlock(&tp->mutex);
+}
+
+#ifdef _WIN32
+static unsigned int __stdcall opj_thread_pool_worker_start(void *arg) {
+	opj_thread_pool_worker((opj_worker_t*) arg);
+	return 0;
+}
+#else
+static void* opj_thread_pool_worker_start(void *arg) {
+	opj_thread_pool_worker((opj_worker_t*) arg);
+	return NULL;
+}
+#endif
+
+/* ----------------------------------------------------------------------- */
+
+opj_thread_pool_t* opj_thread_pool_create(int num_threads) {
+	int i;
+	opj_thread_pool_t *tp = (opj_thread_pool_t*) opj_calloc(1, sizeof(opj_thread_pool_t));
+	if (!tp) {
+		return NULL;
+	}
+	if (num_threads <= 1) {
+		return tp;
+	}
+
+	tp->workers = (opj_worker_t*) opj_calloc(num_threads, sizeof(opj_worker_t));
+	if (!tp->workers) {
+		opj_free(tp);
+		return NULL;
+	}
+	opj_mutex_init(&tp->mutex);
+	opj_cond_init(&tp->job_cond);
+	opj_cond_init(&tp->done_cond);
+
+	for (i = 0; i < num_threads; i++) {
+		opj_worker_t *worker = &tp->workers[i];
+		worker->tp = tp;
+		worker->workerno = i;
+#ifdef _WIN32
+		worker->thread = (HANDLE) _beginthreadex(NULL, 0, opj_thread_pool_worker_start, worker, 0, NULL);
+		if (worker->thread == NULL) {
+			break;
+		}
+#else
+		if (pthread_create(&worker->thread, NULL, opj_thread_pool_worker_start, worker) != 0) {
+			break;
+		}
+#endif
+		tp->num_threads++;
+	}
+
+	/* could not start any worker: fall back on synchronous execution */
+	if (tp->num_threads == 0) {
+		opj_cond_destroy(&tp->done_cond);
+		opj_cond_destroy(&tp->job_cond);
+		opj_mutex_destroy(&tp->mutex);
+		opj_free(tp->workers);
+		tp->workers = NULL;
+	}
+
+	return tp;
+}
+
+void opj_thread_pool_destroy(opj_thread_pool_t *tp) {
+	int i;
+	if (!tp) {
+		return;
+	}
+	if (tp->num_threads > 0) {
+		opj_mutex_lock(&tp->mutex);
+		tp->stop = OPJ_TRUE;
+		opj_cond_broadcast(&tp->job_cond);
+		opj_mutex_unlock(&tp->mutex);
+
+		for (i = 0; i < tp->num_threads; i++) {
+#ifdef _WIN32
+			WaitForSingleObject(tp->workers[i].thread, INFINITE);
+			CloseHandle(tp->workers[i].thread);
+#else
+			pthread_join(tp->workers[i].thread, NULL);
+#endif
+		}
+
+		opj_cond_destroy(&tp->done_cond);
+		opj_cond_destroy(&tp->job_cond);
+		opj_mutex_destroy(&tp->mutex);
+		opj_free(tp->workers);
+	}
+	opj_free(tp);
+}
+
+int opj_thread_pool_get_thread_count(opj_thread_pool_t *tp) {
+	return tp->num_threads > 0 ? tp->num_threads : 1;
+}
+
+opj_bool opj_thread_pool_submit_job(opj_thread_pool_t *tp, opj_job_fn job_fn, void *user_data) {
+	opj_job_t *job;
+
+	if (tp->num_threads == 0) {
+		job_fn(user_data, 0);
+		return OPJ_TRUE;
+	}
+
+	job = (opj_job_t*) opj_malloc(sizeof(opj_job_t));
+	if (!job) {
+		return OPJ_FALSE;
+	}
+	job->job_fn = job_fn;
+	job->user_data = user_data;
+	job->next = NULL;
+
+	opj_mutex_lock(&tp->mutex);
+	if (tp->tail) {
+		tp->tail->next = job;
+	} else {
+		tp->head = job;
+	}
+	tp->tail = job;
+	tp->pending++;
+	opj_cond_signal(&tp->job_cond);
+	opj_mutex_unlock(&tp->mutex);
+
+	return OPJ_TRUE;
+}
+
+void opj_thread_pool_submit_or_run(opj_thread_pool_t *tp, opj_job_fn job_fn, void *user_data) {
+	if (!opj_thread_pool_submit_job(tp, job_fn, user_data)) {
+		opj_thread_pool_wait_completion(tp, 0);
+		job_fn(user_data, 0);
+	}
+}
+
+void opj_thread_pool_wait_completion(opj_thread_pool_t *tp, int max_remaining_jobs) {
+	if (tp->num_threads == 0) {
+		return;
+	}
+	if (max_remaining_jobs < 0) {
+		max_remaining_jobs = 0;
+	}
+	opj_mutex_lock(&tp->mutex);
+	while (tp->pending > max_remaining_jobs) {
+		opj_cond_wait(&tp->done_cond, &tp->mutex);
+	}
+	opj_mutex_unlock(&tp->mutex);
+}
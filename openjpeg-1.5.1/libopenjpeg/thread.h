@@ -0,0 +1,104 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __THREAD_H
+#define __THREAD_H
+/**
+@file thread.h
+@brief Implementation of a thread pool (THREAD)
+
+The functions in THREAD.C run independent jobs on a fixed set of worker threads.
+They are used by TCD.C and T1.C to spread the decoding of a tile over several cores.
+When threads are not requested (or cannot be started), jobs are run synchronously
+in the calling thread.
+*/
+
+/** @defgroup THREAD THREAD - Implementation of a thread pool */
+/*@{*/
+
+/**
+Opaque thread pool handle
+*/
+typedef struct opj_thread_pool opj_thread_pool_t;
+
+/**
+Job callback
+@param user_data Pointer given to opj_thread_pool_submit_job
+@param workerno Index of the worker running the job, in [0, opj_thread_pool_get_thread_count()[
+*/
+typedef void (*opj_job_fn)(void *user_data, int workerno);
+
+/** @name Exported functions */
+/*@{*/
+/* ----------------------------------------------------------------------- */
+/**
+Create a thread pool
+@param num_threads Number of worker threads. If <= 1, jobs are run in the calling thread.
+@return Returns a new thread pool if successful, returns NULL otherwise
+*/
+opj_thread_pool_t* opj_thread_pool_create(int num_threads);
+/**
+Destroy a thread pool. Jobs still queued are run before the workers exit.
+@param tp Thread pool to destroy
+*/
+void opj_thread_pool_destroy(opj_thread_pool_t *tp);
+/**
+Get the number of jobs the pool may run concurrently
+@param tp Thread pool
+@return Returns the number of worker threads, or 1 for a synchronous pool
+*/
+int opj_thread_pool_get_thread_count(opj_thread_pool_t *tp);
+/**
+Queue a job. With a synchronous pool the job is run before returning.
+@param tp Thread pool
+@param job_fn Function to run
+@param user_data Argument of job_fn
+@return Returns OPJ_TRUE if successful, returns OPJ_FALSE otherwise
+*/
+opj_bool opj_thread_pool_submit_job(opj_thread_pool_t *tp, opj_job_fn job_fn, void *user_data);
+/**
+Queue a job, or run it in the calling thread as worker 0 when it cannot be queued. 
+The job is then only run once the jobs already queued are finished, since one of them 
+may be using the resources of worker 0.
+@param tp Thread pool
+@param job_fn Function to run
+@param user_data Argument of job_fn
+*/
+void opj_thread_pool_submit_or_run(opj_thread_pool_t *tp, opj_job_fn job_fn, void *user_data);
+/**
+Wait until at most max_remaining_jobs jobs are queued or running
+@param tp Thread pool
+@param max_remaining_jobs Number of unfinished jobs allowed on return (0 waits for all jobs)
+*/
+void opj_thread_pool_wait_completion(opj_thread_pool_t *tp, int max_remaining_jobs);
+/* ----------------------------------------------------------------------- */
+/*@}*/
+
+/*@}*/
+
+#endif /* __THREAD_H */
@@ -0,0 +1,434 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Decoding benchmark. Without -i, a synthetic image is encoded with the code-block
+ * sizes and mode switches that exercise the different tier-1 decoding passes, and each
+ * codestream is decoded repeatedly. With -i, the given J2K codestream is decoded instead.
+ * The best and mean wall-clock time of a decode are reported, to compare two builds.
+ *
+ * With -preview, the codestream (by default the synthetic image encoded in 3 layers) is
+ * decoded with combinations of cp_reduce, cp_layer and cp_max_passes, and with the presets
+ * of opj_set_preview_decoder_parameters. Each one is reported with its speed-up and its
+ * PSNR against the complete decoding at the same resolution.
+ *
+ * usage: bench_decode [-i file.j2k] [-n iterations] [-threads n] [-preview]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "openjpeg.h"
+
+#define IMAGE_W 1024
+#define IMAGE_H 768
+#define IMAGE_COMPS 3
+
+typedef struct bench_config {
+	const char *name;
+	int cblk_size;
+	int mode;
+	int irreversible;
+	/** 1 for a lossless layer, 3 for layers at 1:50, 1:10 and lossless */
+	int numlayers;
+} bench_config_t;
+
+static const bench_config_t configs[] = {
+	{ "64x64", 64, 0, 0, 1 },
+	{ "32x32", 32, 0, 0, 1 },
+	{ "16x16", 16, 0, 0, 1 },
+	{ "64x64 9-7", 64, 0, 1, 1 },
+	{ "64x64 LAZY", 64, 1, 0, 1 },
+	{ "64x64 VSC", 64, 8, 0, 1 },
+	{ "64x64 SEGSYM|RESET", 64, 34, 0, 1 }
+};
+
+static const bench_config_t preview_config = { "64x64 3 layers", 64, 0, 0, 3 };
+
+static unsigned int seed = 1;
+
+static int rand_int(int n) {
+	seed = seed * 1103515245u + 12345u;
+	return (int)((seed >> 8) % (unsigned int)n);
+}
+
+/* gradients, a few sharp edges and some noise, so every bit-plane carries information */
+static opj_image_t* create_image(void) {
+	opj_image_cmptparm_t cmptparm[IMAGE_COMPS];
+	opj_image_t *image;
+	int compno, x, y;
+
+	memset(cmptparm, 0, sizeof(cmptparm));
+	for (compno = 0; compno < IMAGE_COMPS; compno++) {
+		cmptparm[compno].dx = 1;
+		cmptparm[compno].dy = 1;
+		cmptparm[compno].w = IMAGE_W;
+		cmptparm[compno].h = IMAGE_H;
+		cmptparm[compno].prec = 8;
+		cmptparm[compno].bpp = 8;
+		cmptparm[compno].sgnd = 0;
+	}
+	image = opj_image_create(IMAGE_COMPS, cmptparm, CLRSPC_SRGB);
+	if (!image) {
+		return NULL;
+	}
+	image->x0 = 0;
+	image->y0 = 0;
+	image->x1 = IMAGE_W;
+	image->y1 = IMAGE_H;
+
+	for (compno = 0; compno < IMAGE_COMPS; compno++) {
+		int *data = image->comps[compno].data;
+		for (y = 0; y < IMAGE_H; y++) {
+			for (x = 0; x < IMAGE_W; x++) {
+				int v = (x * (compno + 1) + y * (3 - compno)) / 8;
+				if (((x / 96) + (y / 64)) & 1) {
+					v += 64;
+				}
+				v += rand_int(24);
+				data[y * IMAGE_W + x] = v & 0xff;
+			}
+		}
+	}
+
+	return image;
+}
+
+static unsigned char* encode_image(opj_image_t *image, const bench_config_t *config, int *length) {
+	opj_cparameters_t parameters;
+	opj_cinfo_t *cinfo;
+	opj_cio_t *cio;
+	unsigned char *buffer = NULL;
+
+	opj_set_default_encoder_parameters(&parameters);
+	if (config->numlayers == 3) {
+		parameters.tcp_numlayers = 3;
+		parameters.tcp_rates[0] = 50;
+		parameters.tcp_rates[1] = 10;
+		parameters.tcp_rates[2] = 1;
+	} else {
+		parameters.tcp_numlayers = 1;
+		parameters.tcp_rates[0] = 0;
+	}
+	parameters.cp_disto_alloc = 1;
+	parameters.tcp_mct = 1;
+	parameters.cblockw_init = config->cblk_size;
+	parameters.cblockh_init = config->cblk_size;
+	parameters.mode = config->mode;
+	parameters.irreversible = config->irreversible;
+
+	cinfo = opj_create_compress(CODEC_J2K);
+	opj_setup_encoder(cinfo, &parameters, image);
+	cio = opj_cio_open((opj_common_ptr)cinfo, NULL, 0);
+	if (opj_encode(cinfo, cio, image, NULL)) {
+		*length = cio_tell(cio);
+		buffer = (unsigned char*) malloc(*length);
+		if (buffer) {
+			memcpy(buffer, cio->buffer, *length);
+		}
+	}
+	opj_cio_close(cio);
+	opj_destroy_compress(cinfo);
+
+	return buffer;
+}
+
+/* wall-clock time in ms: the processor time would add up the time of all the decoding threads */
+static double wall_ms(void) {
+#ifdef _WIN32
+	LARGE_INTEGER freq, t;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t);
+	return (double)t.QuadPart * 1000.0 / (double)freq.QuadPart;
+#else
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return (double)t.tv_sec * 1000.0 + (double)t.tv_usec / 1000.0;
+#endif
+}
+
+static opj_image_t* decode(unsigned char *buffer, int length, opj_dparameters_t *parameters, double *ms) {
+	opj_dinfo_t *dinfo;
+	opj_cio_t *cio;
+	opj_image_t *image;
+	double start;
+
+	start = wall_ms();
+	dinfo = opj_create_decompress(CODEC_J2K);
+	opj_setup_decoder(dinfo, parameters);
+	cio = opj_cio_open((opj_common_ptr)dinfo, buffer, length);
+	image = opj_decode(dinfo, cio);
+	opj_cio_close(cio);
+	opj_destroy_decompress(dinfo);
+	*ms = wall_ms() - start;
+
+	return image;
+}
+
+/* best wall-clock time of a decode with the given parameters, < 0 if it fails */
+static double bench_parameters(unsigned char *buffer, int length, int iterations, opj_dparameters_t *parameters, double *mean, opj_image_t **last) {
+	double best = 0.0, total = 0.0, ms;
+	int i;
+
+	*last = NULL;
+	for (i = 0; i < iterations; i++) {
+		opj_image_t *image = decode(buffer, length, parameters, &ms);
+		if (!image) {
+			return -1.0;
+		}
+		if (*last) {
+			opj_image_destroy(*last);
+		}
+		*last = image;
+		total += ms;
+		if (i == 0 || ms < best) {
+			best = ms;
+		}
+	}
+	*mean = total / iterations;
+
+	return best;
+}
+
+static int bench(const char *name, unsigned char *buffer, int length, int iterations, int num_threads) {
+	opj_dparameters_t parameters;
+	opj_image_t *image;
+	double best, mean;
+
+	opj_set_default_decoder_parameters(&parameters);
+	parameters.num_threads = num_threads;
+
+	best = bench_parameters(buffer, length, iterations, &parameters, &mean, &image);
+	if (best < 0.0) {
+		fprintf(stderr, "%s: failed to decode\n", name);
+		return 1;
+	}
+	opj_image_destroy(image);
+	printf("%-20s %9d bytes  best %8.2f ms  mean %8.2f ms\n", name, length, best, mean);
+
+	return 0;
+}
+
+/* PSNR of image against ref, over all the components, 0 if they can not be compared */
+static double psnr(opj_image_t *image, opj_image_t *ref) {
+	double sse = 0.0, peak = 0.0;
+	long count = 0;
+	int compno, i;
+
+	if (!ref || image->numcomps != ref->numcomps) {
+		return 0.0;
+	}
+	for (compno = 0; compno < ref->numcomps; compno++) {
+		opj_image_comp_t *a = &image->comps[compno];
+		opj_image_comp_t *b = &ref->comps[compno];
+		int n = b->w * b->h;
+		if (a->w != b->w || a->h != b->h) {
+			return 0.0;
+		}
+		for (i = 0; i < n; i++) {
+			double d = (double)(a->data[i] - b->data[i]);
+			sse += d * d;
+		}
+		count += n;
+		if ((double)((1 << b->prec) - 1) > peak) {
+			peak = (double)((1 << b->prec) - 1);
+		}
+	}
+	if (sse == 0.0) {
+		return 99.99;
+	}
+
+	return 10.0 * log10(peak * peak * count / sse);
+}
+
+static void report_preview(const char *name, opj_dparameters_t *parameters, double best, double full, opj_image_t *image, opj_image_t *ref) {
+	printf("%-12s %6d %6d %6d  best %8.2f ms  x%5.2f  PSNR %6.2f dB\n", name,
+			parameters->cp_reduce, parameters->cp_layer, parameters->cp_max_passes,
+			best, best > 0.0 ? full / best : 0.0, psnr(image, ref));
+}
+
+static int bench_preview(unsigned char *buffer, int length, int iterations, int num_threads) {
+	static const int layers[] = { 0, 2, 1 };
+	static const int passes[] = { 0, 16, 10, 7, 4, 1 };
+	opj_dparameters_t parameters;
+	opj_image_t *refs[3] = { NULL, NULL, NULL };
+	opj_image_t *image;
+	double full = 0.0, best, mean;
+	int reduce, l, p, level, ret = 0;
+
+	printf("%-12s %6s %6s %6s\n", "", "reduce", "layers", "passes");
+	for (reduce = 0; reduce < 3; reduce++) {
+		/* the complete decoding at this resolution is the reference */
+		opj_set_default_decoder_parameters(&parameters);
+		parameters.num_threads = num_threads;
+		parameters.cp_reduce = reduce;
+		best = bench_parameters(buffer, length, iterations, &parameters, &mean, &refs[reduce]);
+		if (best < 0.0) {
+			fprintf(stderr, "failed to decode with reduce %d\n", reduce);
+			ret = 1;
+			break;
+		}
+		if (reduce == 0) {
+			full = best;
+		}
+		for (l = 0; l < (int)(sizeof(layers) / sizeof(layers[0])); l++) {
+			for (p = 0; p < (int)(sizeof(passes) / sizeof(passes[0])); p++) {
+				parameters.cp_layer = layers[l];
+				parameters.cp_max_passes = passes[p];
+				if (layers[l] == 0 && passes[p] == 0) {
+					report_preview("", &parameters, best, full, refs[reduce], refs[reduce]);
+					continue;
+				}
+				best = bench_parameters(buffer, length, iterations, &parameters, &mean, &image);
+				if (best < 0.0) {
+					fprintf(stderr, "failed to decode\n");
+					ret = 1;
+					continue;
+				}
+				report_preview("", &parameters, best, full, image, refs[reduce]);
+				opj_image_destroy(image);
+			}
+		}
+	}
+
+	for (level = 1; level <= 3 && !ret; level++) {
+		char name[32];
+		opj_set_default_decoder_parameters(&parameters);
+		parameters.num_threads = num_threads;
+		opj_set_preview_decoder_parameters(&parameters, level);
+		best = bench_parameters(buffer, length, iterations, &parameters, &mean, &image);
+		if (best < 0.0) {
+			fprintf(stderr, "failed to decode preview %d\n", level);
+			ret = 1;
+			break;
+		}
+		sprintf(name, "preview %d", level);
+		report_preview(name, &parameters, best, full,
+				image, parameters.cp_reduce < 3 ? refs[parameters.cp_reduce] : NULL);
+		opj_image_destroy(image);
+	}
+
+	for (reduce = 0; reduce < 3; reduce++) {
+		if (refs[reduce]) {
+			opj_image_destroy(refs[reduce]);
+		}
+	}
+
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	const char *input = NULL;
+	int iterations = 10, num_threads = 0, preview = 0;
+	int i, ret = 0;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+			input = argv[++i];
+		} else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			iterations = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-threads") && i + 1 < argc) {
+			num_threads = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-preview")) {
+			preview = 1;
+		} else {
+			fprintf(stderr, "usage: %s [-i file.j2k] [-n iterations] [-threads n] [-preview]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (iterations < 1) {
+		iterations = 1;
+	}
+
+	if (input) {
+		FILE *f = fopen(input, "rb");
+		unsigned char *buffer;
+		long length;
+		if (!f) {
+			fprintf(stderr, "cannot open %s\n", input);
+			return 1;
+		}
+		fseek(f, 0, SEEK_END);
+		length = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		buffer = (unsigned char*) malloc(length);
+		if (!buffer || fread(buffer, 1, length, f) != (size_t)length) {
+			fprintf(stderr, "cannot read %s\n", input);
+			fclose(f);
+			free(buffer);
+			return 1;
+		}
+		fclose(f);
+		if (preview) {
+			ret = bench_preview(buffer, (int)length, iterations, num_threads);
+		} else {
+			ret = bench(input, buffer, (int)length, iterations, num_threads);
+		}
+		free(buffer);
+	} else {
+		opj_image_t *image = create_image();
+		if (!image) {
+			fprintf(stderr, "cannot create the test image\n");
+			return 1;
+		}
+		if (preview) {
+			int length = 0;
+			unsigned char *buffer = encode_image(image, &preview_config, &length);
+			if (!buffer) {
+				fprintf(stderr, "%s: failed to encode\n", preview_config.name);
+				opj_image_destroy(image);
+				return 1;
+			}
+			printf("%s, %d bytes\n", preview_config.name, length);
+			ret = bench_preview(buffer, length, iterations, num_threads);
+			free(buffer);
+			opj_image_destroy(image);
+			return ret;
+		}
+		for (i = 0; i < (int)(sizeof(configs) / sizeof(configs[0])); i++) {
+			int length = 0;
+			unsigned char *buffer = encode_image(image, &configs[i], &length);
+			if (!buffer) {
+				fprintf(stderr, "%s: failed to encode\n", configs[i].name);
+				ret = 1;
+				continue;
+			}
+			ret |= bench(configs[i].name, buffer, length, iterations, num_threads);
+			free(buffer);
+		}
+		opj_image_destroy(image);
+	}
+
+	return ret;
+}
@@ -0,0 +1,296 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Header probing benchmark. The description of a set of J2K codestreams and JP2 files is
+ * read with opj_read_header_info and, as before it existed, with opj_decode limited to the
+ * main header. Both must agree, and the processor time of each method is reported for the
+ * given number of probes, spread over the set. Without file arguments, the set is made of
+ * small synthetic images of various geometries, encoded in memory.
+ *
+ * usage: bench_probe [-n probes] [file.j2k|file.jp2 ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "openjpeg.h"
+
+typedef struct probe_file {
+	const char *name;
+	OPJ_CODEC_FORMAT format;
+	unsigned char *buffer;
+	int length;
+} probe_file_t;
+
+typedef struct probe_config {
+	const char *name;
+	OPJ_CODEC_FORMAT format;
+	int w, h, numcomps;
+	int tile_size;	/* 0 for a single tile */
+	int numresolutions;
+	int numlayers;
+	int cblk_size;
+} probe_config_t;
+
+static const probe_config_t configs[] = {
+	{ "64x64 RGB", CODEC_J2K, 64, 64, 3, 0, 5, 1, 64 },
+	{ "256x256 RGB 3 layers", CODEC_JP2, 256, 256, 3, 0, 6, 3, 64 },
+	{ "512x384 gray", CODEC_J2K, 512, 384, 1, 0, 7, 1, 32 },
+	{ "1024x1024 RGBA tiled", CODEC_JP2, 1024, 1024, 4, 256, 6, 2, 64 },
+	{ "2048x1024 gray tiled", CODEC_J2K, 2048, 1024, 1, 128, 4, 1, 64 },
+	{ "128x32 RGB", CODEC_JP2, 128, 32, 3, 0, 3, 1, 16 }
+};
+
+static unsigned char* encode_image(const probe_config_t *config, int *length) {
+	opj_image_cmptparm_t cmptparm[4];
+	opj_cparameters_t parameters;
+	opj_image_t *image;
+	opj_cinfo_t *cinfo;
+	opj_cio_t *cio;
+	unsigned char *buffer = NULL;
+	int compno, i;
+
+	memset(cmptparm, 0, sizeof(cmptparm));
+	for (compno = 0; compno < config->numcomps; compno++) {
+		cmptparm[compno].dx = 1;
+		cmptparm[compno].dy = 1;
+		cmptparm[compno].w = config->w;
+		cmptparm[compno].h = config->h;
+		cmptparm[compno].prec = 8;
+		cmptparm[compno].bpp = 8;
+		cmptparm[compno].sgnd = 0;
+	}
+	image = opj_image_create(config->numcomps, cmptparm, config->numcomps == 1 ? CLRSPC_GRAY : CLRSPC_SRGB);
+	if (!image) {
+		return NULL;
+	}
+	image->x0 = 0;
+	image->y0 = 0;
+	image->x1 = config->w;
+	image->y1 = config->h;
+	for (compno = 0; compno < config->numcomps; compno++) {
+		for (i = 0; i < config->w * config->h; i++) {
+			image->comps[compno].data[i] = (i % config->w + i / config->w) & 0xff;
+		}
+	}
+
+	opj_set_default_encoder_parameters(&parameters);
+	parameters.tcp_numlayers = config->numlayers;
+	for (i = 0; i < config->numlayers; i++) {
+		parameters.tcp_rates[i] = (float)((config->numlayers - i - 1) * 20);
+	}
+	parameters.cp_disto_alloc = 1;
+	parameters.tcp_mct = config->numcomps >= 3;
+	parameters.numresolution = config->numresolutions;
+	parameters.cblockw_init = config->cblk_size;
+	parameters.cblockh_init = config->cblk_size;
+	if (config->tile_size) {
+		parameters.tile_size_on = OPJ_TRUE;
+		parameters.cp_tdx = config->tile_size;
+		parameters.cp_tdy = config->tile_size;
+	}
+
+	cinfo = opj_create_compress(config->format);
+	opj_setup_encoder(cinfo, &parameters, image);
+	cio = opj_cio_open((opj_common_ptr)cinfo, NULL, 0);
+	if (opj_encode(cinfo, cio, image, NULL)) {
+		*length = cio_tell(cio);
+		buffer = (unsigned char*) malloc(*length);
+		if (buffer) {
+			memcpy(buffer, cio->buffer, *length);
+		}
+	}
+	opj_cio_close(cio);
+	opj_destroy_compress(cinfo);
+	opj_image_destroy(image);
+
+	return buffer;
+}
+
+/* what the applications did before opj_read_header_info: decode the main header only */
+static opj_image_t* decode_main_header(probe_file_t *file) {
+	opj_dparameters_t parameters;
+	opj_dinfo_t *dinfo;
+	opj_cio_t *cio;
+	opj_image_t *image;
+
+	opj_set_default_decoder_parameters(&parameters);
+	parameters.cp_limit_decoding = LIMIT_TO_MAIN_HEADER;
+	dinfo = opj_create_decompress(file->format);
+	opj_setup_decoder(dinfo, &parameters);
+	cio = opj_cio_open((opj_common_ptr)dinfo, file->buffer, file->length);
+	image = opj_decode(dinfo, cio);
+	opj_cio_close(cio);
+	opj_destroy_decompress(dinfo);
+
+	return image;
+}
+
+static int check(probe_file_t *file) {
+	opj_header_info_t info;
+	opj_image_t *image;
+	int compno, ok;
+
+	if (!opj_read_header_info(file->buffer, file->length, &info)) {
+		fprintf(stderr, "%s: opj_read_header_info failed\n", file->name);
+		return 0;
+	}
+	file->format = info.codec_format;
+	image = decode_main_header(file);
+	if (!image) {
+		fprintf(stderr, "%s: failed to decode the main header\n", file->name);
+		return 0;
+	}
+	ok = info.x0 == image->x0 && info.y0 == image->y0 && info.x1 == image->x1 && info.y1 == image->y1
+			&& info.numcomps == image->numcomps;
+	for (compno = 0; ok && compno < info.numcomps && compno < OPJ_HEADER_MAXCOMPS; compno++) {
+		ok = info.comps[compno].dx == image->comps[compno].dx && info.comps[compno].dy == image->comps[compno].dy
+				&& info.comps[compno].prec == image->comps[compno].prec && info.comps[compno].sgnd == image->comps[compno].sgnd;
+	}
+	if (!ok) {
+		fprintf(stderr, "%s: the header information does not match the decoded main header\n", file->name);
+	}
+	printf("%-24s %s %9d bytes  %5dx%-5d %d comps  %2dx%-2d tiles  %2d resolutions  %d layers\n",
+			file->name, info.codec_format == CODEC_JP2 ? "JP2" : "J2K", file->length,
+			info.x1 - info.x0, info.y1 - info.y0, info.numcomps, info.tw, info.th,
+			info.numresolutions, info.numlayers);
+	opj_image_destroy(image);
+
+	return ok;
+}
+
+static int bench(probe_file_t *files, int numfiles, int probes) {
+	opj_header_info_t info;
+	clock_t start;
+	double probe_ms, decode_ms;
+	long sum = 0;
+	int i;
+
+	start = clock();
+	for (i = 0; i < probes; i++) {
+		probe_file_t *file = &files[i % numfiles];
+		if (!opj_read_header_info(file->buffer, file->length, &info)) {
+			return 1;
+		}
+		sum += info.x1 + info.numresolutions;
+	}
+	probe_ms = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+
+	start = clock();
+	for (i = 0; i < probes; i++) {
+		opj_image_t *image = decode_main_header(&files[i % numfiles]);
+		if (!image) {
+			return 1;
+		}
+		sum -= image->x1;
+		opj_image_destroy(image);
+	}
+	decode_ms = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+
+	printf("%d probes (%ld)\n", probes, sum);
+	printf("opj_read_header_info        %9.2f ms  %8.3f us per file\n", probe_ms, probe_ms * 1000.0 / probes);
+	printf("opj_decode, main header     %9.2f ms  %8.3f us per file  x%.1f\n", decode_ms, decode_ms * 1000.0 / probes,
+			probe_ms > 0.0 ? decode_ms / probe_ms : 0.0);
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	probe_file_t *files;
+	int numfiles = 0, probes = 10000;
+	int i, ret = 0;
+
+	files = (probe_file_t*) calloc(argc + sizeof(configs) / sizeof(configs[0]), sizeof(probe_file_t));
+	if (!files) {
+		return 1;
+	}
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			probes = atoi(argv[++i]);
+		} else if (argv[i][0] == '-') {
+			fprintf(stderr, "usage: %s [-n probes] [file.j2k|file.jp2 ...]\n", argv[0]);
+			free(files);
+			return 1;
+		} else {
+			probe_file_t *file = &files[numfiles];
+			FILE *f = fopen(argv[i], "rb");
+			if (!f) {
+				fprintf(stderr, "cannot open %s\n", argv[i]);
+				ret = 1;
+				break;
+			}
+			fseek(f, 0, SEEK_END);
+			file->length = (int)ftell(f);
+			fseek(f, 0, SEEK_SET);
+			file->buffer = (unsigned char*) malloc(file->length);
+			if (!file->buffer || fread(file->buffer, 1, file->length, f) != (size_t)file->length) {
+				fprintf(stderr, "cannot read %s\n", argv[i]);
+				fclose(f);
+				ret = 1;
+				break;
+			}
+			fclose(f);
+			file->name = argv[i];
+			numfiles++;
+		}
+	}
+	if (!ret && numfiles == 0) {
+		for (i = 0; i < (int)(sizeof(configs) / sizeof(configs[0])); i++) {
+			probe_file_t *file = &files[numfiles];
+			file->buffer = encode_image(&configs[i], &file->length);
+			if (!file->buffer) {
+				fprintf(stderr, "%s: failed to encode\n", configs[i].name);
+				ret = 1;
+				break;
+			}
+			file->name = configs[i].name;
+			numfiles++;
+		}
+	}
+	if (probes < 1) {
+		probes = 1;
+	}
+
+	for (i = 0; !ret && i < numfiles; i++) {
+		if (!check(&files[i])) {
+			ret = 1;
+		}
+	}
+	if (!ret) {
+		ret = bench(files, numfiles, probes);
+	}
+
+	for (i = 0; i < numfiles; i++) {
+		free(files[i].buffer);
+	}
+	free(files);
+
+	return ret;
+}
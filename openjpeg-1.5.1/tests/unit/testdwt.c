@@ -0,0 +1,161 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Checks that the vector wavelet transforms give exactly the same coefficients
+ * as the scalar ones. dwt.c is built into this test, and opj_cpu_features is
+ * replaced so that each code path can be selected in turn.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the real processor detection, renamed */
+#define opj_cpu_features opj_cpu_features_detected
+#include "cpu.c"
+#undef opj_cpu_features
+
+static int cpu_mask;
+
+int opj_cpu_features(void);
+int opj_cpu_features(void) {
+	return opj_cpu_features_detected() & cpu_mask;
+}
+
+#define NUM_CASES 400
+
+enum { ENCODE, ENCODE_REAL, DECODE, DECODE_REAL };
+
+static const char *transform_names[] = {
+	"dwt_encode", "dwt_encode_real", "dwt_decode", "dwt_decode_real"
+};
+
+static unsigned int seed = 1;
+
+static int rand_int(int lo, int hi) {
+	seed = seed * 1103515245u + 12345u;
+	return lo + (int)((seed >> 8) % (unsigned int)(hi - lo + 1));
+}
+
+static void init_tilec(opj_tcd_tilecomp_t *tilec, int x0, int y0, int x1, int y1, int numres) {
+	int resno;
+	tilec->x0 = x0;
+	tilec->y0 = y0;
+	tilec->x1 = x1;
+	tilec->y1 = y1;
+	tilec->numresolutions = numres;
+	tilec->resolutions = (opj_tcd_resolution_t*) opj_calloc(numres, sizeof(opj_tcd_resolution_t));
+	for (resno = 0; resno < numres; resno++) {
+		int levelno = numres - 1 - resno;
+		opj_tcd_resolution_t *res = &tilec->resolutions[resno];
+		res->x0 = int_ceildivpow2(x0, levelno);
+		res->y0 = int_ceildivpow2(y0, levelno);
+		res->x1 = int_ceildivpow2(x1, levelno);
+		res->y1 = int_ceildivpow2(y1, levelno);
+	}
+	/* the +3 is the headroom required by the vectorized DWT, as in tcd_malloc_decode_tile */
+	tilec->data = (int*) opj_aligned_malloc(((x1 - x0) * (y1 - y0) + 3) * sizeof(int));
+}
+
+static void run_transform(opj_tcd_tilecomp_t *tilec, int transform, const int *input, int mask) {
+	int n = (tilec->x1 - tilec->x0) * (tilec->y1 - tilec->y0);
+	memcpy(tilec->data, input, n * sizeof(int));
+	cpu_mask = mask;
+	switch (transform) {
+		case ENCODE: dwt_encode(tilec); break;
+		case ENCODE_REAL: dwt_encode_real(tilec); break;
+		case DECODE: dwt_decode(tilec, tilec->numresolutions); break;
+		case DECODE_REAL: dwt_decode_real(tilec, tilec->numresolutions); break;
+	}
+}
+
+int main(void) {
+	/* every vector path, from the narrowest to the widest */
+	const int masks[] = {
+		OPJ_CPU_SSE2,
+		OPJ_CPU_SSE2 | OPJ_CPU_SSE41,
+		OPJ_CPU_SSE2 | OPJ_CPU_SSE41 | OPJ_CPU_AVX,
+		OPJ_CPU_SSE2 | OPJ_CPU_SSE41 | OPJ_CPU_AVX | OPJ_CPU_AVX2
+	};
+	int caseno, failures = 0;
+
+	printf("processor features: 0x%x\n", opj_cpu_features_detected());
+
+	for (caseno = 0; caseno < NUM_CASES; caseno++) {
+		opj_tcd_tilecomp_t tilec;
+		int x0 = rand_int(0, 5), y0 = rand_int(0, 5);
+		int x1 = x0 + rand_int(1, caseno < NUM_CASES / 2 ? 40 : 300);
+		int y1 = y0 + rand_int(1, caseno < NUM_CASES / 2 ? 40 : 100);
+		int numres = rand_int(1, 6);
+		int n = (x1 - x0) * (y1 - y0);
+		int *input = (int*) opj_malloc(n * sizeof(int));
+		int *expected = (int*) opj_malloc(n * sizeof(int));
+		int transform, i, m;
+
+		init_tilec(&tilec, x0, y0, x1, y1, numres);
+
+		for (transform = ENCODE; transform <= DECODE_REAL; transform++) {
+			/* the scalar 9-7 inverse transform is in floating point and may round
+			differently: compare the vector paths with the narrowest one instead */
+			int ref_mask = transform == DECODE_REAL ? OPJ_CPU_SSE2 : 0;
+			for (i = 0; i < n; i++) {
+				switch (transform) {
+					case ENCODE: input[i] = rand_int(-(1 << 16), 1 << 16); break;
+					case ENCODE_REAL: input[i] = rand_int(-(1 << 20), 1 << 20); break;
+					case DECODE: input[i] = rand_int(-(1 << 18), 1 << 18); break;
+					case DECODE_REAL: {
+						float f = (float) rand_int(-(1 << 20), 1 << 20) / 1024.0f;
+						memcpy(&input[i], &f, sizeof(float));
+						break;
+					}
+				}
+			}
+			run_transform(&tilec, transform, input, ref_mask);
+			memcpy(expected, tilec.data, n * sizeof(int));
+			for (m = 0; m < (int) (sizeof(masks) / sizeof(masks[0])); m++) {
+				if ((opj_cpu_features_detected() & masks[m]) != masks[m] || masks[m] == ref_mask) {
+					continue;
+				}
+				run_transform(&tilec, transform, input, masks[m]);
+				if (memcmp(expected, tilec.data, n * sizeof(int)) != 0) {
+					fprintf(stderr, "%s differs with features 0x%x: tile (%d,%d)-(%d,%d), %d resolutions\n",
+						transform_names[transform], masks[m], x0, y0, x1, y1, numres);
+					failures++;
+				}
+			}
+		}
+
+		opj_aligned_free(tilec.data);
+		opj_free(tilec.resolutions);
+		opj_free(input);
+		opj_free(expected);
+	}
+
+	printf("%d cases, %d failures\n", NUM_CASES, failures);
+	return failures ? 1 : 0;
+}
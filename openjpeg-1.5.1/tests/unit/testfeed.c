@@ -0,0 +1,266 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Checks the incremental decoder: a J2K codestream fed to opj_decoder_feed by chunks of one
+ * byte, of an odd size or all at once must make opj_decoder_poll return DECODER_NEED_DATA
+ * until data is fed, DECODER_TILE_DECODED once per tile, then DECODER_DONE for good, and
+ * give the image of opj_decode. Corrupted codestreams must end in DECODER_ERROR.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "openjpeg.h"
+#include "testimage.h"
+
+typedef struct feed_config {
+	const char *name;
+	int w, h, numcomps;
+	int tile_size;	/* 0 for a single tile */
+	char tp_flag;	/* 0 for a single tile-part per tile, otherwise the tile-part division */
+	int reduce;
+	int numlayers;
+	float rates[2];
+} feed_config_t;
+
+static const feed_config_t configs[] = {
+	{ "256x192 RGB tiled 64", 256, 192, 3, 64, 0, 0, 1, { 0 } },
+	{ "200x150 gray 2 layers", 200, 150, 1, 0, 0, 0, 2, { 20, 5 } },
+	{ "300x200 RGB tiled 128 tile-parts", 300, 200, 3, 128, 'R', 0, 2, { 30, 8 } },
+	{ "320x240 RGBA tiled 100 reduce 1", 320, 240, 4, 100, 0, 1, 1, { 0 } }
+};
+
+/* sizes of the chunks fed, 0 for the whole codestream at once */
+static const int chunk_sizes[] = { 1, 777, 0 };
+
+static unsigned char* encode(const feed_config_t *config, int *size) {
+	opj_cparameters_t parameters;
+	opj_image_t *image;
+	unsigned char *data;
+
+	image = test_create_image(config->w, config->h, config->numcomps);
+	if (!image) {
+		return NULL;
+	}
+	test_set_encoder_parameters(&parameters, config->numcomps, config->tile_size, config->numlayers, config->rates);
+	if (config->tp_flag) {
+		parameters.tp_on = 1;
+		parameters.tp_flag = config->tp_flag;
+	}
+	data = test_encode(CODEC_J2K, image, &parameters, NULL, size);
+	opj_image_destroy(image);
+	return data;
+}
+
+static opj_dinfo_t* create_decompress(const feed_config_t *config, int *errors) {
+	opj_dparameters_t parameters;
+
+	opj_set_default_decoder_parameters(&parameters);
+	parameters.cp_reduce = config->reduce;
+	return test_create_decompress(CODEC_J2K, &parameters, errors);
+}
+
+/* position of the first SOT marker, found by skipping the marker segments of the main header */
+static int first_sot(const unsigned char *data, int size) {
+	int pos = 2;
+
+	while (pos + 4 <= size && ((data[pos] << 8) | data[pos + 1]) != 0xff90) {
+		pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
+	}
+	return pos;
+}
+
+/*
+ * feeds the codestream by chunks of chunk_size bytes (all at once if 0), polling after each
+ * one, then signals its end; checks the statuses returned and, unless corrupted, that each tile
+ * is decoded once; returns the image of DECODER_DONE in *image and the last status
+ */
+static OPJ_DECODER_STATUS feed(const feed_config_t *config, const char *what, opj_dinfo_t *dinfo, const unsigned char *data, int size,
+		int chunk_size, int numtiles, opj_image_t **image, int *failures) {
+	OPJ_DECODER_STATUS status;
+	opj_image_t *polled = NULL;
+	int pos = 0, tiles = 0;
+
+	*image = NULL;
+	if (!chunk_size) {
+		chunk_size = size;
+	}
+	if (opj_decoder_poll(dinfo, &polled) != DECODER_NEED_DATA || polled) {
+		fprintf(stderr, "%s, %s: a decoder without data must need data\n", config->name, what);
+		(*failures)++;
+	}
+	do {
+		int len = size - pos < chunk_size ? size - pos : chunk_size;
+		if (!opj_decoder_feed(dinfo, (unsigned char*) data + pos, len)) {
+			fprintf(stderr, "%s, %s: feeding %d bytes at %d failed\n", config->name, what, len, pos);
+			(*failures)++;
+			return DECODER_ERROR;
+		}
+		pos += len;
+		while ((status = opj_decoder_poll(dinfo, &polled)) == DECODER_TILE_DECODED) {
+			tiles++;
+		}
+		/* nothing after the end of the codestream can be needed */
+		if (status == DECODER_DONE && pos < size) {
+			fprintf(stderr, "%s, %s: done with %d bytes of %d\n", config->name, what, pos, size);
+			(*failures)++;
+		}
+	} while (pos < size && status == DECODER_NEED_DATA);
+
+	if (status == DECODER_NEED_DATA) {
+		opj_decoder_feed(dinfo, NULL, 0);
+		while ((status = opj_decoder_poll(dinfo, &polled)) == DECODER_TILE_DECODED) {
+			tiles++;
+		}
+	}
+	if (status == DECODER_ERROR) {
+		return status;
+	}
+	if (status != DECODER_DONE || tiles != numtiles) {
+		fprintf(stderr, "%s, %s: status %d after %d tiles of %d\n", config->name, what, status, tiles, numtiles);
+		(*failures)++;
+		return status;
+	}
+	*image = polled;
+	/* the end is final */
+	if (opj_decoder_poll(dinfo, &polled) != DECODER_DONE) {
+		fprintf(stderr, "%s, %s: polling after the end is not done\n", config->name, what);
+		(*failures)++;
+	}
+	return status;
+}
+
+static int check_chunks(const feed_config_t *config, const unsigned char *data, int size, int numtiles, int chunk_size, opj_image_t *ref) {
+	char what[32];
+	opj_dinfo_t *dinfo;
+	opj_image_t *image;
+	OPJ_DECODER_STATUS status;
+	int errors = 0, failures = 0;
+
+	sprintf(what, chunk_size ? "chunks of %d" : "whole", chunk_size);
+	dinfo = create_decompress(config, &errors);
+	if (!dinfo) {
+		return 1;
+	}
+	status = feed(config, what, dinfo, data, size, chunk_size, numtiles, &image, &failures);
+	if (status != DECODER_DONE || errors) {
+		fprintf(stderr, "%s, %s: decoding failed or raised %d errors\n", config->name, what, errors);
+		failures++;
+	} else if (!test_same_image(image, ref)) {
+		fprintf(stderr, "%s, %s: not the image of opj_decode\n", config->name, what);
+		failures++;
+	}
+	if (image) {
+		opj_image_destroy(image);
+	}
+	opj_destroy_decompress(dinfo);
+	return failures;
+}
+
+/* a copy of the codestream damaged at pos, or cut there if byte is negative, must end in DECODER_ERROR */
+static int check_corrupted(const feed_config_t *config, const unsigned char *data, int size, int pos, int byte, const char *what) {
+	unsigned char *copy;
+	opj_dinfo_t *dinfo;
+	opj_image_t *image = NULL;
+	int c, errors = 0, failures = 0;
+
+	copy = (unsigned char*) malloc(size);
+	if (!copy) {
+		return 1;
+	}
+	memcpy(copy, data, size);
+	if (byte >= 0) {
+		copy[pos] = (unsigned char) byte;
+	} else {
+		size = pos;
+	}
+	for (c = 0; c < TEST_COUNT(chunk_sizes); c++) {
+		errors = 0;
+		dinfo = create_decompress(config, &errors);
+		if (!dinfo) {
+			failures++;
+			continue;
+		}
+		if (feed(config, what, dinfo, copy, size, chunk_sizes[c], 0, &image, &failures) != DECODER_ERROR || !errors) {
+			fprintf(stderr, "%s, %s: no error with chunks of %d\n", config->name, what, chunk_sizes[c]);
+			failures++;
+		} else if (opj_decoder_poll(dinfo, &image) != DECODER_ERROR) {
+			fprintf(stderr, "%s, %s: polling after the error is not an error\n", config->name, what);
+			failures++;
+		}
+		opj_destroy_decompress(dinfo);
+	}
+	free(copy);
+	return failures;
+}
+
+static int check_config(const feed_config_t *config) {
+	opj_dinfo_t *dinfo;
+	unsigned char *data;
+	opj_image_t *ref;
+	int size, sot, c, numtiles, errors = 0, failures = 0;
+
+	data = encode(config, &size);
+	if (!data) {
+		fprintf(stderr, "%s: cannot encode the image\n", config->name);
+		return 1;
+	}
+	dinfo = create_decompress(config, &errors);
+	ref = dinfo ? test_decode_memory(dinfo, data, size) : NULL;
+	opj_destroy_decompress(dinfo);
+	if (!ref || errors) {
+		fprintf(stderr, "%s: cannot decode the image\n", config->name);
+		free(data);
+		return 1;
+	}
+	numtiles = config->tile_size ? ((config->w + config->tile_size - 1) / config->tile_size) * ((config->h + config->tile_size - 1) / config->tile_size) : 1;
+
+	for (c = 0; c < TEST_COUNT(chunk_sizes); c++) {
+		failures += check_chunks(config, data, size, numtiles, chunk_sizes[c], ref);
+	}
+	sot = first_sot(data, size);
+	failures += check_corrupted(config, data, size, sot, 0x12, "SOT marker damaged");
+	/* the high byte of Isot: the tile number gets out of range */
+	failures += check_corrupted(config, data, size, sot + 4, 0xff, "tile number out of range");
+	failures += check_corrupted(config, data, size, sot - 3, -1, "cut in the main header");
+	printf("%-36s %7d bytes  %3d tiles  %s\n", config->name, size, numtiles, failures ? "FAILED" : "ok");
+
+	opj_image_destroy(ref);
+	free(data);
+	return failures;
+}
+
+int main(void) {
+	int i, failures = 0;
+
+	for (i = 0; i < TEST_COUNT(configs); i++) {
+		failures += check_config(&configs[i]);
+	}
+	return test_summary(TEST_COUNT(configs), failures);
+}
@@ -0,0 +1,205 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Checks opj_read_header_info on every prefix of J2K codestreams and JP2 files: it must fail
+ * until the SIZ, COD and QCD markers are all in the prefix, then describe the image decoded by
+ * opj_decode and the coding parameters of the encoder, the same way for all the longer
+ * prefixes, and locate the first SOT marker once the prefix holds it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "openjpeg.h"
+#include "testimage.h"
+
+typedef struct header_config {
+	const char *name;
+	OPJ_CODEC_FORMAT format;
+	int w, h, numcomps;
+	int x0, y0;	/* offset of the image on the reference grid */
+	int tile_size;	/* 0 for a single tile */
+	int tx0, ty0;	/* offset of the first tile */
+	int numresolution;
+	int cblk_size;
+	int mode;
+	OPJ_PROG_ORDER prog_order;
+	int irreversible;
+	int numlayers;
+	float rates[3];
+} header_config_t;
+
+static const header_config_t configs[] = {
+	{ "J2K 256x192 RGB tiled 64", CODEC_J2K, 256, 192, 3, 0, 0, 64, 0, 0, 6, 64, 0, RLCP, 0, 1, { 0 } },
+	{ "J2K 200x150 gray offset RPCL 9-7", CODEC_J2K, 200, 150, 1, 13, 7, 64, 5, 3, 4, 32, 1, RPCL, 1, 3, { 40, 10, 4 } },
+	{ "JP2 300x200 RGBA tiled 100", CODEC_JP2, 300, 200, 4, 0, 0, 100, 0, 0, 5, 16, 0, CPRL, 1, 2, { 20, 5 } },
+	{ "JP2 160x120 gray", CODEC_JP2, 160, 120, 1, 0, 0, 0, 0, 0, 6, 64, 0, LRCP, 0, 1, { 0 } }
+};
+
+static unsigned char* encode(const header_config_t *config, int *size) {
+	opj_cparameters_t parameters;
+	opj_image_t *image;
+	unsigned char *data;
+	int compno;
+
+	image = test_create_image(config->w, config->h, config->numcomps);
+	if (!image) {
+		return NULL;
+	}
+	image->x0 = config->x0;
+	image->y0 = config->y0;
+	image->x1 = config->x0 + config->w;
+	image->y1 = config->y0 + config->h;
+	for (compno = 0; compno < config->numcomps; compno++) {
+		image->comps[compno].x0 = config->x0;
+		image->comps[compno].y0 = config->y0;
+	}
+	test_set_encoder_parameters(&parameters, config->numcomps, config->tile_size, config->numlayers, config->rates);
+	parameters.cp_tx0 = config->tx0;
+	parameters.cp_ty0 = config->ty0;
+	parameters.numresolution = config->numresolution;
+	parameters.cblockw_init = config->cblk_size;
+	parameters.cblockh_init = config->cblk_size;
+	parameters.mode = config->mode;
+	parameters.prog_order = config->prog_order;
+	parameters.irreversible = config->irreversible;
+	data = test_encode(config->format, image, &parameters, NULL, size);
+	opj_image_destroy(image);
+	return data;
+}
+
+static int read_int(const unsigned char *p, int n) {
+	int v = 0;
+	while (n-- > 0) {
+		v = (v << 8) | *p++;
+	}
+	return v;
+}
+
+/*
+ * position of the codestream in the file, of its first SOT marker in *sot, and the length of
+ * the shortest prefix holding the SIZ, COD and QCD markers, found by walking the boxes and markers
+ */
+static int find_header(const header_config_t *config, const unsigned char *data, int size, int *sot, int *needed) {
+	int start = 0, pos;
+
+	if (config->format == CODEC_JP2) {
+		while (start + 8 <= size && memcmp(data + start + 4, "jp2c", 4)) {
+			start += read_int(data + start, 4);
+		}
+		start += 8;
+	}
+	*needed = 0;
+	for (pos = start + 2; pos + 4 <= size && read_int(data + pos, 2) != 0xff90; pos += 2 + read_int(data + pos + 2, 2)) {
+		int id = read_int(data + pos, 2);
+		if (id == 0xff51 || id == 0xff52 || id == 0xff5c) {
+			*needed = pos + 2 + read_int(data + pos + 2, 2);
+		}
+	}
+	*sot = pos;
+	return start;
+}
+
+/* compares the description of the image with the decoded image and the parameters of the config */
+static int check_info(const header_config_t *config, opj_header_info_t *info, opj_image_t *image, int start) {
+	int compno, tdx, tdy;
+
+	tdx = config->tile_size ? config->tile_size : config->x0 + config->w;
+	tdy = config->tile_size ? config->tile_size : config->y0 + config->h;
+	if (info->codec_format != config->format || info->codestream_start != start
+		|| info->x0 != image->x0 || info->y0 != image->y0 || info->x1 != image->x1 || info->y1 != image->y1
+		|| info->numcomps != image->numcomps
+		|| info->color_space != (config->format == CODEC_JP2 ? image->color_space : CLRSPC_UNSPECIFIED)) {
+		return 0;
+	}
+	for (compno = 0; compno < image->numcomps; compno++) {
+		opj_image_comp_t *comp = &image->comps[compno];
+		if (info->comps[compno].dx != comp->dx || info->comps[compno].dy != comp->dy
+			|| info->comps[compno].prec != comp->prec || info->comps[compno].sgnd != comp->sgnd) {
+			return 0;
+		}
+	}
+	return info->tx0 == config->tx0 && info->ty0 == config->ty0 && info->tdx == tdx && info->tdy == tdy
+		&& info->tw == (config->x0 + config->w - config->tx0 + tdx - 1) / tdx
+		&& info->th == (config->y0 + config->h - config->ty0 + tdy - 1) / tdy
+		&& info->numresolutions == config->numresolution && info->numlayers == config->numlayers
+		&& info->prog_order == config->prog_order && info->mct == (config->numcomps >= 3)
+		&& info->cblockw == config->cblk_size && info->cblockh == config->cblk_size
+		&& info->mode == config->mode && info->irreversible == config->irreversible;
+}
+
+static int check_config(const header_config_t *config) {
+	opj_header_info_t info;
+	opj_image_t *image;
+	unsigned char *data;
+	int size, start, sot, needed, length, errors = 0, failures = 0;
+
+	data = encode(config, &size);
+	if (!data) {
+		fprintf(stderr, "%s: cannot encode the image\n", config->name);
+		return 1;
+	}
+	image = test_decode(config->format, data, size, NULL, &errors);
+	if (!image || errors) {
+		fprintf(stderr, "%s: cannot decode the image\n", config->name);
+		failures++;
+	}
+	start = find_header(config, data, size, &sot, &needed);
+
+	for (length = 0; length <= size && image && !failures; length++) {
+		opj_bool read = opj_read_header_info(data, length, &info);
+		if (read != (length >= needed)) {
+			fprintf(stderr, "%s: %d bytes %s while the main header needs %d\n", config->name, length, read ? "read" : "not read", needed);
+			failures++;
+		} else if (read && !check_info(config, &info, image, start)) {
+			fprintf(stderr, "%s: %d bytes: not the description of the image\n", config->name, length);
+			failures++;
+		} else if (read && (info.main_head_end ? info.main_head_end != sot : length >= sot + 4)) {
+			/* the SOT marker and its length tell where the main header ends */
+			fprintf(stderr, "%s: %d bytes: main header ending at %d instead of %d\n", config->name, length, info.main_head_end, sot);
+			failures++;
+		}
+	}
+	printf("%-36s %7d bytes  header of %d bytes  %s\n", config->name, size, sot, failures ? "FAILED" : "ok");
+
+	if (image) {
+		opj_image_destroy(image);
+	}
+	free(data);
+	return failures;
+}
+
+int main(void) {
+	int i, failures = 0;
+
+	for (i = 0; i < TEST_COUNT(configs); i++) {
+		failures += check_config(&configs[i]);
+	}
+	return test_summary(TEST_COUNT(configs), failures);
+}
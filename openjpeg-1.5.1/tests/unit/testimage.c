@@ -0,0 +1,208 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "testimage.h"
+
+static unsigned int seed = 1;
+
+int test_rand_int(int lo, int hi) {
+	seed = seed * 1103515245u + 12345u;
+	return lo + (int)((seed >> 8) % (unsigned int)(hi - lo + 1));
+}
+
+opj_image_t* test_create_image(int w, int h, int numcomps) {
+	opj_image_cmptparm_t cmptparm[4];
+	opj_image_t *image;
+	int compno, x, y;
+
+	memset(cmptparm, 0, sizeof(cmptparm));
+	for (compno = 0; compno < numcomps; compno++) {
+		cmptparm[compno].dx = 1;
+		cmptparm[compno].dy = 1;
+		cmptparm[compno].w = w;
+		cmptparm[compno].h = h;
+		cmptparm[compno].prec = 8;
+		cmptparm[compno].bpp = 8;
+		cmptparm[compno].sgnd = 0;
+	}
+	image = opj_image_create(numcomps, cmptparm, numcomps == 1 ? CLRSPC_GRAY : CLRSPC_SRGB);
+	if (!image) {
+		return NULL;
+	}
+	image->x0 = 0;
+	image->y0 = 0;
+	image->x1 = w;
+	image->y1 = h;
+	/* smooth areas, edges and noise, so that every layer has more data than it can hold */
+	for (compno = 0; compno < numcomps; compno++) {
+		for (y = 0; y < h; y++) {
+			for (x = 0; x < w; x++) {
+				int v = ((x * (compno + 1) + y * 2) / 3) % 160 + (((x / 24) ^ (y / 16)) & 1) * 60 + test_rand_int(0, 35);
+				image->comps[compno].data[y * w + x] = v;
+			}
+		}
+	}
+	return image;
+}
+
+void test_set_encoder_parameters(opj_cparameters_t *parameters, int numcomps, int tile_size, int numlayers, const float *rates) {
+	int layno;
+
+	opj_set_default_encoder_parameters(parameters);
+	parameters->tcp_numlayers = numlayers;
+	for (layno = 0; layno < numlayers; layno++) {
+		parameters->tcp_rates[layno] = rates[layno];
+	}
+	parameters->cp_disto_alloc = 1;
+	parameters->tcp_mct = numcomps >= 3;
+	if (tile_size) {
+		parameters->tile_size_on = OPJ_TRUE;
+		parameters->cp_tdx = tile_size;
+		parameters->cp_tdy = tile_size;
+	}
+}
+
+void test_set_precincts(opj_cparameters_t *parameters, int numresolutions, int prc_size) {
+	int resno;
+
+	parameters->csty |= 0x01;
+	parameters->res_spec = numresolutions;
+	for (resno = 0; resno < numresolutions; resno++) {
+		parameters->prcw_init[resno] = prc_size;
+		parameters->prch_init[resno] = prc_size;
+	}
+}
+
+unsigned char* test_encode(OPJ_CODEC_FORMAT format, opj_image_t *image, opj_cparameters_t *parameters, opj_codestream_info_t *cstr_info, int *size) {
+	opj_cinfo_t *cinfo;
+	opj_cio_t *cio;
+	unsigned char *data = NULL;
+	opj_bool success;
+
+	cinfo = opj_create_compress(format);
+	opj_setup_encoder(cinfo, parameters, image);
+	cio = opj_cio_open((opj_common_ptr)cinfo, NULL, 0);
+	if (cstr_info) {
+		memset(cstr_info, 0, sizeof(opj_codestream_info_t));
+		success = cio && opj_encode_with_info(cinfo, cio, image, cstr_info);
+	} else {
+		success = cio && opj_encode(cinfo, cio, image, NULL);
+	}
+	if (success) {
+		*size = cio_tell(cio);
+		data = (unsigned char*) malloc(*size);
+		if (data) {
+			memcpy(data, cio->buffer, *size);
+		}
+	}
+	if (!data && cstr_info) {
+		opj_destroy_cstr_info(cstr_info);
+	}
+	opj_cio_close(cio);
+	opj_destroy_compress(cinfo);
+	return data;
+}
+
+void test_count_errors(const char *msg, void *client_data) {
+	(void) msg;
+	(*(int*) client_data)++;
+}
+
+/* the decompressors keep a pointer to their event manager */
+static opj_event_mgr_t error_counter = { test_count_errors, NULL, NULL };
+
+opj_dinfo_t* test_create_decompress(OPJ_CODEC_FORMAT format, opj_dparameters_t *parameters, int *errors) {
+	opj_dparameters_t default_parameters;
+	opj_dinfo_t *dinfo = opj_create_decompress(format);
+
+	if (!dinfo) {
+		return NULL;
+	}
+	if (errors) {
+		opj_set_event_mgr((opj_common_ptr)dinfo, &error_counter, errors);
+	}
+	if (!parameters) {
+		opj_set_default_decoder_parameters(&default_parameters);
+		parameters = &default_parameters;
+	}
+	opj_setup_decoder(dinfo, parameters);
+	return dinfo;
+}
+
+opj_image_t* test_decode_memory(opj_dinfo_t *dinfo, const unsigned char *data, int size) {
+	opj_cio_t *cio = opj_cio_open((opj_common_ptr)dinfo, (unsigned char*) data, size);
+	opj_image_t *image = NULL;
+
+	if (cio) {
+		image = opj_decode(dinfo, cio);
+	}
+	/* like the codec applications, the caller owns the ICC profile of a JP2 */
+	if (image && image->icc_profile_buf) {
+		free(image->icc_profile_buf);
+		image->icc_profile_buf = NULL;
+		image->icc_profile_len = 0;
+	}
+	opj_cio_close(cio);
+	return image;
+}
+
+opj_image_t* test_decode(OPJ_CODEC_FORMAT format, const unsigned char *data, int size, opj_dparameters_t *parameters, int *errors) {
+	opj_dinfo_t *dinfo = test_create_decompress(format, parameters, errors);
+	opj_image_t *image = NULL;
+
+	if (dinfo) {
+		image = test_decode_memory(dinfo, data, size);
+	}
+	opj_destroy_decompress(dinfo);
+	return image;
+}
+
+int test_same_image(opj_image_t *a, opj_image_t *b) {
+	int compno;
+
+	if (a->numcomps != b->numcomps || a->color_space != b->color_space) {
+		return 0;
+	}
+	for (compno = 0; compno < a->numcomps; compno++) {
+		opj_image_comp_t *ca = &a->comps[compno], *cb = &b->comps[compno];
+		if (ca->x0 != cb->x0 || ca->y0 != cb->y0 || ca->w != cb->w || ca->h != cb->h || ca->factor != cb->factor
+			|| memcmp(ca->data, cb->data, ca->w * ca->h * sizeof(int))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int test_summary(int numconfigs, int failures) {
+	printf("%d configs, %d failures\n", numconfigs, failures);
+	return failures ? 1 : 0;
+}
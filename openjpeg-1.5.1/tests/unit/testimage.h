@@ -0,0 +1,85 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TESTIMAGE_H
+#define TESTIMAGE_H
+/*
+ * Seeded generator, synthetic images and the encoding, decoding and comparison helpers
+ * shared by the unit tests that encode an image.
+ */
+#include "openjpeg.h"
+
+/* number of entries of a static array, such as the table of configs of a test */
+#define TEST_COUNT(array) ((int) (sizeof(array) / sizeof((array)[0])))
+
+/* next value of the generator, in [lo, hi]; the sequence only depends on the calls made before */
+int test_rand_int(int lo, int hi);
+
+/*
+ * 8-bit image of w x h pixels with numcomps components (at most 4), gray for a single
+ * component and sRGB otherwise, returns NULL if it cannot be allocated
+ */
+opj_image_t* test_create_image(int w, int h, int numcomps);
+
+/*
+ * default encoder parameters for an image of numcomps components, on tiles of tile_size
+ * (0 for a single tile), with numlayers layers at the given rates (0 for lossless)
+ */
+void test_set_encoder_parameters(opj_cparameters_t *parameters, int numcomps, int tile_size, int numlayers, const float *rates);
+
+/* precincts of prc_size x prc_size in each of the numresolutions resolutions */
+void test_set_precincts(opj_cparameters_t *parameters, int numresolutions, int prc_size);
+
+/*
+ * encodes the image in memory, with its index if cstr_info is not NULL, returns the file
+ * (released with free) and its size in *size, or NULL if the encoding fails
+ */
+unsigned char* test_encode(OPJ_CODEC_FORMAT format, opj_image_t *image, opj_cparameters_t *parameters, opj_codestream_info_t *cstr_info, int *size);
+
+/* error handler adding 1 to the int given as client data */
+void test_count_errors(const char *msg, void *client_data);
+
+/*
+ * decompressor set up with parameters (the defaults if NULL), whose errors are added to
+ * *errors if errors is not NULL
+ */
+opj_dinfo_t* test_create_decompress(OPJ_CODEC_FORMAT format, opj_dparameters_t *parameters, int *errors);
+
+/* decodes the first size bytes of a file in memory with dinfo, returns NULL if it fails */
+opj_image_t* test_decode_memory(opj_dinfo_t *dinfo, const unsigned char *data, int size);
+
+/* decodes the first size bytes of a file in memory with a decompressor of its own, see test_create_decompress */
+opj_image_t* test_decode(OPJ_CODEC_FORMAT format, const unsigned char *data, int size, opj_dparameters_t *parameters, int *errors);
+
+/* tells whether the two images have the same components, at the same position and resolution, and the same samples */
+int test_same_image(opj_image_t *a, opj_image_t *b);
+
+/* prints the number of configs checked and of failures, returns the exit status of the test */
+int test_summary(int numconfigs, int failures);
+
+#endif /* TESTIMAGE_H */
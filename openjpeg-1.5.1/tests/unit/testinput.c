@@ -0,0 +1,262 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Checks that an image decoded from an input stream (opj_cio_open_input, opj_cio_open_input_fd,
+ * opj_cio_open_mmap) is the image decoded from memory, with and without a decode area, and
+ * that the tiles outside the decode area are skipped in the input rather than read. The image
+ * decoded in the decode area must also be that area of the whole image.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "openjpeg.h"
+#include "testimage.h"
+
+typedef struct input_config {
+	const char *name;
+	OPJ_CODEC_FORMAT format;
+	int w, h, numcomps;
+	int tile_size;	/* 0 for a single tile */
+	int numlayers;
+	float rates[3];
+	char tp_flag;	/* 0 for a tile-part per tile */
+} input_config_t;
+
+static const input_config_t configs[] = {
+	{ "J2K 512x512 RGB lossless", CODEC_J2K, 512, 512, 3, 64, 1, { 0 }, 0 },
+	{ "J2K 400x300 gray 1 tile", CODEC_J2K, 400, 300, 1, 0, 2, { 20, 4 }, 0 },
+	{ "JP2 512x384 RGB 2 layers", CODEC_JP2, 512, 384, 3, 128, 2, { 20, 5 }, 0 },
+	{ "JP2 384x384 RGB tile-parts", CODEC_JP2, 384, 384, 3, 96, 1, { 0 }, 'R' }
+};
+
+/* decode area, on the reference grid */
+#define AREA_X0 200
+#define AREA_Y0 150
+#define AREA_X1 280
+#define AREA_Y1 230
+
+/* input of the callbacks */
+typedef struct mem_input {
+	const unsigned char *data;
+	int size;
+	int pos;
+	/* largest number of bytes given by a read, to split the reads */
+	int max_read;
+	/* number of bytes given by the reads */
+	int bytes_read;
+} mem_input_t;
+
+static int mem_read(unsigned char *buffer, int length, void *user_data) {
+	mem_input_t *in = (mem_input_t*) user_data;
+	int n = length;
+	if (n > in->size - in->pos) {
+		n = in->size - in->pos;
+	}
+	if (in->max_read && n > in->max_read) {
+		n = in->max_read;
+	}
+	memcpy(buffer, in->data + in->pos, n);
+	in->pos += n;
+	in->bytes_read += n;
+	return n;
+}
+
+static opj_bool mem_skip(int n, void *user_data) {
+	mem_input_t *in = (mem_input_t*) user_data;
+	in->pos = in->pos + n > in->size ? in->size : in->pos + n;
+	return OPJ_TRUE;
+}
+
+static opj_bool mem_seek(int pos, void *user_data) {
+	mem_input_t *in = (mem_input_t*) user_data;
+	in->pos = pos > in->size ? in->size : pos;
+	return OPJ_TRUE;
+}
+
+/* encodes a generated image in memory, returns the size of the file in *size */
+static unsigned char* encode(const input_config_t *config, int *size) {
+	opj_cparameters_t parameters;
+	opj_image_t *image;
+	unsigned char *data;
+
+	image = test_create_image(config->w, config->h, config->numcomps);
+	if (!image) {
+		return NULL;
+	}
+	test_set_encoder_parameters(&parameters, config->numcomps, config->tile_size, config->numlayers, config->rates);
+	if (config->tp_flag) {
+		parameters.tp_on = 1;
+		parameters.tp_flag = config->tp_flag;
+	}
+	data = test_encode(config->format, image, &parameters, NULL, size);
+	opj_image_destroy(image);
+	return data;
+}
+
+/* decodes the file from memory, from the callbacks with a skip or a seek function or neither, from a file descriptor or from a mapped file */
+static opj_image_t* decode(const input_config_t *config, const unsigned char *data, int size, int source, int area, mem_input_t *in) {
+	opj_dinfo_t *dinfo;
+	opj_cio_t *cio = NULL;
+	opj_image_t *image = NULL;
+	FILE *f = NULL;
+
+	dinfo = test_create_decompress(config->format, NULL, NULL);
+	if (!dinfo) {
+		return NULL;
+	}
+	if (area && !opj_set_decode_area(dinfo, AREA_X0, AREA_Y0, AREA_X1, AREA_Y1)) {
+		opj_destroy_decompress(dinfo);
+		return NULL;
+	}
+
+	memset(in, 0, sizeof(mem_input_t));
+	in->data = data;
+	in->size = size;
+	switch (source) {
+		case 0:
+			cio = opj_cio_open((opj_common_ptr)dinfo, (unsigned char*) data, size);
+			break;
+		case 1:
+			cio = opj_cio_open_input((opj_common_ptr)dinfo, mem_read, mem_skip, NULL, in);
+			break;
+		case 2:
+			cio = opj_cio_open_input((opj_common_ptr)dinfo, mem_read, NULL, mem_seek, in);
+			break;
+		case 3:
+			/* the skipped bytes are read, by small reads */
+			in->max_read = 1000;
+			cio = opj_cio_open_input((opj_common_ptr)dinfo, mem_read, NULL, NULL, in);
+			break;
+		default:
+			f = tmpfile();
+			if (f && fwrite(data, 1, size, f) == (size_t) size && fflush(f) == 0 && fseek(f, 0, SEEK_SET) == 0) {
+				if (source == 4) {
+					cio = opj_cio_open_input_fd((opj_common_ptr)dinfo, fileno(f));
+				} else {
+					cio = opj_cio_open_mmap((opj_common_ptr)dinfo, fileno(f));
+				}
+			}
+			break;
+	}
+	if (cio) {
+		image = opj_decode(dinfo, cio);
+	}
+	opj_cio_close(cio);
+	if (f) {
+		fclose(f);
+	}
+	opj_destroy_decompress(dinfo);
+	return image;
+}
+
+/* tells whether the image decoded in the decode area covers it with the samples of the whole image */
+static int same_crop(opj_image_t *area, opj_image_t *full) {
+	int compno, y;
+
+	if (area->numcomps != full->numcomps || area->color_space != full->color_space) {
+		return 0;
+	}
+	for (compno = 0; compno < area->numcomps; compno++) {
+		opj_image_comp_t *ca = &area->comps[compno], *cf = &full->comps[compno];
+		if (ca->x0 > AREA_X0 || ca->y0 > AREA_Y0 || ca->x0 + ca->w < AREA_X1 || ca->y0 + ca->h < AREA_Y1
+			|| ca->x0 < cf->x0 || ca->y0 < cf->y0 || ca->x0 + ca->w > cf->x0 + cf->w || ca->y0 + ca->h > cf->y0 + cf->h) {
+			return 0;
+		}
+		for (y = 0; y < ca->h; y++) {
+			int *row = &cf->data[(ca->y0 - cf->y0 + y) * cf->w + ca->x0 - cf->x0];
+			if (memcmp(&ca->data[y * ca->w], row, ca->w * sizeof(int))) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+static int check_config(const input_config_t *config) {
+	static const char *source_names[] = { "memory", "input with skip", "input with seek", "input without seek", "file descriptor", "mapped file" };
+	opj_image_t *full = NULL;
+	unsigned char *data;
+	int size, area, source, failures = 0;
+
+	data = encode(config, &size);
+	if (!data) {
+		fprintf(stderr, "%s: cannot encode the image\n", config->name);
+		return 1;
+	}
+	for (area = 0; area < 2; area++) {
+		mem_input_t in;
+		opj_image_t *ref = decode(config, data, size, 0, area, &in);
+		if (!ref) {
+			fprintf(stderr, "%s: cannot decode the image from memory\n", config->name);
+			failures++;
+			continue;
+		}
+		if (area && full && !same_crop(ref, full)) {
+			fprintf(stderr, "%s (area): not the area of the whole image\n", config->name);
+			failures++;
+		}
+		for (source = 1; source < 6; source++) {
+			opj_image_t *image = decode(config, data, size, source, area, &in);
+			if (!image) {
+				fprintf(stderr, "%s%s: decoding from a %s failed\n", config->name, area ? " (area)" : "", source_names[source]);
+				failures++;
+				continue;
+			}
+			if (!test_same_image(image, ref)) {
+				fprintf(stderr, "%s%s: %s: not the image decoded from memory\n", config->name, area ? " (area)" : "", source_names[source]);
+				failures++;
+			} else if (area && source == 1 && config->tile_size && in.bytes_read > size / 2) {
+				/* the decode area covers a few tiles only */
+				fprintf(stderr, "%s (area): %s: %d bytes read of %d\n", config->name, source_names[source], in.bytes_read, size);
+				failures++;
+			}
+			opj_image_destroy(image);
+		}
+		if (area) {
+			opj_image_destroy(ref);
+		} else {
+			full = ref;
+		}
+	}
+	opj_image_destroy(full);
+	printf("%-28s %7d bytes  %s\n", config->name, size, failures ? "FAILED" : "ok");
+
+	free(data);
+	return failures;
+}
+
+int main(void) {
+	int i, failures = 0;
+
+	for (i = 0; i < TEST_COUNT(configs); i++) {
+		failures += check_config(&configs[i]);
+	}
+	return test_summary(TEST_COUNT(configs), failures);
+}
@@ -0,0 +1,275 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Checks that the pixels stored by opj_set_decode_output are those of the image components
+ * decoded without an output buffer, converted to each pixel format: gray replicated to RGB,
+ * opaque alpha when there is no alpha component, signed samples made unsigned and the
+ * precisions rescaled to 8 bits. The bytes of the buffer outside the image must be left
+ * untouched. Each codestream is decoded whole, in a decode area, at a reduce factor and on
+ * several threads.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "openjpeg.h"
+#include "testimage.h"
+
+/* value of the bytes of the buffers not written by the decoder */
+#define SENTINEL 0xa5
+
+typedef struct output_config {
+	const char *name;
+	OPJ_CODEC_FORMAT format;
+	int w, h, numcomps;
+	int prec, sgnd;
+	int tile_size;	/* 0 for a single tile */
+	int irreversible;
+	int numlayers;
+	float rates[2];
+} output_config_t;
+
+static const output_config_t configs[] = {
+	{ "J2K 256x192 RGB tiled", CODEC_J2K, 256, 192, 3, 8, 0, 64, 0, 1, { 0 } },
+	{ "J2K 200x150 RGB 9-7", CODEC_J2K, 200, 150, 3, 8, 0, 0, 1, 2, { 20, 5 } },
+	{ "J2K 160x120 gray", CODEC_J2K, 160, 120, 1, 8, 0, 48, 0, 1, { 0 } },
+	{ "J2K 160x128 gray 12-bit signed", CODEC_J2K, 160, 128, 1, 12, 1, 64, 0, 1, { 0 } },
+	{ "J2K 128x96 gray alpha 4-bit", CODEC_J2K, 128, 96, 2, 4, 0, 0, 0, 1, { 0 } },
+	{ "JP2 192x160 RGBA tiled 9-7", CODEC_JP2, 192, 160, 4, 8, 0, 64, 1, 1, { 10 } }
+};
+
+typedef struct output_mode {
+	const char *name;
+	int area;	/* decode the middle of the image only */
+	int reduce;
+	int num_threads;
+} output_mode_t;
+
+static const output_mode_t modes[] = {
+	{ "whole", 0, 0, 1 },
+	{ "area", 1, 0, 1 },
+	{ "reduce 1", 0, 1, 1 },
+	{ "3 threads", 0, 0, 3 },
+	{ "area reduce 1 4 threads", 1, 1, 4 }
+};
+
+static const char *format_names[] = { "L8", "RGB8", "RGBA8", "PLANAR16" };
+
+/* encodes a generated image with the precision and signedness of the config */
+static unsigned char* encode(const output_config_t *config, int *size) {
+	opj_cparameters_t parameters;
+	opj_image_t *image;
+	unsigned char *data;
+	int compno, i;
+
+	image = test_create_image(config->w, config->h, config->numcomps);
+	if (!image) {
+		return NULL;
+	}
+	for (compno = 0; compno < config->numcomps; compno++) {
+		opj_image_comp_t *comp = &image->comps[compno];
+		for (i = 0; i < config->w * config->h; i++) {
+			comp->data[i] = comp->data[i] * ((1 << config->prec) - 1) / 255 - (config->sgnd ? 1 << (config->prec - 1) : 0);
+		}
+		comp->prec = config->prec;
+		comp->bpp = config->prec;
+		comp->sgnd = config->sgnd;
+	}
+	test_set_encoder_parameters(&parameters, config->numcomps, config->tile_size, config->numlayers, config->rates);
+	parameters.irreversible = config->irreversible;
+	data = test_encode(config->format, image, &parameters, NULL, size);
+	opj_image_destroy(image);
+	return data;
+}
+
+static opj_dinfo_t* create_decompress(const output_config_t *config, const output_mode_t *mode, int *errors) {
+	opj_dparameters_t parameters;
+	opj_dinfo_t *dinfo;
+
+	opj_set_default_decoder_parameters(&parameters);
+	parameters.cp_reduce = mode->reduce;
+	parameters.num_threads = mode->num_threads;
+	dinfo = test_create_decompress(config->format, &parameters, errors);
+	if (dinfo && mode->area && !opj_set_decode_area(dinfo, config->w / 4, config->h / 3, config->w * 3 / 4 + 1, config->h * 2 / 3 + 1)) {
+		opj_destroy_decompress(dinfo);
+		return NULL;
+	}
+	return dinfo;
+}
+
+/* sample i of component compno as written to an 8-bit pixel format */
+static unsigned char sample8(opj_image_comp_t *comp, int i) {
+	int v = comp->data[i] + (comp->sgnd ? 1 << (comp->prec - 1) : 0);
+	int shift = comp->prec - 8, maxv = (1 << comp->prec) - 1;
+	if (shift > 0) {
+		v = (v + (1 << (shift - 1))) >> shift;
+		return (unsigned char) (v > 255 ? 255 : v);
+	}
+	return (unsigned char) (shift < 0 ? (v * 255 + maxv / 2) / maxv : v);
+}
+
+/* fills the buffer with what the decoder must leave in it for the reference image */
+static void fill_expected(opj_output_buffer_t *out, opj_image_t *ref) {
+	opj_image_comp_t *comps = ref->comps;
+	int gray = ref->numcomps < 3;
+	int x, y, c, compno;
+
+	for (y = 0; y < comps[0].h; y++) {
+		for (x = 0; x < comps[0].w; x++) {
+			int i = y * comps[0].w + x;
+			unsigned char *p = out->data + y * out->stride;
+			switch (out->format) {
+				case OPJ_PIXFMT_L8:
+					p[x] = sample8(&comps[0], i);
+					break;
+				case OPJ_PIXFMT_RGB8:
+				case OPJ_PIXFMT_RGBA8:
+					p += x * (out->format == OPJ_PIXFMT_RGB8 ? 3 : 4);
+					for (c = 0; c < 3; c++) {
+						p[c] = sample8(&comps[gray ? 0 : c], i);
+					}
+					if (out->format == OPJ_PIXFMT_RGBA8) {
+						/* the alpha component follows the colour ones */
+						p[3] = ref->numcomps == 2 || ref->numcomps == 4 ? sample8(&comps[ref->numcomps - 1], i) : 255;
+					}
+					break;
+				default:
+					for (compno = 0; compno < ref->numcomps; compno++) {
+						unsigned short *p16 = (unsigned short*) (out->data + compno * out->plane_stride + y * out->stride) + x;
+						*p16 = (unsigned short) comps[compno].data[i];
+					}
+					break;
+			}
+		}
+	}
+}
+
+/* output buffer of the format for the image, with padding after each row and after the last one */
+static int alloc_output(opj_output_buffer_t *out, OPJ_PIXEL_FORMAT format, opj_image_t *ref) {
+	static const int bpp[] = { 1, 3, 4, 2 };
+	int size;
+
+	out->format = format;
+	out->w = ref->comps[0].w;
+	out->h = ref->comps[0].h;
+	/* 16-bit samples must stay aligned */
+	out->stride = out->w * bpp[format] + (format == OPJ_PIXFMT_PLANAR16 ? 6 : 5);
+	out->plane_stride = format == OPJ_PIXFMT_PLANAR16 ? out->stride * (out->h + 1) : 0;
+	size = format == OPJ_PIXFMT_PLANAR16 ? out->plane_stride * ref->numcomps : out->stride * (out->h + 1);
+	out->data = (unsigned char*) malloc(size);
+	if (!out->data) {
+		return 0;
+	}
+	memset(out->data, SENTINEL, size);
+	return size;
+}
+
+static int check_format(const output_config_t *config, const output_mode_t *mode, const unsigned char *data, int size,
+		opj_image_t *ref, OPJ_PIXEL_FORMAT format) {
+	opj_output_buffer_t out, expected;
+	opj_dinfo_t *dinfo;
+	opj_image_t *image = NULL;
+	int compno, outsize, errors = 0, failures = 0;
+
+	outsize = alloc_output(&out, format, ref);
+	if (!outsize || !alloc_output(&expected, format, ref)) {
+		fprintf(stderr, "%s, %s, %s: out of memory\n", config->name, mode->name, format_names[format]);
+		free(out.data);
+		return 1;
+	}
+	fill_expected(&expected, ref);
+
+	dinfo = create_decompress(config, mode, &errors);
+	if (dinfo && opj_set_decode_output(dinfo, &out)) {
+		image = test_decode_memory(dinfo, data, size);
+	}
+	if (!image || errors) {
+		fprintf(stderr, "%s, %s, %s: decoding failed or raised %d errors\n", config->name, mode->name, format_names[format], errors);
+		failures++;
+	} else {
+		for (compno = 0; compno < image->numcomps; compno++) {
+			if (image->comps[compno].data) {
+				fprintf(stderr, "%s, %s, %s: component %d has data\n", config->name, mode->name, format_names[format], compno);
+				failures++;
+			}
+		}
+		if (memcmp(out.data, expected.data, outsize)) {
+			fprintf(stderr, "%s, %s, %s: not the pixels of the image\n", config->name, mode->name, format_names[format]);
+			failures++;
+		}
+	}
+	if (image) {
+		opj_image_destroy(image);
+	}
+	opj_destroy_decompress(dinfo);
+	free(out.data);
+	free(expected.data);
+	return failures;
+}
+
+static int check_config(const output_config_t *config) {
+	unsigned char *data;
+	int size, m, format, failures = 0;
+
+	data = encode(config, &size);
+	if (!data) {
+		fprintf(stderr, "%s: cannot encode the image\n", config->name);
+		return 1;
+	}
+	for (m = 0; m < TEST_COUNT(modes); m++) {
+		int errors = 0;
+		opj_dinfo_t *dinfo = create_decompress(config, &modes[m], &errors);
+		opj_image_t *ref = dinfo ? test_decode_memory(dinfo, data, size) : NULL;
+		opj_destroy_decompress(dinfo);
+		if (!ref || errors) {
+			fprintf(stderr, "%s, %s: cannot decode the image\n", config->name, modes[m].name);
+			failures++;
+		} else {
+			for (format = OPJ_PIXFMT_L8; format <= OPJ_PIXFMT_PLANAR16; format++) {
+				failures += check_format(config, &modes[m], data, size, ref, (OPJ_PIXEL_FORMAT) format);
+			}
+		}
+		if (ref) {
+			opj_image_destroy(ref);
+		}
+	}
+	printf("%-32s %7d bytes  %s\n", config->name, size, failures ? "FAILED" : "ok");
+
+	free(data);
+	return failures;
+}
+
+int main(void) {
+	int i, failures = 0;
+
+	for (i = 0; i < TEST_COUNT(configs); i++) {
+		failures += check_config(&configs[i]);
+	}
+	return test_summary(TEST_COUNT(configs), failures);
+}
@@ -0,0 +1,232 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Checks the pass cap of the decoder (opj_dparameters_t::cp_max_passes): the error of the image
+ * decoded with a cap must not grow when the cap grows, must be positive for the lowest caps,
+ * and a cap of 0 or above the number of passes of every code-block must give the image
+ * decoded without a cap, which is the original one for a lossless codestream. The preview
+ * presets of opj_set_preview_decoder_parameters must set the documented parameters and decode
+ * like them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "openjpeg.h"
+#include "testimage.h"
+
+typedef struct passes_config {
+	const char *name;
+	int w, h, numcomps;
+	int tile_size;	/* 0 for a single tile */
+	int irreversible;
+	int numlayers;
+	float rates[3];	/* 0 for lossless */
+} passes_config_t;
+
+static const passes_config_t configs[] = {
+	{ "J2K 256x192 RGB lossless", 256, 192, 3, 0, 0, 1, { 0 } },
+	{ "J2K 320x240 gray tiled 64 lossless", 320, 240, 1, 64, 0, 1, { 0 } },
+	{ "J2K 300x200 RGB 9-7 3 layers", 300, 200, 3, 0, 1, 3, { 40, 10, 4 } }
+};
+
+/* increasing caps, from the most significant bit-plane alone to more than its 16 bit-planes */
+static const int caps[] = { 1, 4, 7, 10, 13, 16, 19, 22, 25, 3 * 17 - 2 };
+
+/* reduce, layers and passes documented for each preview level */
+static const int presets[3][3] = { { 0, 2, 16 }, { 1, 1, 10 }, { 2, 1, 7 } };
+
+static unsigned char* encode(const passes_config_t *config, opj_image_t *image, int *size) {
+	opj_cparameters_t parameters;
+
+	test_set_encoder_parameters(&parameters, config->numcomps, config->tile_size, config->numlayers, config->rates);
+	parameters.irreversible = config->irreversible;
+	return test_encode(CODEC_J2K, image, &parameters, NULL, size);
+}
+
+static opj_image_t* decode(const unsigned char *data, int size, opj_dparameters_t *parameters, const char *name, int *failures) {
+	int errors = 0;
+	opj_image_t *image = test_decode(CODEC_J2K, data, size, parameters, &errors);
+
+	if (!image || errors) {
+		fprintf(stderr, "%s: decoding failed or raised %d errors\n", name, errors);
+		(*failures)++;
+		if (image) {
+			opj_image_destroy(image);
+		}
+		return NULL;
+	}
+	return image;
+}
+
+/* sum of the squared differences between the samples of two images of the same size */
+static double squared_error(opj_image_t *a, opj_image_t *b) {
+	double sum = 0;
+	int compno, i;
+
+	for (compno = 0; compno < a->numcomps; compno++) {
+		opj_image_comp_t *ca = &a->comps[compno], *cb = &b->comps[compno];
+		for (i = 0; i < ca->w * ca->h; i++) {
+			double d = ca->data[i] - cb->data[i];
+			sum += d * d;
+		}
+	}
+	return sum;
+}
+
+/* decodes with each cap, returns the number of failures */
+static int check_caps(const passes_config_t *config, const unsigned char *data, int size, opj_image_t *original) {
+	opj_dparameters_t parameters;
+	opj_image_t *full, *image;
+	double error, previous = -1;
+	int c, failures = 0;
+
+	opj_set_default_decoder_parameters(&parameters);
+	if (parameters.cp_max_passes != 0) {
+		fprintf(stderr, "%s: the default cap is %d\n", config->name, parameters.cp_max_passes);
+		failures++;
+	}
+	full = decode(data, size, &parameters, config->name, &failures);
+	if (!full) {
+		return failures;
+	}
+	/* a J2K codestream has no colour space: only the samples are compared */
+	if (!config->rates[0] && squared_error(full, original) != 0) {
+		fprintf(stderr, "%s: the lossless codestream does not give the original image\n", config->name);
+		failures++;
+	}
+	for (c = 0; c < TEST_COUNT(caps); c++) {
+		parameters.cp_max_passes = caps[c];
+		image = decode(data, size, &parameters, config->name, &failures);
+		if (!image) {
+			continue;
+		}
+		error = squared_error(image, full);
+		if (c == 0 && error == 0) {
+			fprintf(stderr, "%s: the most significant bit-plane alone gives the whole image\n", config->name);
+			failures++;
+		}
+		if (previous >= 0 && error > previous) {
+			fprintf(stderr, "%s: %d passes give a larger error than %d passes (%g > %g)\n", config->name, caps[c], caps[c - 1], error, previous);
+			failures++;
+		}
+		if (c == TEST_COUNT(caps) - 1 && !test_same_image(image, full)) {
+			fprintf(stderr, "%s: a cap above the passes of every code-block changes the image\n", config->name);
+			failures++;
+		}
+		previous = error;
+		opj_image_destroy(image);
+	}
+	opj_image_destroy(full);
+	return failures;
+}
+
+/* decodes with each preview level, returns the number of failures */
+static int check_presets(const passes_config_t *config, const unsigned char *data, int size) {
+	opj_dparameters_t parameters, manual;
+	opj_image_t *preview, *image;
+	int level, failures = 0;
+
+	/* a level <= 0 leaves the parameters unchanged */
+	opj_set_default_decoder_parameters(&parameters);
+	parameters.cp_reduce = 1;
+	opj_set_preview_decoder_parameters(&parameters, 0);
+	if (parameters.cp_reduce != 1 || parameters.cp_layer != 0 || parameters.cp_max_passes != 0) {
+		fprintf(stderr, "%s: level 0 changes the parameters\n", config->name);
+		failures++;
+	}
+	for (level = 1; level <= 4; level++) {
+		/* the levels above 3 are level 3 */
+		const int *preset = presets[level > 3 ? 2 : level - 1];
+
+		opj_set_default_decoder_parameters(&parameters);
+		opj_set_preview_decoder_parameters(&parameters, level);
+		if (parameters.cp_reduce != preset[0] || parameters.cp_layer != preset[1] || parameters.cp_max_passes != preset[2]) {
+			fprintf(stderr, "%s: level %d sets reduce %d, %d layers, %d passes\n", config->name, level,
+				parameters.cp_reduce, parameters.cp_layer, parameters.cp_max_passes);
+			failures++;
+			continue;
+		}
+		opj_set_default_decoder_parameters(&manual);
+		manual.cp_reduce = preset[0];
+		manual.cp_layer = preset[1];
+		manual.cp_max_passes = preset[2];
+		preview = decode(data, size, &parameters, config->name, &failures);
+		image = decode(data, size, &manual, config->name, &failures);
+		if (preview && image && !test_same_image(preview, image)) {
+			fprintf(stderr, "%s: level %d does not decode like its parameters\n", config->name, level);
+			failures++;
+		}
+		if (preview && (preview->comps[0].w != (config->w + (1 << preset[0]) - 1) >> preset[0]
+			|| preview->comps[0].h != (config->h + (1 << preset[0]) - 1) >> preset[0])) {
+			fprintf(stderr, "%s: level %d gives a %dx%d image\n", config->name, level, preview->comps[0].w, preview->comps[0].h);
+			failures++;
+		}
+		if (preview) {
+			opj_image_destroy(preview);
+		}
+		if (image) {
+			opj_image_destroy(image);
+		}
+	}
+	return failures;
+}
+
+static int check_config(const passes_config_t *config) {
+	opj_image_t *original;
+	unsigned char *data = NULL;
+	int size, failures = 0;
+
+	original = test_create_image(config->w, config->h, config->numcomps);
+	if (original) {
+		data = encode(config, original, &size);
+	}
+	if (!data) {
+		fprintf(stderr, "%s: cannot encode the image\n", config->name);
+		failures++;
+	} else {
+		failures += check_caps(config, data, size, original);
+		failures += check_presets(config, data, size);
+		printf("%-36s %7d bytes  %s\n", config->name, size, failures ? "FAILED" : "ok");
+	}
+	if (original) {
+		opj_image_destroy(original);
+	}
+	free(data);
+	return failures;
+}
+
+int main(void) {
+	int i, failures = 0;
+
+	for (i = 0; i < TEST_COUNT(configs); i++) {
+		failures += check_config(&configs[i]);
+	}
+	return test_summary(TEST_COUNT(configs), failures);
+}
@@ -0,0 +1,321 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Checks that the bytes planned by opj_plan_byte_range for a reduce factor and a number of
+ * layers decode to the image decoded from the whole file with the same settings. The planning
+ * is given the file a few bytes at a time, as a client fetching the missing bytes would. The
+ * encoder does not write PLT markers: they are added from the index of the packets.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "openjpeg.h"
+#include "testimage.h"
+
+#define NUMRESOLUTIONS 6
+
+/* bytes given to the first planning, and fetched from the missing position when more are needed */
+#define FETCH_SIZE 200
+
+typedef struct plan_config {
+	const char *name;
+	OPJ_CODEC_FORMAT format;
+	int w, h, numcomps;
+	int tile_size;	/* 0 for a single tile */
+	OPJ_PROG_ORDER prog_order;
+	int numlayers;
+	float rates[3];
+	char tp_flag;	/* 0 for a tile-part per tile, otherwise the tile-parts are listed in a TLM marker */
+	int plt;	/* PLT markers in the tile-part headers (J2K only) */
+} plan_config_t;
+
+static const plan_config_t configs[] = {
+	{ "J2K 256x256 RGB LRCP", CODEC_J2K, 256, 256, 3, 0, LRCP, 3, { 40, 10, 4 }, 0, 0 },
+	{ "J2K 256x256 RGB LRCP PLT", CODEC_J2K, 256, 256, 3, 0, LRCP, 3, { 40, 10, 4 }, 0, 1 },
+	{ "J2K 512x384 gray RLCP tiled PLT", CODEC_J2K, 512, 384, 1, 128, RLCP, 2, { 20, 5 }, 0, 1 },
+	{ "J2K 384x256 RGB RPCL TLM", CODEC_J2K, 384, 256, 3, 128, RPCL, 2, { 30, 6 }, 'R', 0 },
+	{ "J2K 384x256 RGB LRCP TLM PLT", CODEC_J2K, 384, 256, 3, 128, LRCP, 3, { 40, 10, 4 }, 'L', 1 },
+	{ "JP2 320x240 RGB RLCP TLM", CODEC_JP2, 320, 240, 3, 96, RLCP, 2, { 20, 5 }, 'R', 0 }
+};
+
+/* (reduce, layers) pairs, 0 layers for all of them */
+static const int requests[][2] = {
+	{ 0, 0 }, { 0, 1 }, { 1, 0 }, { 1, 2 }, { 2, 1 }, { 3, 0 }, { NUMRESOLUTIONS - 1, 1 }
+};
+
+static unsigned int read_be(const unsigned char *p, int n) {
+	unsigned int v = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		v = (v << 8) | p[i];
+	}
+	return v;
+}
+
+static void write_be(unsigned char *p, unsigned int v, int n) {
+	int i;
+	for (i = n - 1; i >= 0; i--) {
+		p[i] = (unsigned char) v;
+		v >>= 8;
+	}
+}
+
+/* encodes a generated image in memory with its index, returns the size of the file in *size */
+static unsigned char* encode(const plan_config_t *config, int *size, opj_codestream_info_t *cstr_info) {
+	opj_cparameters_t parameters;
+	opj_image_t *image;
+	unsigned char *data;
+
+	image = test_create_image(config->w, config->h, config->numcomps);
+	if (!image) {
+		return NULL;
+	}
+	test_set_encoder_parameters(&parameters, config->numcomps, config->tile_size, config->numlayers, config->rates);
+	parameters.prog_order = config->prog_order;
+	parameters.numresolution = NUMRESOLUTIONS;
+	if (config->tp_flag) {
+		parameters.tp_on = 1;
+		parameters.tp_flag = config->tp_flag;
+	}
+	data = test_encode(config->format, image, &parameters, cstr_info, size);
+	opj_image_destroy(image);
+	return data;
+}
+
+/* writes the PLT marker segments of the packets starting in [start, end[, returns their size */
+static int write_plt(unsigned char *out, opj_codestream_info_t *cstr_info, int start, int end, int *total) {
+	unsigned char *segment = NULL;
+	int tileno, packno, numpacks, len = 0, zplt = 0;
+
+	numpacks = cstr_info->numlayers * cstr_info->numcomps;
+	for (tileno = 0; tileno < cstr_info->tw * cstr_info->th; tileno++) {
+		opj_tile_info_t *tile = &cstr_info->tile[tileno];
+		int resno, numprecs = 0;
+		for (resno = 0; resno < NUMRESOLUTIONS; resno++) {
+			numprecs += tile->pw[resno] * tile->ph[resno];
+		}
+		for (packno = 0; packno < numprecs * numpacks; packno++) {
+			opj_packet_info_t *packet = &tile->packet[packno];
+			int packet_len = packet->end_pos + 1 - packet->start_pos;
+			unsigned char bytes[5];
+			int n = 0;
+
+			if (packet->start_pos < start || packet->start_pos >= end) {
+				continue;
+			}
+			*total += packet_len;
+			/* Iplt: 7 bits per byte, the high bit set on all the bytes but the last */
+			do {
+				bytes[n++] = (unsigned char) (packet_len & 0x7f);
+				packet_len >>= 7;
+			} while (packet_len);
+			if (!segment || out + len - segment + n > 65535) {
+				segment = out + len;
+				write_be(segment, 0xff58, 2);	/* PLT */
+				write_be(segment + 2, 3, 2);	/* Lplt */
+				segment[4] = (unsigned char) zplt++;	/* Zplt */
+				len += 5;
+			}
+			while (n > 0) {
+				n--;
+				out[len++] = bytes[n] | (n ? 0x80 : 0);
+			}
+			write_be(segment + 2, (unsigned int) (out + len - segment - 2), 2);
+		}
+	}
+	return len;
+}
+
+/* copies a J2K codestream with a PLT marker in the header of each tile-part, returns NULL if the index does not match */
+static unsigned char* add_plt(const unsigned char *data, int size, opj_codestream_info_t *cstr_info, int *newsize) {
+	unsigned char *out;
+	int pos = 2, outpos, tlm = 0, tpno = 0;
+
+	/* a packet takes at least as many bytes as its Iplt entry */
+	out = (unsigned char*) malloc(2 * size + 1024);
+	if (!out) {
+		return NULL;
+	}
+
+	/* the main header, up to the first SOT marker */
+	while (read_be(data + pos, 2) != 0xff90) {
+		if (read_be(data + pos, 2) == 0xff55) {
+			tlm = pos;
+		}
+		pos += 2 + read_be(data + pos + 2, 2);
+	}
+	memcpy(out, data, pos);
+	outpos = pos;
+
+	while (read_be(data + pos, 2) == 0xff90) {
+		int psot = read_be(data + pos + 6, 4);
+		int sod = pos + 12, plt_len, total = 0;
+		while (read_be(data + sod, 2) != 0xff93) {
+			sod += 2 + read_be(data + sod + 2, 2);
+		}
+		memcpy(out + outpos, data + pos, sod - pos);
+		plt_len = write_plt(out + outpos + sod - pos, cstr_info, sod + 2, pos + psot, &total);
+		if (total != pos + psot - sod - 2) {
+			fprintf(stderr, "tile-part %d: %d bytes of packets in the index for %d bytes of data\n", tpno, total, pos + psot - sod - 2);
+			free(out);
+			return NULL;
+		}
+		memcpy(out + outpos + sod - pos + plt_len, data + sod, pos + psot - sod);
+		write_be(out + outpos + 6, psot + plt_len, 4);	/* Psot */
+		if (tlm) {
+			/* Stlm of the encoder: 8-bit Ttlm, 32-bit Ptlm */
+			write_be(out + tlm + 6 + 5 * tpno + 1, psot + plt_len, 4);
+		}
+		outpos += psot + plt_len;
+		pos += psot;
+		tpno++;
+	}
+	memcpy(out + outpos, data + pos, size - pos);
+	*newsize = outpos + size - pos;
+	return out;
+}
+
+/* decodes the first size bytes of the file, the errors reported are added to *errors */
+static opj_image_t* decode(const plan_config_t *config, const unsigned char *data, int size, int reduce, int layers, int *errors) {
+	opj_dparameters_t parameters;
+
+	opj_set_default_decoder_parameters(&parameters);
+	parameters.cp_reduce = reduce;
+	parameters.cp_layer = layers;
+	return test_decode(config->format, data, size, &parameters, errors);
+}
+
+/* number of bytes of the file planned for the request, -1 if the planning fails */
+static int plan(const plan_config_t *config, const unsigned char *data, int size, int reduce, int layers, opj_byte_range_t *range) {
+	opj_dinfo_t *dinfo = test_create_decompress(config->format, NULL, NULL);
+	int length = size < FETCH_SIZE ? size : FETCH_SIZE, end = -1;
+
+	if (!dinfo) {
+		return -1;
+	}
+	for (;;) {
+		if (!opj_plan_byte_range(dinfo, (unsigned char*) data, length, reduce, layers, range)) {
+			break;
+		}
+		if (range->end) {
+			end = range->end;
+			break;
+		}
+		if (!range->missing) {
+			/* the last tile-part has no length */
+			end = size;
+			break;
+		}
+		if (length == size) {
+			break;
+		}
+		length = (range->missing > length ? range->missing : length) + FETCH_SIZE;
+		if (length > size) {
+			length = size;
+		}
+	}
+	opj_destroy_decompress(dinfo);
+	return end;
+}
+
+static int check_config(const plan_config_t *config) {
+	opj_codestream_info_t cstr_info;
+	unsigned char *data;
+	int size, i, saved = 0, failures = 0;
+
+	data = encode(config, &size, &cstr_info);
+	if (!data) {
+		fprintf(stderr, "%s: cannot encode the image\n", config->name);
+		return 1;
+	}
+	if (config->plt) {
+		int newsize;
+		unsigned char *newdata = add_plt(data, size, &cstr_info, &newsize);
+		free(data);
+		if (!newdata) {
+			fprintf(stderr, "%s: cannot add the PLT markers\n", config->name);
+			opj_destroy_cstr_info(&cstr_info);
+			return 1;
+		}
+		data = newdata;
+		size = newsize;
+	}
+	opj_destroy_cstr_info(&cstr_info);
+
+	for (i = 0; i < TEST_COUNT(requests); i++) {
+		int reduce = requests[i][0], layers = requests[i][1];
+		opj_byte_range_t range;
+		opj_image_t *ref, *image;
+		int errors = 0;
+		int end = plan(config, data, size, reduce, layers, &range);
+
+		if (end < 0 || end > size) {
+			fprintf(stderr, "%s: reduce %d, %d layers: planning failed\n", config->name, reduce, layers);
+			failures++;
+			continue;
+		}
+		/* without tile-parts skipped by their TLM entry, the PLT markers locate the last packet */
+		if (config->plt && !config->tp_flag && !range.exact) {
+			fprintf(stderr, "%s: reduce %d, %d layers: %d bytes, not exact\n", config->name, reduce, layers, end);
+			failures++;
+		}
+		ref = decode(config, data, size, reduce, layers, &errors);
+		image = decode(config, data, end, reduce, layers, &errors);
+		if (!ref || !image || errors) {
+			fprintf(stderr, "%s: reduce %d, %d layers: decoding failed or raised %d errors\n", config->name, reduce, layers, errors);
+			failures++;
+		} else if (!test_same_image(image, ref)) {
+			fprintf(stderr, "%s: reduce %d, %d layers: the %d bytes planned of %d decode to another image\n",
+				config->name, reduce, layers, end, size);
+			failures++;
+		}
+		if (image) {
+			opj_image_destroy(image);
+		}
+		if (ref) {
+			opj_image_destroy(ref);
+		}
+		saved += size - end;
+	}
+	printf("%-32s %7d bytes  %7d saved  %s\n", config->name, size, saved / TEST_COUNT(requests),
+		failures ? "FAILED" : "ok");
+
+	free(data);
+	return failures;
+}
+
+int main(void) {
+	int i, failures = 0;
+
+	for (i = 0; i < TEST_COUNT(configs); i++) {
+		failures += check_config(&configs[i]);
+	}
+	return test_summary(TEST_COUNT(configs), failures);
+}
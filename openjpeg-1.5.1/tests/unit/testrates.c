@@ -0,0 +1,163 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Checks that the rate allocation keeps each quality layer within the size asked
+ * by tcp_rates, and that it does not fall far short of it. Images are encoded in
+ * LRCP order with an index, which gives the end of each layer in every tile.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "openjpeg.h"
+#include "testimage.h"
+
+/* the last layer of a tile must use at least this fraction of its budget */
+#define MIN_FILL 0.9
+
+typedef struct rate_config {
+	const char *name;
+	int w, h, numcomps;
+	int tile_size;	/* 0 for a single tile */
+	int numresolutions;
+	int cblk_size;
+	int irreversible;
+	int csty;	/* SOP and EPH markers */
+	int prc_size;	/* 0 for the default precincts */
+	int numlayers;
+	float rates[4];
+} rate_config_t;
+
+static const rate_config_t configs[] = {
+	{ "256x256 RGB", 256, 256, 3, 0, 6, 64, 0, 0, 0, 3, { 40, 20, 10 } },
+	{ "256x256 RGB 9-7", 256, 256, 3, 0, 6, 64, 1, 0, 0, 3, { 80, 30, 8 } },
+	{ "300x200 gray SOP EPH", 300, 200, 1, 0, 5, 32, 0, 0x06, 0, 4, { 100, 50, 25, 12 } },
+	{ "384x256 RGB precincts", 384, 256, 3, 0, 5, 32, 0, 0, 64, 2, { 30, 6 } },
+	{ "512x512 gray tiled", 512, 512, 1, 128, 5, 64, 0, 0, 0, 3, { 50, 20, 5 } },
+	{ "192x128 RGBA tiled SOP", 192, 128, 4, 64, 4, 16, 1, 0x02, 0, 4, { 60, 30, 15, 4 } }
+};
+
+/* bytes given to layer layno of a tile by tcd_init_encode, before the main header share */
+static float layer_budget(const rate_config_t *config, int tile_w, int tile_h, int layno) {
+	float budget = 0;
+	int j;
+	for (j = 0; j <= layno; j++) {
+		float prev = budget;
+		budget = ((float) (config->numcomps * tile_w * tile_h * 8)) / (config->rates[j] * 8);
+		if (j && budget < prev + 10) {
+			budget = prev + 20;
+		} else if (!j && budget < 30) {
+			budget = 30;
+		}
+	}
+	if (layno == config->numlayers - 1) {
+		budget -= 2;
+	}
+	return budget;
+}
+
+static int check_config(const rate_config_t *config) {
+	opj_cparameters_t parameters;
+	opj_codestream_info_t cstr_info;
+	opj_image_t *image;
+	unsigned char *data;
+	int size, tileno, layno, resno, header_share, slack, failures = 0;
+
+	image = test_create_image(config->w, config->h, config->numcomps);
+	if (!image) {
+		fprintf(stderr, "%s: cannot create the image\n", config->name);
+		return 1;
+	}
+
+	test_set_encoder_parameters(&parameters, config->numcomps, config->tile_size, config->numlayers, config->rates);
+	parameters.prog_order = LRCP;
+	parameters.numresolution = config->numresolutions;
+	parameters.cblockw_init = config->cblk_size;
+	parameters.cblockh_init = config->cblk_size;
+	parameters.irreversible = config->irreversible;
+	parameters.csty = config->csty;
+	if (config->prc_size) {
+		test_set_precincts(&parameters, config->numresolutions, config->prc_size);
+	}
+
+	data = test_encode(CODEC_J2K, image, &parameters, &cstr_info, &size);
+	opj_image_destroy(image);
+	if (!data) {
+		fprintf(stderr, "%s: encoding failed\n", config->name);
+		return 1;
+	}
+
+	/* like j2k_write_sod, every tile pays a share of what precedes the data of the first one */
+	header_share = (cstr_info.tile[0].end_header + 1) / (cstr_info.tw * cstr_info.th);
+	/* tier-2 does not check the SOP and EPH markers against the budget: the last packet may pass it */
+	slack = ((config->csty & 0x02) ? 6 : 0) + ((config->csty & 0x04) ? 2 : 0);
+	for (tileno = 0; tileno < cstr_info.tw * cstr_info.th; tileno++) {
+		opj_tile_info_t *tile = &cstr_info.tile[tileno];
+		int p = tileno % cstr_info.tw, q = tileno / cstr_info.tw;
+		int tile_w = (p + 1) * cstr_info.tile_x < config->w ? cstr_info.tile_x : config->w - p * cstr_info.tile_x;
+		int tile_h = (q + 1) * cstr_info.tile_y < config->h ? cstr_info.tile_y : config->h - q * cstr_info.tile_y;
+		int sod_start = tile->end_header + 1;
+		int numprecs = 0;
+
+		for (resno = 0; resno < config->numresolutions; resno++) {
+			numprecs += tile->pw[resno] * tile->ph[resno];
+		}
+		for (layno = 0; layno < config->numlayers; layno++) {
+			/* in LRCP order, the packets of the first layers come first */
+			int len = tile->packet[(layno + 1) * numprecs * config->numcomps - 1].end_pos + 1 - sod_start;
+			float budget = layer_budget(config, tile_w, tile_h, layno);
+			int maxlen = budget > header_share ? (int) ceil(budget - header_share) : 1;
+			if (len > maxlen + slack) {
+				fprintf(stderr, "%s: tile %d, layer %d: %d bytes for a rate of %g (%d bytes)\n",
+					config->name, tileno, layno, len, config->rates[layno], maxlen);
+				failures++;
+			} else if (layno == config->numlayers - 1 && len < MIN_FILL * maxlen) {
+				fprintf(stderr, "%s: tile %d, layer %d: only %d bytes for a rate of %g (%d bytes)\n",
+					config->name, tileno, layno, len, config->rates[layno], maxlen);
+				failures++;
+			}
+		}
+	}
+	printf("%-24s %2d tiles  %d layers  %7d bytes  %s\n", config->name, cstr_info.tw * cstr_info.th,
+		config->numlayers, size, failures ? "FAILED" : "ok");
+
+	opj_destroy_cstr_info(&cstr_info);
+	free(data);
+
+	return failures;
+}
+
+int main(void) {
+	int i, failures = 0;
+
+	for (i = 0; i < TEST_COUNT(configs); i++) {
+		failures += check_config(&configs[i]);
+	}
+	return test_summary(TEST_COUNT(configs), failures);
+}
@@ -0,0 +1,212 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Checks that a decompressor reset with opj_decoder_reset decodes a series of codestreams of
+ * different sizes, tilings and component counts, in both directions, into the images of a
+ * fresh decompressor. Before some of them, the first half of another codestream is fed to the
+ * incremental decoder and abandoned by the reset; every other codestream is then decoded with
+ * opj_decoder_feed instead of opj_decode.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "openjpeg.h"
+#include "testimage.h"
+
+/* size of the chunks given to opj_decoder_feed */
+#define CHUNK 333
+
+typedef struct reset_config {
+	const char *name;
+	int w, h, numcomps;
+	int tile_size;	/* 0 for a single tile */
+	int numlayers;
+	float rates[2];
+} reset_config_t;
+
+static const reset_config_t configs[] = {
+	{ "256x192 RGB tiled 64", 256, 192, 3, 64, 1, { 0 } },
+	{ "100x80 gray 2 layers", 100, 80, 1, 0, 2, { 20, 5 } },
+	{ "320x240 RGBA tiled 96", 320, 240, 4, 96, 1, { 0 } },
+	{ "64x64 RGB", 64, 64, 3, 0, 1, { 0 } },
+	{ "333x177 gray tiled 50", 333, 177, 1, 50, 2, { 30, 8 } },
+	{ "200x120 gray alpha tiled 50", 200, 120, 2, 50, 1, { 0 } }
+};
+
+/* thread counts of the decompressors */
+static const int thread_counts[] = { 1, 3 };
+
+typedef struct codestream {
+	unsigned char *data;
+	int size;
+} codestream_t;
+
+static unsigned char* encode(const reset_config_t *config, OPJ_CODEC_FORMAT format, int *size) {
+	opj_cparameters_t parameters;
+	opj_image_t *image;
+	unsigned char *data;
+
+	image = test_create_image(config->w, config->h, config->numcomps);
+	if (!image) {
+		return NULL;
+	}
+	test_set_encoder_parameters(&parameters, config->numcomps, config->tile_size, config->numlayers, config->rates);
+	data = test_encode(format, image, &parameters, NULL, size);
+	opj_image_destroy(image);
+	return data;
+}
+
+/* feeds the first size bytes of the codestream by chunks and decodes what can be, returns the last status */
+static OPJ_DECODER_STATUS feed(opj_dinfo_t *dinfo, codestream_t *cs, int size, opj_image_t **image) {
+	OPJ_DECODER_STATUS status = DECODER_NEED_DATA;
+	int pos;
+
+	for (pos = 0; pos < size && status == DECODER_NEED_DATA; pos += CHUNK) {
+		if (!opj_decoder_feed(dinfo, cs->data + pos, size - pos < CHUNK ? size - pos : CHUNK)) {
+			return DECODER_ERROR;
+		}
+		while ((status = opj_decoder_poll(dinfo, image)) == DECODER_TILE_DECODED) {
+		}
+	}
+	return status;
+}
+
+/* decodes the whole codestream with opj_decoder_feed, returns NULL if it fails */
+static opj_image_t* decode_fed(opj_dinfo_t *dinfo, codestream_t *cs) {
+	opj_image_t *image = NULL;
+	OPJ_DECODER_STATUS status = feed(dinfo, cs, cs->size, &image);
+
+	if (status == DECODER_NEED_DATA && opj_decoder_feed(dinfo, NULL, 0)) {
+		while ((status = opj_decoder_poll(dinfo, &image)) == DECODER_TILE_DECODED) {
+		}
+	}
+	return status == DECODER_DONE ? image : NULL;
+}
+
+/* decodes the codestreams in order then in reverse order with a single decompressor, returns the number of failures */
+static int check_series(OPJ_CODEC_FORMAT format, codestream_t *codestreams, opj_image_t **refs, int num_threads) {
+	opj_dparameters_t parameters;
+	opj_dinfo_t *dinfo;
+	int n = TEST_COUNT(configs);
+	int step, errors = 0, failures = 0;
+
+	opj_set_default_decoder_parameters(&parameters);
+	parameters.num_threads = num_threads;
+	dinfo = test_create_decompress(format, &parameters, &errors);
+	if (!dinfo) {
+		fprintf(stderr, "%d threads: cannot create the decompressor\n", num_threads);
+		return 1;
+	}
+	for (step = 0; step < 2 * n; step++) {
+		int i = step < n ? step : 2 * n - 1 - step;
+		codestream_t *cs = &codestreams[i];
+		opj_image_t *image;
+
+		/* the incremental decoder is only available for J2K codestreams */
+		if (format == CODEC_J2K && step % 3 == 1) {
+			codestream_t *other = &codestreams[(i + 1) % n];
+			if (feed(dinfo, other, other->size / 2, &image) != DECODER_NEED_DATA) {
+				fprintf(stderr, "%s, %d threads: feeding half of %s failed\n", configs[i].name, num_threads, configs[(i + 1) % n].name);
+				failures++;
+			}
+			opj_decoder_reset(dinfo);
+		}
+		image = format == CODEC_J2K && step % 2 ? decode_fed(dinfo, cs) : test_decode_memory(dinfo, cs->data, cs->size);
+		if (!image || errors) {
+			fprintf(stderr, "%s, %d threads: decoding failed or raised %d errors\n", configs[i].name, num_threads, errors);
+			failures++;
+		} else if (!test_same_image(image, refs[i])) {
+			fprintf(stderr, "%s, %d threads: not the image of a fresh decompressor\n", configs[i].name, num_threads);
+			failures++;
+		}
+		if (image) {
+			opj_image_destroy(image);
+		}
+		if (!opj_decoder_reset(dinfo)) {
+			fprintf(stderr, "%s, %d threads: reset failed\n", configs[i].name, num_threads);
+			failures++;
+		}
+	}
+	opj_destroy_decompress(dinfo);
+	return failures;
+}
+
+static int check_format(OPJ_CODEC_FORMAT format, const char *format_name) {
+	codestream_t codestreams[TEST_COUNT(configs)];
+	opj_image_t *refs[TEST_COUNT(configs)];
+	int i, t, failures = 0;
+
+	memset(codestreams, 0, sizeof(codestreams));
+	memset(refs, 0, sizeof(refs));
+	for (i = 0; i < TEST_COUNT(configs) && !failures; i++) {
+		codestreams[i].data = encode(&configs[i], format, &codestreams[i].size);
+		if (!codestreams[i].data) {
+			fprintf(stderr, "%s %s: cannot encode the image\n", format_name, configs[i].name);
+			failures++;
+		}
+	}
+	for (t = 0; t < TEST_COUNT(thread_counts) && !failures; t++) {
+		for (i = 0; i < TEST_COUNT(configs); i++) {
+			opj_dparameters_t parameters;
+			int errors = 0;
+
+			opj_set_default_decoder_parameters(&parameters);
+			parameters.num_threads = thread_counts[t];
+			refs[i] = test_decode(format, codestreams[i].data, codestreams[i].size, &parameters, &errors);
+			if (!refs[i] || errors) {
+				fprintf(stderr, "%s %s: cannot decode the image\n", format_name, configs[i].name);
+				failures++;
+			}
+		}
+		if (!failures) {
+			failures += check_series(format, codestreams, refs, thread_counts[t]);
+		}
+		for (i = 0; i < TEST_COUNT(configs); i++) {
+			if (refs[i]) {
+				opj_image_destroy(refs[i]);
+				refs[i] = NULL;
+			}
+		}
+	}
+	printf("%-32s %s\n", format_name, failures ? "FAILED" : "ok");
+
+	for (i = 0; i < TEST_COUNT(configs); i++) {
+		free(codestreams[i].data);
+	}
+	return failures;
+}
+
+int main(void) {
+	int failures = 0;
+
+	failures += check_format(CODEC_J2K, "J2K");
+	failures += check_format(CODEC_JP2, "JP2");
+	return test_summary(2 * TEST_COUNT(configs), failures);
+}
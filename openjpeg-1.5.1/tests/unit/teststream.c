@@ -0,0 +1,192 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Checks that an image encoded to an output stream (opj_cio_open_output, opj_cio_open_fd)
+ * gives the same file as when it is encoded in memory, with and without a seek function,
+ * and that the stream only keeps a few tiles of a seekable output in memory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "openjpeg.h"
+#include "testimage.h"
+
+typedef struct stream_config {
+	const char *name;
+	OPJ_CODEC_FORMAT format;
+	int w, h, numcomps;
+	int tile_size;
+	int num_threads;
+	int numlayers;
+	float rates[3];
+	int check_buffer;	/* the codestream is much larger than the first buffer of the stream */
+} stream_config_t;
+
+static const stream_config_t configs[] = {
+	{ "J2K 512x512 RGB lossless", CODEC_J2K, 512, 512, 3, 64, 1, 1, { 0 }, 1 },
+	{ "J2K 640x480 gray 3 layers", CODEC_J2K, 640, 480, 1, 128, 4, 3, { 40, 10, 4 }, 0 },
+	{ "JP2 512x384 RGB lossless", CODEC_JP2, 512, 384, 3, 64, 2, 1, { 0 }, 1 },
+	{ "JP2 300x200 RGB 2 layers", CODEC_JP2, 300, 200, 3, 48, 1, 2, { 20, 5 }, 0 }
+};
+
+/* output of the callbacks, growing like a file */
+typedef struct mem_output {
+	unsigned char *data;
+	int size;
+	int pos;
+	/* largest buffer of the stream seen while writing */
+	int max_buffer;
+} mem_output_t;
+
+static opj_cio_t *current_cio;
+
+static int mem_write(const unsigned char *buffer, int length, void *user_data) {
+	mem_output_t *out = (mem_output_t*) user_data;
+	int buffer_size = (int) (current_cio->end - current_cio->start);
+	if (out->pos + length > out->size) {
+		unsigned char *data = (unsigned char*) realloc(out->data, out->pos + length);
+		if (!data) {
+			return 0;
+		}
+		out->data = data;
+		out->size = out->pos + length;
+	}
+	memcpy(out->data + out->pos, buffer, length);
+	out->pos += length;
+	if (buffer_size > out->max_buffer) {
+		out->max_buffer = buffer_size;
+	}
+	return length;
+}
+
+static opj_bool mem_seek(int pos, void *user_data) {
+	mem_output_t *out = (mem_output_t*) user_data;
+	if (pos > out->size) {
+		return OPJ_FALSE;
+	}
+	out->pos = pos;
+	return OPJ_TRUE;
+}
+
+static void set_parameters(const stream_config_t *config, opj_cparameters_t *parameters) {
+	test_set_encoder_parameters(parameters, config->numcomps, config->tile_size, config->numlayers, config->rates);
+	parameters->num_threads = config->num_threads;
+}
+
+/* encodes the image to the callbacks with seek_fn or without, or to a file */
+static int encode(const stream_config_t *config, opj_image_t *image, int sink, mem_output_t *out) {
+	opj_cparameters_t parameters;
+	opj_cinfo_t *cinfo;
+	opj_cio_t *cio = NULL;
+	FILE *f = NULL;
+	opj_bool success;
+
+	set_parameters(config, &parameters);
+	cinfo = opj_create_compress(config->format);
+	opj_setup_encoder(cinfo, &parameters, image);
+	memset(out, 0, sizeof(mem_output_t));
+	switch (sink) {
+		case 1:
+			cio = opj_cio_open_output((opj_common_ptr)cinfo, mem_write, mem_seek, out);
+			break;
+		case 2:
+			cio = opj_cio_open_output((opj_common_ptr)cinfo, mem_write, NULL, out);
+			break;
+		default:
+			f = tmpfile();
+			if (f) {
+				cio = opj_cio_open_fd((opj_common_ptr)cinfo, fileno(f));
+			}
+			break;
+	}
+	current_cio = cio;
+	success = cio && opj_encode(cinfo, cio, image, NULL);
+	if (success && f) {
+		out->size = cio_tell(cio);
+		out->data = (unsigned char*) malloc(out->size);
+		fseek(f, 0, SEEK_SET);
+		success = fread(out->data, 1, out->size, f) == (size_t) out->size;
+	}
+	if (f) {
+		fclose(f);
+	}
+	opj_cio_close(cio);
+	opj_destroy_compress(cinfo);
+	return success;
+}
+
+static int check_config(const stream_config_t *config) {
+	static const char *sink_names[] = { "memory", "seekable output", "output without seek", "file descriptor" };
+	opj_cparameters_t parameters;
+	mem_output_t ref, out;
+	opj_image_t *image;
+	int sink, failures = 0;
+
+	image = test_create_image(config->w, config->h, config->numcomps);
+	if (image) {
+		set_parameters(config, &parameters);
+		ref.data = test_encode(config->format, image, &parameters, NULL, &ref.size);
+	}
+	if (!image || !ref.data) {
+		fprintf(stderr, "%s: cannot encode the image in memory\n", config->name);
+		opj_image_destroy(image);
+		return 1;
+	}
+	for (sink = 1; sink < 4; sink++) {
+		if (!encode(config, image, sink, &out)) {
+			fprintf(stderr, "%s: encoding to a %s failed\n", config->name, sink_names[sink]);
+			failures++;
+		} else if (out.size != ref.size || memcmp(out.data, ref.data, ref.size)) {
+			fprintf(stderr, "%s: %s: %d bytes, not the %d bytes encoded in memory\n",
+				config->name, sink_names[sink], out.size, ref.size);
+			failures++;
+		} else if (sink == 1 && config->check_buffer && out.max_buffer > ref.size / 4) {
+			/* without seek, a JP2 file is held to its end */
+			fprintf(stderr, "%s: %s: %d bytes buffered for %d bytes\n",
+				config->name, sink_names[sink], out.max_buffer, ref.size);
+			failures++;
+		}
+		free(out.data);
+	}
+	printf("%-28s %7d bytes  %s\n", config->name, ref.size, failures ? "FAILED" : "ok");
+
+	free(ref.data);
+	opj_image_destroy(image);
+	return failures;
+}
+
+int main(void) {
+	int i, failures = 0;
+
+	for (i = 0; i < TEST_COUNT(configs); i++) {
+		failures += check_config(&configs[i]);
+	}
+	return test_summary(TEST_COUNT(configs), failures);
+}
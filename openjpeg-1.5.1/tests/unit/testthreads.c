@@ -0,0 +1,165 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Checks that the thread count changes neither the encoder nor the decoder output: codestreams
+ * encoded with several threads must be byte-identical to the one encoded in the calling thread,
+ * and the images decoded with several threads, at several reduce factors and in a decode area,
+ * identical to the ones decoded in the calling thread.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "openjpeg.h"
+#include "testimage.h"
+
+typedef struct threads_config {
+	const char *name;
+	OPJ_CODEC_FORMAT format;
+	int w, h, numcomps;
+	int tile_size;	/* 0 for a single tile */
+	int irreversible;
+	int numlayers;
+	float rates[3];
+} threads_config_t;
+
+static const threads_config_t configs[] = {
+	{ "J2K 256x192 RGB tiled 64", CODEC_J2K, 256, 192, 3, 64, 0, 1, { 0 } },
+	{ "J2K 512x384 RGB single tile", CODEC_J2K, 512, 384, 3, 0, 0, 1, { 0 } },
+	{ "J2K 333x280 gray tiled 48 9-7", CODEC_J2K, 333, 280, 1, 48, 1, 3, { 40, 10, 4 } },
+	{ "JP2 300x200 RGBA tiled 100", CODEC_JP2, 300, 200, 4, 100, 1, 2, { 20, 5 } }
+};
+
+/* thread counts compared with the calling thread alone */
+static const int thread_counts[] = { 2, 3, 4, 7 };
+
+typedef struct threads_mode {
+	const char *name;
+	int reduce;
+	int area;	/* decode the middle of the image only */
+} threads_mode_t;
+
+static const threads_mode_t modes[] = {
+	{ "whole", 0, 0 },
+	{ "reduce 1", 1, 0 },
+	{ "reduce 2", 2, 0 },
+	{ "area", 0, 1 }
+};
+
+static unsigned char* encode(const threads_config_t *config, opj_image_t *image, int num_threads, int *size) {
+	opj_cparameters_t parameters;
+
+	test_set_encoder_parameters(&parameters, config->numcomps, config->tile_size, config->numlayers, config->rates);
+	parameters.irreversible = config->irreversible;
+	parameters.num_threads = num_threads;
+	return test_encode(config->format, image, &parameters, NULL, size);
+}
+
+/* decodes the file with num_threads threads, the errors reported are added to *errors */
+static opj_image_t* decode(const threads_config_t *config, const threads_mode_t *mode, const unsigned char *data, int size,
+		int num_threads, int *errors) {
+	opj_dparameters_t parameters;
+	opj_dinfo_t *dinfo;
+	opj_image_t *image = NULL;
+
+	opj_set_default_decoder_parameters(&parameters);
+	parameters.cp_reduce = mode->reduce;
+	parameters.num_threads = num_threads;
+	dinfo = test_create_decompress(config->format, &parameters, errors);
+	if (dinfo && (!mode->area || opj_set_decode_area(dinfo, config->w / 5, config->h / 3, config->w * 4 / 5 + 1, config->h * 2 / 3 + 3))) {
+		image = test_decode_memory(dinfo, data, size);
+	}
+	opj_destroy_decompress(dinfo);
+	return image;
+}
+
+static int check_config(const threads_config_t *config) {
+	opj_image_t *image;
+	unsigned char *data;
+	int size, t, m, failures = 0;
+
+	image = test_create_image(config->w, config->h, config->numcomps);
+	data = image ? encode(config, image, 1, &size) : NULL;
+	if (!data) {
+		fprintf(stderr, "%s: cannot encode the image\n", config->name);
+		if (image) {
+			opj_image_destroy(image);
+		}
+		return 1;
+	}
+	for (t = 0; t < TEST_COUNT(thread_counts); t++) {
+		int tsize;
+		unsigned char *tdata = encode(config, image, thread_counts[t], &tsize);
+		if (!tdata || tsize != size || memcmp(tdata, data, size)) {
+			fprintf(stderr, "%s: not the codestream of the calling thread when encoded with %d threads\n", config->name, thread_counts[t]);
+			failures++;
+		}
+		free(tdata);
+	}
+	opj_image_destroy(image);
+
+	for (m = 0; m < TEST_COUNT(modes); m++) {
+		int errors = 0;
+		opj_image_t *ref = decode(config, &modes[m], data, size, 1, &errors);
+		if (!ref || errors) {
+			fprintf(stderr, "%s, %s: cannot decode the image\n", config->name, modes[m].name);
+			failures++;
+		} else {
+			for (t = 0; t < TEST_COUNT(thread_counts); t++) {
+				opj_image_t *image = decode(config, &modes[m], data, size, thread_counts[t], &errors);
+				if (!image || errors) {
+					fprintf(stderr, "%s, %s, %d threads: decoding failed or raised %d errors\n", config->name, modes[m].name, thread_counts[t], errors);
+					failures++;
+				} else if (!test_same_image(image, ref)) {
+					fprintf(stderr, "%s, %s, %d threads: not the image of the calling thread\n", config->name, modes[m].name, thread_counts[t]);
+					failures++;
+				}
+				if (image) {
+					opj_image_destroy(image);
+				}
+			}
+		}
+		if (ref) {
+			opj_image_destroy(ref);
+		}
+	}
+	printf("%-32s %7d bytes  %s\n", config->name, size, failures ? "FAILED" : "ok");
+
+	free(data);
+	return failures;
+}
+
+int main(void) {
+	int i, failures = 0;
+
+	for (i = 0; i < TEST_COUNT(configs); i++) {
+		failures += check_config(&configs[i]);
+	}
+	return test_summary(TEST_COUNT(configs), failures);
+}
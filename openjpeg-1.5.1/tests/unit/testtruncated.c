@@ -0,0 +1,292 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+ * Copyright (c) 2002-2012, Communications and Remote Sensing Laboratory, Universite catholique de Louvain (UCL), Belgium
+ * Copyright (c) 2002-2012, Professor Benoit Macq
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Checks that truncated prefixes of a single-tile codestream, decoded with
+ * OPJ_DPARAMETERS_TRUNCATED_FLAG, give the highest resolution they hold completely without
+ * raising an error. When every layer of the resolutions kept is in the prefix, the image must
+ * be the one decoded from the whole file at that resolution.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "openjpeg.h"
+#include "testimage.h"
+
+#define NUMRESOLUTIONS 6
+
+typedef struct truncated_config {
+	const char *name;
+	OPJ_CODEC_FORMAT format;
+	int w, h, numcomps;
+	OPJ_PROG_ORDER prog_order;	/* the position orders need a single precinct per resolution */
+	int prc_size;	/* 0 for the default precincts */
+	int numlayers;
+	float rates[3];
+} truncated_config_t;
+
+static const truncated_config_t configs[] = {
+	{ "J2K 256x256 RGB RLCP", CODEC_J2K, 256, 256, 3, RLCP, 0, 1, { 0 } },
+	{ "J2K 320x240 gray RPCL 3 layers", CODEC_J2K, 320, 240, 1, RPCL, 0, 3, { 40, 10, 4 } },
+	{ "J2K 256x192 RGB LRCP 2 layers", CODEC_J2K, 256, 192, 3, LRCP, 0, 2, { 20, 5 } },
+	{ "J2K 256x256 RGB CPRL 2 layers", CODEC_J2K, 256, 256, 3, CPRL, 0, 2, { 20, 5 } },
+	{ "J2K 384x256 RGB RLCP precincts", CODEC_J2K, 384, 256, 3, RLCP, 64, 2, { 30, 6 } },
+	{ "JP2 256x256 RGB RLCP 2 layers", CODEC_JP2, 256, 256, 3, RLCP, 0, 2, { 20, 5 } }
+};
+
+/* encodes a generated image in memory with its index, returns the size of the file in *size */
+static unsigned char* encode(const truncated_config_t *config, int *size, opj_codestream_info_t *cstr_info) {
+	opj_cparameters_t parameters;
+	opj_image_t *image;
+	unsigned char *data;
+
+	image = test_create_image(config->w, config->h, config->numcomps);
+	if (!image) {
+		return NULL;
+	}
+	test_set_encoder_parameters(&parameters, config->numcomps, 0, config->numlayers, config->rates);
+	parameters.prog_order = config->prog_order;
+	parameters.numresolution = NUMRESOLUTIONS;
+	if (config->prc_size) {
+		test_set_precincts(&parameters, NUMRESOLUTIONS, config->prc_size);
+	}
+	data = test_encode(config->format, image, &parameters, cstr_info, size);
+	opj_image_destroy(image);
+	return data;
+}
+
+/* records the component, resolution and layer of packet n */
+static void set_packet(int n, int compno, int resno, int layno, int *compnos, int *resnos, int *laynos) {
+	compnos[n] = compno;
+	resnos[n] = resno;
+	laynos[n] = layno;
+}
+
+/* component, resolution and layer of the packets of the tile, in codestream order, returns their number */
+static int packet_order(const truncated_config_t *config, opj_tile_info_t *tile, int *compnos, int *resnos, int *laynos) {
+	int n = 0, r, l, c, p;
+
+	switch (config->prog_order) {
+		case LRCP:
+			for (l = 0; l < config->numlayers; l++) {
+				for (r = 0; r < NUMRESOLUTIONS; r++) {
+					for (c = 0; c < config->numcomps; c++) {
+						for (p = 0; p < tile->pw[r] * tile->ph[r]; p++) {
+							set_packet(n++, c, r, l, compnos, resnos, laynos);
+						}
+					}
+				}
+			}
+			break;
+		case RLCP:
+			for (r = 0; r < NUMRESOLUTIONS; r++) {
+				for (l = 0; l < config->numlayers; l++) {
+					for (c = 0; c < config->numcomps; c++) {
+						for (p = 0; p < tile->pw[r] * tile->ph[r]; p++) {
+							set_packet(n++, c, r, l, compnos, resnos, laynos);
+						}
+					}
+				}
+			}
+			break;
+		case RPCL:
+			for (r = 0; r < NUMRESOLUTIONS; r++) {
+				for (p = 0; p < tile->pw[r] * tile->ph[r]; p++) {
+					for (c = 0; c < config->numcomps; c++) {
+						for (l = 0; l < config->numlayers; l++) {
+							set_packet(n++, c, r, l, compnos, resnos, laynos);
+						}
+					}
+				}
+			}
+			break;
+		default:
+			/* PCRL and CPRL: with a single precinct, all the resolutions are at the first position */
+			for (c = 0; c < config->numcomps; c++) {
+				for (r = 0; r < NUMRESOLUTIONS; r++) {
+					for (l = 0; l < config->numlayers; l++) {
+						set_packet(n++, c, r, l, compnos, resnos, laynos);
+					}
+				}
+			}
+			break;
+	}
+	return n;
+}
+
+/* decodes the first size bytes of the file, the errors reported are added to *errors */
+static opj_image_t* decode(const truncated_config_t *config, const unsigned char *data, int size, int truncated, int reduce, int *errors) {
+	opj_dparameters_t parameters;
+
+	opj_set_default_decoder_parameters(&parameters);
+	parameters.cp_reduce = reduce;
+	if (truncated) {
+		parameters.flags |= OPJ_DPARAMETERS_TRUNCATED_FLAG;
+	}
+	return test_decode(config->format, data, size, &parameters, errors);
+}
+
+/* decodes the first length bytes, counts the images compared in *compared, returns the number of failures */
+static int check_prefix(const truncated_config_t *config, const unsigned char *data, int length, opj_packet_info_t *packets,
+		int *compnos, int *resnos, int *laynos, int numpacks, opj_image_t **refs, int *compared) {
+	opj_image_t *image;
+	int complete[3], mincomplete, all = NUMRESOLUTIONS - 1;
+	int factor, compno, packno, errors = 0, failures = 0;
+
+	/* the highest resolutions whose packets of the first layer are in the prefix, in each component */
+	for (compno = 0; compno < config->numcomps; compno++) {
+		complete[compno] = NUMRESOLUTIONS - 1;
+	}
+	for (packno = 0; packno < numpacks; packno++) {
+		if (packets[packno].end_pos + 1 > length) {
+			compno = compnos[packno];
+			if (laynos[packno] == 0 && resnos[packno] <= complete[compno]) {
+				complete[compno] = resnos[packno] - 1;
+			}
+			/* and whose packets of all the layers are, in all the components */
+			if (resnos[packno] <= all) {
+				all = resnos[packno] - 1;
+			}
+		}
+	}
+	/* the components are decoded at the same factor; without any complete resolution, the lowest one is decoded all the same */
+	mincomplete = complete[0];
+	for (compno = 1; compno < config->numcomps; compno++) {
+		if (complete[compno] < mincomplete) {
+			mincomplete = complete[compno];
+		}
+	}
+	factor = NUMRESOLUTIONS - 1 - (mincomplete < 0 ? 0 : mincomplete);
+
+	image = decode(config, data, length, 1, 0, &errors);
+	if (!image || errors) {
+		fprintf(stderr, "%s: %d bytes: decoding failed or raised %d errors\n", config->name, length, errors);
+		failures++;
+	} else {
+		for (compno = 0; compno < image->numcomps; compno++) {
+			opj_image_comp_t *comp = &image->comps[compno];
+			if (comp->factor != factor || comp->resno_decoded != complete[compno]
+				|| comp->w != (config->w + (1 << factor) - 1) >> factor
+				|| comp->h != (config->h + (1 << factor) - 1) >> factor) {
+				fprintf(stderr, "%s: %d bytes: component %d at factor %d (%dx%d, resolution %d complete) instead of %d (resolution %d)\n",
+					config->name, length, compno, comp->factor, comp->w, comp->h, comp->resno_decoded, factor, complete[compno]);
+				failures++;
+				break;
+			}
+		}
+		if (!failures && mincomplete >= 0 && all >= mincomplete) {
+			(*compared)++;
+			if (!test_same_image(image, refs[factor])) {
+				fprintf(stderr, "%s: %d bytes: not the image decoded from the whole file at factor %d\n", config->name, length, factor);
+				failures++;
+			}
+		}
+	}
+	if (image) {
+		opj_image_destroy(image);
+	}
+	return failures;
+}
+
+static int check_config(const truncated_config_t *config) {
+	opj_codestream_info_t cstr_info;
+	opj_image_t *refs[NUMRESOLUTIONS];
+	unsigned char *data;
+	int *compnos = NULL, *resnos = NULL, *laynos = NULL;
+	int size, numpacks, maxpacks, reduce, resno, packno, prefixes = 0, compared = 0, failures = 0;
+	opj_tile_info_t *tile;
+
+	data = encode(config, &size, &cstr_info);
+	if (!data) {
+		fprintf(stderr, "%s: cannot encode the image\n", config->name);
+		return 1;
+	}
+	tile = &cstr_info.tile[0];
+
+	/* the whole file at each resolution */
+	memset(refs, 0, sizeof(refs));
+	for (reduce = 0; reduce < NUMRESOLUTIONS; reduce++) {
+		int errors = 0;
+		refs[reduce] = decode(config, data, size, 0, reduce, &errors);
+		if (!refs[reduce] || errors) {
+			fprintf(stderr, "%s: cannot decode the whole file at factor %d\n", config->name, reduce);
+			failures++;
+		}
+	}
+
+	maxpacks = 0;
+	for (resno = 0; resno < NUMRESOLUTIONS; resno++) {
+		maxpacks += tile->pw[resno] * tile->ph[resno] * config->numcomps * config->numlayers;
+	}
+	compnos = (int*) malloc(maxpacks * sizeof(int));
+	resnos = (int*) malloc(maxpacks * sizeof(int));
+	laynos = (int*) malloc(maxpacks * sizeof(int));
+	if (!failures && compnos && resnos && laynos) {
+		numpacks = packet_order(config, tile, compnos, resnos, laynos);
+
+		/* no packet, then every packet cut in its middle and complete */
+		failures += check_prefix(config, data, tile->end_header + 1, tile->packet, compnos, resnos, laynos, numpacks, refs, &compared);
+		prefixes++;
+		for (packno = 0; packno < numpacks; packno++) {
+			opj_packet_info_t *packet = &tile->packet[packno];
+			int len = packet->end_pos + 1 - packet->start_pos;
+			if (len > 1) {
+				failures += check_prefix(config, data, packet->start_pos + len / 2, tile->packet, compnos, resnos, laynos, numpacks, refs, &compared);
+				prefixes++;
+			}
+			failures += check_prefix(config, data, packet->end_pos + 1, tile->packet, compnos, resnos, laynos, numpacks, refs, &compared);
+			prefixes++;
+		}
+	} else if (!failures) {
+		fprintf(stderr, "%s: out of memory\n", config->name);
+		failures++;
+	}
+	printf("%-32s %7d bytes  %3d prefixes, %3d compared  %s\n", config->name, size, prefixes, compared, failures ? "FAILED" : "ok");
+
+	free(compnos);
+	free(resnos);
+	free(laynos);
+	for (reduce = 0; reduce < NUMRESOLUTIONS; reduce++) {
+		if (refs[reduce]) {
+			opj_image_destroy(refs[reduce]);
+		}
+	}
+	opj_destroy_cstr_info(&cstr_info);
+	free(data);
+	return failures;
+}
+
+int main(void) {
+	int i, failures = 0;
+
+	for (i = 0; i < TEST_COUNT(configs); i++) {
+		failures += check_config(&configs[i]);
+	}
+	return test_summary(TEST_COUNT(configs), failures);
+}